@@ -8,11 +8,128 @@
 
 #import "SimpleSpeechAppDelegate.h"
 #import "SimpleSpeechViewController.h"
+#import "SpeechTrace.h"
+#import "SpeechMetrics.h"
+#import "SpeechConfigStore.h"
+#import "SpeechConfig.h"
+#import "SpeechAuth.h"
+#import "SpeechLoadGenerator.h"
+#import "SpeechMockServer.h"
+#import "SpeechListener.h"
+#import "SpeechRecorder.h"
+#import "SpeechReplayer.h"
+#import "SpeechRequestHeaders.h"
+#include "SpeechSelfTest.h"
+#include <mach/mach.h>
+#include <malloc/malloc.h>
+#include <pthread.h>
+#include <math.h>
+
+/** Tune how often the metrics file is rewritten for a collector to scrape. **/
+static const NSTimeInterval METRICS_FLUSH_INTERVAL = 60.0; // seconds
+
+/** Tune the synthetic conversation of the soak test: each turn is up to
+    2.6 seconds of speech, then a pause. **/
+static const double SOAK_TURN_DURATION = 3.5; // seconds
+
+/** Tune how much audio the soak test feeds at a time. **/
+static const double SOAK_CHUNK_DURATION = 0.1; // seconds
+
+/** Tune how many times each benchmark repeats what it times. **/
+static const NSUInteger BENCHMARK_ITERATIONS = 10000;
+
+/* Synthetic speech for the soak test: a buzzy tone with a syllable rhythm
+   for the first part of each turn, over low noise. */
+static void SynthesizeSpeech(int16_t* samples, size_t count, uint64_t position, int sample_rate)
+{
+    size_t i;
+    for (i = 0; i < count; i++) {
+        uint64_t n = position + i;
+        double t = (double)n / sample_rate;
+        uint64_t turn = (uint64_t)(t / SOAK_TURN_DURATION);
+        double speech = 1.0 + (double)(turn % 5) * 0.4;
+        double x = (double)((uint32_t)(n * 2654435761u) >> 24) - 128.0;
+        if (t - (double)turn * SOAK_TURN_DURATION < speech)
+            x += 6000.0 * sin(2.0 * M_PI * 150.0 * t) * (0.6 + 0.4 * sin(2.0 * M_PI * 4.0 * t));
+        samples[i] = (int16_t)x;
+    }
+}
+
+/* The app's resident memory, in megabytes. */
+static double ResidentMegabytes(void)
+{
+    struct task_basic_info info;
+    mach_msg_type_number_t count = TASK_BASIC_INFO_COUNT;
+    if (task_info(mach_task_self(), TASK_BASIC_INFO, (task_info_t)&info, &count) != KERN_SUCCESS)
+        return 0;
+    return info.resident_size / (1024.0 * 1024.0);
+}
+
+/* Heap blocks allocated and not yet freed, in every zone. */
+static size_t AllocatedBlocks(void)
+{
+    malloc_statistics_t stats;
+    malloc_zone_statistics(NULL, &stats);
+    return stats.blocks_in_use;
+}
+
+/* Updates a counter and a histogram BENCHMARK_ITERATIONS times each, as
+   one of several threads at once. */
+static void* UpdateMetrics(void* unused)
+{
+    NSUInteger i;
+    for (i = 0; i < BENCHMARK_ITERATIONS; i++) {
+        SpeechMetricCount("benchmark.count");
+        SpeechMetricRecord("benchmark.latency", (double)(i % 700));
+    }
+    return NULL;
+}
+
+/* A recognition request's headers formatted from scratch, as SpeechRequest
+   did for every request before SpeechRequestHeaders, for comparison. */
+static void FormatHeadersEachTime(NSMutableURLRequest* request, NSString* contentType,
+                                  NSString* bearerAuthToken, NSString* speechContext, NSDictionary* xArgs)
+{
+    [request setValue: @"application/json" forHTTPHeaderField: @"Accept"];
+    if (bearerAuthToken != nil)
+        [request setValue: [@"Bearer " stringByAppendingString: bearerAuthToken]
+       forHTTPHeaderField: @"Authorization"];
+    if (contentType != nil)
+        [request setValue: contentType forHTTPHeaderField: @"Content-Type"];
+    if (speechContext != nil)
+        [request setValue: speechContext forHTTPHeaderField: @"X-SpeechContext"];
+    if (xArgs.count > 0) {
+        NSMutableArray* pairs = [NSMutableArray arrayWithCapacity: xArgs.count];
+        for (NSString* key in xArgs) {
+            NSString* value = [[xArgs objectForKey: key] description];
+            NSString* escaped = [(NSString*)CFURLCreateStringByAddingPercentEscapes(
+                NULL, (CFStringRef)value, NULL, CFSTR(",=&+;:/?# "), kCFStringEncodingUTF8) autorelease];
+            [pairs addObject: [NSString stringWithFormat: @"%@=%@", key, escaped]];
+        }
+        [request setValue: [pairs componentsJoinedByString: @","] forHTTPHeaderField: @"X-Arg"];
+    }
+}
+
+@interface SimpleSpeechAppDelegate ()
+@property (nonatomic, retain) SpeechLoadGenerator* loadGenerator;
+@property (nonatomic, retain) SpeechListener* soakListener;
+@property (nonatomic, retain) SpeechAuth* soakAuth;
+@property (nonatomic, retain) SpeechReplayer* replayer;
+- (void) runLoadTest;
+- (void) runSoakTest;
+- (void) runReplay;
+- (void) runBenchmarks;
+- (NSString*) metricsPath;
+@end
 
 @implementation SimpleSpeechAppDelegate
 
 @synthesize window;
 @synthesize viewController;
+@synthesize loadGenerator;
+@synthesize soakListener;
+@synthesize soakAuth;
+@synthesize replayer;
 
 
 #pragma mark -
@@ -22,10 +139,36 @@
 {    
     // Override point for customization after application launch.
 
+    // Pick up changes to the speech config file while the app runs.
+    SpeechConfigStore* config = [SpeechConfigStore sharedStore];
+    [config startWatching];
+    [[NSNotificationCenter defaultCenter] addObserver: self selector: @selector(speechConfigDidChange:)
+                                                 name: SpeechConfigDidChangeNotification object: config];
+
+    // Keep the health metrics where a collector can pick them up.
+    [SpeechMetrics startFlushingToFile: [self metricsPath] interval: METRICS_FLUSH_INTERVAL];
+
     // Hook up the UI from Interface Builder.
     self.window.rootViewController = self.viewController;
     [self.window makeKeyAndVisible];
 
+    // Launched with -SpeechSelfTest YES, check the C modules; failures go
+    // to the console.
+    if ([[NSUserDefaults standardUserDefaults] boolForKey: @"SpeechSelfTest"])
+        SpeechSelfTest(NSTemporaryDirectory().fileSystemRepresentation);
+    // Launched with -SpeechBenchmark YES, time the hot paths.
+    if ([[NSUserDefaults standardUserDefaults] boolForKey: @"SpeechBenchmark"])
+        [self runBenchmarks];
+    // Launched with -SpeechLoadTest YES, replay recorded audio for load testing.
+    if ([[NSUserDefaults standardUserDefaults] boolForKey: @"SpeechLoadTest"])
+        [self runLoadTest];
+    // Launched with -SpeechSoakTest YES, run hands-free listening for hours.
+    if ([[NSUserDefaults standardUserDefaults] boolForKey: @"SpeechSoakTest"])
+        [self runSoakTest];
+    // Launched with -SpeechReplay and a recording, replay it.
+    if ([[NSUserDefaults standardUserDefaults] stringForKey: @"SpeechReplay"] != nil)
+        [self runReplay];
+
     return YES;
 }
 
@@ -33,10 +176,351 @@
 {
     // Since the app has come to the foreground, (re-)initialize SpeechKit.
     [viewController prepareSpeech];
+
+    // Launched with -SpeechRecord YES, record each time in the foreground
+    // to a file of its own in Documents/Recordings.
+    SpeechRecorder* recorder = [SpeechRecorder sharedRecorder];
+    if ([[NSUserDefaults standardUserDefaults] boolForKey: @"SpeechRecord"] && !recorder.isRecording) {
+        NSString* documents =
+            [NSSearchPathForDirectoriesInDomains(NSDocumentDirectory, NSUserDomainMask, YES) objectAtIndex: 0];
+        NSString* directory = [documents stringByAppendingPathComponent: @"Recordings"];
+        [[NSFileManager defaultManager] createDirectoryAtPath: directory withIntermediateDirectories: YES
+                                                   attributes: nil error: NULL];
+        NSString* name = [NSString stringWithFormat: @"SpeechRecording-%.0f.sprc",
+                          [[NSDate date] timeIntervalSince1970]];
+        if (![recorder startRecordingToFile: [directory stringByAppendingPathComponent: name]])
+            NSLog(@"Couldn't start recording to %@", name);
+    }
+}
+
+- (void) speechConfigDidChange: (NSNotification*) notification
+{
+    // The endpoints or credentials may have changed, so start over.
+    [viewController prepareSpeech];
+}
+
+- (void) applicationDidEnterBackground: (UIApplication*) application
+{
+    // Save the latency trace where it can be pulled from the device, and
+    // print the percentiles for a quick look.
+    NSString* documents =
+        [NSSearchPathForDirectoriesInDomains(NSDocumentDirectory, NSUserDomainMask, YES) objectAtIndex: 0];
+    [SpeechTrace writeChromeTraceToFile: [documents stringByAppendingPathComponent: @"SpeechTrace.json"]];
+    [SpeechTrace logSummary];
+    // The app may not run again for a while, so write the latest metrics.
+    [SpeechMetrics writeToFile: [self metricsPath]];
+    // And finish the recording, writing its index, in case it's terminated.
+    [[SpeechRecorder sharedRecorder] stopRecording];
+}
+
+- (NSString*) metricsPath
+{
+    NSString* documents =
+        [NSSearchPathForDirectoriesInDomains(NSDocumentDirectory, NSUserDomainMask, YES) objectAtIndex: 0];
+    return [documents stringByAppendingPathComponent: @"SpeechMetrics.prom"];
+}
+
+#pragma mark -
+#pragma mark Load testing
+
+// Sends the audio files in Documents/LoadCorpus to the Speech API, or to
+// SpeechMockServer when launched with -SpeechLoadTestMock YES, at the rate
+// and for the duration given by -SpeechLoadTestRate and
+// -SpeechLoadTestDuration.  The report goes to the log and to
+// Documents/SpeechLoadReport.json.
+- (void) runLoadTest
+{
+    NSUserDefaults* defaults = [NSUserDefaults standardUserDefaults];
+    NSString* documents =
+        [NSSearchPathForDirectoriesInDomains(NSDocumentDirectory, NSUserDomainMask, YES) objectAtIndex: 0];
+    NSString* corpusPath = [documents stringByAppendingPathComponent: @"LoadCorpus"];
+    NSMutableArray* corpus = [NSMutableArray array];
+    for (NSString* name in [[NSFileManager defaultManager] contentsOfDirectoryAtPath: corpusPath error: NULL]) {
+        NSString* extension = name.pathExtension.lowercaseString;
+        if ([extension isEqualToString: @"wav"] || [extension isEqualToString: @"amr"]
+            || [extension isEqualToString: @"spx"])
+            [corpus addObject: [corpusPath stringByAppendingPathComponent: name]];
+    }
+    if (corpus.count == 0) {
+        NSLog(@"Load test: no audio files in %@", corpusPath);
+        return;
+    }
+
+    NSURL* recognitionURL = SpeechServiceUrl();
+    NSURL* oauthURL = SpeechOAuthUrl();
+    if ([defaults boolForKey: @"SpeechLoadTestMock"]) {
+        [SpeechMockServer startWithHost: @"speech.mock"];
+        recognitionURL = [SpeechMockServer recognitionURL];
+        oauthURL = [SpeechMockServer oauthURL];
+    }
+    self.loadGenerator = [SpeechLoadGenerator generatorWithURL: recognitionURL];
+    self.loadGenerator.speechAuth =
+        [SpeechAuth authenticatorForService: oauthURL withId: SpeechOAuthKey()
+                                     secret: SpeechOAuthSecret() scope: SpeechOAuthScope()];
+    self.loadGenerator.corpus = corpus;
+    self.loadGenerator.speechContext = SpeechContext();
+    if ([defaults doubleForKey: @"SpeechLoadTestRate"] > 0)
+        self.loadGenerator.requestsPerSecond = [defaults doubleForKey: @"SpeechLoadTestRate"];
+    if ([defaults doubleForKey: @"SpeechLoadTestDuration"] > 0)
+        self.loadGenerator.duration = [defaults doubleForKey: @"SpeechLoadTestDuration"];
+
+    NSLog(@"Load test: %lu files at %.2f/s for %.0fs", (unsigned long)corpus.count,
+          self.loadGenerator.requestsPerSecond, self.loadGenerator.duration);
+    __block SimpleSpeechAppDelegate* blockSelf = self;
+    [self.loadGenerator startWithCompletion: ^(NSDictionary* report) {
+        NSLog(@"Load test finished:\n%@", [SpeechLoadGenerator descriptionOfReport: report]);
+        // JSON can't hold the infinite bound of the last histogram bucket.
+        NSMutableDictionary* saved = [NSMutableDictionary dictionaryWithDictionary: report];
+        [saved removeObjectForKey: @"histogram"];
+        NSMutableArray* bounds = [NSMutableArray array];
+        NSMutableArray* counts = [NSMutableArray array];
+        for (NSArray* bucket in [report objectForKey: @"histogram"]) {
+            if (!isinf([[bucket objectAtIndex: 0] doubleValue]))
+                [bounds addObject: [bucket objectAtIndex: 0]];
+            [counts addObject: [bucket objectAtIndex: 1]];
+        }
+        [saved setObject: bounds forKey: @"histogramBounds"];
+        [saved setObject: counts forKey: @"histogramCounts"];
+        NSData* json = [NSJSONSerialization dataWithJSONObject: saved options: 0 error: NULL];
+        [json writeToFile: [documents stringByAppendingPathComponent: @"SpeechLoadReport.json"] atomically: YES];
+        [SpeechMockServer stop];
+        blockSelf.loadGenerator = nil;
+    }];
+}
+
+#pragma mark -
+#pragma mark Soak testing
+
+// Feeds synthetic speech through SpeechListener to SpeechMockServer, for
+// -SpeechSoakTestDuration seconds of audio (3 hours by default) at
+// -SpeechSoakTestSpeed times real time (10 by default).  Memory is logged
+// every 10 minutes of audio and should level off; the summary at the end
+// should show one result per turn, in order.
+- (void) runSoakTest
+{
+    NSUserDefaults* defaults = [NSUserDefaults standardUserDefaults];
+    NSTimeInterval duration = [defaults doubleForKey: @"SpeechSoakTestDuration"];
+    if (duration <= 0)
+        duration = 3 * 60 * 60;
+    double speed = [defaults doubleForKey: @"SpeechSoakTestSpeed"];
+    if (speed <= 0)
+        speed = 10;
+
+    [SpeechMockServer startWithHost: @"speech.mock"];
+    SpeechListener* listener = [SpeechListener listenerWithURL: [SpeechMockServer recognitionURL]];
+    listener.speechContext = SpeechContext();
+    self.soakListener = listener;
+    int sampleRate = listener.sampleRate;
+    size_t chunk = (size_t)(SOAK_CHUNK_DURATION * sampleRate);
+    uint64_t total = (uint64_t)(duration * sampleRate);
+    uint64_t logInterval = 600 * (uint64_t)sampleRate;
+
+    // The blocks don't retain self, which owns the soak test.  The feeder
+    // retains the listener until it's canceled.
+    __block SimpleSpeechAppDelegate* blockSelf = self;
+    __block NSUInteger delivered = 0, failed = 0, misordered = 0;
+    __block BOOL fed = NO, abandoned = NO;
+    void (^finishIfDone)(void) = ^{
+        SpeechListener* soak = blockSelf.soakListener;
+        if (!fed || soak == nil || delivered < soak.utteranceCount)
+            return;
+        NSLog(@"Soak test finished: %.1f hours of audio, %lu turns, %lu utterances, "
+              @"%lu failed, %lu dropped, %lu out of order, %.1f MB resident",
+              duration / 3600, (unsigned long)ceil(duration / SOAK_TURN_DURATION),
+              (unsigned long)soak.utteranceCount, (unsigned long)failed,
+              (unsigned long)soak.droppedCount, (unsigned long)misordered, ResidentMegabytes());
+        [SpeechMockServer stop];
+        // Not from inside the listener's own callback.
+        [[NSOperationQueue mainQueue] addOperationWithBlock: ^{
+            blockSelf.soakListener = nil;
+            blockSelf.soakAuth = nil;
+        }];
+    };
+    finishIfDone = [[finishIfDone copy] autorelease];
+    listener.resultBlock = ^(NSUInteger utterance, NSArray* strings, NSDictionary* json, NSError* error) {
+        if (utterance != delivered)
+            misordered++;
+        delivered++;
+        if (error != nil)
+            failed++;
+        finishIfDone();
+    };
+
+    // Feed the audio from a thread of its own, as the microphone would.
+    dispatch_queue_t feedQueue = dispatch_queue_create("SpeechSoakTest", NULL);
+    dispatch_source_t feeder = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0, feedQueue);
+    dispatch_release(feedQueue);
+    dispatch_source_set_timer(feeder, DISPATCH_TIME_NOW,
+                              (uint64_t)(SOAK_CHUNK_DURATION / speed * NSEC_PER_SEC), NSEC_PER_MSEC);
+    int16_t* samples = malloc(chunk * sizeof(int16_t));
+    __block uint64_t position = 0;
+    dispatch_source_set_event_handler(feeder, ^{
+        SynthesizeSpeech(samples, chunk, position, sampleRate);
+        [listener appendSamples: samples count: chunk];
+        position += chunk;
+        if (position % logInterval < chunk)
+            NSLog(@"Soak test: %.0f minutes of audio, %.1f MB resident",
+                  (double)position / sampleRate / 60, ResidentMegabytes());
+        if (position >= total)
+            dispatch_source_cancel(feeder);
+    });
+    dispatch_source_set_cancel_handler(feeder, ^{
+        free(samples);
+        dispatch_release(feeder);
+        dispatch_async(dispatch_get_main_queue(), ^{
+            if (abandoned) {
+                [SpeechMockServer stop];
+                blockSelf.soakListener = nil;
+                blockSelf.soakAuth = nil;
+                return;
+            }
+            fed = YES;
+            [blockSelf.soakListener stop];
+            finishIfDone();
+        });
+    });
+
+    // Start once the mock service has issued a token.
+    NSLog(@"Soak test: %.1f hours of audio at %.0fx", duration / 3600, speed);
+    self.soakAuth =
+        [SpeechAuth authenticatorForService: [SpeechMockServer oauthURL] withId: SpeechOAuthKey()
+                                     secret: SpeechOAuthSecret() scope: SpeechOAuthScope()];
+    __block BOOL started = NO;
+    [self.soakAuth fetchTo: ^(NSString* token, NSError* error) {
+        if (token == nil) {
+            NSLog(@"Soak test: no token from the mock service: %@", error);
+            if (!started) {
+                // The feeder has to be resumed for its cancel handler to
+                // run and free it, with the samples and the listener.
+                started = abandoned = YES;
+                dispatch_source_cancel(feeder);
+                dispatch_resume(feeder);
+            }
+            return;
+        }
+        blockSelf.soakListener.bearerAuthToken = token;
+        if (!started) {
+            started = YES;
+            [blockSelf.soakListener startWithoutMicrophone];
+            dispatch_resume(feeder);
+        }
+    }];
+}
+
+#pragma mark -
+#pragma mark Replay
+
+// Replays the recording named by -SpeechReplay, relative to Documents
+// unless it's an absolute path, to SpeechMockServer answering each request
+// with its recorded response, so the same recording always gives the same
+// results.  Interactions start at their recorded times, or back to back
+// with -SpeechReplayFast YES.  The report goes to the log and to
+// Documents/SpeechReplayReport.json.
+- (void) runReplay
+{
+    NSUserDefaults* defaults = [NSUserDefaults standardUserDefaults];
+    NSString* documents =
+        [NSSearchPathForDirectoriesInDomains(NSDocumentDirectory, NSUserDomainMask, YES) objectAtIndex: 0];
+    NSString* path = [defaults stringForKey: @"SpeechReplay"];
+    if (!path.isAbsolutePath)
+        path = [documents stringByAppendingPathComponent: path];
+
+    [SpeechMockServer startWithHost: @"speech.mock"];
+    SpeechReplayer* newReplayer = [SpeechReplayer replayerWithFile: path URL: [SpeechMockServer recognitionURL]];
+    if (newReplayer == nil) {
+        NSLog(@"Replay: %@ isn't a recording", path);
+        [SpeechMockServer stop];
+        return;
+    }
+    newReplayer.speechAuth =
+        [SpeechAuth authenticatorForService: [SpeechMockServer oauthURL] withId: SpeechOAuthKey()
+                                     secret: SpeechOAuthSecret() scope: SpeechOAuthScope()];
+    newReplayer.preservesTiming = ![defaults boolForKey: @"SpeechReplayFast"];
+    newReplayer.tagsRequests = YES;
+    [SpeechMockServer setResponder: [newReplayer recordedResponder]];
+    self.replayer = newReplayer;
+
+    NSLog(@"Replay: %lu interactions from %@", (unsigned long)newReplayer.replayableCount, path);
+    __block SimpleSpeechAppDelegate* blockSelf = self;
+    [newReplayer startWithCompletion: ^(NSDictionary* report) {
+        NSLog(@"Replay finished:\n%@", [SpeechReplayer descriptionOfReport: report]);
+        NSData* json = [NSJSONSerialization dataWithJSONObject: report options: 0 error: NULL];
+        [json writeToFile: [documents stringByAppendingPathComponent: @"SpeechReplayReport.json"] atomically: YES];
+        // The responder keeps the replayer alive until it's removed.
+        [SpeechMockServer setResponder: nil];
+        [SpeechMockServer stop];
+        blockSelf.replayer = nil;
+    }];
+}
+
+#pragma mark -
+#pragma mark Benchmarks
+
+// Times building a recognition request's headers, formatted from scratch
+// as before and shared through SpeechRequestHeaders, with the app's own
+// speech context and X-Args, and logs the time and heap blocks allocated
+// per request.  Then times metric updates from 1, 4 and 8 threads at once.
+// Run a release build on the device for figures worth comparing.
+- (void) runBenchmarks
+{
+    NSURL* url = [NSURL URLWithString: @"https://api.att.com/speech/v3/speechToText"];
+    NSString* speechContext = SpeechContext();
+    NSDictionary* xArgs = [NSDictionary dictionaryWithObjectsAndKeys: @"main", @"ClientScreen", nil];
+    NSString* token = @"0123456789abcdef0123456789abcdef";
+    NSString* contentType = @"audio/wav";
+    int shared;
+    for (shared = 0; shared <= 1; shared++) {
+        uint64_t elapsed = 0;
+        size_t blocks = 0;
+        NSUInteger i;
+        for (i = 0; i < BENCHMARK_ITERATIONS; i++) {
+            NSAutoreleasePool* pool = [[NSAutoreleasePool alloc] init];
+            NSMutableURLRequest* request = [NSMutableURLRequest requestWithURL: url];
+            size_t before = AllocatedBlocks();
+            uint64_t start = SpeechTraceNow();
+            if (shared)
+                [[SpeechRequestHeaders headersWithSpeechContext: speechContext xArgs: xArgs]
+                    applyToRequest: request contentType: contentType bearerAuthToken: token];
+            else
+                FormatHeadersEachTime(request, contentType, token, speechContext, xArgs);
+            elapsed += SpeechTraceNow() - start;
+            // Autoreleased objects are still counted, since the pool hasn't
+            // been drained yet.
+            blocks += AllocatedBlocks() - before;
+            [pool drain];
+        }
+        NSLog(@"Benchmark: request headers %@: %.0f ns, %.1f heap blocks per request",
+              shared ? @"shared" : @"formatted each time",
+              SpeechTraceMilliseconds(elapsed) * 1e6 / BENCHMARK_ITERATIONS,
+              (double)blocks / BENCHMARK_ITERATIONS);
+    }
+
+    static const int threadCounts[] = { 1, 4, 8 };
+    size_t run;
+    for (run = 0; run < sizeof(threadCounts) / sizeof(threadCounts[0]); run++) {
+        pthread_t threads[8];
+        int count = threadCounts[run], t;
+        uint64_t start = SpeechTraceNow();
+        for (t = 0; t < count; t++)
+            pthread_create(&threads[t], NULL, UpdateMetrics, NULL);
+        for (t = 0; t < count; t++)
+            pthread_join(threads[t], NULL);
+        // Each iteration makes two updates.
+        NSLog(@"Benchmark: metrics from %d threads: %.0f ns per update", count,
+              SpeechTraceMilliseconds(SpeechTraceNow() - start) * 1e6 / (2.0 * count * BENCHMARK_ITERATIONS));
+    }
+    // Keep the benchmark's metrics out of the real ones.
+    [SpeechMetrics reset];
 }
 
 - (void) dealloc 
 {
+    [[NSNotificationCenter defaultCenter] removeObserver: self];
+    [soakAuth cancel];
+    [soakAuth release];
+    [soakListener release];
+    [loadGenerator release];
+    [replayer release];
     [viewController release];
     [window release];
     [super dealloc];
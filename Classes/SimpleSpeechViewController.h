@@ -19,8 +19,14 @@
 // Initialize SpeechKit for this app.
 - (void) prepareSpeech;
 
+// Message sent when the "Press to Talk" button is first touched
+- (IBAction) prepareToListen: (id) sender;
+
 // Message sent by "Press to Talk" button in UI
 - (IBAction) listen: (id) sender;
 
+// Turn hands-free listening on or off
+- (IBAction) listenContinuously: (id) sender;
+
 @end
 
@@ -9,22 +9,93 @@
 #import "SimpleSpeechViewController.h"
 #import "SpeechConfig.h"
 #import "SpeechAuth.h"
+#import "SpeechTransport.h"
+#import "SpeechBandwidthEstimator.h"
+#import "SpeechTrace.h"
+#import "SpeechMetrics.h"
+#import "SpeechVocabulary.h"
+#import "SpeechSearchLoader.h"
+#import "SpeechListener.h"
+#import "SpeechRecorder.h"
+
+/** Tune how long the user may wait, after they stop talking, for the audio
+    to finish uploading.  Slower links get more compressed audio. **/
+static const NSTimeInterval AUDIO_LATENCY_BUDGET = 0.5; // seconds
 
 @interface SimpleSpeechViewController ()
+@property (retain, nonatomic) SpeechAuth* speechAuth;
+@property (assign, nonatomic) uint64_t traceStart;
+@property (assign, nonatomic) uint64_t recordingInteraction;
+@property (assign, nonatomic) BOOL preparedToListen;
+@property (assign, nonatomic) BOOL loadingVocabulary;
+@property (retain, nonatomic) SpeechVocabulary* vocabulary;
+@property (retain, nonatomic) SpeechSearchLoader* searchLoader;
+@property (retain, nonatomic) SpeechListener* listener;
+@property (retain, nonatomic) NSDictionary* xArgs;
+- (void) showListening: (id) sender;
+- (NSString*) textForHypotheses: (NSArray*) nbest;
 - (void) speechAuthFailed: (NSError*) error;
 @end
 
+/* Name of each state as it appears in the trace. */
+static const char* StateTraceName(ATTSpeechServiceState state)
+{
+    switch (state) {
+        case ATTSpeechServiceStateRecording: return "state.recording";
+        case ATTSpeechServiceStateProcessing: return "state.processing";
+        case ATTSpeechServiceStateConnecting: return "state.connecting";
+        case ATTSpeechServiceStateSendingAudioData: return "state.sendingAudioData";
+        case ATTSpeechServiceStateError: return "state.error";
+        default: return NULL; // Idle ends the interaction.
+    }
+}
+
+/* Name of the counter for each kind of speech error. */
+static const char* ErrorMetricName(NSError* error)
+{
+    if ([error.domain isEqualToString: ATTSpeechServiceHTTPErrorDomain])
+        return error.code >= 500 ? "speech.error.http5xx" : "speech.error.http4xx";
+    if ([error.domain isEqualToString: ATTSpeechServiceErrorDomain]) {
+        switch (error.code) {
+            case ATTSpeechServiceErrorCodeConnectionFailure: return "speech.error.connectionFailure";
+            case ATTSpeechServiceErrorCodeNoResponseFromServer: return "speech.error.noResponseFromServer";
+            case ATTSpeechServiceErrorCodeAudioTooShort: return "speech.error.audioTooShort";
+            case ATTSpeechServiceErrorCodeNoAudio: return "speech.error.noAudio";
+            case ATTSpeechServiceErrorCodeNoMicrophone: return "speech.error.noMicrophone";
+            case ATTSpeechServiceErrorCodeCanceledByUser: return "speech.error.canceledByUser";
+        }
+    }
+    return "speech.error.other";
+}
+
 @implementation SimpleSpeechViewController
 
 @synthesize textLabel;
 @synthesize webView;
 @synthesize talkButton;
+@synthesize speechAuth;
+@synthesize traceStart;
+@synthesize recordingInteraction;
+@synthesize preparedToListen;
+@synthesize vocabulary;
+@synthesize loadingVocabulary;
+@synthesize searchLoader;
+@synthesize listener;
+@synthesize xArgs;
 
 #pragma mark -
 #pragma mark Lifecyle
 
 - (void) dealloc
 {
+    [speechAuth cancel];
+    self.speechAuth = nil;
+    self.vocabulary = nil;
+    [searchLoader cancel];
+    self.searchLoader = nil;
+    [listener cancel];
+    self.listener = nil;
+    self.xArgs = nil;
     self.textLabel = nil;
     self.webView = nil;
     self.talkButton = nil;
@@ -48,26 +119,69 @@
     speechService.showUI = YES;
     
     // Choose the speech recognition package.
-    speechService.speechContext = @"WebSearch";
+    speechService.speechContext = SpeechContext();
+
+    // Add extra arguments for speech recogniton.
+    // The parameter is the name of the current screen within this app.
+    // They stay the same from request to request, so build them once.
+    self.xArgs =
+        [NSDictionary dictionaryWithObjectsAndKeys:
+         @"main", @"ClientScreen", nil];
+    speechService.xArgs = self.xArgs;
+
+    // Use the configured connection timeout, if there is one.
+    if (SpeechConnectionTimeout() > 0)
+        speechService.connectionTimeout = SpeechConnectionTimeout();
     
     // Start the OAuth background operation, disabling the Talk button until 
-    // it's done.
+    // it's done.  A token cached by an earlier launch comes back immediately,
+    // and SpeechAuth keeps calling the block with fresh tokens until canceled.
+    // The block doesn't retain self, since self retains the authenticator.
     talkButton.enabled = NO;
-    [[SpeechAuth authenticatorForService: SpeechOAuthUrl()
-                                  withId: SpeechOAuthKey()
-                                  secret: SpeechOAuthSecret()
-                                   scope: SpeechOAuthScope()]
-        fetchTo: ^(NSString* token, NSError* error) {
-            if (token) {
-                speechService.bearerAuthToken = token;
-                talkButton.enabled = YES;
-            }
-            else
-                [self speechAuthFailed: error];
+    [self.speechAuth cancel];
+    self.speechAuth =
+        [SpeechAuth authenticatorForService: SpeechOAuthUrl()
+                                     withId: SpeechOAuthKey()
+                                     secret: SpeechOAuthSecret()
+                                      scope: SpeechOAuthScope()];
+    __block SimpleSpeechViewController* blockSelf = self;
+    [self.speechAuth fetchTo: ^(NSString* token, NSError* error) {
+        if (token) {
+            speechService.bearerAuthToken = token;
+            blockSelf.listener.bearerAuthToken = token;
+            blockSelf.talkButton.enabled = YES;
+        }
+        else
+            [blockSelf speechAuthFailed: error];
     }];
 
+    // Keep hands-free listening, if it's on, in step with the config.
+    self.listener.speechContext = SpeechContext();
+    self.listener.xArgs = self.xArgs;
+    self.listener.connectionTimeout = SpeechConnectionTimeout();
+
+    // Load the phrases this app expects, if it has any, for correcting
+    // recognition results against.  Compiling a long list takes a while,
+    // so it's done off the main thread; results that arrive before it's
+    // done go uncorrected.
+    NSString* vocabularyPath = [[NSBundle mainBundle] pathForResource: @"Vocabulary" ofType: @"txt"];
+    if (vocabularyPath != nil && self.vocabulary == nil && !self.loadingVocabulary) {
+        self.loadingVocabulary = YES;
+        dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_LOW, 0), ^{
+            SpeechVocabulary* compiled = [SpeechVocabulary vocabularyWithContentsOfFile: vocabularyPath];
+            dispatch_async(dispatch_get_main_queue(), ^{
+                self.vocabulary = compiled;
+                self.loadingVocabulary = NO;
+            });
+        });
+    }
+
     // Wake the audio components so there is minimal delay on the first request.
     [speechService prepare];
+    
+    // Open the connection to the speech host now, so the first request 
+    // doesn't wait for the TCP and TLS handshakes.
+    [[SpeechTransport sharedTransport] prewarmURL: SpeechServiceUrl()];
 }
 
 #pragma mark -
@@ -81,38 +195,131 @@
 #pragma mark -
 #pragma mark Actions
 
+// Get ready for a speech request as soon as the "Push to talk" button is
+// touched, so the setup overlaps the press and listen: can start at once.
+- (IBAction) prepareToListen: (id) sender
+{
+    SpeechTraceInstant("prepareToListen");
+    ATTSpeechService* speechService = [ATTSpeechService sharedSpeechService];
+
+    // Send the best audio the network can carry without keeping the user
+    // waiting, unless the config names a format.
+    NSString* audioFormat = SpeechAudioFormat();
+    if (audioFormat == nil)
+        audioFormat = [[SpeechBandwidthEstimator sharedEstimator] audioFormatForLatencyBudget: AUDIO_LATENCY_BUDGET];
+    speechService.audioFormat = audioFormat;
+
+    // Reopen the connection to the speech host if it went idle since the
+    // last request.  If the user doesn't follow through, it simply closes.
+    [[SpeechTransport sharedTransport] prewarmURL: SpeechServiceUrl()];
+    self.preparedToListen = YES;
+}
+
 // Perform the action of the "Push to talk" button
 - (IBAction) listen: (id) sender
 {
     NSLog(@"Starting speech request");
-    
+    // Time the whole interaction, from here until the result is shown.
+    self.traceStart = SpeechTraceNow();
+    SpeechTraceInstant("listen");
+    // SpeechKit keeps the audio to itself, so only the states and the
+    // outcome are recorded.
+    self.recordingInteraction = [[SpeechRecorder sharedRecorder] beginInteraction];
+
+    // The button normally prepared on touch-down, but not if it was
+    // triggered some other way, such as by VoiceOver.
+    if (!self.preparedToListen)
+        [self prepareToListen: sender];
+    self.preparedToListen = NO;
+
     // Start listening via the microphone.
     ATTSpeechService* speechService = [ATTSpeechService sharedSpeechService];
+    [speechService startListening];
+}
 
-    // Add extra arguments for speech recogniton.
-    // The parameter is the name of the current screen within this app.
-    speechService.xArgs =
-        [NSDictionary dictionaryWithObjectsAndKeys:
-         @"main", @"ClientScreen", nil];
+// Listen hands-free until sent again.  Each utterance is recognized as it
+// ends, while the user goes on talking; the setup that listen: does for
+// every request is done once here.
+- (IBAction) listenContinuously: (id) sender
+{
+    if (self.listener.isListening) {
+        [self.listener stop];
+        [self showListening: sender];
+        return;
+    }
+    if (self.listener == nil) {
+        SpeechListener* newListener = [SpeechListener listenerWithURL: SpeechServiceUrl()];
+        newListener.speechContext = SpeechContext();
+        newListener.connectionTimeout = SpeechConnectionTimeout();
+        newListener.xArgs = self.xArgs;
+        // The blocks don't retain self, since self retains the listener.
+        __block SimpleSpeechViewController* blockSelf = self;
+        newListener.speechBlock = ^(NSUInteger utterance) {
+            // The user is talking over the last result, so stop loading it.
+            [blockSelf.searchLoader cancel];
+        };
+        newListener.resultBlock = ^(NSUInteger utterance, NSArray* nbest, NSDictionary* json, NSError* error) {
+            // Hands-free, a misheard or failed utterance is simply skipped.
+            if (error != nil) {
+                NSLog(@"Utterance %lu had an error: %@", (unsigned long)utterance, error);
+                return;
+            }
+            NSString* recognizedText = [blockSelf textForHypotheses: nbest];
+            if (recognizedText.length)
+                [blockSelf handleRecognition: recognizedText alternatives: nbest completion: nil];
+        };
+        self.listener = newListener;
+    }
+    self.listener.bearerAuthToken = [ATTSpeechService sharedSpeechService].bearerAuthToken;
+    if (![self.listener start]) {
+        UIAlertView* alert =
+            [[UIAlertView alloc] initWithTitle: @"Can't listen"
+                                       message: @"The microphone is unavailable."
+                                      delegate: self
+                             cancelButtonTitle: @"OK"
+                             otherButtonTitles: nil];
+        [alert show];
+        [alert release];
+    }
+    [self showListening: sender];
+}
 
-    [speechService startListening];
+// The "Hands-Free" button reads "Stop" while the listener is on.
+- (void) showListening: (id) sender
+{
+    if ([sender isKindOfClass: [UIButton class]])
+        [(UIButton*)sender setSelected: self.listener.isListening];
+}
+
+// The text to act on: the app's own phrase that best matches any of the
+// hypotheses, or else the top hypothesis.
+- (NSString*) textForHypotheses: (NSArray*) nbest
+{
+    // There can be 0 strings, 1 empty string, or 1 non-empty string.
+    NSString* recognizedText = @"";
+    if (nbest != nil && nbest.count > 0)
+        recognizedText = [nbest objectAtIndex: 0];
+    NSString* phrase = [self.vocabulary phraseMatchingHypotheses: nbest];
+    if (phrase != nil)
+        recognizedText = phrase;
+    return recognizedText;
 }
 
 // Make use of the recognition text in this app.
-- (void) handleRecognition: (NSString*) recognizedText
+// block is called once the page is shown.
+- (void) handleRecognition: (NSString*) recognizedText alternatives: (NSArray*) nbest
+                completion: (void (^)(void)) block
 {
     // Display the recognized text.
     [self.textLabel setText: recognizedText];
     
-    // Load a website using the recognized text.
-    // First make the recognizedText safe for use as a search term in a URL.
-    NSString* escapedTerm =
-        [recognizedText stringByAddingPercentEscapesUsingEncoding: NSUTF8StringEncoding];
-    NSString* urlString =
-        [NSString stringWithFormat: @"http://en.m.wikipedia.org/w/index.php?search=%@", escapedTerm];
-    NSURL* url = [NSURL URLWithString: urlString];
-    NSURLRequest* request = [NSURLRequest requestWithURL: url];
-    [self.webView loadRequest:request];
+    // Load a website using the recognized text, searching for the other
+    // hypotheses too in case the user wants one of them instead.
+    if (self.searchLoader == nil)
+        self.searchLoader =
+            [SpeechSearchLoader loaderWithURLFormat: @"http://en.m.wikipedia.org/w/index.php?search=%@"
+                                            webView: self.webView];
+    [self.searchLoader showResultsForQuery: recognizedText alternatives: nbest completion: block];
 }
 
 #pragma mark -
@@ -121,6 +328,10 @@
 - (void) speechServiceSucceeded: (ATTSpeechService*) speechService
 {
     NSLog(@"Speech service succeeded");
+    SpeechMetricCount("speech.succeeded");
+    [[SpeechRecorder sharedRecorder] recordResponseStatus: speechService.statusCode
+                                                     data: speechService.responseData
+                                              interaction: self.recordingInteraction];
     
     // Extract the needed data from the SpeechService object:
     // For raw bytes, read speechService.responseData.
@@ -128,15 +339,19 @@
     // For the n-best ASR strings, use speechService.responseStrings.
     
     // In this example, use the ASR strings.
-    // There can be 0 strings, 1 empty string, or 1 non-empty string.
     // Display the recognized text in the interface is it's non-empty,
     // otherwise have the user try again.
     NSArray* nbest = speechService.responseStrings;
-    NSString* recognizedText = @"";
-    if (nbest != nil && nbest.count > 0)
-        recognizedText = [nbest objectAtIndex: 0];
+    NSString* recognizedText = [self textForHypotheses: nbest];
     if (recognizedText.length) { // non-empty?
-        [self handleRecognition: recognizedText];
+        // Rendering lasts until the search loader has the page in the web
+        // view, and the interaction with it.
+        uint64_t renderStart = SpeechTraceNow();
+        uint64_t interactionStart = self.traceStart;
+        [self handleRecognition: recognizedText alternatives: nbest completion: ^{
+            SpeechTraceEnd("render", renderStart);
+            SpeechTraceEnd("interaction", interactionStart);
+        }];
     }
     else {
         UIAlertView* alert =
@@ -153,6 +368,13 @@
 - (void) speechService: (ATTSpeechService*) speechService 
          failedWithError: (NSError*) error
 {
+    SpeechMetricCount(ErrorMetricName(error));
+    SpeechRecorder* recorder = [SpeechRecorder sharedRecorder];
+    if ([error.domain isEqualToString: ATTSpeechServiceHTTPErrorDomain])
+        [recorder recordResponseStatus: error.code data: speechService.responseData
+                           interaction: self.recordingInteraction];
+    else
+        [recorder recordError: error interaction: self.recordingInteraction];
     if ([error.domain isEqualToString: ATTSpeechServiceErrorDomain]
         && (error.code == ATTSpeechServiceErrorCodeCanceledByUser)) {
         NSLog(@"Speech service canceled");
@@ -160,6 +382,7 @@
         return;
     }
     NSLog(@"Speech service had an error: %@", error);
+    SpeechTraceInstant("error");
     
     UIAlertView* alert =
         [[UIAlertView alloc] initWithTitle: @"An error occurred"
@@ -171,16 +394,58 @@
     [alert release];
 }
 
+- (void) speechServiceWillStartListening: (ATTSpeechService*) speechService
+{
+    SpeechTraceInstant("willStartListening");
+}
+
+- (void) speechServiceIsListening: (ATTSpeechService*) speechService
+{
+    SpeechTraceInstant("isListening");
+}
+
+- (void) speechServiceHasStoppedListening: (ATTSpeechService*) speechService
+{
+    SpeechTraceInstant("hasStoppedListening");
+}
+
+- (void) speechService: (ATTSpeechService*) speechService
+        willEnterState: (ATTSpeechServiceState) newState
+{
+    // Each state becomes a span in the trace, ending at the next transition,
+    // and the state it ends is timed in the metrics.
+    const char* stateName = StateTraceName(newState);
+    double milliseconds;
+    const char* endedName = SpeechTracePhase(stateName, &milliseconds);
+    if (endedName != NULL)
+        SpeechMetricRecord(endedName, milliseconds);
+    // And record them with the interaction.
+    [[SpeechRecorder sharedRecorder] recordState: stateName ? [NSString stringWithUTF8String: stateName] : @"state.idle"
+                                     interaction: self.recordingInteraction];
+
+    // Learn the uplink speed from how long each upload takes.
+    [[SpeechBandwidthEstimator sharedEstimator] speechService: speechService
+                                               willEnterState: newState];
+}
+
 #pragma mark -
 #pragma mark OAuth
 
-/* The SpeechAuth authentication failed. */
+/* The SpeechAuth authentication failed, even after retrying. */
 - (void) speechAuthFailed: (NSError*) error
 {
     NSLog(@"OAuth error: %@", error);
+    // Only a 4xx response means the credentials were rejected.  Anything else 
+    // is an outage, and the next prepareSpeech will try again.
+    BOOL rejected = [error.domain isEqualToString: ATTSpeechServiceHTTPErrorDomain]
+        && error.code >= 400 && error.code < 500;
+    SpeechMetricCount(rejected ? "oauth.error.rejected" : "oauth.error.unavailable");
+    NSString* message = rejected
+        ? @"This app was rejected by the speech service.  Contact the developer for an update."
+        : @"The speech service can't be reached.  Please try again later.";
     UIAlertView* alert = 
         [[UIAlertView alloc] initWithTitle: @"Speech Unavailable"
-                                   message: @"This app was rejected by the speech service.  Contact the developer for an update."
+                                   message: message
                                   delegate: self 
                          cancelButtonTitle: @"OK"
                          otherButtonTitles: nil];
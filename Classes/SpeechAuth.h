@@ -6,34 +6,93 @@
 // For more information contact developer.support@att.com http://developer.att.com
 
 #import <Foundation/NSObject.h>
+#import <Foundation/NSDate.h>
 
-@class NSString, NSError;
+@class NSString, NSError, NSIndexSet, NSURLResponse;
 
 /**
  * Type of block called when SpeechAuth gets credential or fails.
  * token will be the OAuth bearer token.
  * If there's an problem authenticating, token will be nil and 
  * error will contain the error.  
+ * When the OAuth service reports how long the token lasts, the block is 
+ * called again with a fresh token each time SpeechAuth refreshes it, until 
+ * the SpeechAuth object is canceled.
  * TO DO: document the keys in error.userInfo
 **/
 typedef void (^SpeechAuthBlock)(NSString* token, NSError* error);
 
+/**
+ * Describes how SpeechAuth retries a failed OAuth request.
+ * Retries wait a random interval between zero and an exponentially growing
+ * limit ("full jitter"), so that many clients failing at once don't all 
+ * come back to the OAuth service at once.
+**/
+@interface SpeechAuthRetryPolicy : NSObject <NSCopying> {
+}
+
+/** Total number of attempts, including the first.  1 disables retries. **/
+@property (assign, nonatomic) NSUInteger maxAttempts;
+
+/** The limit on the delay before the first retry, in seconds.  
+ *  The limit doubles with each attempt. **/
+@property (assign, nonatomic) NSTimeInterval baseDelay;
+
+/** The largest delay before any retry, in seconds. **/
+@property (assign, nonatomic) NSTimeInterval maxDelay;
+
+/** HTTP status codes that are worth retrying.  A Retry-After header on
+ *  such a response sets the delay, up to maxDelay. **/
+@property (copy, nonatomic) NSIndexSet* retryableStatusCodes;
+
+/** Returns a policy of 4 attempts, 0.5 second base delay, 30 second cap,
+ *  retrying 408, 429, and 5xx status codes and transient network errors. **/
++ (SpeechAuthRetryPolicy*) defaultPolicy;
+
+/** Returns a policy that never retries. **/
++ (SpeechAuthRetryPolicy*) noRetryPolicy;
+
+/** Returns the number of seconds to wait before retrying after the given 
+ *  attempt (starting at 1) failed, or a negative number if the request 
+ *  should not be retried.  response is nil if the request failed without one. **/
+- (NSTimeInterval) delayAfterAttempt: (NSUInteger) attempt
+                                error: (NSError*) error
+                             response: (NSURLResponse*) response;
+
+@end
+
 /**
  * Fetches OAuth client credentials, calling a block when done.
+ * SpeechAuth objects that fetch a token for the same URL, client_id, and 
+ * scope while a request is already in flight share that request, and each
+ * of their blocks gets its result.
 **/
 @interface SpeechAuth : NSObject {
 }
 
+/** How to retry failed requests.  Defaults to [SpeechAuthRetryPolicy defaultPolicy].
+ *  When fetches are shared, the policy of the first one to start applies. **/
+@property (copy) SpeechAuthRetryPolicy* retryPolicy;
+
 /** Creates a SpeechAuth object with the given credentials. **/
 + (SpeechAuth*) authenticatorForService: (NSURL*) oauth_url
                                  withId: (NSString*) client_id
                                  secret: (NSString*) client_secret
                                   scope: (NSString*) oauth_scope;
 
-/*! Beging fetching the credentials.  Will call block when done. !*/
+/*! Beging fetching the credentials.  Will call block when done.
+ *  May be called from any thread; the block is called on the main thread.
+ *  If an unexpired token was cached by an earlier fetch, even in a previous
+ *  launch, the block is called with it immediately, and the token is 
+ *  refreshed in the background before it expires. !*/
 - (void) fetchTo: (SpeechAuthBlock) block;
 
-/*! Stop fetching. Once stopped, loading may not resume. !*/
+/*! Discard the token, even if it hasn't expired, and fetch a new one, 
+ *  calling block as fetchTo: does.  Use when a service rejects the token.
+ *  Works after a failed fetch too, but not once canceled. !*/
+- (void) refreshTo: (SpeechAuthBlock) block;
+
+/*! Stop fetching and refreshing. Once stopped, loading may not resume. !*/
 - (void) cancel;
 
 @end
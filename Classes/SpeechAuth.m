@@ -6,7 +6,12 @@
 // For more information contact developer.support@att.com http://developer.att.com
 
 #import "SpeechAuth.h"
+#import "SpeechAuthParser.h"
+#import "SpeechTransport.h"
+#import "SpeechTrace.h"
+#import "SpeechMetrics.h"
 #import "ATTSpeechKit.h"
+#import <Security/Security.h>
 
 typedef enum
 {
@@ -18,40 +23,282 @@ typedef enum
     LoaderStateFinished,
     LoaderStateFailed,
     LoaderStateCanceling,
-    LoaderStateCanceled
+    LoaderStateCanceled,
+    LoaderStateWaitingToRetry
 } LoaderState;
 
+/* Name of the counter of entries to each state. */
+static const char* LoaderStateMetricName(LoaderState state)
+{
+    switch (state) {
+        case LoaderStateInitialized: return "oauth.state.initialized";
+        case LoaderStateConnecting: return "oauth.state.connecting";
+        case LoaderStateReceivedResponse: return "oauth.state.receivedResponse";
+        case LoaderStateReceivedData: return "oauth.state.receivedData";
+        case LoaderStateFinished: return "oauth.state.finished";
+        case LoaderStateFailed: return "oauth.state.failed";
+        case LoaderStateCanceling: return "oauth.state.canceling";
+        case LoaderStateCanceled: return "oauth.state.canceled";
+        case LoaderStateWaitingToRetry: return "oauth.state.waitingToRetry";
+        default: return "oauth.state.unknown";
+    }
+}
+
 // Memory Management
-// 
-// This object will retain its initialiation parameters (the NSURLRequest)
-// during the lifetime of this object.  
-// It will retain the connection, response, data, and delegate only between
-// the call to start and the callbacks to the delegate.
-// It will also add a retain of itself during that interval.  That way, the 
-// client can autorelease this object after starting, and this object 
+//
+// A SpeechAuth object will retain its initialiation parameters (the
+// NSURLRequest) during the lifetime of this object.
+// The network traffic is done by a SpeechAuthLoader, which is shared by every
+// SpeechAuth object fetching a token for the same (URL, client_id, scope).
+// While a fetch is in flight, the loader retains each waiting SpeechAuth
+// object, and a registry of in-flight loaders retains the loader.  That way,
+// the client can autorelease a SpeechAuth object after starting, and it
 // will remain in memory while active.
+// Between attempts, the retry timer retains the loader as well.
+// Once a token with a known lifetime has been delivered, the refresh timer
+// retains the SpeechAuth object (and the block) until the client calls cancel.
+//
+// SpeechAuth and SpeechAuthLoader do all their work on the main thread.
 
-@interface SpeechAuth () {
+@interface SpeechAuth ()
+@property (copy) SpeechAuthBlock authenticatedBlock;
+@property (copy) NSURLRequest* request;// Make a copy in case it's mutable
+@property (copy) NSString* cacheKey;
+@property (copy) NSString* token;
+@property (retain) NSDate* expires;
+@property (retain) NSTimer* refreshTimer;
+@property (assign) BOOL loading;
+
+- (void) start;
+- (void) scheduleRefreshAfter: (NSTimeInterval) interval;
+- (void) loaderDidFinishWithToken: (NSString*) token expires: (NSDate*) expires;
+- (void) loaderDidFailWithError: (NSError*) error;
+@end
+
+/**
+ * Performs one OAuth request on behalf of all the SpeechAuth objects that
+ * want a token for the same credentials at the same time.
+**/
+@interface SpeechAuthLoader : NSObject {
     @private
     LoaderState state;
+    NSUInteger attempts;
+    SpeechAuthParser parser;
+    uint64_t fetchStart;
+    uint64_t attemptStart;
 }
-@property (copy) SpeechAuthBlock authenticatedBlock;
-@property (copy) NSURLRequest* request;// Make a copy in case it's mutable
+@property (copy) NSURLRequest* request;
+@property (copy) NSString* key;
+@property (copy) SpeechAuthRetryPolicy* retryPolicy;
+@property (retain) NSMutableArray* clients;
+@property (retain) NSTimer* retryTimer;
 @property (retain) NSURLConnection* connection;
 @property (retain) NSURLResponse* response;
-@property (retain) NSMutableData* data;
+
+/** Adds client to the in-flight request for key, starting one if needed. **/
++ (void) loadRequest: (NSURLRequest*) request
+              forKey: (NSString*) key
+              client: (SpeechAuth*) client;
+
+/** Stops delivering to client.  The request is canceled when no clients remain. **/
++ (void) removeClient: (SpeechAuth*) client forKey: (NSString*) key;
 
 - (NSInteger) statusCode;
+- (void) enterState: (LoaderState) newState;
+- (void) start;
 - (void) clear;
+- (void) unregister;
+- (BOOL) retryAfterError: (NSError*) error;
+- (void) finishWithToken: (NSString*) token expiresIn: (NSTimeInterval) lifetime;
+- (void) finishWithError: (NSError*) error;
+- (void) failWhileReceiving: (NSError*) error;
 @end
 
+#pragma mark -
+#pragma mark Token Cache
+
+// Tokens are cached in the keychain rather than the user defaults, so they
+// persist across launches without being readable from the app's preferences.
+// Each entry is a property list holding the token and its expiration date.
+
+static NSString* const TokenCacheService = @"SpeechAuth";
+static NSString* const TokenCacheTokenKey = @"token";
+static NSString* const TokenCacheExpiresKey = @"expires";
+
+static NSMutableDictionary* TokenCacheQuery(NSString* key)
+{
+    return [NSMutableDictionary dictionaryWithObjectsAndKeys:
+            (id)kSecClassGenericPassword, (id)kSecClass,
+            TokenCacheService, (id)kSecAttrService,
+            key, (id)kSecAttrAccount, nil];
+}
+
+/* Look up an unexpired token in the cache.  Returns NO if there is none. */
+static BOOL TokenCacheLoad(NSString* key, NSString** token, NSDate** expires)
+{
+    NSMutableDictionary* query = TokenCacheQuery(key);
+    [query setObject: (id)kCFBooleanTrue forKey: (id)kSecReturnData];
+    [query setObject: (id)kSecMatchLimitOne forKey: (id)kSecMatchLimit];
+    CFTypeRef result = NULL;
+    if (SecItemCopyMatching((CFDictionaryRef)query, &result) != noErr || result == NULL)
+        return NO;
+    NSData* data = [(NSData*)result autorelease];
+    // Be very circumspect about the data types so that we don't crash on bad data.
+    NSDictionary* entry =
+        [NSPropertyListSerialization propertyListWithData: data options: 0
+                                                   format: NULL error: NULL];
+    if (![entry isKindOfClass: [NSDictionary class]])
+        return NO;
+    id cachedToken = [entry objectForKey: TokenCacheTokenKey];
+    id cachedExpires = [entry objectForKey: TokenCacheExpiresKey];
+    if (![cachedToken isKindOfClass: [NSString class]]
+        || ![cachedExpires isKindOfClass: [NSDate class]]
+        || [cachedExpires timeIntervalSinceNow] <= 0)
+        return NO;
+    *token = cachedToken;
+    *expires = cachedExpires;
+    return YES;
+}
+
+static void TokenCacheStore(NSString* key, NSString* token, NSDate* expires)
+{
+    NSDictionary* entry =
+        [NSDictionary dictionaryWithObjectsAndKeys:
+         token, TokenCacheTokenKey, expires, TokenCacheExpiresKey, nil];
+    NSData* data =
+        [NSPropertyListSerialization dataWithPropertyList: entry
+                                                   format: NSPropertyListBinaryFormat_v1_0
+                                                  options: 0 error: NULL];
+    if (data == nil)
+        return;
+    NSMutableDictionary* query = TokenCacheQuery(key);
+    SecItemDelete((CFDictionaryRef)query);
+    [query setObject: data forKey: (id)kSecValueData];
+    [query setObject: (id)kSecAttrAccessibleAfterFirstUnlock forKey: (id)kSecAttrAccessible];
+    SecItemAdd((CFDictionaryRef)query, NULL);
+}
+
+static void TokenCacheRemove(NSString* key)
+{
+    SecItemDelete((CFDictionaryRef)TokenCacheQuery(key));
+}
+
+#pragma mark -
+
+@implementation SpeechAuthRetryPolicy
+
+@synthesize maxAttempts = _maxAttempts;
+@synthesize baseDelay = _baseDelay;
+@synthesize maxDelay = _maxDelay;
+@synthesize retryableStatusCodes = _retryableStatusCodes;
+
++ (SpeechAuthRetryPolicy*) defaultPolicy
+{
+    SpeechAuthRetryPolicy* policy = [[[self alloc] init] autorelease];
+    policy.maxAttempts = 4;
+    policy.baseDelay = 0.5;
+    policy.maxDelay = 30.0;
+    NSMutableIndexSet* codes = [NSMutableIndexSet indexSetWithIndexesInRange: NSMakeRange(500, 100)];
+    [codes addIndex: 408]; // Request Timeout
+    [codes addIndex: 429]; // Too Many Requests
+    policy.retryableStatusCodes = codes;
+    return policy;
+}
+
++ (SpeechAuthRetryPolicy*) noRetryPolicy
+{
+    SpeechAuthRetryPolicy* policy = [[[self alloc] init] autorelease];
+    policy.maxAttempts = 1;
+    return policy;
+}
+
+- (id) copyWithZone: (NSZone*) zone
+{
+    SpeechAuthRetryPolicy* copy = [[[self class] allocWithZone: zone] init];
+    copy.maxAttempts = _maxAttempts;
+    copy.baseDelay = _baseDelay;
+    copy.maxDelay = _maxDelay;
+    copy.retryableStatusCodes = _retryableStatusCodes;
+    return copy;
+}
+
+- (void) dealloc
+{
+    self.retryableStatusCodes = nil;
+    [super dealloc];
+}
+
+/* Network errors that are likely to clear up on their own. */
+static BOOL IsTransientNetworkError(NSError* error)
+{
+    if (![error.domain isEqualToString: NSURLErrorDomain])
+        return NO;
+    switch (error.code) {
+        case NSURLErrorTimedOut:
+        case NSURLErrorCannotFindHost:
+        case NSURLErrorCannotConnectToHost:
+        case NSURLErrorNetworkConnectionLost:
+        case NSURLErrorDNSLookupFailed:
+        case NSURLErrorNotConnectedToInternet:
+            return YES;
+        default:
+            return NO;
+    }
+}
+
+/* The delay requested by a Retry-After header, or a negative number if none. */
+static NSTimeInterval RetryAfterDelay(NSURLResponse* response)
+{
+    if (![response respondsToSelector: @selector(allHeaderFields)])
+        return -1;
+    id value = [[(NSHTTPURLResponse*)response allHeaderFields] objectForKey: @"Retry-After"];
+    if (![value isKindOfClass: [NSString class]])
+        return -1;
+    // Only the delta-seconds form is supported; an HTTP-date falls back to backoff.
+    NSScanner* scanner = [NSScanner scannerWithString: value];
+    NSInteger seconds = 0;
+    if (![scanner scanInteger: &seconds] || !scanner.isAtEnd || seconds < 0)
+        return -1;
+    return seconds;
+}
+
+- (NSTimeInterval) delayAfterAttempt: (NSUInteger) attempt
+                                error: (NSError*) error
+                             response: (NSURLResponse*) response
+{
+    if (attempt >= _maxAttempts)
+        return -1;
+    if (response != nil) {
+        NSInteger status = 200;
+        if ([response respondsToSelector: @selector(statusCode)])
+            status = [(NSHTTPURLResponse*)response statusCode];
+        if (![_retryableStatusCodes containsIndex: status])
+            return -1;
+        NSTimeInterval retryAfter = RetryAfterDelay(response);
+        if (retryAfter >= 0)
+            return MIN(retryAfter, _maxDelay);
+    }
+    else if (!IsTransientNetworkError(error))
+        return -1;
+    // Full jitter: anywhere from zero up to the exponential limit.
+    NSTimeInterval limit = MIN(_maxDelay, _baseDelay * pow(2.0, (double)(attempt - 1)));
+    return limit * ((double)arc4random() / UINT32_MAX);
+}
+
+@end
+
+#pragma mark -
+
 @implementation SpeechAuth
 
 @synthesize authenticatedBlock = _authenticatedBlock;
 @synthesize request = _request;
-@synthesize connection = _connection;
-@synthesize response = _response;
-@synthesize data = _data;
+@synthesize cacheKey = _cacheKey;
+@synthesize token = _token;
+@synthesize expires = _expires;
+@synthesize refreshTimer = _refreshTimer;
+@synthesize loading = _loading;
+@synthesize retryPolicy = _retryPolicy;
 
 
 - (id) initWithRequest: (NSURLRequest*) request
@@ -64,11 +311,9 @@ typedef enum
             [self release];
             return nil;
         }
-        self.request = request; 
-        self.data = [NSMutableData data];
-        _connection = nil; // Create connection when client wants to start loading.
-        _response = nil;
-        state = LoaderStateInitialized;
+        self.request = request;
+        self.retryPolicy = [SpeechAuthRetryPolicy defaultPolicy];
+        _loading = NO; // Join a loader when client wants to start loading.
     }
     return self;
 }
@@ -76,6 +321,19 @@ typedef enum
 /** Tune the timeout values based on application behavior. **/
 static const NSTimeInterval CONNECT_TIMEOUT = 10.0; // seconds
 
+/** Largest OAuth response body to accept.  Real ones are a few hundred bytes. **/
+static const size_t MAX_RESPONSE_LENGTH = 16 * 1024;
+
+/** How long before expiration to start refreshing a token in the background. **/
+static const NSTimeInterval REFRESH_MARGIN = 300.0; // seconds
+
+/** Don't bother retrying a failed refresh with less than this left on the token. **/
+static const NSTimeInterval REFRESH_RETRY_MIN = 30.0; // seconds
+
+/** Longest token lifetime to believe.  Longer ones are cut to this, so a
+    bad expires_in can't keep a token cached forever. **/
+static const NSTimeInterval MAX_TOKEN_LIFETIME = 30 * 24 * 60 * 60.0; // seconds
+
 + (SpeechAuth*) authenticatorForService: (NSURL*) oauth_url
                                  withId: (NSString*) client_id
                                  secret: (NSString*) client_secret
@@ -83,24 +341,241 @@ static const NSTimeInterval CONNECT_TIMEOUT = 10.0; // seconds
 {
     NSMutableURLRequest* request = [NSMutableURLRequest requestWithURL: oauth_url];
     NSString* postString = [NSString stringWithFormat:
-        @"grant_type=client_credentials&scope=%@&client_id=%@&client_secret=%@", 
+        @"grant_type=client_credentials&scope=%@&client_id=%@&client_secret=%@",
         oauth_scope, client_id, client_secret];
     request.HTTPMethod = @"POST";
     request.HTTPBody = [postString dataUsingEncoding:NSUTF8StringEncoding];
     request.timeoutInterval = CONNECT_TIMEOUT;
-    return [[[self alloc] initWithRequest: request] autorelease];
-    
+    SpeechAuth* auth = [[[self alloc] initWithRequest: request] autorelease];
+    auth.cacheKey = [NSString stringWithFormat: @"%@ %@ %@",
+                     oauth_url.absoluteString, client_id, oauth_scope];
+    return auth;
+}
+
+- (void) dealloc
+{
+    // We should have already been canceled, but just in case...
+    [_refreshTimer invalidate];
+
+    self.refreshTimer = nil;
+    self.cacheKey = nil;
+    self.token = nil;
+    self.expires = nil;
+    self.request = nil;
+    self.retryPolicy = nil;
+    self.authenticatedBlock = nil;
+
+    [super dealloc];
+}
+
+- (void) start
+{
+    // The loader retains this object until it calls back.
+    _loading = YES;
+    [SpeechAuthLoader loadRequest: _request forKey: _cacheKey client: self];
+}
+
+- (void) fetchTo: (SpeechAuthBlock) block
+{
+    // Loaders and timers live on the main run loop.
+    if (![NSThread isMainThread]) {
+        dispatch_async(dispatch_get_main_queue(), ^{
+            [self fetchTo: block];
+        });
+        return;
+    }
+    self.authenticatedBlock = block;
+
+    // If a previous launch left a good token in the cache, hand it back right
+    // away and refresh it in the background before it expires.
+    NSString* cachedToken = nil;
+    NSDate* cachedExpires = nil;
+    if (TokenCacheLoad(_cacheKey, &cachedToken, &cachedExpires)) {
+        SpeechMetricCount("oauth.cacheHit");
+        self.token = cachedToken;
+        self.expires = cachedExpires;
+        block(cachedToken, nil);
+        // The block may have canceled us.
+        if (_authenticatedBlock != nil)
+            [self scheduleRefreshAfter: [cachedExpires timeIntervalSinceNow] - REFRESH_MARGIN];
+        return;
+    }
+    [self start];
+}
+
+- (void) refreshTo: (SpeechAuthBlock) block
+{
+    if (![NSThread isMainThread]) {
+        dispatch_async(dispatch_get_main_queue(), ^{
+            [self refreshTo: block];
+        });
+        return;
+    }
+    self.authenticatedBlock = block;
+    [_refreshTimer invalidate];
+    self.refreshTimer = nil;
+    // Forget the rejected token, so neither a failed load nor a later
+    // fetch falls back on it.
+    TokenCacheRemove(_cacheKey);
+    self.token = nil;
+    self.expires = nil;
+    SpeechMetricCount("oauth.forcedRefresh");
+    // A load already in flight will bring a new token.
+    if (!_loading)
+        [self start];
+}
+
+- (void) scheduleRefreshAfter: (NSTimeInterval) interval
+{
+    [_refreshTimer invalidate];
+    // The timer retains this object until it fires or we are canceled.
+    // Even an immediate refresh goes through the timer, so that it starts
+    // after the loader that is finishing now has been cleared.
+    self.refreshTimer =
+        [NSTimer scheduledTimerWithTimeInterval: MAX(interval, 0) target: self
+                                       selector: @selector(refreshTimerFired:)
+                                       userInfo: nil repeats: NO];
+}
+
+- (void) refreshTimerFired: (NSTimer*) timer
+{
+    self.refreshTimer = nil;
+    [self start];
+}
+
+- (void) loaderDidFinishWithToken: (NSString*) token expires: (NSDate*) expires
+{
+    _loading = NO;
+    self.token = token;
+    self.expires = expires;
+    SpeechAuthBlock block = [[_authenticatedBlock retain] autorelease];
+    if (block == nil)
+        return; // We were canceled.
+    block(token, nil);
+    if (_authenticatedBlock == nil)
+        return; // The block canceled us.
+    if (expires != nil) {
+        NSTimeInterval lifetime = [expires timeIntervalSinceNow];
+        [self scheduleRefreshAfter: MAX(lifetime - REFRESH_MARGIN, lifetime / 2)];
+    }
+    else
+        self.authenticatedBlock = nil; // Nothing more to deliver.
+}
+
+- (void) loaderDidFailWithError: (NSError*) error
+{
+    _loading = NO;
+    // A failed background refresh isn't fatal while the token the client
+    // already has is still good.  Try again partway to its expiration.
+    NSTimeInterval remaining = [_expires timeIntervalSinceNow];
+    if (_expires != nil && remaining > REFRESH_RETRY_MIN) {
+        [self scheduleRefreshAfter: remaining / 2];
+        return;
+    }
+    SpeechAuthBlock block = [[_authenticatedBlock retain] autorelease];
+    self.authenticatedBlock = nil;
+    if (block != nil)
+        block(nil, error);
+}
+
+- (void) cancel
+{
+    // Stop refreshing, and leave the loader when we cancel.
+    [_refreshTimer invalidate];
+    self.refreshTimer = nil;
+    self.authenticatedBlock = nil;
+    if (_loading) {
+        _loading = NO;
+        [SpeechAuthLoader removeClient: self forKey: _cacheKey];
+    }
+}
+
+@end
+
+#pragma mark -
+
+@implementation SpeechAuthLoader
+
+@synthesize request = _request;
+@synthesize key = _key;
+@synthesize retryPolicy = _retryPolicy;
+@synthesize clients = _clients;
+@synthesize retryTimer = _retryTimer;
+@synthesize connection = _connection;
+@synthesize response = _response;
+
+/* Loaders with a request in flight, keyed by URL, client_id and scope. */
+static NSMutableDictionary* InFlightLoaders(void)
+{
+    static NSMutableDictionary* loaders = nil;
+    if (loaders == nil)
+        loaders = [[NSMutableDictionary alloc] init];
+    return loaders;
+}
+
++ (void) loadRequest: (NSURLRequest*) request
+              forKey: (NSString*) key
+              client: (SpeechAuth*) client
+{
+    SpeechAuthLoader* loader = [InFlightLoaders() objectForKey: key];
+    if (loader != nil) {
+        // Someone is already fetching this token, so wait for their result.
+        if (![loader.clients containsObject: client])
+            [loader.clients addObject: client];
+        return;
+    }
+    loader = [[self alloc] initWithRequest: request key: key];
+    loader.retryPolicy = client.retryPolicy;
+    [loader.clients addObject: client];
+    [InFlightLoaders() setObject: loader forKey: key];
+    [loader release];
+    [loader start];
+}
+
++ (void) removeClient: (SpeechAuth*) client forKey: (NSString*) key
+{
+    SpeechAuthLoader* loader = [InFlightLoaders() objectForKey: key];
+    [loader.clients removeObject: client];
+    if (loader != nil && loader.clients.count == 0)
+    {
+        // Nobody wants the result any more.
+        [loader enterState: LoaderStateCanceling];
+        [[loader retain] autorelease];
+        [loader clear];
+        [loader unregister];
+        [loader enterState: LoaderStateCanceled];
+    }
+}
+
+- (id) initWithRequest: (NSURLRequest*) request key: (NSString*) key
+{
+    self = [super init];
+    if (self != nil)
+    {
+        self.request = request;
+        self.key = key;
+        self.clients = [NSMutableArray array];
+        _connection = nil; // Create connection when the first client starts loading.
+        _response = nil;
+        [self enterState: LoaderStateInitialized];
+        attempts = 0;
+        fetchStart = SpeechTraceNow();
+    }
+    return self;
 }
 
 - (void) dealloc
 {
     // We should have already been cleared, but just in case...
     [_connection cancel];
-    
+    [_retryTimer invalidate];
+
     self.request = nil;
+    self.key = nil;
+    self.retryPolicy = nil;
+    self.clients = nil;
+    self.retryTimer = nil;
     self.response = nil;
-    self.data = nil;
-    self.authenticatedBlock = nil;
     self.connection = nil;
 
     [super dealloc];
@@ -115,105 +590,196 @@ static const NSTimeInterval CONNECT_TIMEOUT = 10.0; // seconds
         code = [(NSHTTPURLResponse*)_response statusCode];
     // The other kind of response we support is file: URLs.
     // The behavior of NSURLConnection in that case is to only call connection:didReceiveResponse:
-    // when the file is found.  
+    // when the file is found.
     // When it's not found, it calls connection:didFailWithError: directly.
     // So if our response is non-nil, assume it's OK.
-    else 
+    else
         code = 200 ;
     return code;
 }
 
+- (void) enterState: (LoaderState) newState
+{
+    // Data arrives in many pieces; count each state once per visit.
+    if (newState != state)
+        SpeechMetricCount(LoaderStateMetricName(newState));
+    state = newState;
+}
+
 - (void) start
 {
-    state = LoaderStateConnecting;
-    // Add a retention to this object do it doesn't dispose during the connection.
-    [self retain];
+    [self enterState: LoaderStateConnecting];
+    attempts++;
+    attemptStart = SpeechTraceNow();
+    SpeechAuthParserInit(&parser, MAX_RESPONSE_LENGTH);
+
+    // Allocate the NSURLConnection and start it in one step, sharing
+    // keep-alive connections with the app's other Speech API requests.
+    self.connection = [[SpeechTransport sharedTransport] connectionWithRequest: _request
+                                                                      delegate: self];
 
-    // Allocate the NSURLConnection and start it in one step.
-    self.connection = [NSURLConnection connectionWithRequest: _request 
-                                                    delegate: self];
-        
     if (_connection == nil) {
-        state = LoaderStateFailed;
-        // Report the error the delegate on the next time through the runloop.
+        [self enterState: LoaderStateFailed];
+        // Report the error the clients on the next time through the runloop.
         [[NSOperationQueue mainQueue] addOperationWithBlock: ^{
+            if (state != LoaderStateFailed)
+                return; // Canceled in the meantime.
             // TO DO: the arguments to NSError are completely arbitrary!
-            NSError* error = [NSError errorWithDomain: ATTSpeechServiceErrorDomain 
-                                                 code: ATTSpeechServiceErrorCodeConnectionFailure 
+            NSError* error = [NSError errorWithDomain: ATTSpeechServiceErrorDomain
+                                                 code: ATTSpeechServiceErrorCodeConnectionFailure
                                              userInfo: nil];
-            _authenticatedBlock(nil, error);
-            [self clear];
+            [self finishWithError: error];
         }];
         return;
     }
     // Don't call [_connection start], since it's already started.
 }
 
-- (void) fetchTo: (SpeechAuthBlock) block
-{
-    self.authenticatedBlock = block;
-    [self start];
-}
-
 - (void) clear
 {
-    // Completely dispose the connection, delegate, and response data 
-    // when we are done.
-    self.authenticatedBlock = nil;
+    // Completely dispose the connection and response when we are done.
+    // The parser holds no memory of its own, so there's nothing else to free.
+    if (_connection != nil) {
+        SpeechTraceEnd("oauth.attempt", attemptStart);
+        SpeechMetricTime("oauth.attempt", attemptStart);
+    }
     [_connection cancel];
     self.connection = nil;
     self.response = nil;
-    _data.length = 0;
-    // And release the retain count we added during start.
-    [self release];
+    [_retryTimer invalidate];
+    self.retryTimer = nil;
 }
 
-- (void) cancel
+- (void) unregister
 {
-    // Completely dispose the connection when we cancel it.
-    if (state != LoaderStateFinished)
-    {
-        state = LoaderStateCanceling;
-        [self clear];
+    // Later requests for this key get a fresh loader.
+    // The caller must hold a reference, since this may release the last one.
+    if ([InFlightLoaders() objectForKey: _key] == self)
+        [InFlightLoaders() removeObjectForKey: _key];
+}
+
+- (BOOL) retryAfterError: (NSError*) error
+{
+    NSTimeInterval delay = [_retryPolicy delayAfterAttempt: attempts
+                                                     error: error
+                                                  response: _response];
+    if (delay < 0)
+        return NO;
+    // Stay registered, so fetches in the meantime wait for the retry.
+    [self clear];
+    [self enterState: LoaderStateWaitingToRetry];
+    self.retryTimer =
+        [NSTimer scheduledTimerWithTimeInterval: delay target: self
+                                       selector: @selector(retryTimerFired:)
+                                       userInfo: nil repeats: NO];
+    return YES;
+}
+
+- (void) retryTimerFired: (NSTimer*) timer
+{
+    self.retryTimer = nil;
+    [self start];
+}
+
+- (void) finishWithToken: (NSString*) token expiresIn: (NSTimeInterval) lifetime
+{
+    NSDate* expires = nil;
+    if (lifetime > MAX_TOKEN_LIFETIME)
+        lifetime = MAX_TOKEN_LIFETIME;
+    if (lifetime > 0) {
+        expires = [NSDate dateWithTimeIntervalSinceNow: lifetime];
+        TokenCacheStore(_key, token, expires);
     }
+    SpeechTraceEnd("oauth.fetch", fetchStart);
+    SpeechMetricTime("oauth.fetch", fetchStart);
+    SpeechMetricCount("oauth.fetch.succeeded");
+    // Take the clients before clearing, so any of them that start another
+    // fetch from the callback get a new loader.
+    NSArray* clients = [[_clients copy] autorelease];
+    [_clients removeAllObjects];
+    [[self retain] autorelease];
+    [self clear];
+    [self unregister];
+    for (SpeechAuth* client in clients)
+        [client loaderDidFinishWithToken: token expires: expires];
+}
+
+- (void) finishWithError: (NSError*) error
+{
+    SpeechTraceEnd("oauth.fetch", fetchStart);
+    SpeechMetricTime("oauth.fetch", fetchStart);
+    SpeechMetricCount("oauth.fetch.failed");
+    NSArray* clients = [[_clients copy] autorelease];
+    [_clients removeAllObjects];
+    [[self retain] autorelease];
+    [self clear];
+    [self unregister];
+    for (SpeechAuth* client in clients)
+        [client loaderDidFailWithError: error];
 }
 
 // NSURLConnection delegate methods
 
 
-- (void) connection: (NSURLConnection*) connection 
+- (void) connection: (NSURLConnection*) connection
  didReceiveResponse: (NSURLResponse*) response
 {
-    // The connection just got a new response.  Clear out anything we've already loaded.
+    // The connection just got a new response.  Clear out anything we've already parsed.
     self.response = response;
-    _data.length = 0;
-    state = LoaderStateReceivedResponse;
+    SpeechAuthParserInit(&parser, MAX_RESPONSE_LENGTH);
+    [self enterState: LoaderStateReceivedResponse];
 }
 
-- (void) connection: (NSURLConnection*) connection 
+- (void) connection: (NSURLConnection*) connection
      didReceiveData: (NSData*) data
 {
     // The connection is sending us some data incrementally.
-    [_data appendData: data];
-    state = LoaderStateReceivedData;
+    // Parse it as it arrives; only a successful response has a body we need.
+    [self enterState: LoaderStateReceivedData];
+    if (self.statusCode != 200)
+        return;
+    SpeechAuthParseStatus status = SpeechAuthParserFeed(&parser, data.bytes, data.length);
+    // Give up as soon as the body is unusable, rather than downloading the rest.
+    if (status == SpeechAuthParseTooLarge)
+        [self failWhileReceiving: [NSError errorWithDomain: NSURLErrorDomain
+                                                      code: NSURLErrorDataLengthExceedsMaximum
+                                                  userInfo: nil]];
+    else if (status == SpeechAuthParseError)
+        [self failWhileReceiving: [NSError errorWithDomain: NSCocoaErrorDomain
+                                                      code: NSPropertyListReadCorruptError
+                                                  userInfo: nil]];
+}
+
+- (void) failWhileReceiving: (NSError*) error
+{
+    [self enterState: LoaderStateFailed];
+    [_connection cancel];
+    if (![self retryAfterError: error])
+        [self finishWithError: error];
 }
 
 - (void) connectionDidFinishLoading: (NSURLConnection*) connection
 {
-    // Loading is complete. 
-    state = LoaderStateFinished;
+    // Loading is complete.
+    [self enterState: LoaderStateFinished];
 
     NSError* error = nil;
     BOOL succeeded = NO;
-    if (self.statusCode == 200 && _data.length) {
-        // Use iOS 5 JSON library to decode OAuth response.
-        // Be very circumspect about the data types so that we don't crash on bad data.
-        NSDictionary* json = [NSJSONSerialization JSONObjectWithData: _data options: 0 error: &error];
-        if ([json isKindOfClass: [NSDictionary class]]) {
-            id token = [json objectForKey: @"access_token"];
+    if (self.statusCode == 200 && parser.consumed > 0) {
+        // The parser has already seen the whole body; make sure it was complete.
+        if (SpeechAuthParserFinish(&parser) != SpeechAuthParseDone)
+            error = [NSError errorWithDomain: NSCocoaErrorDomain
+                                        code: NSPropertyListReadCorruptError
+                                    userInfo: nil];
+        else if (parser.has_access_token) {
+            NSString* token = [[[NSString alloc] initWithBytes: parser.access_token
+                                                        length: parser.access_token_length
+                                                      encoding: NSUTF8StringEncoding] autorelease];
             if (token != nil) {
-                // We have a token, so give it to the delegate.
-                _authenticatedBlock([token description], nil);
+                // expires_in may have come back as a number or a string.
+                NSTimeInterval lifetime = parser.has_expires_in ? parser.expires_in : 0;
+                // We have a token, so give it to the clients.
+                [self finishWithToken: token expiresIn: lifetime];
                 succeeded = YES;
             }
         }
@@ -223,24 +789,20 @@ static const NSTimeInterval CONNECT_TIMEOUT = 10.0; // seconds
         if (error == nil)
             error = [NSError errorWithDomain: ATTSpeechServiceHTTPErrorDomain
                                 code: self.statusCode userInfo: nil];
-        _authenticatedBlock(nil, error);
+        if (![self retryAfterError: error])
+            [self finishWithError: error];
     }
-    
-    // The callback is complete, so clean up.
-    [self clear];
 }
 
 - (void) connection: (NSURLConnection*) connection didFailWithError: (NSError*) error
 {
-    // Loading failed. 
-    state = LoaderStateFailed;
+    // Loading failed.
+    [self enterState: LoaderStateFailed];
 
-    _authenticatedBlock(nil, error);
-    
-    // The callback is complete, so clean up.
-    [self clear];
+    // NSURLConnection has no response to report in this case.
+    self.response = nil;
+    if (![self retryAfterError: error])
+        [self finishWithError: error];
 }
 
 @end
-
-
@@ -0,0 +1,399 @@
+//  SpeechAuthParser.c
+//
+// Licensed by AT&T under 'Software Development Kit Tools Agreement' 2012.
+// TERMS AND CONDITIONS FOR USE, REPRODUCTION, AND DISTRIBUTION: http://developer.att.com/sdk_agreement/
+// Copyright 2012 AT&T Intellectual Property. All rights reserved.
+// For more information contact developer.support@att.com http://developer.att.com
+
+#include "SpeechAuthParser.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+// The parser is a byte-at-a-time JSON state machine.  It validates the whole
+// body, tracking nesting on a small stack, but only copies out the values of
+// the top-level access_token, refresh_token, and expires_in members.
+
+enum {
+    StateValue = 0,         // expecting any value
+    StateKeyOrEnd,          // just after '{'
+    StateKey,               // after ',' in an object
+    StateColon,             // after a key
+    StateObjectCommaOrEnd,  // after a member value
+    StateValueOrEnd,        // just after '['
+    StateArrayCommaOrEnd,   // after an element
+    StateString,            // inside a string
+    StateNumber,            // inside a number
+    StateLiteral,           // inside true, false, or null
+    StateDone               // after the top-level object
+};
+
+enum {
+    FieldNone = 0,
+    FieldKey,
+    FieldAccessToken,
+    FieldRefreshToken,
+    FieldExpiresIn
+};
+
+static int IsSpace(unsigned char c)
+{
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+static int IsNumberChar(unsigned char c)
+{
+    return (c >= '0' && c <= '9') || c == '-' || c == '+' || c == '.' || c == 'e' || c == 'E';
+}
+
+static int HexValue(unsigned char c)
+{
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    return -1;
+}
+
+void SpeechAuthParserInit(SpeechAuthParser* parser, size_t max_length)
+{
+    memset(parser, 0, sizeof(*parser));
+    parser->max_length = max_length;
+    parser->state = StateValue;
+}
+
+/* Parses the collected scratch characters as a number of seconds. */
+static void TakeExpiresIn(SpeechAuthParser* parser)
+{
+    char* end = NULL;
+    double value;
+    if (parser->scratch_length == 0 || parser->scratch_length >= sizeof(parser->scratch))
+        return;
+    parser->scratch[parser->scratch_length] = '\0';
+    value = strtod(parser->scratch, &end);
+    if (end != NULL && *end == '\0' && isfinite(value)) {
+        parser->expires_in = value;
+        parser->has_expires_in = 1;
+    }
+}
+
+/* Appends one byte of string or number text to the current field.
+   Returns 0 if the field overflows in a way that makes the body unusable. */
+static int Append(SpeechAuthParser* parser, char c)
+{
+    switch (parser->field) {
+        case FieldKey:
+            // Keys longer than any we look for just won't match.
+            if (parser->key_length < sizeof(parser->key) - 1)
+                parser->key[parser->key_length] = c;
+            parser->key_length++;
+            return 1;
+        case FieldAccessToken:
+            if (parser->access_token_length >= SPEECH_AUTH_MAX_TOKEN)
+                return 0;
+            parser->access_token[parser->access_token_length++] = c;
+            return 1;
+        case FieldRefreshToken:
+            if (parser->refresh_token_length >= SPEECH_AUTH_MAX_TOKEN)
+                return 0;
+            parser->refresh_token[parser->refresh_token_length++] = c;
+            return 1;
+        case FieldExpiresIn:
+            // Too long to be a sensible number; TakeExpiresIn will ignore it.
+            if (parser->scratch_length < sizeof(parser->scratch))
+                parser->scratch[parser->scratch_length] = c;
+            parser->scratch_length++;
+            return 1;
+        default:
+            return 1;
+    }
+}
+
+/* Appends a \u escape as UTF-8.  Surrogate pairs are encoded separately,
+   which is harmless for the ASCII tokens an OAuth service issues. */
+static int AppendCodePoint(SpeechAuthParser* parser, unsigned int code)
+{
+    if (code < 0x80)
+        return Append(parser, (char)code);
+    if (code < 0x800)
+        return Append(parser, (char)(0xC0 | (code >> 6)))
+            && Append(parser, (char)(0x80 | (code & 0x3F)));
+    return Append(parser, (char)(0xE0 | (code >> 12)))
+        && Append(parser, (char)(0x80 | ((code >> 6) & 0x3F)))
+        && Append(parser, (char)(0x80 | (code & 0x3F)));
+}
+
+/* Called when a key string ends: decide where its value should go. */
+static void EndKey(SpeechAuthParser* parser)
+{
+    size_t length = parser->key_length;
+    parser->pending_field = FieldNone;
+    if (parser->depth != 1 || length >= sizeof(parser->key))
+        return;
+    if (length == 12 && memcmp(parser->key, "access_token", 12) == 0)
+        parser->pending_field = FieldAccessToken;
+    else if (length == 13 && memcmp(parser->key, "refresh_token", 13) == 0)
+        parser->pending_field = FieldRefreshToken;
+    else if (length == 10 && memcmp(parser->key, "expires_in", 10) == 0)
+        parser->pending_field = FieldExpiresIn;
+}
+
+/* Called when any value ends, to move to the state of its container. */
+static void EndValue(SpeechAuthParser* parser)
+{
+    parser->field = FieldNone;
+    if (parser->depth == 0)
+        parser->state = StateDone;
+    else if (parser->stack[parser->depth - 1] == '{')
+        parser->state = StateObjectCommaOrEnd;
+    else
+        parser->state = StateArrayCommaOrEnd;
+}
+
+/* Begins a string, number, or literal value, or opens a container. */
+static int BeginValue(SpeechAuthParser* parser, unsigned char c)
+{
+    int field = parser->pending_field;
+    parser->pending_field = FieldNone;
+    // The top-level value must be an object.
+    if (parser->depth == 0 && c != '{')
+        return 0;
+    switch (c) {
+        case '{':
+        case '[':
+            if (parser->depth >= SPEECH_AUTH_MAX_DEPTH)
+                return 0;
+            parser->stack[parser->depth++] = (char)c;
+            parser->state = (c == '{') ? StateKeyOrEnd : StateValueOrEnd;
+            return 1;
+        case '"':
+            parser->field = field;
+            parser->state = StateString;
+            // A repeated member replaces the earlier value.
+            if (field == FieldAccessToken) {
+                parser->access_token_length = 0;
+                parser->has_access_token = 0;
+            }
+            else if (field == FieldRefreshToken) {
+                parser->refresh_token_length = 0;
+                parser->has_refresh_token = 0;
+            }
+            else if (field == FieldExpiresIn)
+                parser->scratch_length = 0;
+            return 1;
+        case 't':
+            parser->literal = "rue";
+            parser->state = StateLiteral;
+            return 1;
+        case 'f':
+            parser->literal = "alse";
+            parser->state = StateLiteral;
+            return 1;
+        case 'n':
+            parser->literal = "ull";
+            parser->state = StateLiteral;
+            return 1;
+        default:
+            if (c != '-' && (c < '0' || c > '9'))
+                return 0;
+            parser->field = (field == FieldExpiresIn) ? FieldExpiresIn : FieldNone;
+            parser->scratch_length = 0;
+            parser->state = StateNumber;
+            return Append(parser, (char)c);
+    }
+}
+
+/* Begins a member name in an object. */
+static int BeginKey(SpeechAuthParser* parser, unsigned char c)
+{
+    if (c != '"')
+        return 0;
+    parser->field = FieldKey;
+    parser->key_length = 0;
+    parser->state = StateString;
+    return 1;
+}
+
+/* Closes the innermost container if it matches c. */
+static int EndContainer(SpeechAuthParser* parser, unsigned char c)
+{
+    char open = (c == '}') ? '{' : '[';
+    if (parser->depth == 0 || parser->stack[parser->depth - 1] != open)
+        return 0;
+    parser->depth--;
+    EndValue(parser);
+    return 1;
+}
+
+/* Handles the closing quote of a string. */
+static void EndString(SpeechAuthParser* parser)
+{
+    switch (parser->field) {
+        case FieldKey:
+            EndKey(parser);
+            parser->field = FieldNone;
+            parser->state = StateColon;
+            return;
+        case FieldAccessToken:
+            parser->access_token[parser->access_token_length] = '\0';
+            parser->has_access_token = 1;
+            break;
+        case FieldRefreshToken:
+            parser->refresh_token[parser->refresh_token_length] = '\0';
+            parser->has_refresh_token = 1;
+            break;
+        case FieldExpiresIn:
+            TakeExpiresIn(parser);
+            break;
+    }
+    EndValue(parser);
+}
+
+/* Consumes one byte inside a string.  Returns 0 on malformed input. */
+static int StringByte(SpeechAuthParser* parser, unsigned char c)
+{
+    if (parser->unicode_digits > 0) {
+        int digit = HexValue(c);
+        if (digit < 0)
+            return 0;
+        parser->unicode = (parser->unicode << 4) | (unsigned int)digit;
+        if (--parser->unicode_digits == 0)
+            return AppendCodePoint(parser, parser->unicode);
+        return 1;
+    }
+    if (parser->escape) {
+        parser->escape = 0;
+        switch (c) {
+            case '"': case '\\': case '/':
+                return Append(parser, (char)c);
+            case 'b': return Append(parser, '\b');
+            case 'f': return Append(parser, '\f');
+            case 'n': return Append(parser, '\n');
+            case 'r': return Append(parser, '\r');
+            case 't': return Append(parser, '\t');
+            case 'u':
+                parser->unicode = 0;
+                parser->unicode_digits = 4;
+                return 1;
+            default:
+                return 0;
+        }
+    }
+    if (c == '\\') {
+        parser->escape = 1;
+        return 1;
+    }
+    if (c == '"') {
+        EndString(parser);
+        return 1;
+    }
+    if (c < 0x20)
+        return 0; // Control characters must be escaped.
+    return Append(parser, (char)c);
+}
+
+/* Consumes one byte.  Returns 0 on malformed input. */
+static int Step(SpeechAuthParser* parser, unsigned char c)
+{
+    switch (parser->state) {
+        case StateString:
+            return StringByte(parser, c);
+
+        case StateNumber:
+            if (IsNumberChar(c))
+                return Append(parser, (char)c);
+            if (parser->field == FieldExpiresIn)
+                TakeExpiresIn(parser);
+            EndValue(parser);
+            // The byte that ended the number belongs to the container.
+            return Step(parser, c);
+
+        case StateLiteral:
+            if (c != (unsigned char)*parser->literal)
+                return 0;
+            if (*++parser->literal == '\0')
+                EndValue(parser);
+            return 1;
+
+        default:
+            break;
+    }
+
+    if (IsSpace(c))
+        return 1;
+
+    switch (parser->state) {
+        case StateValue:
+            return BeginValue(parser, c);
+
+        case StateValueOrEnd:
+            if (c == ']')
+                return EndContainer(parser, c);
+            return BeginValue(parser, c);
+
+        case StateKeyOrEnd:
+            if (c == '}')
+                return EndContainer(parser, c);
+            return BeginKey(parser, c);
+
+        case StateKey:
+            return BeginKey(parser, c);
+
+        case StateColon:
+            if (c != ':')
+                return 0;
+            parser->state = StateValue;
+            return 1;
+
+        case StateObjectCommaOrEnd:
+            if (c == ',') {
+                parser->state = StateKey;
+                return 1;
+            }
+            return c == '}' && EndContainer(parser, c);
+
+        case StateArrayCommaOrEnd:
+            if (c == ',') {
+                parser->state = StateValue;
+                return 1;
+            }
+            return c == ']' && EndContainer(parser, c);
+
+        default: // StateDone: nothing but whitespace may follow.
+            return 0;
+    }
+}
+
+SpeechAuthParseStatus SpeechAuthParserFeed(SpeechAuthParser* parser,
+                                           const void* bytes, size_t length)
+{
+    const unsigned char* p = (const unsigned char*)bytes;
+    size_t i;
+    if (parser->status == SpeechAuthParseError || parser->status == SpeechAuthParseTooLarge)
+        return parser->status;
+    if (length > parser->max_length - parser->consumed) {
+        parser->status = SpeechAuthParseTooLarge;
+        return parser->status;
+    }
+    parser->consumed += length;
+    for (i = 0; i < length; i++) {
+        if (!Step(parser, p[i])) {
+            parser->status = SpeechAuthParseError;
+            return parser->status;
+        }
+    }
+    if (parser->state == StateDone)
+        parser->status = SpeechAuthParseDone;
+    return parser->status;
+}
+
+SpeechAuthParseStatus SpeechAuthParserFinish(SpeechAuthParser* parser)
+{
+    // The top level is always an object, so it can't end in the middle of
+    // a number or literal.
+    if (parser->status == SpeechAuthParseIncomplete)
+        parser->status = SpeechAuthParseError;
+    return parser->status;
+}
@@ -0,0 +1,78 @@
+//  SpeechAuthParser.h
+//
+// Licensed by AT&T under 'Software Development Kit Tools Agreement' 2012.
+// TERMS AND CONDITIONS FOR USE, REPRODUCTION, AND DISTRIBUTION: http://developer.att.com/sdk_agreement/
+// Copyright 2012 AT&T Intellectual Property. All rights reserved.
+// For more information contact developer.support@att.com http://developer.att.com
+//
+// Incremental parser for OAuth token responses.  It consumes the JSON body
+// as it arrives from the network and keeps only the fields SpeechAuth needs,
+// so the response is never buffered whole or turned into an NSDictionary.
+// It is plain C and does no allocation; a parser can live on the stack or in
+// an instance variable.
+
+#ifndef SPEECH_AUTH_PARSER_H
+#define SPEECH_AUTH_PARSER_H
+
+#include <stddef.h>
+
+/** Longest access_token or refresh_token value that will be accepted. **/
+#define SPEECH_AUTH_MAX_TOKEN 1024
+
+/** Deepest nesting of objects and arrays that will be accepted. **/
+#define SPEECH_AUTH_MAX_DEPTH 32
+
+typedef enum SpeechAuthParseStatus {
+    /** The body is well-formed so far; feed it more bytes. **/
+    SpeechAuthParseIncomplete = 0,
+    /** The top-level object is complete. **/
+    SpeechAuthParseDone,
+    /** The body is not a well-formed JSON object, or a token is too long. **/
+    SpeechAuthParseError,
+    /** The body is longer than the parser's limit. **/
+    SpeechAuthParseTooLarge
+} SpeechAuthParseStatus;
+
+typedef struct SpeechAuthParser {
+    /* Results.  Valid once the status is SpeechAuthParseDone. */
+    char access_token[SPEECH_AUTH_MAX_TOKEN + 1]; /* NUL-terminated UTF-8 */
+    size_t access_token_length;
+    int has_access_token;
+    char refresh_token[SPEECH_AUTH_MAX_TOKEN + 1]; /* NUL-terminated UTF-8 */
+    size_t refresh_token_length;
+    int has_refresh_token;
+    double expires_in; /* seconds, always finite */
+    int has_expires_in;
+
+    /* Private parsing state. */
+    SpeechAuthParseStatus status;
+    size_t max_length;
+    size_t consumed;
+    int state;
+    int depth;
+    char stack[SPEECH_AUTH_MAX_DEPTH];
+    int field;
+    int pending_field;
+    int escape;
+    unsigned int unicode;
+    int unicode_digits;
+    const char* literal;
+    char key[16];
+    size_t key_length;
+    char scratch[32];
+    size_t scratch_length;
+} SpeechAuthParser;
+
+/** Prepares parser for a new response body of at most max_length bytes. **/
+void SpeechAuthParserInit(SpeechAuthParser* parser, size_t max_length);
+
+/** Consumes the next length bytes of the body.  Once the result is anything
+    but SpeechAuthParseIncomplete, further bytes may only be whitespace. **/
+SpeechAuthParseStatus SpeechAuthParserFeed(SpeechAuthParser* parser,
+                                           const void* bytes, size_t length);
+
+/** Signals the end of the body.  Returns SpeechAuthParseDone only if the
+    body held one complete JSON object. **/
+SpeechAuthParseStatus SpeechAuthParserFinish(SpeechAuthParser* parser);
+
+#endif
@@ -0,0 +1,53 @@
+//  SpeechBandwidthEstimator.h
+//
+// Licensed by AT&T under 'Software Development Kit Tools Agreement' 2012.
+// TERMS AND CONDITIONS FOR USE, REPRODUCTION, AND DISTRIBUTION: http://developer.att.com/sdk_agreement/
+// Copyright 2012 AT&T Intellectual Property. All rights reserved.
+// For more information contact developer.support@att.com http://developer.att.com
+
+#import <Foundation/NSObject.h>
+#import <Foundation/NSDate.h>
+#import "ATTSpeechKit.h"
+
+@class NSString;
+
+/**
+ * Learns the uplink throughput to the Speech API from the timing of
+ * ATTSpeechService interactions, and picks the audio format that keeps the
+ * upload within a latency budget.
+ *
+ * The SDK streams audio while recording, so a link faster than the audio
+ * bitrate finishes sending almost as soon as recording stops; that only
+ * shows the link is at least that fast.  A slower link leaves a backlog to
+ * drain after recording, and the time it takes measures the throughput.
+ * Estimates are kept across launches in the user defaults.
+ *
+ * Use SpeechBandwidthEstimator only from the main thread.
+**/
+@interface SpeechBandwidthEstimator : NSObject {
+}
+
+/** Returns the estimator shared by the whole app. **/
++ (SpeechBandwidthEstimator*) sharedEstimator;
+
+/** Estimated uplink throughput in bits per second, or 0 if unknown. **/
+@property (readonly) double bitsPerSecond;
+
+/** Whether bitsPerSecond is only a lower bound, because no upload so far
+ *  has been limited by the link. **/
+@property (readonly) BOOL isLowerBound;
+
+/** Typical length of the user's recordings, in seconds. **/
+@property (readonly) NSTimeInterval typicalAudioDuration;
+
+/** Call from the ATTSpeechService delegate's speechService:willEnterState:
+ *  to time each interaction. **/
+- (void) speechService: (ATTSpeechService*) speechService
+        willEnterState: (ATTSpeechServiceState) newState;
+
+/** The highest quality audio format expected to finish uploading within
+ *  budget seconds after the user stops talking.  Until something has been
+ *  measured, that is Speex wideband, which even a weak link can carry. **/
+- (NSString*) audioFormatForLatencyBudget: (NSTimeInterval) budget;
+
+@end
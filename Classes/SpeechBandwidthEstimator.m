@@ -0,0 +1,198 @@
+//  SpeechBandwidthEstimator.m
+//
+// Licensed by AT&T under 'Software Development Kit Tools Agreement' 2012.
+// TERMS AND CONDITIONS FOR USE, REPRODUCTION, AND DISTRIBUTION: http://developer.att.com/sdk_agreement/
+// Copyright 2012 AT&T Intellectual Property. All rights reserved.
+// For more information contact developer.support@att.com http://developer.att.com
+
+#import "SpeechBandwidthEstimator.h"
+
+/** Tune how quickly the estimates follow new measurements. **/
+static const double SMOOTHING = 0.3;
+
+/** Upload time after recording ends beyond which the link, not the
+    microphone, was limiting the upload. **/
+static const NSTimeInterval CONGESTED_TAIL = 0.2; // seconds
+
+/** After this many interactions in a lower format than the best, try the
+    next better one once, in case the link has improved. **/
+static const NSUInteger PROBE_INTERVAL = 8;
+
+/** Typical recording length to assume before any have been measured. **/
+static const NSTimeInterval DEFAULT_DURATION = 3.0; // seconds
+
+static NSString* const BITS_PER_SECOND_KEY = @"SpeechBandwidthBitsPerSecond";
+static NSString* const LOWER_BOUND_KEY = @"SpeechBandwidthIsLowerBound";
+static NSString* const DURATION_KEY = @"SpeechBandwidthTypicalDuration";
+
+/* Bitrate of each audio format, as documented in ATTSpeechKit.h. */
+static double BitrateForFormat(NSString* format)
+{
+    if ([format isEqualToString: ATTSKAudioFormatWAV_WB])
+        return 256000;
+    if ([format isEqualToString: ATTSKAudioFormatWAV_NB])
+        return 128000;
+    if ([format isEqualToString: ATTSKAudioFormatSpeex_WB])
+        return 14000;
+    // AMR narrowband, the SDK's default.
+    return 12200;
+}
+
+/* Formats worth choosing, best first.  WAV narrowband is left out, since
+   Speex wideband has better audio at a tenth of the bitrate. */
+static NSArray* FormatsByQuality(void)
+{
+    return [NSArray arrayWithObjects: ATTSKAudioFormatWAV_WB, ATTSKAudioFormatSpeex_WB,
+            ATTSKAudioFormatAMR_NB, nil];
+}
+
+@interface SpeechBandwidthEstimator () {
+    @private
+    NSUInteger downgradedCount;
+}
+@property (readwrite) double bitsPerSecond;
+@property (readwrite) BOOL isLowerBound;
+@property (readwrite) NSTimeInterval typicalAudioDuration;
+@property (copy) NSString* format;
+@property (retain) NSDate* recordingStart;
+@property (retain) NSDate* recordingEnd;
+
+- (void) uploadFinished;
+- (void) save;
+@end
+
+@implementation SpeechBandwidthEstimator
+
+@synthesize bitsPerSecond = _bitsPerSecond;
+@synthesize isLowerBound = _isLowerBound;
+@synthesize typicalAudioDuration = _typicalAudioDuration;
+@synthesize format = _format;
+@synthesize recordingStart = _recordingStart;
+@synthesize recordingEnd = _recordingEnd;
+
++ (SpeechBandwidthEstimator*) sharedEstimator
+{
+    static SpeechBandwidthEstimator* sharedEstimator = nil;
+    if (sharedEstimator == nil)
+        sharedEstimator = [[SpeechBandwidthEstimator alloc] init];
+    return sharedEstimator;
+}
+
+- (id) init
+{
+    self = [super init];
+    if (self != nil) {
+        NSUserDefaults* defaults = [NSUserDefaults standardUserDefaults];
+        _bitsPerSecond = [defaults doubleForKey: BITS_PER_SECOND_KEY];
+        _isLowerBound = [defaults boolForKey: LOWER_BOUND_KEY];
+        _typicalAudioDuration = [defaults doubleForKey: DURATION_KEY];
+        if (_typicalAudioDuration <= 0)
+            _typicalAudioDuration = DEFAULT_DURATION;
+    }
+    return self;
+}
+
+- (void) dealloc
+{
+    self.format = nil;
+    self.recordingStart = nil;
+    self.recordingEnd = nil;
+    [super dealloc];
+}
+
+- (void) speechService: (ATTSpeechService*) speechService
+        willEnterState: (ATTSpeechServiceState) newState
+{
+    switch (newState) {
+        case ATTSpeechServiceStateRecording:
+            self.format = speechService.audioFormat;
+            self.recordingStart = [NSDate date];
+            self.recordingEnd = nil;
+            break;
+        case ATTSpeechServiceStateSendingAudioData:
+        case ATTSpeechServiceStateProcessing:
+            if (speechService.currentState == ATTSpeechServiceStateRecording)
+                self.recordingEnd = [NSDate date];
+            // The server only starts processing once it has all the audio.
+            if (newState == ATTSpeechServiceStateProcessing && _recordingStart != nil && _recordingEnd != nil)
+                [self uploadFinished];
+            break;
+        case ATTSpeechServiceStateIdle:
+        case ATTSpeechServiceStateError:
+            self.recordingStart = nil;
+            self.recordingEnd = nil;
+            break;
+        default:
+            break;
+    }
+}
+
+- (void) uploadFinished
+{
+    NSDate* now = [NSDate date];
+    NSTimeInterval duration = [_recordingEnd timeIntervalSinceDate: _recordingStart];
+    NSTimeInterval uploadTime = [now timeIntervalSinceDate: _recordingStart];
+    NSTimeInterval tail = [now timeIntervalSinceDate: _recordingEnd];
+    self.recordingStart = nil;
+    self.recordingEnd = nil;
+    if (duration <= 0 || uploadTime <= 0)
+        return;
+
+    double sample = BitrateForFormat(_format) * duration / uploadTime;
+    if (tail > CONGESTED_TAIL) {
+        // The link was the bottleneck, so this is a real measurement.
+        if (_bitsPerSecond <= 0 || _isLowerBound)
+            self.bitsPerSecond = sample;
+        else
+            self.bitsPerSecond = _bitsPerSecond + SMOOTHING * (sample - _bitsPerSecond);
+        self.isLowerBound = NO;
+    }
+    else if (sample > _bitsPerSecond) {
+        // The link kept up, so it is at least this fast.
+        if (_bitsPerSecond <= 0)
+            self.isLowerBound = YES;
+        self.bitsPerSecond = sample;
+    }
+    self.typicalAudioDuration = _typicalAudioDuration + SMOOTHING * (duration - _typicalAudioDuration);
+    [self save];
+}
+
+- (void) save
+{
+    NSUserDefaults* defaults = [NSUserDefaults standardUserDefaults];
+    [defaults setDouble: _bitsPerSecond forKey: BITS_PER_SECOND_KEY];
+    [defaults setBool: _isLowerBound forKey: LOWER_BOUND_KEY];
+    [defaults setDouble: _typicalAudioDuration forKey: DURATION_KEY];
+}
+
+- (NSString*) audioFormatForLatencyBudget: (NSTimeInterval) budget
+{
+    // Until an upload has been measured, the link may be a weak one, so
+    // start with a compressed format; probing moves up from there.
+    if (_bitsPerSecond <= 0)
+        return ATTSKAudioFormatSpeex_WB;
+    NSArray* formats = FormatsByQuality();
+
+    // Streaming overlaps the upload with recording, so only the part of the
+    // upload that outlasts the recording adds latency.
+    NSUInteger choice = formats.count - 1;
+    NSUInteger i;
+    for (i = 0; i < formats.count; i++) {
+        double bitrate = BitrateForFormat([formats objectAtIndex: i]);
+        NSTimeInterval tail = _typicalAudioDuration * (bitrate / _bitsPerSecond - 1);
+        if (tail <= budget) {
+            choice = i;
+            break;
+        }
+    }
+    // Now and then try a better format, to notice when the link improves.
+    if (choice == 0)
+        downgradedCount = 0;
+    else if (++downgradedCount >= PROBE_INTERVAL) {
+        downgradedCount = 0;
+        choice--;
+    }
+    return [formats objectAtIndex: choice];
+}
+
+@end
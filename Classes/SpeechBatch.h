@@ -0,0 +1,75 @@
+//  SpeechBatch.h
+//
+// Licensed by AT&T under 'Software Development Kit Tools Agreement' 2012.
+// TERMS AND CONDITIONS FOR USE, REPRODUCTION, AND DISTRIBUTION: http://developer.att.com/sdk_agreement/
+// Copyright 2012 AT&T Intellectual Property. All rights reserved.
+// For more information contact developer.support@att.com http://developer.att.com
+
+#import <Foundation/NSObject.h>
+
+@class NSString, NSURL, NSArray, NSDictionary, NSError;
+@class SpeechResultCache;
+
+/**
+ * Type of block called as each job in a SpeechBatch finishes.
+ * path is the audio file of the job.  responseStrings holds the n-best
+ * hypotheses, or is nil and error is set if recognition failed.
+**/
+typedef void (^SpeechBatchResultBlock)(NSString* path, NSArray* responseStrings, NSError* error);
+
+/**
+ * Transcribes many audio files, running a limited number of SpeechRequests
+ * at a time.  Jobs start in priority order, highest first, and in the order
+ * they were added within a priority.  Results are reported in the order the
+ * jobs finish.
+ *
+ * Use SpeechBatch only from the main thread.
+**/
+@interface SpeechBatch : NSObject {
+}
+
+/** Creates a batch that sends its jobs to the given Speech API URL. **/
++ (SpeechBatch*) batchWithURL: (NSURL*) recognitionURL;
+
+/** The OAuth access token for jobs.  Jobs that start after it changes use
+ *  the new value, so it can be updated from a SpeechAuth block. **/
+@property (copy) NSString* bearerAuthToken;
+
+/** The Speech API speech context for jobs. **/
+@property (copy) NSString* speechContext;
+
+/** X-Arg key-value pairs for jobs. **/
+@property (copy) NSDictionary* xArgs;
+
+/** Whether jobs cut silence from WAV files before sending them.
+ *  See SpeechRequest.trimsSilence.  Default is NO. **/
+@property (assign) BOOL trimsSilence;
+
+/** Cache that jobs answer from and add to.  See SpeechRequest.resultCache. **/
+@property (retain) SpeechResultCache* resultCache;
+
+/** The most jobs that may be running at once.  Defaults to 4. **/
+@property (assign) NSUInteger maxConcurrentRequests;
+
+/** Called as each job finishes. **/
+@property (copy) SpeechBatchResultBlock resultBlock;
+
+/** Called whenever the last running job finishes and no jobs are waiting. **/
+@property (copy) void (^completionBlock)(void);
+
+/** Number of jobs waiting to start. **/
+@property (readonly) NSUInteger pendingCount;
+
+/** Number of jobs running now. **/
+@property (readonly) NSUInteger activeCount;
+
+/** Adds a job with priority 0, starting it if there's room. **/
+- (void) addAudioFile: (NSString*) path;
+
+/** Adds a job, starting it if there's room. **/
+- (void) addAudioFile: (NSString*) path priority: (NSInteger) priority;
+
+/** Cancels all running and waiting jobs.  No more results are reported. **/
+- (void) cancel;
+
+@end
@@ -0,0 +1,174 @@
+//  SpeechBatch.m
+//
+// Licensed by AT&T under 'Software Development Kit Tools Agreement' 2012.
+// TERMS AND CONDITIONS FOR USE, REPRODUCTION, AND DISTRIBUTION: http://developer.att.com/sdk_agreement/
+// Copyright 2012 AT&T Intellectual Property. All rights reserved.
+// For more information contact developer.support@att.com http://developer.att.com
+
+#import "SpeechBatch.h"
+#import "SpeechRequest.h"
+
+/** Tune the concurrency based on the service's rate limits. **/
+static const NSUInteger DEFAULT_MAX_CONCURRENT = 4;
+
+/**
+ * One audio file waiting in, or running from, a SpeechBatch.
+**/
+@interface SpeechBatchJob : NSObject {
+}
+@property (copy) NSString* path;
+@property (assign) NSInteger priority;
+@property (retain) SpeechRequest* request;
+@end
+
+@implementation SpeechBatchJob
+
+@synthesize path = _path;
+@synthesize priority = _priority;
+@synthesize request = _request;
+
+- (void) dealloc
+{
+    self.path = nil;
+    self.request = nil;
+    [super dealloc];
+}
+
+@end
+
+#pragma mark -
+
+@interface SpeechBatch ()
+@property (retain) NSURL* recognitionURL;
+@property (retain) NSMutableArray* pending; // sorted by priority, then age
+@property (retain) NSMutableArray* active;
+
+- (void) startJobs;
+- (void) job: (SpeechBatchJob*) job finishedWithStrings: (NSArray*) strings error: (NSError*) error;
+@end
+
+@implementation SpeechBatch
+
+@synthesize recognitionURL = _recognitionURL;
+@synthesize bearerAuthToken = _bearerAuthToken;
+@synthesize speechContext = _speechContext;
+@synthesize xArgs = _xArgs;
+@synthesize trimsSilence = _trimsSilence;
+@synthesize resultCache = _resultCache;
+@synthesize maxConcurrentRequests = _maxConcurrentRequests;
+@synthesize resultBlock = _resultBlock;
+@synthesize completionBlock = _completionBlock;
+@synthesize pending = _pending;
+@synthesize active = _active;
+
++ (SpeechBatch*) batchWithURL: (NSURL*) recognitionURL
+{
+    SpeechBatch* batch = [[[self alloc] init] autorelease];
+    batch.recognitionURL = recognitionURL;
+    return batch;
+}
+
+- (id) init
+{
+    self = [super init];
+    if (self != nil) {
+        _maxConcurrentRequests = DEFAULT_MAX_CONCURRENT;
+        self.pending = [NSMutableArray array];
+        self.active = [NSMutableArray array];
+    }
+    return self;
+}
+
+- (void) dealloc
+{
+    // Running jobs retain the batch, so none are left by now.
+    self.recognitionURL = nil;
+    self.bearerAuthToken = nil;
+    self.speechContext = nil;
+    self.xArgs = nil;
+    self.resultCache = nil;
+    self.resultBlock = nil;
+    self.completionBlock = nil;
+    self.pending = nil;
+    self.active = nil;
+    [super dealloc];
+}
+
+- (NSUInteger) pendingCount
+{
+    return _pending.count;
+}
+
+- (NSUInteger) activeCount
+{
+    return _active.count;
+}
+
+- (void) addAudioFile: (NSString*) path
+{
+    [self addAudioFile: path priority: 0];
+}
+
+- (void) addAudioFile: (NSString*) path priority: (NSInteger) priority
+{
+    SpeechBatchJob* job = [[[SpeechBatchJob alloc] init] autorelease];
+    job.path = path;
+    job.priority = priority;
+
+    // Insert after every job of the same or higher priority.
+    NSUInteger index = _pending.count;
+    while (index > 0 && ((SpeechBatchJob*)[_pending objectAtIndex: index - 1]).priority < priority)
+        index--;
+    [_pending insertObject: job atIndex: index];
+    [self startJobs];
+}
+
+- (void) startJobs
+{
+    NSUInteger limit = MAX(_maxConcurrentRequests, 1);
+    while (_active.count < limit && _pending.count > 0) {
+        SpeechBatchJob* job = [[[_pending objectAtIndex: 0] retain] autorelease];
+        [_pending removeObjectAtIndex: 0];
+
+        SpeechRequest* request = [SpeechRequest requestWithURL: _recognitionURL];
+        request.bearerAuthToken = _bearerAuthToken;
+        request.speechContext = _speechContext;
+        request.xArgs = _xArgs;
+        request.trimsSilence = _trimsSilence;
+        request.resultCache = _resultCache;
+        job.request = request;
+        [_active addObject: job];
+        // The request's block retains this batch until the job finishes.
+        [request startWithAudioFile: job.path
+                         completion: ^(NSArray* strings, NSDictionary* json, NSError* error) {
+            [self job: job finishedWithStrings: strings error: error];
+        }];
+    }
+}
+
+- (void) job: (SpeechBatchJob*) job finishedWithStrings: (NSArray*) strings error: (NSError*) error
+{
+    [[job retain] autorelease];
+    job.request = nil;
+    [_active removeObjectIdenticalTo: job];
+    // Start the next job before reporting, so the pipeline stays full even
+    // if the result block is slow.
+    [self startJobs];
+    if (_resultBlock != nil)
+        _resultBlock(job.path, strings, error);
+    if (_active.count == 0 && _pending.count == 0 && _completionBlock != nil)
+        _completionBlock();
+}
+
+- (void) cancel
+{
+    // Canceling the requests releases their hold on this object.
+    [[self retain] autorelease];
+    [_pending removeAllObjects];
+    NSArray* running = [[_active copy] autorelease];
+    [_active removeAllObjects];
+    for (SpeechBatchJob* job in running)
+        [job.request cancel];
+}
+
+@end
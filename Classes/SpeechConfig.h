@@ -3,6 +3,8 @@
 // Declares customization parameters for this application's use of
 // AT&T Speech SDK.
 
+#import <Foundation/NSDate.h>
+
 @class NSString, NSURL;
 
 /** The URL of AT&T Speech API. **/
@@ -19,3 +21,13 @@ NSString* SpeechOAuthSecret(void);
 
 /** The OAuth scope for the Speech API requests. **/
 NSString* SpeechOAuthScope(void);
+
+/** The speech context for recognition requests. **/
+NSString* SpeechContext(void);
+
+/** The audio format to send, or nil to choose it from the network speed. **/
+NSString* SpeechAudioFormat(void);
+
+/** Seconds to wait for the Speech API to accept a connection, or 0 to
+    keep the SDK's default. **/
+NSTimeInterval SpeechConnectionTimeout(void);
@@ -4,27 +4,36 @@
 // AT&T Speech SDK.
 //
 // Customize the functions declared here with the parameters of your application.
+// Each one can also be overridden without rebuilding by the active profile
+// of SpeechConfig.ini; see SpeechConfigStore.h.
 
 #import "SpeechConfig.h"
+#import "SpeechConfigStore.h"
 
+/* The active profile's value for key, or fallback if it has none. */
+static NSString* ConfigString(NSString* key, NSString* fallback)
+{
+    NSString* value = [[SpeechConfigStore sharedStore] stringForKey: key];
+    return value != nil ? value : fallback;
+}
 
 /** The URL of AT&T Speech API. **/
 NSURL* SpeechServiceUrl(void)
 {
-    return [NSURL URLWithString: @"https://api.att.com/speech/v3/speechToText"];
+    return [NSURL URLWithString: ConfigString(@"service_url", @"https://api.att.com/speech/v3/speechToText")];
 }
 
 /** The URL of AT&T Speech API OAuth service. **/
 NSURL* SpeechOAuthUrl(void)
 {
-    return [NSURL URLWithString: @"https://api.att.com/oauth/token"];
+    return [NSURL URLWithString: ConfigString(@"oauth_url", @"https://api.att.com/oauth/token")];
 }
 
 /** Unobfuscates the OAuth client_id credential for the application. **/
 NSString* SpeechOAuthKey(void)
 {
 //    #error Add code to unobfuscate your Speech API credentials, then delete this line.
-    return @"6f25e6fc79c417aaaaddc94752cda689";
+    return ConfigString(@"oauth_key", @"6f25e6fc79c417aaaaddc94752cda689");
 //    return MY_UNOBFUSCATE(my_obfuscated_client_id);
 }
 
@@ -32,12 +41,31 @@ NSString* SpeechOAuthKey(void)
 NSString* SpeechOAuthSecret(void)
 {
 //    #error Add code to unobfuscate your Speech API credentials, then delete this line.
-    return @"6fc8c2566d57c01b";
+    return ConfigString(@"oauth_secret", @"6fc8c2566d57c01b");
 //    return MY_UNOBFUSCATE(my_obfuscated_client_secret);
 }
 
 /** The OAuth scope for the Speech API requests. **/
 NSString* SpeechOAuthScope(void)
 {
-    return @"SPEECH";
+    return ConfigString(@"oauth_scope", @"SPEECH");
+}
+
+/** The speech context for recognition requests. **/
+NSString* SpeechContext(void)
+{
+    return ConfigString(@"speech_context", @"WebSearch");
+}
+
+/** The audio format to send, or nil to choose it from the network speed. **/
+NSString* SpeechAudioFormat(void)
+{
+    return ConfigString(@"audio_format", nil);
+}
+
+/** Seconds to wait for the Speech API to accept a connection, or 0 to
+    keep the SDK's default. **/
+NSTimeInterval SpeechConnectionTimeout(void)
+{
+    return [ConfigString(@"connection_timeout", @"0") doubleValue];
 }
@@ -0,0 +1,77 @@
+//  SpeechConfigStore.h
+//
+// Licensed by AT&T under 'Software Development Kit Tools Agreement' 2012.
+// TERMS AND CONDITIONS FOR USE, REPRODUCTION, AND DISTRIBUTION: http://developer.att.com/sdk_agreement/
+// Copyright 2012 AT&T Intellectual Property. All rights reserved.
+// For more information contact developer.support@att.com http://developer.att.com
+
+#import <Foundation/NSObject.h>
+
+@class NSString, NSArray;
+
+/** Posted on the main thread after the config file is reloaded. **/
+extern NSString* const SpeechConfigDidChangeNotification;
+
+/**
+ * Named profiles of settings, such as endpoints and credentials for each
+ * tenant or environment, read from a config file so they can change
+ * without rebuilding the app.
+ *
+ * The file is plain text:
+ *
+ *     # Lines before the first section choose the profile.
+ *     profile = staging
+ *
+ *     [default]
+ *     service_url = https://api.att.com/speech/v3/speechToText
+ *     speech_context = WebSearch
+ *
+ *     [staging]
+ *     service_url = https://staging.example.com/speech/v3/speechToText
+ *
+ * A key missing from the active profile is looked up in [default].  Lines
+ * starting with # or ; are comments.
+ *
+ * The file is memory-mapped and only its section headers are scanned when
+ * it is loaded; a profile's lines are parsed the first time one of its keys
+ * is looked up, and looking up a key after that is a dictionary lookup.
+ * When watching, changes to the file are loaded on a background queue and
+ * swapped in on the main thread.  Save changes by replacing the file, as an
+ * atomic write does, rather than rewriting it in place under the mapping.
+ *
+ * Use SpeechConfigStore only from the main thread.
+**/
+@interface SpeechConfigStore : NSObject {
+}
+
+/** Returns the store shared by the whole app, loaded from SpeechConfig.ini
+ *  in the app's Documents directory if it is there, or else in the app
+ *  bundle.  With neither, every lookup returns nil. **/
++ (SpeechConfigStore*) sharedStore;
+
+/** Creates a store loaded from the file at path. **/
++ (SpeechConfigStore*) storeWithContentsOfFile: (NSString*) path;
+
+/** The file the store is loaded from. **/
+@property (readonly, copy) NSString* path;
+
+/** The profile that lookups use: the one named by the file, unless set
+ *  here.  Defaults to @"default". **/
+@property (copy) NSString* activeProfile;
+
+/** Names of the profiles in the file, in order. **/
+@property (readonly) NSArray* profileNames;
+
+/** The value of key in the active profile, or nil if it isn't set. **/
+- (NSString*) stringForKey: (NSString*) key;
+
+/** The value of key in the named profile, or nil if it isn't set. **/
+- (NSString*) stringForKey: (NSString*) key profile: (NSString*) profile;
+
+/** Starts reloading the file whenever it changes. **/
+- (void) startWatching;
+
+/** Stops reloading the file. **/
+- (void) stopWatching;
+
+@end
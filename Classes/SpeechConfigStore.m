@@ -0,0 +1,337 @@
+//  SpeechConfigStore.m
+//
+// Licensed by AT&T under 'Software Development Kit Tools Agreement' 2012.
+// TERMS AND CONDITIONS FOR USE, REPRODUCTION, AND DISTRIBUTION: http://developer.att.com/sdk_agreement/
+// Copyright 2012 AT&T Intellectual Property. All rights reserved.
+// For more information contact developer.support@att.com http://developer.att.com
+
+#import "SpeechConfigStore.h"
+#import <fcntl.h>
+#import <unistd.h>
+
+NSString* const SpeechConfigDidChangeNotification = @"SpeechConfigDidChangeNotification";
+
+static NSString* const ConfigFileName = @"SpeechConfig.ini";
+static NSString* const DefaultProfile = @"default";
+static NSString* const ProfileKey = @"profile";
+
+/** Tune how soon to look again for a file that was deleted or replaced. **/
+static const NSTimeInterval REWATCH_DELAY = 1.0; // seconds
+
+/* Whether c is a space or tab. */
+static BOOL IsBlank(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+/* Narrows [*start, *end) to exclude leading and trailing blanks. */
+static void Trim(const char* bytes, NSUInteger* start, NSUInteger* end)
+{
+    while (*start < *end && IsBlank(bytes[*start]))
+        (*start)++;
+    while (*end > *start && IsBlank(bytes[*end - 1]))
+        (*end)--;
+}
+
+/* The end of the line starting at start, not counting the newline. */
+static NSUInteger LineEnd(const char* bytes, NSUInteger start, NSUInteger length)
+{
+    const char* newline = memchr(bytes + start, '\n', length - start);
+    return newline != NULL ? (NSUInteger)(newline - bytes) : length;
+}
+
+static NSString* StringWithBytes(const char* bytes, NSUInteger start, NSUInteger end)
+{
+    return [[[NSString alloc] initWithBytes: bytes + start length: end - start
+                                   encoding: NSUTF8StringEncoding] autorelease];
+}
+
+/* Parses the key = value lines of one section. */
+static NSDictionary* ParseSection(const char* bytes, NSRange range)
+{
+    NSMutableDictionary* values = [NSMutableDictionary dictionary];
+    NSUInteger limit = NSMaxRange(range);
+    NSUInteger start = range.location;
+    while (start < limit) {
+        NSUInteger end = LineEnd(bytes, start, limit);
+        NSUInteger next = end + 1;
+        Trim(bytes, &start, &end);
+        const char* equals = start < end ? memchr(bytes + start, '=', end - start) : NULL;
+        if (equals != NULL && bytes[start] != '#' && bytes[start] != ';') {
+            NSUInteger keyEnd = (NSUInteger)(equals - bytes);
+            NSUInteger valueStart = keyEnd + 1;
+            NSUInteger keyStart = start;
+            Trim(bytes, &keyStart, &keyEnd);
+            Trim(bytes, &valueStart, &end);
+            NSString* key = StringWithBytes(bytes, keyStart, keyEnd);
+            NSString* value = StringWithBytes(bytes, valueStart, end);
+            if (key.length > 0 && value != nil)
+                [values setObject: value forKey: key];
+        }
+        start = next;
+    }
+    return values;
+}
+
+/**
+ * One loaded version of the config file.  Its sections are found when it
+ * is created, which may be on any thread, and parsed on the main thread
+ * as they are needed.
+**/
+@interface SpeechConfigFile : NSObject {
+}
+@property (retain) NSData* data;
+@property (retain) NSMutableArray* names;         // section names, in order
+@property (retain) NSMutableDictionary* ranges;   // section name -> NSValue of NSRange
+@property (retain) NSMutableDictionary* sections; // section name -> parsed NSDictionary
+@property (copy) NSString* profile;               // named before the first section
++ (SpeechConfigFile*) fileWithPath: (NSString*) path;
+- (NSDictionary*) section: (NSString*) name;
+@end
+
+@implementation SpeechConfigFile
+
+@synthesize data = _data;
+@synthesize names = _names;
+@synthesize ranges = _ranges;
+@synthesize sections = _sections;
+@synthesize profile = _profile;
+
++ (SpeechConfigFile*) fileWithPath: (NSString*) path
+{
+    NSData* data = [NSData dataWithContentsOfFile: path options: NSDataReadingMappedIfSafe error: NULL];
+    if (data == nil)
+        return nil;
+    SpeechConfigFile* file = [[[self alloc] init] autorelease];
+    file.data = data;
+    file.names = [NSMutableArray array];
+    file.ranges = [NSMutableDictionary dictionary];
+    file.sections = [NSMutableDictionary dictionary];
+
+    // Find the sections without parsing what's in them.
+    const char* bytes = (const char*)data.bytes;
+    NSUInteger length = data.length;
+    NSUInteger start = 0;
+    NSUInteger sectionStart = 0;
+    NSString* name = nil;
+    while (start < length) {
+        NSUInteger end = LineEnd(bytes, start, length);
+        NSUInteger next = end + 1;
+        NSUInteger lineStart = start;
+        Trim(bytes, &lineStart, &end);
+        if (lineStart < end && bytes[lineStart] == '[' && bytes[end - 1] == ']') {
+            NSRange range = NSMakeRange(sectionStart, start - sectionStart);
+            if (name == nil)
+                file.profile = [ParseSection(bytes, range) objectForKey: ProfileKey];
+            else if ([file.ranges objectForKey: name] == nil) {
+                [file.names addObject: name];
+                [file.ranges setObject: [NSValue valueWithRange: range] forKey: name];
+            }
+            name = StringWithBytes(bytes, lineStart + 1, end - 1);
+            sectionStart = next < length ? next : length;
+        }
+        start = next;
+    }
+    NSRange range = NSMakeRange(sectionStart, length - sectionStart);
+    if (name == nil)
+        file.profile = [ParseSection(bytes, range) objectForKey: ProfileKey];
+    else if ([file.ranges objectForKey: name] == nil) {
+        [file.names addObject: name];
+        [file.ranges setObject: [NSValue valueWithRange: range] forKey: name];
+    }
+    return file;
+}
+
+- (void) dealloc
+{
+    self.data = nil;
+    self.names = nil;
+    self.ranges = nil;
+    self.sections = nil;
+    self.profile = nil;
+    [super dealloc];
+}
+
+- (NSDictionary*) section: (NSString*) name
+{
+    NSDictionary* section = [_sections objectForKey: name];
+    if (section == nil) {
+        NSValue* range = [_ranges objectForKey: name];
+        if (range == nil)
+            return nil;
+        section = ParseSection((const char*)_data.bytes, [range rangeValue]);
+        [_sections setObject: section forKey: name];
+    }
+    return section;
+}
+
+@end
+
+#pragma mark -
+
+@interface SpeechConfigStore () {
+    @private
+    dispatch_queue_t queue;   // watches and loads the file
+    dispatch_source_t source; // used only on queue
+    BOOL watching;            // used only on queue
+}
+@property (readwrite, copy) NSString* path;
+@property (retain) SpeechConfigFile* file;
+@property (copy) NSString* profileOverride;
+- (void) watchFile;
+- (void) reloadFile;
+@end
+
+@implementation SpeechConfigStore
+
+@synthesize path = _path;
+@synthesize file = _file;
+@synthesize profileOverride = _profileOverride;
+
++ (SpeechConfigStore*) sharedStore
+{
+    static SpeechConfigStore* shared = nil;
+    if (shared == nil) {
+        NSString* documents =
+            [NSSearchPathForDirectoriesInDomains(NSDocumentDirectory, NSUserDomainMask, YES) objectAtIndex: 0];
+        NSString* path = [documents stringByAppendingPathComponent: ConfigFileName];
+        if (![[NSFileManager defaultManager] fileExistsAtPath: path])
+            path = [[[NSBundle mainBundle] resourcePath] stringByAppendingPathComponent: ConfigFileName];
+        shared = [[SpeechConfigStore storeWithContentsOfFile: path] retain];
+    }
+    return shared;
+}
+
++ (SpeechConfigStore*) storeWithContentsOfFile: (NSString*) path
+{
+    SpeechConfigStore* store = [[[self alloc] init] autorelease];
+    store.path = path;
+    store.file = [SpeechConfigFile fileWithPath: path];
+    return store;
+}
+
+- (void) dealloc
+{
+    [self stopWatching];
+    if (queue != NULL)
+        dispatch_release(queue);
+    self.path = nil;
+    self.file = nil;
+    self.profileOverride = nil;
+    [super dealloc];
+}
+
+- (NSString*) activeProfile
+{
+    if (_profileOverride != nil)
+        return _profileOverride;
+    if (_file.profile != nil)
+        return _file.profile;
+    return DefaultProfile;
+}
+
+- (void) setActiveProfile: (NSString*) profile
+{
+    self.profileOverride = profile;
+}
+
+- (NSArray*) profileNames
+{
+    return _file != nil ? [[_file.names copy] autorelease] : [NSArray array];
+}
+
+- (NSString*) stringForKey: (NSString*) key
+{
+    return [self stringForKey: key profile: self.activeProfile];
+}
+
+- (NSString*) stringForKey: (NSString*) key profile: (NSString*) profile
+{
+    NSString* value = [[_file section: profile] objectForKey: key];
+    if (value == nil && ![profile isEqualToString: DefaultProfile])
+        value = [[_file section: DefaultProfile] objectForKey: key];
+    return value;
+}
+
+#pragma mark -
+#pragma mark Watching
+
+- (void) startWatching
+{
+    if (queue == NULL)
+        queue = dispatch_queue_create("SpeechConfigStore", NULL);
+    dispatch_async(queue, ^{
+        if (!watching) {
+            watching = YES;
+            [self watchFile];
+        }
+    });
+}
+
+- (void) stopWatching
+{
+    if (queue == NULL)
+        return;
+    dispatch_sync(queue, ^{
+        watching = NO;
+        if (source != NULL) {
+            dispatch_source_cancel(source);
+            dispatch_release(source);
+            source = NULL;
+        }
+    });
+}
+
+/* Runs on queue.  Watches the file now at path, which may be a different
+   file from the one loaded if it was replaced. */
+- (void) watchFile
+{
+    int fd = open(_path.fileSystemRepresentation, O_EVTONLY);
+    if (fd < 0) {
+        // It's gone for now; look again shortly.
+        dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(REWATCH_DELAY * NSEC_PER_SEC)), queue, ^{
+            if (watching && source == NULL) {
+                [self watchFile];
+                if (source != NULL)
+                    [self reloadFile];
+            }
+        });
+        return;
+    }
+    source = dispatch_source_create(DISPATCH_SOURCE_TYPE_VNODE, (uintptr_t)fd,
+                                    DISPATCH_VNODE_WRITE | DISPATCH_VNODE_EXTEND
+                                    | DISPATCH_VNODE_DELETE | DISPATCH_VNODE_RENAME,
+                                    queue);
+    dispatch_source_set_cancel_handler(source, ^{
+        close(fd);
+    });
+    dispatch_source_set_event_handler(source, ^{
+        if (dispatch_source_get_data(source) & (DISPATCH_VNODE_DELETE | DISPATCH_VNODE_RENAME)) {
+            // Replaced, as by an atomic save: watch whatever is there now.
+            dispatch_source_cancel(source);
+            dispatch_release(source);
+            source = NULL;
+            [self watchFile];
+        }
+        [self reloadFile];
+    });
+    dispatch_resume(source);
+}
+
+/* Runs on queue.  Maps and indexes the file here, off the main thread,
+   then swaps it in on the main thread. */
+- (void) reloadFile
+{
+    NSAutoreleasePool* pool = [[NSAutoreleasePool alloc] init];
+    SpeechConfigFile* file = [SpeechConfigFile fileWithPath: _path];
+    if (file != nil) {
+        dispatch_async(dispatch_get_main_queue(), ^{
+            self.file = file;
+            [[NSNotificationCenter defaultCenter] postNotificationName: SpeechConfigDidChangeNotification
+                                                                object: self];
+        });
+    }
+    [pool drain];
+}
+
+@end
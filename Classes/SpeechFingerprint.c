@@ -0,0 +1,182 @@
+//  SpeechFingerprint.c
+//
+// Licensed by AT&T under 'Software Development Kit Tools Agreement' 2012.
+// TERMS AND CONDITIONS FOR USE, REPRODUCTION, AND DISTRIBUTION: http://developer.att.com/sdk_agreement/
+// Copyright 2012 AT&T Intellectual Property. All rights reserved.
+// For more information contact developer.support@att.com http://developer.att.com
+
+#include "SpeechFingerprint.h"
+#include <math.h>
+
+/** Bands span the telephone voice range, so narrowband and wideband
+    recordings of the same words give the same fingerprint. **/
+static const float LOW_FREQUENCY = 300.0f;
+static const float HIGH_FREQUENCY = 3400.0f;
+
+/** One more band than bits in a word. **/
+#define BANDS 33
+
+/** Largest FFT, enough for 64 ms frames at 48 kHz. **/
+#define MAX_FFT 4096
+
+static const float PI = 3.14159265358979f;
+
+/* FFT length for about 64 ms of audio, rounded up to a power of two.
+   Frames this long resolve the narrow low bands even at 8 kHz. */
+static size_t FrameLength(int sample_rate)
+{
+    size_t length = 256;
+    while (length < (size_t)sample_rate * 64 / 1000)
+        length *= 2;
+    return length;
+}
+
+size_t SpeechFingerprintLength(size_t count, int sample_rate)
+{
+    size_t frame, hop;
+    if (sample_rate < 8000 || sample_rate > 48000)
+        return 0;
+    frame = FrameLength(sample_rate);
+    hop = frame / 2;
+    // The first frame only sets up the differences.
+    return count < frame + hop ? 0 : (count - frame) / hop;
+}
+
+/* In-place iterative radix-2 FFT of length n. */
+static void FFT(float* re, float* im, size_t n)
+{
+    size_t i, j, k, length;
+    for (i = 1, j = 0; i < n; i++) {
+        size_t bit = n >> 1;
+        for (; j & bit; bit >>= 1)
+            j ^= bit;
+        j |= bit;
+        if (i < j) {
+            float t = re[i]; re[i] = re[j]; re[j] = t;
+            t = im[i]; im[i] = im[j]; im[j] = t;
+        }
+    }
+    for (length = 2; length <= n; length <<= 1) {
+        float angle = -2.0f * PI / (float)length;
+        float wr = cosf(angle), wi = sinf(angle);
+        for (i = 0; i < n; i += length) {
+            float cr = 1.0f, ci = 0.0f;
+            for (k = 0; k < length / 2; k++) {
+                size_t a = i + k, b = i + k + length / 2;
+                float tr = re[b] * cr - im[b] * ci;
+                float ti = re[b] * ci + im[b] * cr;
+                float next;
+                re[b] = re[a] - tr;
+                im[b] = im[a] - ti;
+                re[a] += tr;
+                im[a] += ti;
+                next = cr * wr - ci * wi;
+                ci = cr * wi + ci * wr;
+                cr = next;
+            }
+        }
+    }
+}
+
+static float Mel(float frequency)
+{
+    return 2595.0f * log10f(1.0f + frequency / 700.0f);
+}
+
+static float Frequency(float mel)
+{
+    return 700.0f * (powf(10.0f, mel / 2595.0f) - 1.0f);
+}
+
+/* Energy in each of BANDS mel-spaced bands of one Hann-windowed frame. */
+static void BandEnergies(const int16_t* samples, size_t length, int sample_rate, float* energies)
+{
+    float re[MAX_FFT], im[MAX_FFT];
+    float low = Mel(LOW_FREQUENCY);
+    float step = (Mel(HIGH_FREQUENCY) - low) / BANDS;
+    float bin_width = (float)sample_rate / (float)length;
+    size_t i;
+    int band;
+    for (i = 0; i < length; i++) {
+        float window = 0.5f - 0.5f * cosf(2.0f * PI * (float)i / (float)length);
+        re[i] = (float)samples[i] * window;
+        im[i] = 0.0f;
+    }
+    FFT(re, im, length);
+    for (band = 0; band < BANDS; band++) {
+        size_t first = (size_t)(Frequency(low + step * (float)band) / bin_width + 0.5f);
+        size_t last = (size_t)(Frequency(low + step * (float)(band + 1)) / bin_width + 0.5f);
+        float sum = 0.0f;
+        if (last <= first)
+            last = first + 1;
+        for (i = first; i < last; i++)
+            sum += re[i] * re[i] + im[i] * im[i];
+        energies[band] = sum;
+    }
+}
+
+size_t SpeechFingerprintCompute(const int16_t* samples, size_t count, int sample_rate,
+                                uint32_t* words, size_t max_words)
+{
+    size_t frame, hop, total, n;
+    float previous[BANDS], current[BANDS];
+    int band;
+    total = SpeechFingerprintLength(count, sample_rate);
+    if (total == 0)
+        return 0;
+    if (total > max_words)
+        total = max_words;
+    frame = FrameLength(sample_rate);
+    hop = frame / 2;
+
+    BandEnergies(samples, frame, sample_rate, previous);
+    for (n = 0; n < total; n++) {
+        uint32_t word = 0;
+        BandEnergies(samples + (n + 1) * hop, frame, sample_rate, current);
+        for (band = 0; band < BANDS - 1; band++) {
+            float now = current[band] - current[band + 1];
+            float before = previous[band] - previous[band + 1];
+            if (now - before > 0.0f)
+                word |= (uint32_t)1 << band;
+        }
+        words[n] = word;
+        for (band = 0; band < BANDS; band++)
+            previous[band] = current[band];
+    }
+    return total;
+}
+
+static int BitCount(uint32_t x)
+{
+    x = x - ((x >> 1) & 0x55555555);
+    x = (x & 0x33333333) + ((x >> 2) & 0x33333333);
+    return (int)((((x + (x >> 4)) & 0x0F0F0F0F) * 0x01010101) >> 24);
+}
+
+float SpeechFingerprintDistance(const uint32_t* a, size_t a_count,
+                                const uint32_t* b, size_t b_count, int max_shift)
+{
+    size_t shorter = a_count < b_count ? a_count : b_count;
+    size_t longer = a_count < b_count ? b_count : a_count;
+    float best = 1.0f;
+    int shift;
+    if (shorter == 0 || (longer - shorter) * 5 > longer)
+        return 1.0f;
+    for (shift = -max_shift; shift <= max_shift; shift++) {
+        // Compare a[i] with b[i + shift] wherever both exist.
+        size_t i = shift < 0 ? (size_t)(-shift) : 0;
+        size_t compared = 0;
+        unsigned int differing = 0;
+        for (; i < a_count && i + (size_t)shift < b_count; i++) {
+            differing += (unsigned int)BitCount(a[i] ^ b[i + (size_t)shift]);
+            compared++;
+        }
+        // Require most of the shorter fingerprint to overlap.
+        if (compared * 5 >= shorter * 4) {
+            float rate = (float)differing / (float)(compared * 32);
+            if (rate < best)
+                best = rate;
+        }
+    }
+    return best;
+}
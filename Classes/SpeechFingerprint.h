@@ -0,0 +1,39 @@
+//  SpeechFingerprint.h
+//
+// Licensed by AT&T under 'Software Development Kit Tools Agreement' 2012.
+// TERMS AND CONDITIONS FOR USE, REPRODUCTION, AND DISTRIBUTION: http://developer.att.com/sdk_agreement/
+// Copyright 2012 AT&T Intellectual Property. All rights reserved.
+// For more information contact developer.support@att.com http://developer.att.com
+//
+// Compact acoustic fingerprints of 16-bit PCM audio, for recognizing a
+// recording that sounds the same as an earlier one.  Each frame of audio is
+// reduced to a 32-bit word: one bit per pair of adjacent frequency bands,
+// set when the energy difference between the bands grew since the previous
+// frame.  The bits depend only on the shape of the spectrum over time, so
+// they survive changes in volume and mild noise, and two fingerprints are
+// compared by the fraction of their bits that differ.
+// Plain C with no allocation.
+
+#ifndef SPEECH_FINGERPRINT_H
+#define SPEECH_FINGERPRINT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/** Number of fingerprint words produced for count samples at sample_rate. **/
+size_t SpeechFingerprintLength(size_t count, int sample_rate);
+
+/** Computes the fingerprint of count samples, writing at most max_words
+    words to words and returning how many were written.  Returns 0 if the
+    audio is too short or the sample rate is outside 8-48 kHz. **/
+size_t SpeechFingerprintCompute(const int16_t* samples, size_t count, int sample_rate,
+                                uint32_t* words, size_t max_words);
+
+/** The fraction of differing bits between two fingerprints, from 0 for
+    identical to about 0.5 for unrelated audio, at the best alignment within
+    max_shift words either way.  Fingerprints whose lengths differ by more
+    than a fifth are unrelated, and give 1. **/
+float SpeechFingerprintDistance(const uint32_t* a, size_t a_count,
+                                const uint32_t* b, size_t b_count, int max_shift);
+
+#endif
@@ -0,0 +1,41 @@
+//  SpeechGrammarCache.h
+//
+// Licensed by AT&T under 'Software Development Kit Tools Agreement' 2012.
+// TERMS AND CONDITIONS FOR USE, REPRODUCTION, AND DISTRIBUTION: http://developer.att.com/sdk_agreement/
+// Copyright 2012 AT&T Intellectual Property. All rights reserved.
+// For more information contact developer.support@att.com http://developer.att.com
+
+#import <Foundation/NSObject.h>
+
+@class NSString, NSData, NSArray;
+
+/**
+ * Keeps grammars ready to send, so the same grammar isn't read or built
+ * again for every request.  The data returned is immutable and can be
+ * passed to SpeechMultipartBody or -[ATTSpeechService addPart:...] as is,
+ * by any number of requests at once.
+ *
+ * Entries are evicted when memory runs low.
+ * Use SpeechGrammarCache only from the main thread.
+**/
+@interface SpeechGrammarCache : NSObject {
+}
+
+/** Returns the cache shared by the whole app. **/
++ (SpeechGrammarCache*) sharedCache;
+
+/** The contents of a grammar file, memory-mapped.  The file is mapped again
+ *  if it has changed since.  Returns nil if it can't be opened. **/
+- (NSData*) grammarWithContentsOfFile: (NSString*) path;
+
+/** An SRGS XML grammar that accepts any one of phrases, as UTF-8. **/
+- (NSData*) grammarForPhrases: (NSArray*) phrases;
+
+/** Number of grammars returned from the cache, and built or mapped anew. **/
+@property (readonly) NSUInteger hitCount;
+@property (readonly) NSUInteger missCount;
+
+/** Empties the cache. **/
+- (void) removeAllGrammars;
+
+@end
@@ -0,0 +1,122 @@
+//  SpeechGrammarCache.m
+//
+// Licensed by AT&T under 'Software Development Kit Tools Agreement' 2012.
+// TERMS AND CONDITIONS FOR USE, REPRODUCTION, AND DISTRIBUTION: http://developer.att.com/sdk_agreement/
+// Copyright 2012 AT&T Intellectual Property. All rights reserved.
+// For more information contact developer.support@att.com http://developer.att.com
+
+#import "SpeechGrammarCache.h"
+
+/** Tune the memory held by built grammars.  Mapped files don't count,
+    since the system can drop their pages whenever it likes. **/
+static const NSUInteger MAX_BUILT_BYTES = 4 * 1024 * 1024;
+
+// Keys of each mapped file's entry.
+static NSString* const DataKey = @"data";
+static NSString* const DateKey = @"date";
+
+/* Escapes the characters that are special in XML text. */
+static NSString* EscapeXML(NSString* text)
+{
+    NSMutableString* escaped = [NSMutableString stringWithString: text];
+    [escaped replaceOccurrencesOfString: @"&" withString: @"&amp;" options: 0
+                                  range: NSMakeRange(0, escaped.length)];
+    [escaped replaceOccurrencesOfString: @"<" withString: @"&lt;" options: 0
+                                  range: NSMakeRange(0, escaped.length)];
+    [escaped replaceOccurrencesOfString: @">" withString: @"&gt;" options: 0
+                                  range: NSMakeRange(0, escaped.length)];
+    return escaped;
+}
+
+@interface SpeechGrammarCache ()
+@property (readwrite) NSUInteger hitCount;
+@property (readwrite) NSUInteger missCount;
+@property (retain) NSCache* files;   // path -> entry dictionary
+@property (retain) NSCache* phrases; // phrase array -> NSData
+@end
+
+@implementation SpeechGrammarCache
+
+@synthesize hitCount = _hitCount;
+@synthesize missCount = _missCount;
+@synthesize files = _files;
+@synthesize phrases = _phrases;
+
++ (SpeechGrammarCache*) sharedCache
+{
+    static SpeechGrammarCache* shared = nil;
+    if (shared == nil)
+        shared = [[SpeechGrammarCache alloc] init];
+    return shared;
+}
+
+- (id) init
+{
+    self = [super init];
+    if (self != nil) {
+        self.files = [[[NSCache alloc] init] autorelease];
+        self.phrases = [[[NSCache alloc] init] autorelease];
+        _phrases.totalCostLimit = MAX_BUILT_BYTES;
+    }
+    return self;
+}
+
+- (void) dealloc
+{
+    self.files = nil;
+    self.phrases = nil;
+    [super dealloc];
+}
+
+- (NSData*) grammarWithContentsOfFile: (NSString*) path
+{
+    NSDate* modified = [[[NSFileManager defaultManager] attributesOfItemAtPath: path error: NULL]
+                        fileModificationDate];
+    if (modified == nil)
+        return nil;
+    NSDictionary* entry = [_files objectForKey: path];
+    if ([[entry objectForKey: DateKey] isEqualToDate: modified]) {
+        self.hitCount = _hitCount + 1;
+        return [entry objectForKey: DataKey];
+    }
+
+    NSData* grammar = [NSData dataWithContentsOfFile: path options: NSDataReadingMappedIfSafe error: NULL];
+    if (grammar == nil)
+        return nil;
+    self.missCount = _missCount + 1;
+    [_files setObject: [NSDictionary dictionaryWithObjectsAndKeys:
+                        grammar, DataKey, modified, DateKey, nil]
+               forKey: path];
+    return grammar;
+}
+
+- (NSData*) grammarForPhrases: (NSArray*) phrases
+{
+    NSData* grammar = [_phrases objectForKey: phrases];
+    if (grammar != nil) {
+        self.hitCount = _hitCount + 1;
+        return grammar;
+    }
+
+    NSMutableString* xml = [NSMutableString stringWithString:
+        @"<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+        @"<grammar xmlns=\"http://www.w3.org/2001/06/grammar\" version=\"1.0\" root=\"phrases\">\n"
+        @"<rule id=\"phrases\" scope=\"public\">\n<one-of>\n"];
+    for (NSString* phrase in phrases)
+        [xml appendFormat: @"<item>%@</item>\n", EscapeXML([phrase description])];
+    [xml appendString: @"</one-of>\n</rule>\n</grammar>\n"];
+    grammar = [xml dataUsingEncoding: NSUTF8StringEncoding];
+
+    self.missCount = _missCount + 1;
+    // Key by a copy, so later changes to a mutable array don't matter.
+    [_phrases setObject: grammar forKey: [[phrases copy] autorelease] cost: grammar.length];
+    return grammar;
+}
+
+- (void) removeAllGrammars
+{
+    [_files removeAllObjects];
+    [_phrases removeAllObjects];
+}
+
+@end
@@ -0,0 +1,116 @@
+//  SpeechListener.h
+//
+// Licensed by AT&T under 'Software Development Kit Tools Agreement' 2012.
+// TERMS AND CONDITIONS FOR USE, REPRODUCTION, AND DISTRIBUTION: http://developer.att.com/sdk_agreement/
+// Copyright 2012 AT&T Intellectual Property. All rights reserved.
+// For more information contact developer.support@att.com http://developer.att.com
+
+#import <Foundation/NSObject.h>
+#import <Foundation/NSDate.h>
+#import "SpeechMeter.h"
+
+@class NSString, NSURL, NSArray, NSDictionary, NSError;
+
+/**
+ * Type of block called with the result of each utterance, in the order
+ * they were spoken.  utterance counts from 0.  responseStrings,
+ * responseDictionary, and error are as for SpeechRequestBlock.
+**/
+typedef void (^SpeechListenerResultBlock)(NSUInteger utterance,
+                                          NSArray* responseStrings,
+                                          NSDictionary* responseDictionary,
+                                          NSError* error);
+
+/** Type of block called when the user starts speaking. **/
+typedef void (^SpeechListenerSpeechBlock)(NSUInteger utterance);
+
+/** Type of block called with the latest audio level. **/
+typedef void (^SpeechListenerLevelBlock)(const SpeechMeterFrame* level);
+
+/**
+ * Listens hands-free: captures audio continuously, splits it into
+ * utterances with on-device voice activity detection, and sends each
+ * utterance to the Speech API as its own SpeechRequest while capture goes
+ * on.  The user may start talking again before the last result is back.
+ *
+ * Audio goes into a fixed-size ring buffer.  The capture thread only
+ * copies into the ring and runs the detector and meter; it never waits on
+ * the main thread or the network.  An utterance is copied out of the ring
+ * when its request starts, at most maxOutstanding at a time, so memory
+ * stays bounded however slow the network is.  If the network falls so far
+ * behind that an utterance is overwritten before it is sent, or the main
+ * thread so far behind that it can't be told of the utterance in time, its
+ * result is an ATTSpeechServiceErrorCodeNoAudio error.
+ *
+ * Configure and use SpeechListener from the main thread.
+**/
+@interface SpeechListener : NSObject {
+}
+
+/** Creates a listener that sends utterances to the given Speech API URL. **/
++ (SpeechListener*) listenerWithURL: (NSURL*) recognitionURL;
+
+/** The URL of the Speech API service. **/
+@property (readonly, retain) NSURL* recognitionURL;
+
+/** The OAuth access token.  It may be changed while listening. **/
+@property (copy) NSString* bearerAuthToken;
+
+/** The Speech API speech context and X-Arg pairs for every utterance. **/
+@property (copy) NSString* speechContext;
+@property (copy) NSDictionary* xArgs;
+
+/** The maximum number of seconds to wait for each request. **/
+@property (assign) NSTimeInterval connectionTimeout;
+
+/** Capture rate: 16000 for wideband WAV, or 8000.  Defaults to 16000. **/
+@property (assign) int sampleRate;
+
+/** Seconds of audio the ring buffer holds, at least twice
+ *  maxUtteranceDuration.  Defaults to 30. **/
+@property (assign) NSTimeInterval bufferDuration;
+
+/** Longest utterance; speech that runs on is split.  Defaults to 15 seconds. **/
+@property (assign) NSTimeInterval maxUtteranceDuration;
+
+/** Most requests to have running at once.  Defaults to 4. **/
+@property (assign) NSUInteger maxOutstanding;
+
+/** Block called with each utterance's result. **/
+@property (copy) SpeechListenerResultBlock resultBlock;
+
+/** Block called when speech starts, so the app can stop whatever it is
+ *  showing or playing: the user is barging in. **/
+@property (copy) SpeechListenerSpeechBlock speechBlock;
+
+/** Block called about 20 times a second with the latest audio level. **/
+@property (copy) SpeechListenerLevelBlock levelBlock;
+
+/** Whether the listener is capturing audio. **/
+@property (readonly) BOOL isListening;
+
+/** Utterances heard, and those lost because the ring buffer overran. **/
+@property (readonly) NSUInteger utteranceCount;
+@property (readonly) NSUInteger droppedCount;
+
+/** Starts capturing from the microphone.  Returns NO if audio input
+ *  could not be started. **/
+- (BOOL) start;
+
+/** Starts listening to audio passed to appendSamples:count: instead of
+ *  the microphone, for testing with recorded or synthetic audio. **/
+- (void) startWithoutMicrophone;
+
+/** Adds 16-bit mono samples at sampleRate, after startWithoutMicrophone.
+ *  Call it from one thread at a time; it never blocks. **/
+- (void) appendSamples: (const int16_t*) samples count: (NSUInteger) count;
+
+/** Stops capturing.  An utterance in progress ends here, and the results
+ *  of all utterances heard are still delivered.  Without the microphone,
+ *  stop appending samples first. **/
+- (void) stop;
+
+/** Stops capturing and abandons the utterances not yet delivered. **/
+- (void) cancel;
+
+@end
@@ -0,0 +1,627 @@
+//  SpeechListener.m
+//
+// Licensed by AT&T under 'Software Development Kit Tools Agreement' 2012.
+// TERMS AND CONDITIONS FOR USE, REPRODUCTION, AND DISTRIBUTION: http://developer.att.com/sdk_agreement/
+// Copyright 2012 AT&T Intellectual Property. All rights reserved.
+// For more information contact developer.support@att.com http://developer.att.com
+
+#import "SpeechListener.h"
+#import "SpeechRequest.h"
+#import "ATTSpeechKit.h"
+#import <AVFoundation/AVAudioSession.h>
+#include <AudioToolbox/AudioQueue.h>
+#include <libkern/OSAtomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include "SpeechVAD.h"
+#include "SpeechWAV.h"
+
+static const int DEFAULT_SAMPLE_RATE = 16000;
+static const NSTimeInterval DEFAULT_BUFFER_DURATION = 30.0; // seconds
+static const NSTimeInterval DEFAULT_MAX_UTTERANCE_DURATION = 15.0; // seconds
+static const NSUInteger DEFAULT_MAX_OUTSTANDING = 4;
+
+/** Tune how often the main thread collects utterances and levels from the
+    capture thread.  This bounds how late a result's request starts. **/
+static const NSTimeInterval POLL_INTERVAL = 0.05; // seconds
+
+/** Tune the audio queue buffers: shorter means less delay, more wakeups. **/
+static const NSTimeInterval CAPTURE_BUFFER_DURATION = 0.1; // seconds
+#define CAPTURE_BUFFER_COUNT 3
+
+/** Utterance starts and ends in flight from the capture thread. **/
+#define EVENT_CAPACITY 32
+
+#pragma mark -
+#pragma mark Capture
+
+/* These functions run on the capture thread, except where noted, and share
+   only the ring, the event queue, and the level queue with the main
+   thread.  Each of those has one writer, which publishes with a barrier. */
+
+typedef struct CaptureEvent {
+    int started;                /* 1 when speech starts, 0 when it ends */
+    uint32_t lost;              /* utterances lost just before this start */
+    uint64_t position;          /* sample where the utterance starts or ends */
+} CaptureEvent;
+
+typedef struct Capture {
+    int16_t* ring;
+    uint64_t capacity;          /* samples in the ring */
+    uint64_t chunk;             /* most samples published at once */
+    volatile int64_t written;   /* samples written since the start */
+    uint64_t vad_position;      /* samples the detector has seen */
+    uint64_t meter_position;    /* samples the meter has seen */
+    uint64_t padding;           /* samples kept around the speech */
+    uint64_t max_utterance;     /* samples before an utterance is split */
+    int in_utterance;
+    int dropping;               /* the utterance in progress was not queued */
+    uint32_t lost;              /* utterances lost since the last start queued */
+    uint64_t utterance_start;
+    SpeechVAD vad;
+    SpeechMeter meter;
+    SpeechMeterQueue levels;
+    int16_t scratch[SPEECH_METER_MAX_FRAME];
+    CaptureEvent events[EVENT_CAPACITY];
+    volatile uint32_t event_head;
+    volatile uint32_t event_tail;
+} Capture;
+
+/* Allocates a capture for the given rate and durations, on the main thread. */
+static Capture* CaptureCreate(int sample_rate, NSTimeInterval buffer_duration,
+                              NSTimeInterval max_utterance_duration)
+{
+    Capture* capture = calloc(1, sizeof(Capture));
+    SpeechVADConfig config;
+    if (capture == NULL)
+        return NULL;
+    // Room for the longest utterance while the one before it is sent.
+    if (buffer_duration < 2.0 * max_utterance_duration)
+        buffer_duration = 2.0 * max_utterance_duration;
+    capture->capacity = (uint64_t)(buffer_duration * sample_rate);
+    capture->chunk = (uint64_t)(CAPTURE_BUFFER_DURATION * sample_rate);
+    capture->ring = malloc((size_t)capture->capacity * sizeof(int16_t));
+    if (capture->ring == NULL || capture->capacity < 4 * capture->chunk
+        || SpeechMeterInit(&capture->meter, sample_rate, sample_rate >= 16000 ? 512 : 256) != 0) {
+        free(capture->ring);
+        free(capture);
+        return NULL;
+    }
+    SpeechVADDefaultConfig(&config, sample_rate);
+    SpeechVADInit(&capture->vad, &config);
+    capture->padding = (uint64_t)config.sample_rate * (uint64_t)config.padding_ms / 1000;
+    capture->max_utterance = (uint64_t)(max_utterance_duration * sample_rate);
+    SpeechMeterQueueInit(&capture->levels);
+    OSMemoryBarrier();
+    return capture;
+}
+
+static void CaptureDestroy(Capture* capture)
+{
+    if (capture != NULL) {
+        free(capture->ring);
+        free(capture);
+    }
+}
+
+/* Samples written so far, from either thread. */
+static uint64_t CaptureWritten(Capture* capture)
+{
+    return (uint64_t)OSAtomicAdd64Barrier(0, &capture->written);
+}
+
+/* Copies count samples from position in the ring. */
+static void CaptureCopy(const Capture* capture, uint64_t position, uint64_t count, int16_t* samples)
+{
+    uint64_t offset = position % capture->capacity;
+    uint64_t first = count < capture->capacity - offset ? count : capture->capacity - offset;
+    memcpy(samples, capture->ring + offset, (size_t)first * sizeof(int16_t));
+    memcpy(samples + first, capture->ring, (size_t)(count - first) * sizeof(int16_t));
+}
+
+/* Whether the samples from position on are still in the ring, allowing for
+   a chunk the capture thread may be writing but has not yet published.
+   From the main thread. */
+static BOOL CaptureHolds(Capture* capture, uint64_t position)
+{
+    return CaptureWritten(capture) + capture->chunk <= position + capture->capacity;
+}
+
+static void CapturePushEvent(Capture* capture, int started, uint32_t lost, uint64_t position)
+{
+    uint32_t tail = capture->event_tail;
+    capture->events[tail % EVENT_CAPACITY].started = started;
+    capture->events[tail % EVENT_CAPACITY].lost = lost;
+    capture->events[tail % EVENT_CAPACITY].position = position;
+    OSMemoryBarrier();
+    capture->event_tail = tail + 1;
+}
+
+/* Queues the start of an utterance, keeping room for its end.  If the main
+   thread has fallen so far behind that there's no room, the utterance is
+   counted as lost instead, and the next start queued carries the count. */
+static void CaptureStart(Capture* capture, uint64_t position)
+{
+    capture->in_utterance = 1;
+    capture->utterance_start = position;
+    if (capture->event_tail - capture->event_head > EVENT_CAPACITY - 2) {
+        capture->dropping = 1;
+        capture->lost++;
+        return;
+    }
+    capture->dropping = 0;
+    CapturePushEvent(capture, 1, capture->lost, position);
+    capture->lost = 0;
+}
+
+/* Queues the end of the utterance in progress, in the room its start kept. */
+static void CaptureEnd(Capture* capture, uint64_t position)
+{
+    capture->in_utterance = 0;
+    if (!capture->dropping)
+        CapturePushEvent(capture, 0, 0, position);
+}
+
+/* Runs the detector over the frames written since it last ran, marking
+   utterance starts and ends. */
+static void CaptureDetect(Capture* capture, uint64_t written)
+{
+    SpeechVAD* vad = &capture->vad;
+    while (written - capture->vad_position >= vad->frame_length) {
+        SpeechVADEvent event;
+        CaptureCopy(capture, capture->vad_position, vad->frame_length, capture->scratch);
+        event = SpeechVADProcessFrame(vad, capture->scratch);
+        capture->vad_position += vad->frame_length;
+        if (event == SpeechVADEventSpeechStart && !capture->in_utterance) {
+            uint64_t start = (uint64_t)vad->start_frame * vad->frame_length;
+            CaptureStart(capture, start > capture->padding ? start - capture->padding : 0);
+        }
+        else if (event == SpeechVADEventSpeechEnd && capture->in_utterance) {
+            uint64_t end = (uint64_t)vad->end_frame * vad->frame_length + capture->padding;
+            CaptureEnd(capture, end < capture->vad_position ? end : capture->vad_position);
+        }
+        else if (capture->in_utterance
+                 && capture->vad_position - capture->utterance_start >= capture->max_utterance) {
+            // Speech that runs on is cut into pieces the service will take.
+            CaptureEnd(capture, capture->vad_position);
+            CaptureStart(capture, capture->vad_position);
+        }
+    }
+}
+
+/* Meters the frames written since it last ran. */
+static void CaptureMeter(Capture* capture, uint64_t written)
+{
+    SpeechMeter* meter = &capture->meter;
+    while (written - capture->meter_position >= meter->frame_length) {
+        SpeechMeterFrame frame;
+        CaptureCopy(capture, capture->meter_position, meter->frame_length, capture->scratch);
+        SpeechMeterAnalyze(meter, capture->scratch, &frame);
+        capture->meter_position += meter->frame_length;
+        SpeechMeterQueuePush(&capture->levels, &frame);
+    }
+}
+
+/* Adds samples to the ring, a chunk at a time, and analyzes them. */
+static void CaptureAppend(Capture* capture, const int16_t* samples, uint64_t count)
+{
+    uint64_t written = (uint64_t)capture->written; // Only this thread changes it.
+    while (count > 0) {
+        uint64_t length = count < capture->chunk ? count : capture->chunk;
+        uint64_t offset = written % capture->capacity;
+        uint64_t first = length < capture->capacity - offset ? length : capture->capacity - offset;
+        memcpy(capture->ring + offset, samples, (size_t)first * sizeof(int16_t));
+        memcpy(capture->ring, samples + first, (size_t)(length - first) * sizeof(int16_t));
+        OSAtomicAdd64Barrier((int64_t)length, &capture->written);
+        written += length;
+        samples += length;
+        count -= length;
+        CaptureDetect(capture, written);
+        CaptureMeter(capture, written);
+    }
+}
+
+/* Ends an utterance in progress, once capture has stopped.  From the main
+   thread, which is then the only writer. */
+static void CaptureFinish(Capture* capture)
+{
+    if (capture->in_utterance)
+        CaptureEnd(capture, capture->vad_position);
+}
+
+/* Takes the next utterance event, on the main thread.  Returns NO if none. */
+static BOOL CapturePopEvent(Capture* capture, CaptureEvent* event)
+{
+    uint32_t head = capture->event_head;
+    if (head == capture->event_tail)
+        return NO;
+    OSMemoryBarrier();
+    *event = capture->events[head % EVENT_CAPACITY];
+    OSMemoryBarrier();
+    capture->event_head = head + 1;
+    return YES;
+}
+
+static void CaptureCallback(void* userData, AudioQueueRef queue, AudioQueueBufferRef buffer,
+                            const AudioTimeStamp* startTime, UInt32 packetCount,
+                            const AudioStreamPacketDescription* packetDescriptions)
+{
+    Capture* capture = userData;
+    CaptureAppend(capture, buffer->mAudioData, buffer->mAudioDataByteSize / sizeof(int16_t));
+    // Fails harmlessly once the queue is stopping.
+    AudioQueueEnqueueBuffer(queue, buffer, 0, NULL);
+}
+
+#pragma mark -
+#pragma mark Utterance
+
+/* One utterance, from when speech starts until its result is delivered. */
+@interface SpeechListenerUtterance : NSObject {
+    @public
+    NSUInteger index;
+    uint64_t start;
+    uint64_t end;
+    BOOL ended;
+    BOOL sent;
+    BOOL finished;
+}
+@property (retain) NSData* audio;   // copied out of the ring when capture stops
+@property (retain) SpeechRequest* request;
+@property (retain) NSArray* strings;
+@property (retain) NSDictionary* dictionary;
+@property (retain) NSError* error;
+@end
+
+@implementation SpeechListenerUtterance
+
+@synthesize audio = _audio;
+@synthesize request = _request;
+@synthesize strings = _strings;
+@synthesize dictionary = _dictionary;
+@synthesize error = _error;
+
+- (void) dealloc
+{
+    self.audio = nil;
+    self.request = nil;
+    self.strings = nil;
+    self.dictionary = nil;
+    self.error = nil;
+    [super dealloc];
+}
+
+@end
+
+#pragma mark -
+#pragma mark Listener
+
+@interface SpeechListener () {
+    @private
+    Capture* capture;
+    AudioQueueRef queue;
+    BOOL listening;
+    NSUInteger outstanding;
+    NSUInteger utteranceCount;
+    NSUInteger droppedCount;
+}
+@property (retain) NSURL* recognitionURL;
+@property (retain) NSTimer* timer;
+@property (retain) SpeechListenerUtterance* current;   // being spoken
+@property (retain) NSMutableArray* utterances;         // ended, not yet delivered, in order
+
+- (BOOL) startCapture;
+- (void) stopCapture;
+- (void) poll: (NSTimer*) timer;
+- (void) collectEvents;
+- (void) addLostUtterances: (NSUInteger) count;
+- (NSData*) audioForUtterance: (SpeechListenerUtterance*) utterance;
+- (void) sendUtterances;
+- (void) deliverResults;
+@end
+
+@implementation SpeechListener
+
+@synthesize recognitionURL = _recognitionURL;
+@synthesize bearerAuthToken = _bearerAuthToken;
+@synthesize speechContext = _speechContext;
+@synthesize xArgs = _xArgs;
+@synthesize connectionTimeout = _connectionTimeout;
+@synthesize sampleRate = _sampleRate;
+@synthesize bufferDuration = _bufferDuration;
+@synthesize maxUtteranceDuration = _maxUtteranceDuration;
+@synthesize maxOutstanding = _maxOutstanding;
+@synthesize resultBlock = _resultBlock;
+@synthesize speechBlock = _speechBlock;
+@synthesize levelBlock = _levelBlock;
+@synthesize isListening = listening;
+@synthesize utteranceCount;
+@synthesize droppedCount;
+@synthesize timer = _timer;
+@synthesize current = _current;
+@synthesize utterances = _utterances;
+
++ (SpeechListener*) listenerWithURL: (NSURL*) recognitionURL
+{
+    SpeechListener* listener = [[[self alloc] init] autorelease];
+    listener.recognitionURL = recognitionURL;
+    return listener;
+}
+
+- (id) init
+{
+    self = [super init];
+    if (self != nil) {
+        _sampleRate = DEFAULT_SAMPLE_RATE;
+        _bufferDuration = DEFAULT_BUFFER_DURATION;
+        _maxUtteranceDuration = DEFAULT_MAX_UTTERANCE_DURATION;
+        _maxOutstanding = DEFAULT_MAX_OUTSTANDING;
+        _utterances = [[NSMutableArray alloc] init];
+    }
+    return self;
+}
+
+- (void) dealloc
+{
+    [self cancel];
+    self.recognitionURL = nil;
+    self.bearerAuthToken = nil;
+    self.speechContext = nil;
+    self.xArgs = nil;
+    self.resultBlock = nil;
+    self.speechBlock = nil;
+    self.levelBlock = nil;
+    self.utterances = nil;
+    [super dealloc];
+}
+
+- (BOOL) start
+{
+    if (listening)
+        return YES;
+    // Keep the session able to record between SpeechKit's own requests.
+    AVAudioSession* session = [AVAudioSession sharedInstance];
+    [session setCategory: AVAudioSessionCategoryPlayAndRecord error: NULL];
+    [session setActive: YES error: NULL];
+
+    if (![self startCapture])
+        return NO;
+    AudioStreamBasicDescription format;
+    memset(&format, 0, sizeof(format));
+    format.mSampleRate = _sampleRate;
+    format.mFormatID = kAudioFormatLinearPCM;
+    format.mFormatFlags = kLinearPCMFormatFlagIsSignedInteger | kLinearPCMFormatFlagIsPacked;
+    format.mBytesPerPacket = sizeof(int16_t);
+    format.mFramesPerPacket = 1;
+    format.mBytesPerFrame = sizeof(int16_t);
+    format.mChannelsPerFrame = 1;
+    format.mBitsPerChannel = 16;
+    // A NULL run loop puts the callbacks on the queue's own thread, away
+    // from anything the main thread does.
+    OSStatus status = AudioQueueNewInput(&format, CaptureCallback, capture, NULL, NULL, 0, &queue);
+    if (status != noErr)
+        queue = NULL;
+    UInt32 bufferSize = (UInt32)capture->chunk * sizeof(int16_t);
+    for (int i = 0; status == noErr && i < CAPTURE_BUFFER_COUNT; i++) {
+        AudioQueueBufferRef buffer;
+        status = AudioQueueAllocateBuffer(queue, bufferSize, &buffer);
+        if (status == noErr)
+            status = AudioQueueEnqueueBuffer(queue, buffer, 0, NULL);
+    }
+    if (status == noErr)
+        status = AudioQueueStart(queue, NULL);
+    if (status != noErr) {
+        NSLog(@"SpeechListener couldn't start audio input: %ld", (long)status);
+        [self stopCapture];
+        return NO;
+    }
+    return YES;
+}
+
+- (void) startWithoutMicrophone
+{
+    if (!listening)
+        [self startCapture];
+}
+
+- (void) appendSamples: (const int16_t*) samples count: (NSUInteger) count
+{
+    // No lock: the caller is the only producer, as the audio queue would be.
+    if (capture != NULL && queue == NULL)
+        CaptureAppend(capture, samples, count);
+}
+
+- (void) stop
+{
+    if (!listening)
+        return;
+    [self stopCapture];
+    [self sendUtterances];
+}
+
+- (void) cancel
+{
+    [self stopCapture];
+    // Each request's block retains its utterance until the request is
+    // canceled or done.
+    for (SpeechListenerUtterance* utterance in _utterances) {
+        [utterance.request cancel];
+        utterance.request = nil;
+    }
+    [_utterances removeAllObjects];
+    outstanding = 0;
+}
+
+#pragma mark -
+#pragma mark Capture control
+
+- (BOOL) startCapture
+{
+    capture = CaptureCreate(_sampleRate, _bufferDuration, _maxUtteranceDuration);
+    if (capture == NULL)
+        return NO;
+    listening = YES;
+    self.timer = [NSTimer scheduledTimerWithTimeInterval: POLL_INTERVAL target: self
+                                                selector: @selector(poll:) userInfo: nil repeats: YES];
+    return YES;
+}
+
+- (void) stopCapture
+{
+    if (!listening)
+        return;
+    listening = NO;
+    [_timer invalidate];
+    self.timer = nil;
+    if (queue != NULL) {
+        // Synchronous, so the capture thread is done with the ring after this.
+        AudioQueueStop(queue, true);
+        AudioQueueDispose(queue, true);
+        queue = NULL;
+    }
+    CaptureFinish(capture);
+    [self collectEvents];
+    // The capture thread is done, so its count of the last ones lost is final.
+    [self addLostUtterances: capture->lost];
+
+    // The ring goes away, so keep the audio of the utterances still to send.
+    for (SpeechListenerUtterance* utterance in _utterances) {
+        if (!utterance->sent && utterance.audio == nil)
+            utterance.audio = [self audioForUtterance: utterance];
+    }
+    self.current = nil;
+    CaptureDestroy(capture);
+    capture = NULL;
+}
+
+- (void) poll: (NSTimer*) timer
+{
+    [self collectEvents];
+    [self sendUtterances];
+}
+
+// Collects levels and utterance boundaries from the capture thread.
+- (void) collectEvents
+{
+    SpeechMeterFrame level;
+    BOOL leveled = NO;
+    while (SpeechMeterQueuePop(&capture->levels, &level))
+        leveled = YES;
+    if (leveled && _levelBlock != nil)
+        _levelBlock(&level);
+
+    CaptureEvent event;
+    while (CapturePopEvent(capture, &event)) {
+        if (event.started) {
+            [self addLostUtterances: event.lost];
+            SpeechListenerUtterance* utterance = [[SpeechListenerUtterance alloc] init];
+            utterance->index = utteranceCount++;
+            utterance->start = event.position;
+            self.current = utterance;
+            [utterance release];
+            if (_speechBlock != nil)
+                _speechBlock(utterance->index);
+        }
+        else if (_current != nil) {
+            _current->end = event.position;
+            _current->ended = YES;
+            [_utterances addObject: _current];
+            self.current = nil;
+        }
+    }
+}
+
+// Puts utterances the capture thread couldn't queue in line, as dropped.
+- (void) addLostUtterances: (NSUInteger) count
+{
+    for (NSUInteger i = 0; i < count; i++) {
+        SpeechListenerUtterance* utterance = [[SpeechListenerUtterance alloc] init];
+        utterance->index = utteranceCount++;
+        utterance->ended = utterance->sent = utterance->finished = YES;
+        utterance.error = [NSError errorWithDomain: ATTSpeechServiceErrorDomain
+                                              code: ATTSpeechServiceErrorCodeNoAudio
+                                          userInfo: nil];
+        [_utterances addObject: utterance];
+        [utterance release];
+        droppedCount++;
+    }
+}
+
+#pragma mark -
+#pragma mark Requests
+
+// The utterance's audio as WAV, or nil if the ring has overwritten it.
+- (NSData*) audioForUtterance: (SpeechListenerUtterance*) utterance
+{
+    if (utterance.audio != nil)
+        return utterance.audio;
+    if (capture == NULL || !CaptureHolds(capture, utterance->start))
+        return nil;
+    uint64_t count = utterance->end - utterance->start;
+    NSMutableData* audio = [NSMutableData dataWithLength: SPEECH_WAV_HEADER_LENGTH + (NSUInteger)count * sizeof(int16_t)];
+    SpeechWAVWriteHeader(audio.mutableBytes, _sampleRate, (uint32_t)(count * sizeof(int16_t)));
+    CaptureCopy(capture, utterance->start, count, (int16_t*)((uint8_t*)audio.mutableBytes + SPEECH_WAV_HEADER_LENGTH));
+    // Capture may have lapped the copy while it was being made.
+    if (!CaptureHolds(capture, utterance->start))
+        return nil;
+    return audio;
+}
+
+// Starts requests for the oldest utterances not yet sent, as slots allow.
+- (void) sendUtterances
+{
+    for (SpeechListenerUtterance* utterance in _utterances) {
+        if (outstanding >= _maxOutstanding)
+            break;
+        if (utterance->sent)
+            continue;
+        utterance->sent = YES;
+        NSData* audio = [self audioForUtterance: utterance];
+        utterance.audio = nil;
+        if (audio == nil) {
+            droppedCount++;
+            utterance->finished = YES;
+            utterance.error = [NSError errorWithDomain: ATTSpeechServiceErrorDomain
+                                                  code: ATTSpeechServiceErrorCodeNoAudio
+                                              userInfo: nil];
+            continue;
+        }
+        SpeechRequest* request = [SpeechRequest requestWithURL: _recognitionURL];
+        request.bearerAuthToken = _bearerAuthToken;
+        request.speechContext = _speechContext;
+        request.xArgs = _xArgs;
+        request.contentType = @"audio/wav";
+        if (_connectionTimeout > 0)
+            request.connectionTimeout = _connectionTimeout;
+        utterance.request = request;
+        outstanding++;
+        // The block doesn't retain the listener; canceling releases the
+        // utterances, and with them their requests.
+        __block SpeechListener* blockSelf = self;
+        [request startWithAudioData: audio completion: ^(NSArray* strings, NSDictionary* json, NSError* error) {
+            utterance.request = nil;
+            utterance.strings = strings;
+            utterance.dictionary = json;
+            utterance.error = error;
+            utterance->finished = YES;
+            blockSelf->outstanding--;
+            [blockSelf sendUtterances];
+        }];
+    }
+    [self deliverResults];
+}
+
+// Hands on the finished results at the front of the line, in order.
+- (void) deliverResults
+{
+    while (_utterances.count > 0) {
+        SpeechListenerUtterance* utterance = [_utterances objectAtIndex: 0];
+        if (!utterance->finished)
+            break;
+        [[utterance retain] autorelease];
+        [_utterances removeObjectAtIndex: 0];
+        if (_resultBlock != nil)
+            _resultBlock(utterance->index, utterance.strings, utterance.dictionary, utterance.error);
+    }
+}
+
+@end
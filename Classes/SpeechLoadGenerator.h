@@ -0,0 +1,73 @@
+//  SpeechLoadGenerator.h
+//
+// Licensed by AT&T under 'Software Development Kit Tools Agreement' 2012.
+// TERMS AND CONDITIONS FOR USE, REPRODUCTION, AND DISTRIBUTION: http://developer.att.com/sdk_agreement/
+// Copyright 2012 AT&T Intellectual Property. All rights reserved.
+// For more information contact developer.support@att.com http://developer.att.com
+
+#import <Foundation/NSObject.h>
+#import <Foundation/NSDate.h>
+
+@class NSString, NSURL, NSArray, NSDictionary;
+@class SpeechAuth;
+
+/**
+ * Type of block called when a load test ends.  report holds "elapsed",
+ * "sent", "succeeded", "failed", "skipped", and "throughput" (successes per
+ * second); "latency" with "mean", "p50", "p90", "p99", and "max" in
+ * milliseconds; "histogram", an array of [upper bound in ms, count] pairs,
+ * the last bound being infinity; and "errors", a count for each kind of
+ * error by name.
+**/
+typedef void (^SpeechLoadReportBlock)(NSDictionary* report);
+
+/**
+ * Replays a corpus of audio files to the Speech API at a steady request
+ * rate, for capacity planning and for catching client-side slowdowns.
+ *
+ * Requests start on schedule whether or not earlier ones have finished, as
+ * real users' would, up to a limit; a request that would pass the limit is
+ * skipped and counted.  Each request is a SpeechRequest, so it has the same
+ * headers and body as the app's own, and latency is measured from starting
+ * it to its completion block.  Point it at SpeechMockServer to test the
+ * client without the live service.
+ *
+ * Use SpeechLoadGenerator only from the main thread.
+**/
+@interface SpeechLoadGenerator : NSObject {
+}
+
+/** Creates a generator that sends requests to the given Speech API URL. **/
++ (SpeechLoadGenerator*) generatorWithURL: (NSURL*) recognitionURL;
+
+/** Authenticator whose tokens the requests use.  The test starts once it
+ *  has a token. **/
+@property (retain) SpeechAuth* speechAuth;
+
+/** Audio files to send, in turn, starting over after the last. **/
+@property (copy) NSArray* corpus;
+
+/** The Speech API speech context and X-Arg pairs for requests. **/
+@property (copy) NSString* speechContext;
+@property (copy) NSDictionary* xArgs;
+
+/** Requests to start per second.  Defaults to 1. **/
+@property (assign) double requestsPerSecond;
+
+/** How long to keep starting requests.  Defaults to 60 seconds. **/
+@property (assign) NSTimeInterval duration;
+
+/** Most requests to have running at once.  Defaults to 32. **/
+@property (assign) NSUInteger maxOutstanding;
+
+/** Starts the test.  block is called once the requests started during the
+ *  test have all finished. **/
+- (void) startWithCompletion: (SpeechLoadReportBlock) block;
+
+/** Stops starting requests; block is called when the running ones finish. **/
+- (void) stop;
+
+/** A readable form of a report, for the log. **/
++ (NSString*) descriptionOfReport: (NSDictionary*) report;
+
+@end
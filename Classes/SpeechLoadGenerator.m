@@ -0,0 +1,322 @@
+//  SpeechLoadGenerator.m
+//
+// Licensed by AT&T under 'Software Development Kit Tools Agreement' 2012.
+// TERMS AND CONDITIONS FOR USE, REPRODUCTION, AND DISTRIBUTION: http://developer.att.com/sdk_agreement/
+// Copyright 2012 AT&T Intellectual Property. All rights reserved.
+// For more information contact developer.support@att.com http://developer.att.com
+
+#import "SpeechLoadGenerator.h"
+#import "SpeechAuth.h"
+#import "SpeechRequest.h"
+#import "ATTSpeechKit.h"
+
+static const double DEFAULT_REQUESTS_PER_SECOND = 1.0;
+static const NSTimeInterval DEFAULT_DURATION = 60.0; // seconds
+static const NSUInteger DEFAULT_MAX_OUTSTANDING = 32;
+
+/** Tune the histogram buckets to the latencies of interest. **/
+static const double HISTOGRAM_BOUNDS[] = { // milliseconds
+    50, 100, 200, 300, 500, 750, 1000, 1500, 2000, 3000, 5000, 10000
+};
+#define HISTOGRAM_BUCKETS (sizeof(HISTOGRAM_BOUNDS) / sizeof(HISTOGRAM_BOUNDS[0]) + 1)
+
+/* A short name for the kind of error, for grouping them in the report. */
+static NSString* ErrorName(NSError* error)
+{
+    if ([error.domain isEqualToString: ATTSpeechServiceHTTPErrorDomain])
+        return [NSString stringWithFormat: @"HTTP %ld", (long)error.code];
+    if ([error.domain isEqualToString: ATTSpeechServiceErrorDomain]) {
+        switch (error.code) {
+            case ATTSpeechServiceErrorCodeAttemptAtReentrancy: return @"AttemptAtReentrancy";
+            case ATTSpeechServiceErrorCodeInvalidParameter: return @"InvalidParameter";
+            case ATTSpeechServiceErrorCodeInvalidURL: return @"InvalidURL";
+            case ATTSpeechServiceErrorCodeConnectionFailure: return @"ConnectionFailure";
+            case ATTSpeechServiceErrorCodeNoResponseFromServer: return @"NoResponseFromServer";
+            case ATTSpeechServiceErrorCodeAudioTooShort: return @"AudioTooShort";
+            case ATTSpeechServiceErrorCodeNoAudio: return @"NoAudio";
+            case ATTSpeechServiceErrorCodeNoMicrophone: return @"NoMicrophone";
+            case ATTSpeechServiceErrorCodeCanceledByUser: return @"CanceledByUser";
+        }
+    }
+    return [NSString stringWithFormat: @"%@ %ld", error.domain, (long)error.code];
+}
+
+/* The value at fraction of the way through sorted, which is not empty. */
+static double Percentile(const double* sorted, NSUInteger count, double fraction)
+{
+    NSUInteger index = (NSUInteger)(fraction * (double)(count - 1) + 0.5);
+    return sorted[index];
+}
+
+static int CompareDoubles(const void* a, const void* b)
+{
+    double x = *(const double*)a, y = *(const double*)b;
+    return x < y ? -1 : x > y;
+}
+
+@interface SpeechLoadGenerator () {
+    @private
+    BOOL running;
+    BOOL stopping;
+    CFAbsoluteTime startTime;
+    CFAbsoluteTime stopTime;
+    NSUInteger scheduled;  // requests due so far, started or skipped
+    NSUInteger outstanding;
+    NSUInteger sent;
+    NSUInteger succeeded;
+    NSUInteger failed;
+    NSUInteger skipped;
+}
+@property (retain) NSURL* recognitionURL;
+@property (copy) NSString* token;
+@property (copy) SpeechLoadReportBlock completionBlock;
+@property (retain) NSTimer* timer;
+@property (retain) NSMutableData* latencies;    // of double, in milliseconds
+@property (retain) NSMutableDictionary* errors; // error name -> NSNumber count
+
+- (void) begin;
+- (void) tick: (NSTimer*) timer;
+- (void) sendNext;
+- (void) finishIfDone;
+- (NSDictionary*) report;
+@end
+
+@implementation SpeechLoadGenerator
+
+@synthesize speechAuth = _speechAuth;
+@synthesize corpus = _corpus;
+@synthesize speechContext = _speechContext;
+@synthesize xArgs = _xArgs;
+@synthesize requestsPerSecond = _requestsPerSecond;
+@synthesize duration = _duration;
+@synthesize maxOutstanding = _maxOutstanding;
+@synthesize recognitionURL = _recognitionURL;
+@synthesize token = _token;
+@synthesize completionBlock = _completionBlock;
+@synthesize timer = _timer;
+@synthesize latencies = _latencies;
+@synthesize errors = _errors;
+
++ (SpeechLoadGenerator*) generatorWithURL: (NSURL*) recognitionURL
+{
+    SpeechLoadGenerator* generator = [[[self alloc] init] autorelease];
+    generator.recognitionURL = recognitionURL;
+    return generator;
+}
+
+- (id) init
+{
+    self = [super init];
+    if (self != nil) {
+        _requestsPerSecond = DEFAULT_REQUESTS_PER_SECOND;
+        _duration = DEFAULT_DURATION;
+        _maxOutstanding = DEFAULT_MAX_OUTSTANDING;
+    }
+    return self;
+}
+
+- (void) dealloc
+{
+    [_timer invalidate];
+    [_speechAuth cancel];
+    self.speechAuth = nil;
+    self.corpus = nil;
+    self.speechContext = nil;
+    self.xArgs = nil;
+    self.recognitionURL = nil;
+    self.token = nil;
+    self.completionBlock = nil;
+    self.timer = nil;
+    self.latencies = nil;
+    self.errors = nil;
+    [super dealloc];
+}
+
+- (void) startWithCompletion: (SpeechLoadReportBlock) block
+{
+    NSAssert(_completionBlock == nil, @"SpeechLoadGenerator is already running");
+    self.completionBlock = block;
+    self.latencies = [NSMutableData data];
+    self.errors = [NSMutableDictionary dictionary];
+    running = stopping = NO;
+    scheduled = outstanding = sent = succeeded = failed = skipped = 0;
+    if (_speechAuth == nil) {
+        [self begin];
+        return;
+    }
+    // Keep the token fresh for the whole test, and start once there is one.
+    // The block doesn't retain self, since self retains the authenticator.
+    __block SpeechLoadGenerator* blockSelf = self;
+    [_speechAuth fetchTo: ^(NSString* token, NSError* error) {
+        if (token != nil) {
+            blockSelf.token = token;
+            if (!blockSelf->running && !blockSelf->stopping)
+                [blockSelf begin];
+        }
+        else if (!blockSelf->running) {
+            // Nothing can be sent without a token.
+            [blockSelf.errors setObject: [NSNumber numberWithUnsignedInteger: 1]
+                                 forKey: [@"OAuth " stringByAppendingString: ErrorName(error)]];
+            [blockSelf stop];
+        }
+    }];
+}
+
+- (void) begin
+{
+    running = YES;
+    startTime = CFAbsoluteTimeGetCurrent();
+    if (_corpus.count == 0 || _requestsPerSecond <= 0.0) {
+        [self stop];
+        return;
+    }
+    [self sendNext];
+    scheduled = 1;
+    // Tick faster than requests are due, so they start close to on time.
+    NSTimeInterval interval = MIN(1.0 / _requestsPerSecond, 0.1);
+    self.timer = [NSTimer scheduledTimerWithTimeInterval: interval target: self
+                                                selector: @selector(tick:)
+                                                userInfo: nil repeats: YES];
+}
+
+- (void) tick: (NSTimer*) timer
+{
+    CFAbsoluteTime elapsed = CFAbsoluteTimeGetCurrent() - startTime;
+    if (elapsed >= _duration) {
+        [self stop];
+        return;
+    }
+    // Start every request that has come due, even if the timer fell behind.
+    NSUInteger due = (NSUInteger)(elapsed * _requestsPerSecond) + 1;
+    while (scheduled < due) {
+        scheduled++;
+        if (outstanding >= _maxOutstanding)
+            skipped++;
+        else
+            [self sendNext];
+    }
+}
+
+- (void) sendNext
+{
+    NSString* path = [_corpus objectAtIndex: sent % _corpus.count];
+    SpeechRequest* request = [SpeechRequest requestWithURL: _recognitionURL];
+    request.bearerAuthToken = _token;
+    request.speechContext = _speechContext;
+    request.xArgs = _xArgs;
+    sent++;
+    outstanding++;
+    CFAbsoluteTime requestStart = CFAbsoluteTimeGetCurrent();
+    [request startWithAudioFile: path completion: ^(NSArray* strings, NSDictionary* json, NSError* error) {
+        double milliseconds = (CFAbsoluteTimeGetCurrent() - requestStart) * 1000.0;
+        outstanding--;
+        if (error == nil) {
+            succeeded++;
+            [_latencies appendBytes: &milliseconds length: sizeof(milliseconds)];
+        }
+        else {
+            failed++;
+            NSString* name = ErrorName(error);
+            NSUInteger count = [[_errors objectForKey: name] unsignedIntegerValue];
+            [_errors setObject: [NSNumber numberWithUnsignedInteger: count + 1] forKey: name];
+        }
+        [self finishIfDone];
+    }];
+}
+
+- (void) stop
+{
+    if (stopping)
+        return;
+    stopping = YES;
+    stopTime = CFAbsoluteTimeGetCurrent();
+    [_timer invalidate];
+    self.timer = nil;
+    [self finishIfDone];
+}
+
+- (void) finishIfDone
+{
+    if (!stopping || outstanding > 0 || _completionBlock == nil)
+        return;
+    [_speechAuth cancel];
+    NSDictionary* report = [self report];
+    running = NO;
+    SpeechLoadReportBlock block = [[_completionBlock retain] autorelease];
+    self.completionBlock = nil;
+    block(report);
+}
+
+- (NSDictionary*) report
+{
+    NSTimeInterval elapsed = running ? stopTime - startTime : 0.0;
+    NSUInteger count = _latencies.length / sizeof(double);
+    double* sorted = (double*)_latencies.mutableBytes;
+    qsort(sorted, count, sizeof(double), CompareDoubles);
+
+    NSUInteger buckets[HISTOGRAM_BUCKETS] = { 0 };
+    double total = 0.0;
+    NSUInteger i, bucket;
+    for (i = 0; i < count; i++) {
+        for (bucket = 0; bucket < HISTOGRAM_BUCKETS - 1 && sorted[i] > HISTOGRAM_BOUNDS[bucket]; bucket++)
+            ;
+        buckets[bucket]++;
+        total += sorted[i];
+    }
+    NSMutableArray* histogram = [NSMutableArray arrayWithCapacity: HISTOGRAM_BUCKETS];
+    for (bucket = 0; bucket < HISTOGRAM_BUCKETS; bucket++) {
+        double bound = bucket < HISTOGRAM_BUCKETS - 1 ? HISTOGRAM_BOUNDS[bucket] : INFINITY;
+        [histogram addObject: [NSArray arrayWithObjects:
+                               [NSNumber numberWithDouble: bound],
+                               [NSNumber numberWithUnsignedInteger: buckets[bucket]], nil]];
+    }
+
+    NSDictionary* latency = count == 0 ? [NSDictionary dictionary] :
+        [NSDictionary dictionaryWithObjectsAndKeys:
+         [NSNumber numberWithDouble: total / (double)count], @"mean",
+         [NSNumber numberWithDouble: Percentile(sorted, count, 0.50)], @"p50",
+         [NSNumber numberWithDouble: Percentile(sorted, count, 0.90)], @"p90",
+         [NSNumber numberWithDouble: Percentile(sorted, count, 0.99)], @"p99",
+         [NSNumber numberWithDouble: sorted[count - 1]], @"max",
+         nil];
+    return [NSDictionary dictionaryWithObjectsAndKeys:
+            [NSNumber numberWithDouble: elapsed], @"elapsed",
+            [NSNumber numberWithUnsignedInteger: sent], @"sent",
+            [NSNumber numberWithUnsignedInteger: succeeded], @"succeeded",
+            [NSNumber numberWithUnsignedInteger: failed], @"failed",
+            [NSNumber numberWithUnsignedInteger: skipped], @"skipped",
+            [NSNumber numberWithDouble: elapsed > 0.0 ? succeeded / elapsed : 0.0], @"throughput",
+            latency, @"latency",
+            histogram, @"histogram",
+            [[_errors copy] autorelease], @"errors",
+            nil];
+}
+
++ (NSString*) descriptionOfReport: (NSDictionary*) report
+{
+    NSMutableString* text = [NSMutableString string];
+    [text appendFormat: @"%@ sent, %@ succeeded, %@ failed, %@ skipped in %.1fs: %.2f/s\n",
+     [report objectForKey: @"sent"], [report objectForKey: @"succeeded"],
+     [report objectForKey: @"failed"], [report objectForKey: @"skipped"],
+     [[report objectForKey: @"elapsed"] doubleValue], [[report objectForKey: @"throughput"] doubleValue]];
+    NSDictionary* latency = [report objectForKey: @"latency"];
+    if (latency.count > 0)
+        [text appendFormat: @"latency mean=%.0fms p50=%.0fms p90=%.0fms p99=%.0fms max=%.0fms\n",
+         [[latency objectForKey: @"mean"] doubleValue], [[latency objectForKey: @"p50"] doubleValue],
+         [[latency objectForKey: @"p90"] doubleValue], [[latency objectForKey: @"p99"] doubleValue],
+         [[latency objectForKey: @"max"] doubleValue]];
+    for (NSArray* bucket in [report objectForKey: @"histogram"]) {
+        double bound = [[bucket objectAtIndex: 0] doubleValue];
+        NSUInteger count = [[bucket objectAtIndex: 1] unsignedIntegerValue];
+        if (count == 0)
+            continue;
+        [text appendFormat: isinf(bound) ? @"  >%.0fms: %lu\n" : @"  <=%.0fms: %lu\n",
+         isinf(bound) ? HISTOGRAM_BOUNDS[HISTOGRAM_BUCKETS - 2] : bound, (unsigned long)count];
+    }
+    NSDictionary* errors = [report objectForKey: @"errors"];
+    for (NSString* name in [errors.allKeys sortedArrayUsingSelector: @selector(compare:)])
+        [text appendFormat: @"  %@: %@\n", name, [errors objectForKey: name]];
+    return text;
+}
+
+@end
@@ -0,0 +1,174 @@
+//  SpeechMeter.c
+//
+// Licensed by AT&T under 'Software Development Kit Tools Agreement' 2012.
+// TERMS AND CONDITIONS FOR USE, REPRODUCTION, AND DISTRIBUTION: http://developer.att.com/sdk_agreement/
+// Copyright 2012 AT&T Intellectual Property. All rights reserved.
+// For more information contact developer.support@att.com http://developer.att.com
+
+#include "SpeechMeter.h"
+#include <math.h>
+
+/** Lowest band edge.  Below this is mostly hum and handling noise. **/
+static const float LOW_FREQUENCY = 100.0f;
+
+/** Level reported for silence, in dB. **/
+static const float FLOOR_DB = -100.0f;
+
+static const float PI = 3.14159265358979f;
+
+/* Full barrier, so the frame is written before the index that publishes it
+   and read after the index that says it is there. */
+#define MEMORY_BARRIER() __sync_synchronize()
+
+static float Decibels(float power)
+{
+    return power > 1e-10f ? 10.0f * log10f(power) : FLOOR_DB;
+}
+
+int SpeechMeterInit(SpeechMeter* meter, int sample_rate, size_t frame_length)
+{
+    size_t i;
+    int band;
+    float nyquist, ratio;
+    if (sample_rate < 8000 || frame_length < 64 || frame_length > SPEECH_METER_MAX_FRAME
+        || (frame_length & (frame_length - 1)) != 0)
+        return -1;
+    meter->sample_rate = sample_rate;
+    meter->frame_length = frame_length;
+    meter->position = 0;
+    for (i = 0; i < frame_length; i++)
+        meter->window[i] = 0.5f - 0.5f * cosf(2.0f * PI * (float)i / (float)frame_length);
+    for (i = 0; i < frame_length / 2; i++) {
+        meter->cos_table[i] = cosf(-2.0f * PI * (float)i / (float)frame_length);
+        meter->sin_table[i] = sinf(-2.0f * PI * (float)i / (float)frame_length);
+    }
+
+    // Logarithmic band edges up to the Nyquist frequency, each at least one
+    // bin wide.
+    nyquist = (float)sample_rate / 2.0f;
+    ratio = powf(nyquist / LOW_FREQUENCY, 1.0f / SPEECH_METER_BANDS);
+    for (band = 0; band <= SPEECH_METER_BANDS; band++) {
+        float frequency = LOW_FREQUENCY * powf(ratio, (float)band);
+        size_t bin = (size_t)(frequency * (float)frame_length / (float)sample_rate + 0.5f);
+        if (band > 0 && bin <= meter->band_start[band - 1])
+            bin = meter->band_start[band - 1] + 1;
+        meter->band_start[band] = bin;
+    }
+    if (meter->band_start[SPEECH_METER_BANDS] > frame_length / 2)
+        meter->band_start[SPEECH_METER_BANDS] = frame_length / 2;
+    for (band = SPEECH_METER_BANDS - 1; band >= 0; band--) {
+        if (meter->band_start[band] > meter->band_start[band + 1])
+            meter->band_start[band] = meter->band_start[band + 1];
+    }
+    return 0;
+}
+
+/* In-place radix-2 FFT of meter->re and meter->im, using the tables. */
+static void FFT(SpeechMeter* meter)
+{
+    float* re = meter->re;
+    float* im = meter->im;
+    size_t n = meter->frame_length;
+    size_t i, j, k, length;
+    for (i = 1, j = 0; i < n; i++) {
+        size_t bit = n >> 1;
+        for (; j & bit; bit >>= 1)
+            j ^= bit;
+        j |= bit;
+        if (i < j) {
+            float t = re[i]; re[i] = re[j]; re[j] = t;
+            t = im[i]; im[i] = im[j]; im[j] = t;
+        }
+    }
+    for (length = 2; length <= n; length <<= 1) {
+        size_t half = length / 2;
+        size_t stride = n / length;
+        for (i = 0; i < n; i += length) {
+            for (k = 0; k < half; k++) {
+                float wr = meter->cos_table[k * stride];
+                float wi = meter->sin_table[k * stride];
+                size_t a = i + k, b = a + half;
+                float tr = re[b] * wr - im[b] * wi;
+                float ti = re[b] * wi + im[b] * wr;
+                re[b] = re[a] - tr;
+                im[b] = im[a] - ti;
+                re[a] += tr;
+                im[a] += ti;
+            }
+        }
+    }
+}
+
+void SpeechMeterAnalyze(SpeechMeter* meter, const int16_t* samples, SpeechMeterFrame* frame)
+{
+    size_t n = meter->frame_length;
+    size_t i;
+    int64_t sum = 0;
+    int32_t peak = 0;
+    uint32_t clipped = 0;
+    float scale = 32768.0f * 32768.0f;
+    int band;
+
+    // Integer reductions, each in its own loop so each vectorizes.
+    for (i = 0; i < n; i++)
+        sum += (int32_t)samples[i] * samples[i];
+    for (i = 0; i < n; i++) {
+        int32_t magnitude = samples[i] < 0 ? -(int32_t)samples[i] : samples[i];
+        peak = magnitude > peak ? magnitude : peak;
+    }
+    for (i = 0; i < n; i++)
+        clipped += (samples[i] >= 32767 || samples[i] <= -32767);
+
+    frame->position = meter->position;
+    frame->rms_db = Decibels((float)sum / (float)n / scale);
+    frame->peak_db = Decibels((float)peak * (float)peak / scale);
+    frame->clipped = clipped;
+
+    for (i = 0; i < n; i++) {
+        meter->re[i] = (float)samples[i] * meter->window[i];
+        meter->im[i] = 0.0f;
+    }
+    FFT(meter);
+    // Scale so a full-scale sine in one band reads about 0 dB.
+    scale *= (float)n * (float)n / 16.0f;
+    for (band = 0; band < SPEECH_METER_BANDS; band++) {
+        float power = 0.0f;
+        for (i = meter->band_start[band]; i < meter->band_start[band + 1]; i++)
+            power += meter->re[i] * meter->re[i] + meter->im[i] * meter->im[i];
+        frame->bands_db[band] = Decibels(power / scale);
+    }
+    meter->position += n;
+}
+
+void SpeechMeterQueueInit(SpeechMeterQueue* queue)
+{
+    queue->head = 0;
+    queue->tail = 0;
+    queue->dropped = 0;
+    MEMORY_BARRIER();
+}
+
+int SpeechMeterQueuePush(SpeechMeterQueue* queue, const SpeechMeterFrame* frame)
+{
+    uint32_t tail = queue->tail;
+    if (tail - queue->head >= SPEECH_METER_QUEUE_CAPACITY) {
+        queue->dropped++;
+        return 0;
+    }
+    queue->frames[tail % SPEECH_METER_QUEUE_CAPACITY] = *frame;
+    MEMORY_BARRIER();
+    queue->tail = tail + 1;
+    return 1;
+}
+
+int SpeechMeterQueuePop(SpeechMeterQueue* queue, SpeechMeterFrame* frame)
+{
+    uint32_t head = queue->head;
+    if (head == queue->tail)
+        return 0;
+    MEMORY_BARRIER();
+    *frame = queue->frames[head % SPEECH_METER_QUEUE_CAPACITY];
+    MEMORY_BARRIER();
+    queue->head = head + 1;
+    return 1;
+}
@@ -0,0 +1,79 @@
+//  SpeechMeter.h
+//
+// Licensed by AT&T under 'Software Development Kit Tools Agreement' 2012.
+// TERMS AND CONDITIONS FOR USE, REPRODUCTION, AND DISTRIBUTION: http://developer.att.com/sdk_agreement/
+// Copyright 2012 AT&T Intellectual Property. All rights reserved.
+// For more information contact developer.support@att.com http://developer.att.com
+//
+// Per-frame audio levels and spectrum, cheap enough to compute on the audio
+// capture thread, and a lock-free queue to hand them to the main thread.
+// Neither the analysis nor the queue allocates, locks, or makes a system
+// call after initialization, so both are safe in a real-time audio
+// callback.  The level loops work on integers so the compiler can
+// vectorize them; the FFT uses tables built ahead of time.
+
+#ifndef SPEECH_METER_H
+#define SPEECH_METER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/** Longest frame, in samples: 64 ms at 16 kHz. **/
+#define SPEECH_METER_MAX_FRAME 1024
+
+/** Number of spectrum bands, spaced logarithmically from 100 Hz. **/
+#define SPEECH_METER_BANDS 16
+
+/** Frames the queue holds: over a second of 20 ms frames. **/
+#define SPEECH_METER_QUEUE_CAPACITY 64
+
+typedef struct SpeechMeterFrame {
+    uint64_t position;        /* index of the frame's first sample in the stream */
+    float rms_db;             /* RMS level, in dB relative to full scale */
+    float peak_db;            /* largest sample, in dB relative to full scale */
+    uint32_t clipped;         /* samples at full scale */
+    float bands_db[SPEECH_METER_BANDS]; /* energy of each band, in dB */
+} SpeechMeterFrame;
+
+typedef struct SpeechMeter {
+    int sample_rate;
+    size_t frame_length;      /* a power of two */
+    uint64_t position;
+    float window[SPEECH_METER_MAX_FRAME];
+    float cos_table[SPEECH_METER_MAX_FRAME / 2];
+    float sin_table[SPEECH_METER_MAX_FRAME / 2];
+    size_t band_start[SPEECH_METER_BANDS + 1]; /* first FFT bin of each band, and the end */
+    float re[SPEECH_METER_MAX_FRAME];
+    float im[SPEECH_METER_MAX_FRAME];
+} SpeechMeter;
+
+/** Prepares meter for frames of frame_length samples, a power of two from
+    64 to SPEECH_METER_MAX_FRAME.  Returns 0, or -1 if the arguments are
+    out of range.  This is the only call that does real work up front, so
+    make it off the audio thread. **/
+int SpeechMeterInit(SpeechMeter* meter, int sample_rate, size_t frame_length);
+
+/** Analyzes the next frame of meter->frame_length samples. **/
+void SpeechMeterAnalyze(SpeechMeter* meter, const int16_t* samples, SpeechMeterFrame* frame);
+
+/* Single-producer, single-consumer queue */
+
+typedef struct SpeechMeterQueue {
+    SpeechMeterFrame frames[SPEECH_METER_QUEUE_CAPACITY];
+    volatile uint32_t head;   /* next to read; written only by the consumer */
+    volatile uint32_t tail;   /* next to write; written only by the producer */
+    volatile uint32_t dropped; /* frames pushed while full; written only by the producer */
+} SpeechMeterQueue;
+
+/** Empties the queue.  Call it before either thread uses the queue. **/
+void SpeechMeterQueueInit(SpeechMeterQueue* queue);
+
+/** Adds a frame, from the producer thread only.  Returns 1, or 0 if the
+    queue is full and the frame was dropped. **/
+int SpeechMeterQueuePush(SpeechMeterQueue* queue, const SpeechMeterFrame* frame);
+
+/** Removes the oldest frame, from the consumer thread only.  Returns 1,
+    or 0 if the queue is empty. **/
+int SpeechMeterQueuePop(SpeechMeterQueue* queue, SpeechMeterFrame* frame);
+
+#endif
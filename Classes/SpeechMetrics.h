@@ -0,0 +1,68 @@
+//  SpeechMetrics.h
+//
+// Licensed by AT&T under 'Software Development Kit Tools Agreement' 2012.
+// TERMS AND CONDITIONS FOR USE, REPRODUCTION, AND DISTRIBUTION: http://developer.att.com/sdk_agreement/
+// Copyright 2012 AT&T Intellectual Property. All rights reserved.
+// For more information contact developer.support@att.com http://developer.att.com
+
+#import <Foundation/NSObject.h>
+#import <Foundation/NSDate.h>
+#include <stdint.h>
+
+@class NSDictionary, NSString;
+
+/**
+ * Counters and latency histograms for the health of speech and OAuth
+ * requests, kept in process and written out periodically for a collector.
+ *
+ * Each metric is split into per-thread shards updated with an atomic add,
+ * so threads rarely touch the same cache line and never take a lock; only
+ * the first use of a name takes one.  Names must be string literals or
+ * otherwise live forever, like SpeechTrace's.  Histograms have fixed
+ * millisecond buckets, from 1 ms to 30 s.
+ *
+ * The file format is the Prometheus text format, which collectors such
+ * as node_exporter's textfile collector can scrape.
+**/
+
+/** Most distinct metric names; updates to names past this are ignored. **/
+#define SPEECH_METRICS_CAPACITY 64
+
+/** Adds one to the counter. **/
+void SpeechMetricCount(const char* name);
+
+/** Adds amount to the counter. **/
+void SpeechMetricAdd(const char* name, int64_t amount);
+
+/** Records a latency in the histogram. **/
+void SpeechMetricRecord(const char* name, double milliseconds);
+
+/** Records the time since start, from SpeechTraceNow, in the histogram. **/
+void SpeechMetricTime(const char* name, uint64_t start);
+
+@interface SpeechMetrics : NSObject {
+}
+
+/** Current values: an NSNumber for each counter, and for each histogram a
+ *  dictionary with "count", "sum" in milliseconds, and "buckets", an array
+ *  of the counts at or below each of "bounds". **/
++ (NSDictionary*) snapshot;
+
+/** The current values in the Prometheus text format. **/
++ (NSString*) textFormat;
+
+/** Writes textFormat to a file, replacing it atomically, returning
+ *  whether it succeeded. **/
++ (BOOL) writeToFile: (NSString*) path;
+
+/** Writes to path now and every interval seconds from a background queue,
+ *  until stopFlushing. **/
++ (void) startFlushingToFile: (NSString*) path interval: (NSTimeInterval) interval;
+
+/** Stops periodic writing. **/
++ (void) stopFlushing;
+
+/** Sets every metric back to zero. **/
++ (void) reset;
+
+@end
@@ -0,0 +1,268 @@
+//  SpeechMetrics.m
+//
+// Licensed by AT&T under 'Software Development Kit Tools Agreement' 2012.
+// TERMS AND CONDITIONS FOR USE, REPRODUCTION, AND DISTRIBUTION: http://developer.att.com/sdk_agreement/
+// Copyright 2012 AT&T Intellectual Property. All rights reserved.
+// For more information contact developer.support@att.com http://developer.att.com
+
+#import "SpeechMetrics.h"
+#import "SpeechTrace.h"
+#include <libkern/OSAtomic.h>
+#include <pthread.h>
+#include <string.h>
+
+/** Tune the histogram buckets to the latencies of interest. **/
+static const double BUCKET_BOUNDS[] = { // milliseconds
+    1, 2, 5, 10, 20, 50, 100, 200, 500, 1000, 2000, 5000, 10000, 30000
+};
+#define BOUND_COUNT (sizeof(BUCKET_BOUNDS) / sizeof(BUCKET_BOUNDS[0]))
+#define BUCKET_COUNT (BOUND_COUNT + 1)
+
+/** Tune the shards to the number of threads that update metrics at once. **/
+#define SHARD_COUNT 4
+
+// Registry
+//
+// A metric's name is published with a barrier after its slot is set up, so
+// lookups need no lock: they scan the published names, comparing pointers
+// first, and only take the lock to add a name.  Each thread updates the
+// shard it was dealt on its first update, each shard on cache lines of its
+// own, and readers add the shards up.
+
+typedef struct MetricShard {
+    volatile int64_t count;
+    volatile int64_t sum;          /* microseconds, for histograms */
+    volatile int64_t buckets[BUCKET_COUNT];
+} __attribute__((aligned(64))) MetricShard;
+
+typedef struct Metric {
+    const char* name;
+    int histogram;
+    MetricShard shards[SHARD_COUNT];
+} Metric;
+
+static Metric Metrics[SPEECH_METRICS_CAPACITY];
+static volatile int32_t MetricCount = 0;
+static pthread_mutex_t RegistryLock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Each thread's shard index plus one, 0 until it has been dealt one. */
+static pthread_key_t ShardKey;
+static volatile int32_t NextShard = 0;
+
+/* Periodic flushing, used only on FlushQueue. */
+static dispatch_queue_t FlushQueue = NULL;
+static dispatch_source_t FlushTimer = NULL;
+
+static Metric* FindMetric(const char* name, int histogram)
+{
+    int32_t count = MetricCount;
+    int32_t i;
+    OSMemoryBarrier();
+    for (i = 0; i < count; i++) {
+        if (Metrics[i].name == name)
+            return &Metrics[i];
+    }
+
+    // Not seen by this pointer; the same name may have come from elsewhere.
+    Metric* metric = NULL;
+    pthread_mutex_lock(&RegistryLock);
+    count = MetricCount;
+    for (i = 0; i < count && metric == NULL; i++) {
+        if (strcmp(Metrics[i].name, name) == 0)
+            metric = &Metrics[i];
+    }
+    if (metric == NULL && count < SPEECH_METRICS_CAPACITY) {
+        metric = &Metrics[count];
+        metric->name = name;
+        metric->histogram = histogram;
+        OSMemoryBarrier();
+        MetricCount = count + 1;
+    }
+    pthread_mutex_unlock(&RegistryLock);
+    return metric;
+}
+
+static MetricShard* ThreadShard(Metric* metric)
+{
+    // Deal shards out in turn, so any few threads get different ones.
+    // Thread ports are no good for this: they are spaced by multiples of
+    // the shard count, so they all land on the same shard.
+    static dispatch_once_t once;
+    dispatch_once(&once, ^{
+        pthread_key_create(&ShardKey, NULL);
+    });
+    uintptr_t slot = (uintptr_t)pthread_getspecific(ShardKey);
+    if (slot == 0) {
+        slot = (uint32_t)OSAtomicIncrement32(&NextShard) % SHARD_COUNT + 1;
+        pthread_setspecific(ShardKey, (void*)slot);
+    }
+    return &metric->shards[slot - 1];
+}
+
+/* Reads a shard's value whole; a plain 64-bit load may tear on 32-bit ARM. */
+static int64_t AtomicRead(volatile int64_t* value)
+{
+    return OSAtomicAdd64(0, value);
+}
+
+void SpeechMetricCount(const char* name)
+{
+    SpeechMetricAdd(name, 1);
+}
+
+void SpeechMetricAdd(const char* name, int64_t amount)
+{
+    Metric* metric = FindMetric(name, 0);
+    if (metric != NULL)
+        OSAtomicAdd64(amount, &ThreadShard(metric)->count);
+}
+
+void SpeechMetricRecord(const char* name, double milliseconds)
+{
+    Metric* metric = FindMetric(name, 1);
+    if (metric == NULL)
+        return;
+    NSUInteger bucket = 0;
+    while (bucket < BOUND_COUNT && milliseconds > BUCKET_BOUNDS[bucket])
+        bucket++;
+    MetricShard* shard = ThreadShard(metric);
+    OSAtomicAdd64(1, &shard->buckets[bucket]);
+    OSAtomicAdd64((int64_t)(milliseconds * 1000.0), &shard->sum);
+    OSAtomicAdd64(1, &shard->count);
+}
+
+void SpeechMetricTime(const char* name, uint64_t start)
+{
+    SpeechMetricRecord(name, SpeechTraceMilliseconds(SpeechTraceNow() - start));
+}
+
+/* The name as a Prometheus metric name: letters, digits and underscores. */
+static NSString* ExportName(const char* name)
+{
+    NSMutableString* exported = [NSMutableString stringWithUTF8String: name];
+    for (NSUInteger i = 0; i < exported.length; i++) {
+        unichar c = [exported characterAtIndex: i];
+        if (!((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_'))
+            [exported replaceCharactersInRange: NSMakeRange(i, 1) withString: @"_"];
+    }
+    return exported;
+}
+
+@implementation SpeechMetrics
+
++ (NSDictionary*) snapshot
+{
+    NSMutableDictionary* snapshot = [NSMutableDictionary dictionary];
+    int32_t count = MetricCount;
+    OSMemoryBarrier();
+    NSMutableArray* bounds = [NSMutableArray arrayWithCapacity: BOUND_COUNT];
+    for (NSUInteger b = 0; b < BOUND_COUNT; b++)
+        [bounds addObject: [NSNumber numberWithDouble: BUCKET_BOUNDS[b]]];
+
+    for (int32_t i = 0; i < count; i++) {
+        Metric* metric = &Metrics[i];
+        int64_t total = 0, sum = 0;
+        int64_t buckets[BUCKET_COUNT] = { 0 };
+        for (int s = 0; s < SHARD_COUNT; s++) {
+            MetricShard* shard = &metric->shards[s];
+            total += AtomicRead(&shard->count);
+            sum += AtomicRead(&shard->sum);
+            for (NSUInteger b = 0; b < BUCKET_COUNT; b++)
+                buckets[b] += AtomicRead(&shard->buckets[b]);
+        }
+        NSString* name = [NSString stringWithUTF8String: metric->name];
+        if (!metric->histogram) {
+            [snapshot setObject: [NSNumber numberWithLongLong: total] forKey: name];
+            continue;
+        }
+        // Cumulative, as the Prometheus format has them.
+        NSMutableArray* cumulative = [NSMutableArray arrayWithCapacity: BOUND_COUNT];
+        int64_t running = 0;
+        for (NSUInteger b = 0; b < BOUND_COUNT; b++) {
+            running += buckets[b];
+            [cumulative addObject: [NSNumber numberWithLongLong: running]];
+        }
+        [snapshot setObject: [NSDictionary dictionaryWithObjectsAndKeys:
+                              [NSNumber numberWithLongLong: total], @"count",
+                              [NSNumber numberWithDouble: sum / 1000.0], @"sum",
+                              cumulative, @"buckets",
+                              bounds, @"bounds",
+                              nil]
+                     forKey: name];
+    }
+    return snapshot;
+}
+
++ (NSString*) textFormat
+{
+    NSDictionary* snapshot = [self snapshot];
+    NSMutableString* text = [NSMutableString string];
+    for (NSString* name in [[snapshot allKeys] sortedArrayUsingSelector: @selector(compare:)]) {
+        id value = [snapshot objectForKey: name];
+        NSString* exported = ExportName(name.UTF8String);
+        if (![value isKindOfClass: [NSDictionary class]]) {
+            [text appendFormat: @"# TYPE %@_total counter\n%@_total %@\n", exported, exported, value];
+            continue;
+        }
+        [text appendFormat: @"# TYPE %@_ms histogram\n", exported];
+        NSArray* bounds = [value objectForKey: @"bounds"];
+        NSArray* buckets = [value objectForKey: @"buckets"];
+        for (NSUInteger b = 0; b < bounds.count; b++)
+            [text appendFormat: @"%@_ms_bucket{le=\"%@\"} %@\n", exported,
+             [bounds objectAtIndex: b], [buckets objectAtIndex: b]];
+        [text appendFormat: @"%@_ms_bucket{le=\"+Inf\"} %@\n", exported, [value objectForKey: @"count"]];
+        [text appendFormat: @"%@_ms_sum %@\n%@_ms_count %@\n", exported, [value objectForKey: @"sum"],
+         exported, [value objectForKey: @"count"]];
+    }
+    return text;
+}
+
++ (BOOL) writeToFile: (NSString*) path
+{
+    return [[[self textFormat] dataUsingEncoding: NSUTF8StringEncoding] writeToFile: path atomically: YES];
+}
+
++ (void) startFlushingToFile: (NSString*) path interval: (NSTimeInterval) interval
+{
+    [self stopFlushing];
+    if (FlushQueue == NULL)
+        FlushQueue = dispatch_queue_create("SpeechMetrics", NULL);
+    path = [[path copy] autorelease];
+    dispatch_sync(FlushQueue, ^{
+        FlushTimer = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0, FlushQueue);
+        // Leeway lets the system batch the write with other wakeups.
+        dispatch_source_set_timer(FlushTimer, DISPATCH_TIME_NOW, (uint64_t)(interval * NSEC_PER_SEC),
+                                  (uint64_t)(interval * NSEC_PER_SEC / 10));
+        dispatch_source_set_event_handler(FlushTimer, ^{
+            NSAutoreleasePool* pool = [[NSAutoreleasePool alloc] init];
+            [self writeToFile: path];
+            [pool drain];
+        });
+        dispatch_resume(FlushTimer);
+    });
+}
+
++ (void) stopFlushing
+{
+    if (FlushQueue == NULL)
+        return;
+    dispatch_sync(FlushQueue, ^{
+        if (FlushTimer != NULL) {
+            dispatch_source_cancel(FlushTimer);
+            dispatch_release(FlushTimer);
+            FlushTimer = NULL;
+        }
+    });
+}
+
++ (void) reset
+{
+    int32_t count = MetricCount;
+    OSMemoryBarrier();
+    // Updates racing with the reset may survive it, which is harmless.
+    for (int32_t i = 0; i < count; i++)
+        memset((void*)Metrics[i].shards, 0, sizeof(Metrics[i].shards));
+    OSMemoryBarrier();
+}
+
+@end
@@ -0,0 +1,61 @@
+//  SpeechMockServer.h
+//
+// Licensed by AT&T under 'Software Development Kit Tools Agreement' 2012.
+// TERMS AND CONDITIONS FOR USE, REPRODUCTION, AND DISTRIBUTION: http://developer.att.com/sdk_agreement/
+// Copyright 2012 AT&T Intellectual Property. All rights reserved.
+// For more information contact developer.support@att.com http://developer.att.com
+
+#import <Foundation/NSURLProtocol.h>
+
+@class NSString, NSURL, NSData, NSURLRequest, NSError;
+
+/**
+ * Type of block that may answer a recognition request in place of the mock
+ * result: it returns the body and sets *status, or returns nil to let the
+ * server answer as usual.  A status of 0 fails the request instead, with
+ * *error if the block sets it, or as a dropped connection if not.
+ * Called on URL loading threads.
+**/
+typedef NSData* (^SpeechMockResponder)(NSURLRequest* request, NSInteger* status, NSError** error);
+
+/**
+ * A stand-in for the Speech API and its OAuth service that runs inside the
+ * app, for load testing and development without the live service.
+ *
+ * Once started, it answers every NSURLConnection request to its host:
+ * POSTs to a path ending in /oauth/token get a client-credentials token,
+ * and other POSTs get a recognition result if they carry that token.
+ * Responses are delayed to simulate the service's latency, and a fraction
+ * of them can fail, with HTTP 503 or a dropped connection, to exercise
+ * the client's error handling.
+ *
+ * Configure and start it from the main thread.
+**/
+@interface SpeechMockServer : NSURLProtocol {
+}
+
+/** Starts answering requests to host, such as @"speech.mock". **/
++ (void) startWithHost: (NSString*) host;
+
+/** Stops answering requests. **/
++ (void) stop;
+
+/** Base URLs of the mock services, while started. **/
++ (NSURL*) recognitionURL;
++ (NSURL*) oauthURL;
+
+/** Fixed delay before each response, plus a delay per kilobyte of request
+ *  body, simulating upload time.  A streamed body is read to its end to
+ *  count it.  Default to 0.2 and 0.001 seconds. **/
++ (void) setLatency: (NSTimeInterval) latency perKilobyte: (NSTimeInterval) perKilobyte;
+
+/** Fractions of recognition requests that get HTTP 503, and that lose
+ *  the connection.  Both default to 0. **/
++ (void) setServerErrorRate: (float) serverErrorRate connectionErrorRate: (float) connectionErrorRate;
+
+/** Sets the block asked first about each authorized recognition request,
+ *  such as to answer with recorded responses, or nil for none.  Its answers
+ *  take the place of the simulated errors. **/
++ (void) setResponder: (SpeechMockResponder) responder;
+
+@end
@@ -0,0 +1,292 @@
+//  SpeechMockServer.m
+//
+// Licensed by AT&T under 'Software Development Kit Tools Agreement' 2012.
+// TERMS AND CONDITIONS FOR USE, REPRODUCTION, AND DISTRIBUTION: http://developer.att.com/sdk_agreement/
+// Copyright 2012 AT&T Intellectual Property. All rights reserved.
+// For more information contact developer.support@att.com http://developer.att.com
+
+#import "SpeechMockServer.h"
+
+static const NSTimeInterval DEFAULT_LATENCY = 0.2; // seconds
+static const NSTimeInterval DEFAULT_LATENCY_PER_KB = 0.001; // seconds
+
+/** Lifetime of the tokens handed out, short enough to exercise refreshing
+    during a long run. **/
+static const NSTimeInterval TOKEN_LIFETIME = 600.0; // seconds
+
+static NSString* const TokenPrefix = @"mock-";
+
+// Settings, shared with the URL loading threads.  Guarded by the class.
+static NSString* mockHost = nil;
+static NSTimeInterval latency = DEFAULT_LATENCY;
+static NSTimeInterval latencyPerKilobyte = DEFAULT_LATENCY_PER_KB;
+static float serverErrorRate = 0.0f;
+static float connectionErrorRate = 0.0f;
+static SpeechMockResponder mockResponder = nil;
+
+/* Reads the request body to its end, as an upload would, returning its
+   length.  A streamed body, such as a file sent chunked, has no length
+   until it has been read. */
+static NSUInteger ReadBody(NSURLRequest* request)
+{
+    if (request.HTTPBody != nil)
+        return request.HTTPBody.length;
+    NSInputStream* stream = request.HTTPBodyStream;
+    if (stream == nil)
+        return 0;
+    uint8_t buffer[4096];
+    NSUInteger length = 0;
+    NSInteger got;
+    [stream open];
+    while ((got = [stream read: buffer maxLength: sizeof(buffer)]) > 0)
+        length += (NSUInteger)got;
+    [stream close];
+    return length;
+}
+
+/* A uniformly distributed number in [0, 1). */
+static float RandomFraction(void)
+{
+    return (float)arc4random_uniform(1000000) / 1000000.0f;
+}
+
+/**
+ * An HTTP response with a status code, which NSHTTPURLResponse can't be
+ * given directly before iOS 5.
+**/
+@interface SpeechMockHTTPResponse : NSHTTPURLResponse {
+    @private
+    NSInteger status;
+    NSDictionary* headers;
+}
+- (id) initWithURL: (NSURL*) url status: (NSInteger) aStatus contentType: (NSString*) contentType
+            length: (NSUInteger) length;
+@end
+
+@implementation SpeechMockHTTPResponse
+
+- (id) initWithURL: (NSURL*) url status: (NSInteger) aStatus contentType: (NSString*) contentType
+            length: (NSUInteger) length
+{
+    self = [super initWithURL: url MIMEType: contentType expectedContentLength: (NSInteger)length
+             textEncodingName: @"utf-8"];
+    if (self != nil) {
+        status = aStatus;
+        headers = [[NSDictionary alloc] initWithObjectsAndKeys:
+                   contentType, @"Content-Type",
+                   [NSString stringWithFormat: @"%lu", (unsigned long)length], @"Content-Length",
+                   nil];
+    }
+    return self;
+}
+
+- (void) dealloc
+{
+    [headers release];
+    [super dealloc];
+}
+
+- (NSInteger) statusCode
+{
+    return status;
+}
+
+- (NSDictionary*) allHeaderFields
+{
+    return headers;
+}
+
+@end
+
+#pragma mark -
+
+@interface SpeechMockServer () {
+    @private
+    NSUInteger bodyLength;
+}
+- (void) respond;
+- (void) respondWithStatus: (NSInteger) status JSON: (NSDictionary*) json;
+- (void) respondWithStatus: (NSInteger) status data: (NSData*) body;
+@end
+
+@implementation SpeechMockServer
+
++ (void) startWithHost: (NSString*) host
+{
+    @synchronized (self) {
+        [mockHost release];
+        mockHost = [host copy];
+    }
+    [NSURLProtocol registerClass: self];
+}
+
++ (void) stop
+{
+    [NSURLProtocol unregisterClass: self];
+    @synchronized (self) {
+        [mockHost release];
+        mockHost = nil;
+    }
+}
+
++ (NSURL*) recognitionURL
+{
+    @synchronized (self) {
+        if (mockHost == nil)
+            return nil;
+        return [NSURL URLWithString: [NSString stringWithFormat: @"https://%@/speech/v3/speechToText", mockHost]];
+    }
+}
+
++ (NSURL*) oauthURL
+{
+    @synchronized (self) {
+        if (mockHost == nil)
+            return nil;
+        return [NSURL URLWithString: [NSString stringWithFormat: @"https://%@/oauth/token", mockHost]];
+    }
+}
+
++ (void) setLatency: (NSTimeInterval) newLatency perKilobyte: (NSTimeInterval) perKilobyte
+{
+    @synchronized (self) {
+        latency = newLatency;
+        latencyPerKilobyte = perKilobyte;
+    }
+}
+
++ (void) setServerErrorRate: (float) newServerErrorRate connectionErrorRate: (float) newConnectionErrorRate
+{
+    @synchronized (self) {
+        serverErrorRate = newServerErrorRate;
+        connectionErrorRate = newConnectionErrorRate;
+    }
+}
+
++ (void) setResponder: (SpeechMockResponder) responder
+{
+    @synchronized (self) {
+        [mockResponder release];
+        mockResponder = [responder copy];
+    }
+}
+
+#pragma mark -
+#pragma mark NSURLProtocol
+
++ (BOOL) canInitWithRequest: (NSURLRequest*) request
+{
+    @synchronized (self) {
+        return mockHost != nil && [request.URL.host isEqualToString: mockHost];
+    }
+}
+
++ (NSURLRequest*) canonicalRequestForRequest: (NSURLRequest*) request
+{
+    return request;
+}
+
+- (void) startLoading
+{
+    // Uploading takes longer for more audio.
+    bodyLength = ReadBody(self.request);
+    NSTimeInterval delay;
+    @synchronized ([self class]) {
+        delay = latency + latencyPerKilobyte * (NSTimeInterval)bodyLength / 1024.0;
+    }
+    // Respond on this loading thread's run loop, as a network load would.
+    [self performSelector: @selector(respond) withObject: nil afterDelay: delay
+                  inModes: [NSArray arrayWithObject: NSRunLoopCommonModes]];
+}
+
+- (void) stopLoading
+{
+    [NSObject cancelPreviousPerformRequestsWithTarget: self selector: @selector(respond) object: nil];
+}
+
+- (void) respond
+{
+    NSURLRequest* request = self.request;
+    if ([request.URL.path hasSuffix: @"/oauth/token"]) {
+        CFUUIDRef uuid = CFUUIDCreate(NULL);
+        NSString* token = [TokenPrefix stringByAppendingString: [(NSString*)CFUUIDCreateString(NULL, uuid) autorelease]];
+        CFRelease(uuid);
+        [self respondWithStatus: 200 JSON: [NSDictionary dictionaryWithObjectsAndKeys:
+            token, @"access_token",
+            [NSString stringWithFormat: @"%.0f", TOKEN_LIFETIME], @"expires_in",
+            [TokenPrefix stringByAppendingString: @"refresh"], @"refresh_token",
+            nil]];
+        return;
+    }
+
+    NSString* authorization = [request valueForHTTPHeaderField: @"Authorization"];
+    if (![authorization hasPrefix: [@"Bearer " stringByAppendingString: TokenPrefix]]) {
+        [self respondWithStatus: 401 JSON: [NSDictionary dictionaryWithObject: @"invalid token" forKey: @"error"]];
+        return;
+    }
+
+    float serverErrors, connectionErrors;
+    SpeechMockResponder responder;
+    @synchronized ([self class]) {
+        serverErrors = serverErrorRate;
+        connectionErrors = connectionErrorRate;
+        responder = [[mockResponder retain] autorelease];
+    }
+    if (responder != nil) {
+        NSInteger status = 200;
+        NSError* error = nil;
+        NSData* body = responder(request, &status, &error);
+        if (body != nil && status == 0) {
+            if (error == nil)
+                error = [NSError errorWithDomain: NSURLErrorDomain code: NSURLErrorNetworkConnectionLost userInfo: nil];
+            [self.client URLProtocol: self didFailWithError: error];
+            return;
+        }
+        if (body != nil) {
+            [self respondWithStatus: status data: body];
+            return;
+        }
+    }
+
+    float roll = RandomFraction();
+    if (roll < connectionErrors) {
+        NSError* error = [NSError errorWithDomain: NSURLErrorDomain code: NSURLErrorNetworkConnectionLost userInfo: nil];
+        [self.client URLProtocol: self didFailWithError: error];
+        return;
+    }
+    if (roll < connectionErrors + serverErrors) {
+        [self respondWithStatus: 503 JSON: [NSDictionary dictionaryWithObject: @"overloaded" forKey: @"error"]];
+        return;
+    }
+
+    NSString* hypothesis = [NSString stringWithFormat: @"mock result %lu", (unsigned long)bodyLength];
+    NSDictionary* nbest = [NSDictionary dictionaryWithObjectsAndKeys:
+                           hypothesis, @"Hypothesis",
+                           hypothesis, @"ResultText",
+                           [NSNumber numberWithFloat: 0.9f], @"Confidence",
+                           @"accept", @"Grade",
+                           @"en-US", @"LanguageId",
+                           nil];
+    NSDictionary* recognition = [NSDictionary dictionaryWithObjectsAndKeys:
+                                 @"OK", @"Status",
+                                 [NSArray arrayWithObject: nbest], @"NBest",
+                                 nil];
+    [self respondWithStatus: 200 JSON: [NSDictionary dictionaryWithObject: recognition forKey: @"Recognition"]];
+}
+
+- (void) respondWithStatus: (NSInteger) status JSON: (NSDictionary*) json
+{
+    [self respondWithStatus: status data: [NSJSONSerialization dataWithJSONObject: json options: 0 error: NULL]];
+}
+
+- (void) respondWithStatus: (NSInteger) status data: (NSData*) body
+{
+    NSURLResponse* response = [[[SpeechMockHTTPResponse alloc] initWithURL: self.request.URL status: status
+                                                               contentType: @"application/json"
+                                                                    length: body.length] autorelease];
+    [self.client URLProtocol: self didReceiveResponse: response cacheStoragePolicy: NSURLCacheStorageNotAllowed];
+    [self.client URLProtocol: self didLoadData: body];
+    [self.client URLProtocolDidFinishLoading: self];
+}
+
+@end
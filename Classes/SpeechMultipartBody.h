@@ -0,0 +1,74 @@
+//  SpeechMultipartBody.h
+//
+// Licensed by AT&T under 'Software Development Kit Tools Agreement' 2012.
+// TERMS AND CONDITIONS FOR USE, REPRODUCTION, AND DISTRIBUTION: http://developer.att.com/sdk_agreement/
+// Copyright 2012 AT&T Intellectual Property. All rights reserved.
+// For more information contact developer.support@att.com http://developer.att.com
+
+#import <Foundation/NSObject.h>
+
+@class NSString, NSData, NSInputStream;
+
+/**
+ * Builds a MIME multipart request body, such as inline grammars followed by
+ * audio, without concatenating the parts.
+ *
+ * Each part is kept as the NSData it was added with, retained rather than
+ * copied, so one grammar can be shared by many bodies at once.  Files are
+ * memory-mapped, so their pages are read only as they are sent.  The body
+ * is streamed straight from those buffers, part by part; the headers and
+ * boundaries are the only bytes this object creates.
+ *
+ * Use SpeechMultipartBody only from the main thread.
+**/
+@interface SpeechMultipartBody : NSObject {
+}
+
+/** Creates an empty multipart/x-srgs-audio body, the type the Speech API
+ *  expects for inline grammars and hints. **/
++ (SpeechMultipartBody*) body;
+
+/** Creates an empty body of the given multipart subtype, such as @"form-data". **/
++ (SpeechMultipartBody*) bodyWithSubtype: (NSString*) subtype;
+
+/** The boundary between parts, chosen at random. **/
+@property (readonly, copy) NSString* boundary;
+
+/** The value for the Content-Type header, including the boundary. **/
+@property (readonly) NSString* contentType;
+
+/** The total length of the body in bytes. **/
+@property (readonly) unsigned long long contentLength;
+
+/** Number of parts added so far. **/
+@property (readonly) NSUInteger partCount;
+
+/** Adds a part holding partData, which must not be changed afterward.
+ *  disposition is the value of the Content-Disposition header, such as
+ *  @"form-data; name=\"x-grammar\"". **/
+- (void) addPart: (NSData*) partData
+     contentType: (NSString*) contentType
+     disposition: (NSString*) disposition;
+
+/** Adds a part holding the contents of a file, mapped rather than read.
+ *  Returns NO if the file can't be opened. **/
+- (BOOL) addPartWithFile: (NSString*) path
+             contentType: (NSString*) contentType
+             disposition: (NSString*) disposition;
+
+/** Calls block with the header block and the data of each part, in order.
+ *  The header block starts with the part's boundary line. **/
+- (void) enumeratePartsUsingBlock: (void (^)(NSData* headers, NSData* partData)) block;
+
+/** Returns a new, unopened stream of the whole body, for an NSURLRequest's
+ *  HTTPBodyStream.  Each call starts over from the beginning.  The stream
+ *  is fed from the current run loop, in its common modes, for as long as
+ *  the body exists or until closeStreams. **/
+- (NSInputStream*) inputStream;
+
+/** Stops feeding the streams returned so far, ending them early and
+ *  releasing what they hold.  Call it when their request is canceled or
+ *  done, or a stream is being replaced. **/
+- (void) closeStreams;
+
+@end
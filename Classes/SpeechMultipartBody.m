@@ -0,0 +1,249 @@
+//  SpeechMultipartBody.m
+//
+// Licensed by AT&T under 'Software Development Kit Tools Agreement' 2012.
+// TERMS AND CONDITIONS FOR USE, REPRODUCTION, AND DISTRIBUTION: http://developer.att.com/sdk_agreement/
+// Copyright 2012 AT&T Intellectual Property. All rights reserved.
+// For more information contact developer.support@att.com http://developer.att.com
+
+#import "SpeechMultipartBody.h"
+
+/** Tune the stream buffer: larger means fewer run loop passes per body,
+    smaller means less memory held per request. **/
+static const NSUInteger STREAM_BUFFER_SIZE = 64 * 1024;
+
+// Memory Management
+//
+// The bound pair's output stream doesn't retain its delegate, so the body
+// keeps each SpeechMultipartWriter it makes until the writer finishes or
+// the body is done with its streams.  A stream that is never read, such as
+// one replaced when a connection resends the body, then doesn't hold its
+// writer and parts forever.  Writers are scheduled in the common modes, so
+// uploads go on while the UI is tracking a touch.
+
+/**
+ * Copies a list of buffers into the output end of a bound stream pair as
+ * space becomes available.
+**/
+@interface SpeechMultipartWriter : NSObject <NSStreamDelegate> {
+    @private
+    NSArray* segments;
+    NSUInteger segmentIndex;
+    NSUInteger segmentOffset;
+    NSOutputStream* output;
+}
+- (id) initWithSegments: (NSArray*) someSegments output: (NSOutputStream*) anOutput;
+- (BOOL) isClosed;
+- (void) close;
+@end
+
+@implementation SpeechMultipartWriter
+
+- (id) initWithSegments: (NSArray*) someSegments output: (NSOutputStream*) anOutput
+{
+    self = [super init];
+    if (self != nil) {
+        segments = [someSegments copy];
+        output = [anOutput retain];
+        output.delegate = self;
+        [output scheduleInRunLoop: [NSRunLoop currentRunLoop] forMode: NSRunLoopCommonModes];
+        [output open];
+    }
+    return self;
+}
+
+- (void) dealloc
+{
+    [self close];
+    [segments release];
+    [output release];
+    [super dealloc];
+}
+
+- (BOOL) isClosed
+{
+    return output.delegate == nil;
+}
+
+- (void) close
+{
+    if (output.delegate == nil)
+        return;
+    output.delegate = nil;
+    [output removeFromRunLoop: [NSRunLoop currentRunLoop] forMode: NSRunLoopCommonModes];
+    [output close];
+    // Let go of the parts now rather than when the body prunes us.
+    [segments release];
+    segments = nil;
+}
+
+- (void) stream: (NSStream*) stream handleEvent: (NSStreamEvent) event
+{
+    if (event == NSStreamEventHasSpaceAvailable) {
+        // Write straight from the part's own bytes, which for a mapped file
+        // faults its pages in only now.
+        while (segmentIndex < segments.count && output.hasSpaceAvailable) {
+            NSData* segment = [segments objectAtIndex: segmentIndex];
+            if (segmentOffset < segment.length) {
+                NSInteger written = [output write: (const uint8_t*)segment.bytes + segmentOffset
+                                        maxLength: segment.length - segmentOffset];
+                if (written < 0) {
+                    [self close];
+                    return;
+                }
+                if (written == 0)
+                    break;
+                segmentOffset += (NSUInteger)written;
+            }
+            if (segmentOffset >= segment.length) {
+                segmentIndex++;
+                segmentOffset = 0;
+            }
+        }
+        if (segmentIndex >= segments.count)
+            [self close];
+    }
+    else if (event == NSStreamEventErrorOccurred || event == NSStreamEventEndEncountered) {
+        // The reader went away.
+        [self close];
+    }
+}
+
+@end
+
+#pragma mark -
+
+@interface SpeechMultipartBody ()
+@property (readwrite, copy) NSString* boundary;
+@property (copy) NSString* subtype;
+@property (retain) NSMutableArray* segments; // of NSData, without the closing boundary
+@property (retain) NSMutableArray* writers;  // of SpeechMultipartWriter, feeding streams
+@property (readwrite) NSUInteger partCount;
+@end
+
+@implementation SpeechMultipartBody
+
+@synthesize boundary = _boundary;
+@synthesize subtype = _subtype;
+@synthesize segments = _segments;
+@synthesize writers = _writers;
+@synthesize partCount = _partCount;
+
++ (SpeechMultipartBody*) body
+{
+    return [self bodyWithSubtype: @"x-srgs-audio"];
+}
+
++ (SpeechMultipartBody*) bodyWithSubtype: (NSString*) subtype
+{
+    SpeechMultipartBody* body = [[[self alloc] init] autorelease];
+    body.subtype = subtype;
+    return body;
+}
+
+- (id) init
+{
+    self = [super init];
+    if (self != nil) {
+        self.boundary = [NSString stringWithFormat: @"----SpeechBoundary%08x%08x",
+                         arc4random(), arc4random()];
+        self.segments = [NSMutableArray array];
+        self.writers = [NSMutableArray array];
+    }
+    return self;
+}
+
+- (void) dealloc
+{
+    self.boundary = nil;
+    self.subtype = nil;
+    self.segments = nil;
+    [self closeStreams];
+    self.writers = nil;
+    [super dealloc];
+}
+
+- (NSString*) contentType
+{
+    return [NSString stringWithFormat: @"multipart/%@; boundary=%@", _subtype, _boundary];
+}
+
+- (NSData*) closingBoundary
+{
+    return [[NSString stringWithFormat: @"--%@--\r\n", _boundary] dataUsingEncoding: NSUTF8StringEncoding];
+}
+
+- (unsigned long long) contentLength
+{
+    unsigned long long length = [self closingBoundary].length;
+    for (NSData* segment in _segments)
+        length += segment.length;
+    return length;
+}
+
+- (void) addPart: (NSData*) partData
+     contentType: (NSString*) contentType
+     disposition: (NSString*) disposition
+{
+    NSMutableString* header = [NSMutableString stringWithFormat: @"--%@\r\n", _boundary];
+    if (contentType != nil)
+        [header appendFormat: @"Content-Type: %@\r\n", contentType];
+    if (disposition != nil)
+        [header appendFormat: @"Content-Disposition: %@\r\n", disposition];
+    [header appendString: @"\r\n"];
+    [_segments addObject: [header dataUsingEncoding: NSUTF8StringEncoding]];
+    [_segments addObject: partData != nil ? partData : [NSData data]];
+    [_segments addObject: [NSData dataWithBytes: "\r\n" length: 2]];
+    self.partCount = _partCount + 1;
+}
+
+- (BOOL) addPartWithFile: (NSString*) path
+             contentType: (NSString*) contentType
+             disposition: (NSString*) disposition
+{
+    NSData* partData = [NSData dataWithContentsOfFile: path options: NSDataReadingMappedIfSafe error: NULL];
+    if (partData == nil)
+        return NO;
+    [self addPart: partData contentType: contentType disposition: disposition];
+    return YES;
+}
+
+- (void) enumeratePartsUsingBlock: (void (^)(NSData* headers, NSData* partData)) block
+{
+    // Each part is its header, its data, and a line break.
+    for (NSUInteger i = 0; i + 1 < _segments.count; i += 3)
+        block([_segments objectAtIndex: i], [_segments objectAtIndex: i + 1]);
+}
+
+- (NSInputStream*) inputStream
+{
+    CFReadStreamRef readStream = NULL;
+    CFWriteStreamRef writeStream = NULL;
+    CFStreamCreateBoundPair(NULL, &readStream, &writeStream, STREAM_BUFFER_SIZE);
+    if (readStream == NULL || writeStream == NULL) {
+        if (readStream != NULL)
+            CFRelease(readStream);
+        if (writeStream != NULL)
+            CFRelease(writeStream);
+        return nil;
+    }
+    // Forget the writers whose streams are done.
+    for (NSInteger i = (NSInteger)_writers.count - 1; i >= 0; i--) {
+        if ([[_writers objectAtIndex: (NSUInteger)i] isClosed])
+            [_writers removeObjectAtIndex: (NSUInteger)i];
+    }
+    NSArray* segments = [_segments arrayByAddingObject: [self closingBoundary]];
+    SpeechMultipartWriter* writer = [[SpeechMultipartWriter alloc] initWithSegments: segments
+                                                                             output: (NSOutputStream*)writeStream];
+    [_writers addObject: writer];
+    [writer release];
+    CFRelease(writeStream);
+    return [(NSInputStream*)readStream autorelease];
+}
+
+- (void) closeStreams
+{
+    [_writers makeObjectsPerformSelector: @selector(close)];
+    [_writers removeAllObjects];
+}
+
+@end
@@ -0,0 +1,358 @@
+//  SpeechPCM.c
+//
+// Licensed by AT&T under 'Software Development Kit Tools Agreement' 2012.
+// TERMS AND CONDITIONS FOR USE, REPRODUCTION, AND DISTRIBUTION: http://developer.att.com/sdk_agreement/
+// Copyright 2012 AT&T Intellectual Property. All rights reserved.
+// For more information contact developer.support@att.com http://developer.att.com
+
+#include "SpeechPCM.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+/** Tune the resampler quality: zero crossings of the sinc on each side.
+    More is sharper and slower. **/
+static const int RESAMPLER_ZERO_CROSSINGS = 8;
+
+/** Tune the resampler cutoff as a fraction of the output Nyquist rate. **/
+static const double RESAMPLER_CUTOFF = 0.92;
+
+/** Input samples the resampler and encoder take at a time. **/
+#define BLOCK_LENGTH 1024
+
+static const double PI = 3.14159265358979323846;
+
+void SpeechPCMFromInt16(const int16_t* in, float* out, size_t count)
+{
+    size_t i;
+    for (i = 0; i < count; i++)
+        out[i] = (float)in[i] * (1.0f / 32768.0f);
+}
+
+void SpeechPCMToInt16(const float* in, int16_t* out, size_t count)
+{
+    size_t i;
+    for (i = 0; i < count; i++) {
+        float x = in[i] * 32768.0f;
+        x = x > 32767.0f ? 32767.0f : x;
+        x = x < -32768.0f ? -32768.0f : x;
+        out[i] = (int16_t)lrintf(x);
+    }
+}
+
+void SpeechPCMDownmix(const int16_t* in, int channels, float* out, size_t frames)
+{
+    float scale = 1.0f / (32768.0f * (float)channels);
+    size_t i;
+    int c;
+    if (channels == 1) {
+        SpeechPCMFromInt16(in, out, frames);
+        return;
+    }
+    for (i = 0; i < frames; i++) {
+        int sum = 0;
+        for (c = 0; c < channels; c++)
+            sum += in[i * (size_t)channels + (size_t)c];
+        out[i] = (float)sum * scale;
+    }
+}
+
+/* Resampler */
+
+// The stream is conceptually upsampled by L, lowpass filtered, and
+// downsampled by M.  Only the filter taps that land on real input samples
+// are ever computed, so each output is a single dot product of taps
+// contiguous input samples with one of L phases of the filter.
+
+struct SpeechResampler {
+    int up;                 /* L */
+    int down;               /* M */
+    int taps;               /* taps per phase */
+    float* coefficients;    /* up phases of taps, each reversed for a forward dot product */
+    float* buffer;          /* taps - 1 samples of history, then new input */
+    size_t count;           /* samples in buffer */
+    size_t next;            /* buffer index of the newest input the next output uses */
+    int phase;              /* phase of the next output */
+};
+
+static int GreatestCommonDivisor(int a, int b)
+{
+    while (b != 0) {
+        int t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+static int DesignFilter(SpeechResampler* resampler)
+{
+    int up = resampler->up, taps = resampler->taps;
+    int length = up * taps;
+    // Cutoff in cycles per upsampled sample, below both Nyquist rates.
+    double cutoff = 0.5 * RESAMPLER_CUTOFF / (double)(up > resampler->down ? up : resampler->down);
+    double center = (double)(length - 1) / 2.0;
+    double sum = 0.0;
+    int i, p, j;
+    float* prototype = (float*)malloc(sizeof(float) * (size_t)length);
+    if (prototype == NULL)
+        return 0;
+    for (i = 0; i < length; i++) {
+        double t = (double)i - center;
+        double sinc = (t == 0.0) ? 2.0 * cutoff : sin(2.0 * PI * cutoff * t) / (PI * t);
+        // Blackman window
+        double w = 0.42 - 0.5 * cos(2.0 * PI * (i + 0.5) / length) + 0.08 * cos(4.0 * PI * (i + 0.5) / length);
+        prototype[i] = (float)(sinc * w);
+        sum += sinc * w;
+    }
+    // Each phase then sums to about one, so levels are preserved.
+    for (p = 0; p < up; p++)
+        for (j = 0; j < taps; j++)
+            resampler->coefficients[p * taps + (taps - 1 - j)] =
+                (float)(prototype[p + j * up] * up / sum);
+    free(prototype);
+    return 1;
+}
+
+SpeechResampler* SpeechResamplerCreate(int in_rate, int out_rate)
+{
+    SpeechResampler* resampler;
+    int divisor, up, down, taps;
+    if (in_rate <= 0 || out_rate <= 0)
+        return NULL;
+    divisor = GreatestCommonDivisor(in_rate, out_rate);
+    up = out_rate / divisor;
+    down = in_rate / divisor;
+    if (up > SPEECH_RESAMPLER_MAX_PHASES)
+        return NULL;
+    // Widen the filter in proportion to how far it must cut below the input rate.
+    taps = 2 * RESAMPLER_ZERO_CROSSINGS * (down > up ? (down + up - 1) / up : 1);
+
+    resampler = (SpeechResampler*)calloc(1, sizeof(SpeechResampler));
+    if (resampler == NULL)
+        return NULL;
+    resampler->up = up;
+    resampler->down = down;
+    resampler->taps = taps;
+    resampler->coefficients = (float*)calloc((size_t)(up * taps), sizeof(float));
+    resampler->buffer = (float*)calloc((size_t)taps - 1 + BLOCK_LENGTH, sizeof(float));
+    if (resampler->coefficients == NULL || resampler->buffer == NULL || !DesignFilter(resampler)) {
+        SpeechResamplerDestroy(resampler);
+        return NULL;
+    }
+    // Start with silence as history.
+    resampler->count = (size_t)taps - 1;
+    resampler->next = (size_t)taps - 1;
+    return resampler;
+}
+
+void SpeechResamplerDestroy(SpeechResampler* resampler)
+{
+    if (resampler == NULL)
+        return;
+    free(resampler->coefficients);
+    free(resampler->buffer);
+    free(resampler);
+}
+
+size_t SpeechResamplerMaxOutput(const SpeechResampler* resampler, size_t in_count)
+{
+    return in_count * (size_t)resampler->up / (size_t)resampler->down + 1;
+}
+
+static float DotProduct(const float* a, const float* b, int count)
+{
+    float sum = 0.0f;
+    int i;
+    for (i = 0; i < count; i++)
+        sum += a[i] * b[i];
+    return sum;
+}
+
+size_t SpeechResamplerProcess(SpeechResampler* resampler,
+                              const float* in, size_t in_count, float* out)
+{
+    size_t written = 0;
+    size_t history = (size_t)resampler->taps - 1;
+    while (in_count > 0) {
+        size_t chunk = in_count < BLOCK_LENGTH ? in_count : BLOCK_LENGTH;
+        size_t drop;
+        memcpy(resampler->buffer + resampler->count, in, chunk * sizeof(float));
+        resampler->count += chunk;
+        in += chunk;
+        in_count -= chunk;
+
+        while (resampler->next < resampler->count) {
+            out[written++] = DotProduct(resampler->buffer + resampler->next - history,
+                                        resampler->coefficients + resampler->phase * resampler->taps,
+                                        resampler->taps);
+            resampler->phase += resampler->down;
+            resampler->next += (size_t)(resampler->phase / resampler->up);
+            resampler->phase %= resampler->up;
+        }
+
+        // Keep only the history the next outputs need.
+        drop = resampler->count - history;
+        memmove(resampler->buffer, resampler->buffer + drop, history * sizeof(float));
+        resampler->count = history;
+        resampler->next -= drop;
+    }
+    return written;
+}
+
+/* Automatic gain control */
+
+void SpeechAGCInit(SpeechAGC* agc)
+{
+    agc->target = 0.1f;      // -20 dBFS
+    agc->max_gain = 15.85f;  // +24 dB
+    agc->gate = 0.0018f;     // -55 dBFS
+    agc->attack = 0.5f;
+    agc->release = 0.05f;
+    agc->gain = 1.0f;
+}
+
+void SpeechAGCProcess(SpeechAGC* agc, float* samples, size_t count)
+{
+    float sum = 0.0f, rms, desired, gain, step;
+    size_t i;
+    if (count == 0)
+        return;
+    for (i = 0; i < count; i++)
+        sum += samples[i] * samples[i];
+    rms = sqrtf(sum / (float)count);
+
+    // Hold the gain through silence, so background noise isn't pumped up.
+    desired = agc->gain;
+    if (rms > agc->gate) {
+        desired = agc->target / rms;
+        desired = desired > agc->max_gain ? agc->max_gain : desired;
+    }
+    gain = agc->gain;
+    agc->gain += (desired - gain) * (desired < gain ? agc->attack : agc->release);
+
+    // Ramp to the new gain across the block to avoid zipper noise.
+    step = (agc->gain - gain) / (float)count;
+    for (i = 0; i < count; i++) {
+        float x = samples[i] * (gain + step * (float)i);
+        x = x > 1.0f ? 1.0f : x;
+        x = x < -1.0f ? -1.0f : x;
+        samples[i] = x;
+    }
+}
+
+/* Encoder */
+
+struct SpeechPCMEncoder {
+    int channels;
+    int out_rate;
+    SpeechResampler* resampler;  /* NULL if the rates match */
+    int use_agc;
+    SpeechAGC agc;
+    size_t agc_block;            /* 10 ms of output */
+    int wrote_header;
+    uint32_t data_length;
+    float* mono;
+    float* resampled;
+    int16_t* pcm;
+};
+
+SpeechPCMEncoder* SpeechPCMEncoderCreate(int in_rate, int in_channels,
+                                         int out_rate, int use_agc)
+{
+    SpeechPCMEncoder* encoder;
+    size_t resampled_length = BLOCK_LENGTH;
+    if (in_channels < 1 || out_rate <= 0)
+        return NULL;
+    encoder = (SpeechPCMEncoder*)calloc(1, sizeof(SpeechPCMEncoder));
+    if (encoder == NULL)
+        return NULL;
+    encoder->channels = in_channels;
+    encoder->out_rate = out_rate;
+    encoder->use_agc = use_agc;
+    SpeechAGCInit(&encoder->agc);
+    encoder->agc_block = (size_t)out_rate / 100;
+    if (in_rate != out_rate) {
+        encoder->resampler = SpeechResamplerCreate(in_rate, out_rate);
+        if (encoder->resampler == NULL) {
+            SpeechPCMEncoderDestroy(encoder);
+            return NULL;
+        }
+        resampled_length = SpeechResamplerMaxOutput(encoder->resampler, BLOCK_LENGTH);
+    }
+    encoder->mono = (float*)malloc(sizeof(float) * BLOCK_LENGTH);
+    encoder->resampled = (float*)malloc(sizeof(float) * resampled_length);
+    encoder->pcm = (int16_t*)malloc(sizeof(int16_t) * resampled_length);
+    if (encoder->mono == NULL || encoder->resampled == NULL || encoder->pcm == NULL) {
+        SpeechPCMEncoderDestroy(encoder);
+        return NULL;
+    }
+    return encoder;
+}
+
+void SpeechPCMEncoderDestroy(SpeechPCMEncoder* encoder)
+{
+    if (encoder == NULL)
+        return;
+    SpeechResamplerDestroy(encoder->resampler);
+    free(encoder->mono);
+    free(encoder->resampled);
+    free(encoder->pcm);
+    free(encoder);
+}
+
+size_t SpeechPCMEncoderMaxOutput(const SpeechPCMEncoder* encoder, size_t frames)
+{
+    size_t blocks = (frames + BLOCK_LENGTH - 1) / BLOCK_LENGTH;
+    size_t samples = frames;
+    if (encoder->resampler != NULL)
+        samples = SpeechResamplerMaxOutput(encoder->resampler, frames) + blocks;
+    return SPEECH_WAV_HEADER_LENGTH + samples * 2;
+}
+
+size_t SpeechPCMEncoderEncode(SpeechPCMEncoder* encoder,
+                              const int16_t* in, size_t frames, uint8_t* out)
+{
+    size_t written = 0;
+    if (!encoder->wrote_header) {
+        SpeechWAVWriteHeader(out, encoder->out_rate, 0xFFFFFFFF);
+        encoder->wrote_header = 1;
+        written = SPEECH_WAV_HEADER_LENGTH;
+    }
+    while (frames > 0) {
+        size_t chunk = frames < BLOCK_LENGTH ? frames : BLOCK_LENGTH;
+        float* samples = encoder->mono;
+        size_t count = chunk;
+        size_t i;
+
+        SpeechPCMDownmix(in, encoder->channels, encoder->mono, chunk);
+        if (encoder->resampler != NULL) {
+            count = SpeechResamplerProcess(encoder->resampler, encoder->mono, chunk, encoder->resampled);
+            samples = encoder->resampled;
+        }
+        if (encoder->use_agc) {
+            for (i = 0; i < count; i += encoder->agc_block) {
+                size_t length = count - i < encoder->agc_block ? count - i : encoder->agc_block;
+                SpeechAGCProcess(&encoder->agc, samples + i, length);
+            }
+        }
+        SpeechPCMToInt16(samples, encoder->pcm, count);
+        // WAV samples are little-endian regardless of the host.
+        for (i = 0; i < count; i++) {
+            uint16_t sample = (uint16_t)encoder->pcm[i];
+            out[written + 2 * i] = (uint8_t)sample;
+            out[written + 2 * i + 1] = (uint8_t)(sample >> 8);
+        }
+        written += count * 2;
+        encoder->data_length += (uint32_t)(count * 2);
+        in += chunk * (size_t)encoder->channels;
+        frames -= chunk;
+    }
+    return written;
+}
+
+void SpeechPCMEncoderFinalHeader(const SpeechPCMEncoder* encoder,
+                                 uint8_t header[SPEECH_WAV_HEADER_LENGTH])
+{
+    SpeechWAVWriteHeader(header, encoder->out_rate, encoder->data_length);
+}
@@ -0,0 +1,100 @@
+//  SpeechPCM.h
+//
+// Licensed by AT&T under 'Software Development Kit Tools Agreement' 2012.
+// TERMS AND CONDITIONS FOR USE, REPRODUCTION, AND DISTRIBUTION: http://developer.att.com/sdk_agreement/
+// Copyright 2012 AT&T Intellectual Property. All rights reserved.
+// For more information contact developer.support@att.com http://developer.att.com
+//
+// Converts recorded PCM audio into the formats the Speech API accepts, for
+// audio sent with SpeechRequest or ATTSpeechService startWithAudioData:.
+// A polyphase resampler takes 44.1 or 48 kHz audio down to 8 kHz
+// (ATTSKAudioFormatWAV_NB) or 16 kHz (ATTSKAudioFormatWAV_WB), automatic
+// gain control evens out the level, and the encoder chains these into a
+// streaming WAV writer.
+// Plain C; memory is allocated only when an object is created, and the
+// inner loops are contiguous multiply-adds the compiler can vectorize.
+
+#ifndef SPEECH_PCM_H
+#define SPEECH_PCM_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "SpeechWAV.h"
+
+/** Converts 16-bit samples to floats in [-1, 1). **/
+void SpeechPCMFromInt16(const int16_t* in, float* out, size_t count);
+
+/** Converts floats to 16-bit samples, clipping anything out of range. **/
+void SpeechPCMToInt16(const float* in, int16_t* out, size_t count);
+
+/** Averages interleaved 16-bit frames of the given channel count to mono floats. **/
+void SpeechPCMDownmix(const int16_t* in, int channels, float* out, size_t frames);
+
+/* Resampler */
+
+typedef struct SpeechResampler SpeechResampler;
+
+#define SPEECH_RESAMPLER_MAX_PHASES 512
+
+/** Creates a resampler between two rates whose ratio reduces to at most
+    SPEECH_RESAMPLER_MAX_PHASES upsampling phases, which covers the common
+    audio rates.  Returns NULL if the ratio is unsupported or memory runs out. **/
+SpeechResampler* SpeechResamplerCreate(int in_rate, int out_rate);
+
+void SpeechResamplerDestroy(SpeechResampler* resampler);
+
+/** The most samples one call with in_count samples can produce. **/
+size_t SpeechResamplerMaxOutput(const SpeechResampler* resampler, size_t in_count);
+
+/** Resamples the next in_count samples of the stream, returning the number
+    of samples written to out.  Output lags input by half the filter length. **/
+size_t SpeechResamplerProcess(SpeechResampler* resampler,
+                              const float* in, size_t in_count, float* out);
+
+/* Automatic gain control */
+
+typedef struct SpeechAGC {
+    float target;          /* RMS level to aim for, linear */
+    float max_gain;        /* largest gain applied, linear */
+    float gate;            /* RMS below which audio is treated as silence */
+    float attack;          /* fraction of the way to a lower gain per block */
+    float release;         /* fraction of the way to a higher gain per block */
+    float gain;            /* current gain */
+} SpeechAGC;
+
+/** Sets up agc with defaults: -20 dBFS target, at most +24 dB of gain,
+    a -55 dBFS silence gate, fast attack and slow release. **/
+void SpeechAGCInit(SpeechAGC* agc);
+
+/** Adjusts the level of a block of samples in place.  Blocks of 10-20 ms
+    give the smoothest result.  The gain ramps across the block, and the
+    output is limited to [-1, 1]. **/
+void SpeechAGCProcess(SpeechAGC* agc, float* samples, size_t count);
+
+/* Encoder */
+
+typedef struct SpeechPCMEncoder SpeechPCMEncoder;
+
+/** Creates an encoder from interleaved 16-bit audio at in_rate with
+    in_channels channels to 16-bit mono WAV at out_rate, with or without
+    automatic gain control.  Returns NULL if the rates are unsupported. **/
+SpeechPCMEncoder* SpeechPCMEncoderCreate(int in_rate, int in_channels,
+                                         int out_rate, int use_agc);
+
+void SpeechPCMEncoderDestroy(SpeechPCMEncoder* encoder);
+
+/** The most bytes one call with the given number of input frames can produce. **/
+size_t SpeechPCMEncoderMaxOutput(const SpeechPCMEncoder* encoder, size_t frames);
+
+/** Encodes the next frames of input, writing bytes ready to send or store
+    to out and returning how many.  The first call begins with a WAV header
+    whose length is left open, as for a chunked upload. **/
+size_t SpeechPCMEncoderEncode(SpeechPCMEncoder* encoder,
+                              const int16_t* in, size_t frames, uint8_t* out);
+
+/** Writes a header with the true data length of everything encoded so far,
+    to overwrite the start of a finished file. **/
+void SpeechPCMEncoderFinalHeader(const SpeechPCMEncoder* encoder,
+                                 uint8_t header[SPEECH_WAV_HEADER_LENGTH]);
+
+#endif
@@ -0,0 +1,70 @@
+//  SpeechRecorder.h
+//
+// Licensed by AT&T under 'Software Development Kit Tools Agreement' 2012.
+// TERMS AND CONDITIONS FOR USE, REPRODUCTION, AND DISTRIBUTION: http://developer.att.com/sdk_agreement/
+// Copyright 2012 AT&T Intellectual Property. All rights reserved.
+// For more information contact developer.support@att.com http://developer.att.com
+
+#import <Foundation/NSObject.h>
+#include <stdint.h>
+
+@class NSString, NSData, NSError, NSURLRequest;
+
+/**
+ * Records speech interactions to a file in the SpeechRecording format, so
+ * they can be replayed later with SpeechReplayer: the request headers and
+ * audio, the parts of multipart bodies, state transitions, and the server's
+ * response or the error, each stamped with the time since recording began.
+ *
+ * SpeechRequest records itself while the shared recorder is recording, and
+ * so does everything built on it.  ATTSpeechService keeps its audio to
+ * itself, so its interactions are recorded as states and responses only.
+ * A SpeechRequest answered from its result cache is recorded as the request
+ * it stood in for, a "cached" state, and the cached result as a 200 response.
+ *
+ * Audio sent as a whole body is retained rather than copied, and records
+ * are written from a background queue.  The Authorization header is never
+ * recorded.
+ *
+ * Use SpeechRecorder only from the main thread.
+**/
+@interface SpeechRecorder : NSObject {
+}
+
+/** The recorder shared by the whole app. **/
++ (SpeechRecorder*) sharedRecorder;
+
+/** Whether records are being written. **/
+@property (readonly) BOOL isRecording;
+
+/** Starts a new recording, replacing the file at path.  Returns NO if it
+ *  can't be created. **/
+- (BOOL) startRecordingToFile: (NSString*) path;
+
+/** Finishes the recording, writing its index.  Call it before the app may
+ *  be terminated, such as on entering the background. **/
+- (void) stopRecording;
+
+/** Returns a new interaction number to tag records with, or 0 if not
+ *  recording.  The methods below ignore interaction 0. **/
+- (uint64_t) beginInteraction;
+
+/** Records the URL and headers of request, and its HTTPBody as audio. **/
+- (void) recordRequest: (NSURLRequest*) request interaction: (uint64_t) interaction;
+
+/** Records audio sent in the request body. **/
+- (void) recordAudio: (NSData*) audio interaction: (uint64_t) interaction;
+
+/** Records one part of a multipart body: its header block and its data. **/
+- (void) recordPartHeaders: (NSData*) headers data: (NSData*) partData interaction: (uint64_t) interaction;
+
+/** Records entering the named state. **/
+- (void) recordState: (NSString*) state interaction: (uint64_t) interaction;
+
+/** Records the HTTP status and body of the response. **/
+- (void) recordResponseStatus: (NSInteger) status data: (NSData*) data interaction: (uint64_t) interaction;
+
+/** Records an error that ended the interaction without a response. **/
+- (void) recordError: (NSError*) error interaction: (uint64_t) interaction;
+
+@end
@@ -0,0 +1,177 @@
+//  SpeechRecorder.m
+//
+// Licensed by AT&T under 'Software Development Kit Tools Agreement' 2012.
+// TERMS AND CONDITIONS FOR USE, REPRODUCTION, AND DISTRIBUTION: http://developer.att.com/sdk_agreement/
+// Copyright 2012 AT&T Intellectual Property. All rights reserved.
+// For more information contact developer.support@att.com http://developer.att.com
+
+#import "SpeechRecorder.h"
+#import "SpeechRecording.h"
+#include <mach/mach_time.h>
+
+@interface SpeechRecorder () {
+    @private
+    dispatch_queue_t queue;
+    SpeechRecordingWriter* writer; // used only on queue
+    uint64_t startTime;
+    uint64_t lastInteraction;
+    NSUInteger recordingNumber; // counts recordings started
+}
+@property (readwrite) BOOL isRecording;
+- (void) append: (SpeechRecordingType) type data: (NSData*) data interaction: (uint64_t) interaction;
+@end
+
+static uint64_t Microseconds(uint64_t time)
+{
+    static mach_timebase_info_data_t timebase;
+    static dispatch_once_t once;
+    dispatch_once(&once, ^{
+        mach_timebase_info(&timebase);
+    });
+    return time * timebase.numer / timebase.denom / 1000;
+}
+
+@implementation SpeechRecorder
+
+@synthesize isRecording = _isRecording;
+
++ (SpeechRecorder*) sharedRecorder
+{
+    static SpeechRecorder* shared = nil;
+    if (shared == nil)
+        shared = [[SpeechRecorder alloc] init];
+    return shared;
+}
+
+- (id) init
+{
+    self = [super init];
+    if (self != nil)
+        queue = dispatch_queue_create("SpeechRecorder", NULL);
+    return self;
+}
+
+- (void) dealloc
+{
+    [self stopRecording];
+    dispatch_release(queue);
+    [super dealloc];
+}
+
+- (BOOL) startRecordingToFile: (NSString*) path
+{
+    [self stopRecording];
+    const char* filePath = path.fileSystemRepresentation;
+    __block BOOL created = NO;
+    dispatch_sync(queue, ^{
+        writer = SpeechRecordingCreate(filePath);
+        created = (writer != NULL);
+    });
+    if (!created)
+        return NO;
+    startTime = mach_absolute_time();
+    recordingNumber++;
+    self.isRecording = YES;
+    return YES;
+}
+
+- (void) stopRecording
+{
+    if (!_isRecording)
+        return;
+    self.isRecording = NO;
+    // Runs after every record already queued.
+    dispatch_sync(queue, ^{
+        if (writer != NULL && SpeechRecordingFinish(writer) != 0)
+            NSLog(@"SpeechRecorder couldn't write the index; the file will be scanned instead");
+        writer = NULL;
+    });
+}
+
+- (uint64_t) beginInteraction
+{
+    return _isRecording ? ++lastInteraction : 0;
+}
+
+- (void) append: (SpeechRecordingType) type data: (NSData*) data interaction: (uint64_t) interaction
+{
+    if (interaction == 0 || !_isRecording || data.length > UINT32_MAX)
+        return;
+    uint64_t timestamp = Microseconds(mach_absolute_time() - startTime);
+    // Immutable data is only retained; a mutable buffer, such as the
+    // response a request goes on reusing, is copied.
+    data = [[data copy] autorelease];
+    NSUInteger recording = recordingNumber;
+    dispatch_async(queue, ^{
+        if (writer == NULL)
+            return;
+        if (SpeechRecordingAppend(writer, interaction, type, timestamp, data.bytes, (uint32_t)data.length) != 0) {
+            // Most likely the disk is full; keep what was written.
+            NSLog(@"SpeechRecorder couldn't write; recording stopped");
+            SpeechRecordingFinish(writer);
+            writer = NULL;
+            // Unless a new recording has started since.
+            dispatch_async(dispatch_get_main_queue(), ^{
+                if (recording == recordingNumber)
+                    self.isRecording = NO;
+            });
+        }
+    });
+}
+
+- (void) recordRequest: (NSURLRequest*) request interaction: (uint64_t) interaction
+{
+    if (interaction == 0)
+        return;
+    NSMutableString* text = [NSMutableString stringWithFormat: @"%@ %@\r\n",
+                             request.HTTPMethod, request.URL.absoluteString];
+    NSDictionary* fields = request.allHTTPHeaderFields;
+    for (NSString* field in [[fields allKeys] sortedArrayUsingSelector: @selector(compare:)]) {
+        if ([field caseInsensitiveCompare: @"Authorization"] != NSOrderedSame)
+            [text appendFormat: @"%@: %@\r\n", field, [fields objectForKey: field]];
+    }
+    [self append: SpeechRecordingTypeRequest data: [text dataUsingEncoding: NSUTF8StringEncoding]
+     interaction: interaction];
+    if (request.HTTPBody != nil)
+        [self recordAudio: request.HTTPBody interaction: interaction];
+}
+
+- (void) recordAudio: (NSData*) audio interaction: (uint64_t) interaction
+{
+    [self append: SpeechRecordingTypeAudio data: audio interaction: interaction];
+}
+
+- (void) recordPartHeaders: (NSData*) headers data: (NSData*) partData interaction: (uint64_t) interaction
+{
+    if (interaction == 0)
+        return;
+    NSMutableData* part = [NSMutableData dataWithCapacity: headers.length + partData.length];
+    [part appendData: headers];
+    [part appendData: partData];
+    [self append: SpeechRecordingTypePart data: part interaction: interaction];
+}
+
+- (void) recordState: (NSString*) state interaction: (uint64_t) interaction
+{
+    [self append: SpeechRecordingTypeState data: [state dataUsingEncoding: NSUTF8StringEncoding]
+     interaction: interaction];
+}
+
+- (void) recordResponseStatus: (NSInteger) status data: (NSData*) data interaction: (uint64_t) interaction
+{
+    if (interaction == 0)
+        return;
+    uint8_t bytes[4] = { (uint8_t)status, (uint8_t)(status >> 8), (uint8_t)(status >> 16), (uint8_t)(status >> 24) };
+    NSMutableData* response = [NSMutableData dataWithBytes: bytes length: sizeof(bytes)];
+    [response appendData: data];
+    [self append: SpeechRecordingTypeResponse data: response interaction: interaction];
+}
+
+- (void) recordError: (NSError*) error interaction: (uint64_t) interaction
+{
+    NSString* text = [NSString stringWithFormat: @"%@ %ld", error.domain, (long)error.code];
+    [self append: SpeechRecordingTypeError data: [text dataUsingEncoding: NSUTF8StringEncoding]
+     interaction: interaction];
+}
+
+@end
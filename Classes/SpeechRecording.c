@@ -0,0 +1,306 @@
+//  SpeechRecording.c
+//
+// Licensed by AT&T under 'Software Development Kit Tools Agreement' 2012.
+// TERMS AND CONDITIONS FOR USE, REPRODUCTION, AND DISTRIBUTION: http://developer.att.com/sdk_agreement/
+// Copyright 2012 AT&T Intellectual Property. All rights reserved.
+// For more information contact developer.support@att.com http://developer.att.com
+
+// pread is POSIX rather than C99, so ask for it before any system header.
+#define _XOPEN_SOURCE 700
+
+#include "SpeechRecording.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define FILE_HEADER_LENGTH 8
+#define RECORD_HEADER_LENGTH 24
+#define INDEX_ENTRY_LENGTH 32
+#define TRAILER_LENGTH 24
+
+static const uint8_t FILE_MAGIC[4] = { 'S', 'P', 'R', 'C' };
+static const uint8_t INDEX_MAGIC[4] = { 'S', 'P', 'R', 'X' };
+static const uint32_t VERSION = 1;
+
+struct SpeechRecordingWriter {
+    int fd;
+    uint64_t position;      /* bytes actually written, even by a failed write */
+    int failed;             /* set by a failed write; nothing more is appended */
+    SpeechRecordingEntry* entries;
+    size_t count;
+    size_t capacity;
+};
+
+struct SpeechRecordingReader {
+    int fd;
+    SpeechRecordingEntry* entries;
+    size_t count;
+};
+
+static void PutU32(uint8_t* bytes, uint32_t value)
+{
+    bytes[0] = (uint8_t)value;
+    bytes[1] = (uint8_t)(value >> 8);
+    bytes[2] = (uint8_t)(value >> 16);
+    bytes[3] = (uint8_t)(value >> 24);
+}
+
+static void PutU64(uint8_t* bytes, uint64_t value)
+{
+    PutU32(bytes, (uint32_t)value);
+    PutU32(bytes + 4, (uint32_t)(value >> 32));
+}
+
+static uint32_t GetU32(const uint8_t* bytes)
+{
+    return (uint32_t)bytes[0] | (uint32_t)bytes[1] << 8 | (uint32_t)bytes[2] << 16 | (uint32_t)bytes[3] << 24;
+}
+
+static uint64_t GetU64(const uint8_t* bytes)
+{
+    return (uint64_t)GetU32(bytes) | (uint64_t)GetU32(bytes + 4) << 32;
+}
+
+/* Writes all of length bytes, retrying after interruptions and short
+   writes, and adds the bytes written to *position even if it fails. */
+static int WriteAll(int fd, const void* bytes, size_t length, uint64_t* position)
+{
+    const uint8_t* next = bytes;
+    while (length > 0) {
+        ssize_t written = write(fd, next, length);
+        if (written < 0 && errno == EINTR)
+            continue;
+        if (written <= 0)
+            return -1;
+        next += written;
+        length -= (size_t)written;
+        *position += (uint64_t)written;
+    }
+    return 0;
+}
+
+/* Reads all of length bytes at offset.  Returns -1 at the end of the file. */
+static int ReadAll(int fd, void* bytes, size_t length, uint64_t offset)
+{
+    uint8_t* next = bytes;
+    while (length > 0) {
+        ssize_t got = pread(fd, next, length, (off_t)offset);
+        if (got < 0 && errno == EINTR)
+            continue;
+        if (got <= 0)
+            return -1;
+        next += got;
+        length -= (size_t)got;
+        offset += (uint64_t)got;
+    }
+    return 0;
+}
+
+static int AddEntry(SpeechRecordingEntry** entries, size_t* count, size_t* capacity,
+                    const SpeechRecordingEntry* entry)
+{
+    if (*count == *capacity) {
+        size_t grown = *capacity ? *capacity * 2 : 256;
+        SpeechRecordingEntry* resized;
+        if (grown > SIZE_MAX / sizeof(SpeechRecordingEntry))
+            return -1;
+        resized = realloc(*entries, grown * sizeof(SpeechRecordingEntry));
+        if (resized == NULL)
+            return -1;
+        *entries = resized;
+        *capacity = grown;
+    }
+    (*entries)[(*count)++] = *entry;
+    return 0;
+}
+
+SpeechRecordingWriter* SpeechRecordingCreate(const char* path)
+{
+    uint8_t header[FILE_HEADER_LENGTH];
+    SpeechRecordingWriter* writer = calloc(1, sizeof(SpeechRecordingWriter));
+    if (writer == NULL)
+        return NULL;
+    writer->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    memcpy(header, FILE_MAGIC, 4);
+    PutU32(header + 4, VERSION);
+    if (writer->fd < 0 || WriteAll(writer->fd, header, sizeof(header), &writer->position) != 0) {
+        if (writer->fd >= 0)
+            close(writer->fd);
+        free(writer);
+        return NULL;
+    }
+    return writer;
+}
+
+int SpeechRecordingAppend(SpeechRecordingWriter* writer, uint64_t interaction,
+                          SpeechRecordingType type, uint64_t timestamp,
+                          const void* payload, uint32_t length)
+{
+    uint8_t header[RECORD_HEADER_LENGTH];
+    SpeechRecordingEntry entry;
+    if (writer->failed)
+        return -1;
+    PutU32(header, (uint32_t)type);
+    PutU32(header + 4, length);
+    PutU64(header + 8, interaction);
+    PutU64(header + 16, timestamp);
+    entry.offset = writer->position + RECORD_HEADER_LENGTH;
+    entry.interaction = interaction;
+    entry.timestamp = timestamp;
+    entry.type = (uint32_t)type;
+    entry.length = length;
+    // A torn record stays out of the index, which still starts where the
+    // file really ends, so the records before it can be read.
+    if (WriteAll(writer->fd, header, sizeof(header), &writer->position) != 0
+        || WriteAll(writer->fd, payload, length, &writer->position) != 0) {
+        writer->failed = 1;
+        return -1;
+    }
+    return AddEntry(&writer->entries, &writer->count, &writer->capacity, &entry);
+}
+
+int SpeechRecordingFinish(SpeechRecordingWriter* writer)
+{
+    uint8_t bytes[INDEX_ENTRY_LENGTH];
+    uint8_t trailer[TRAILER_LENGTH];
+    uint64_t index_offset = writer->position;
+    size_t i;
+    int result = 0;
+    for (i = 0; i < writer->count && result == 0; i++) {
+        const SpeechRecordingEntry* entry = &writer->entries[i];
+        PutU64(bytes, entry->offset);
+        PutU64(bytes + 8, entry->interaction);
+        PutU64(bytes + 16, entry->timestamp);
+        PutU32(bytes + 24, entry->type);
+        PutU32(bytes + 28, entry->length);
+        result = WriteAll(writer->fd, bytes, sizeof(bytes), &writer->position);
+    }
+    PutU64(trailer, index_offset);
+    PutU64(trailer + 8, (uint64_t)writer->count);
+    memcpy(trailer + 16, INDEX_MAGIC, 4);
+    PutU32(trailer + 20, VERSION);
+    if (result == 0)
+        result = WriteAll(writer->fd, trailer, sizeof(trailer), &writer->position);
+    if (close(writer->fd) != 0)
+        result = -1;
+    free(writer->entries);
+    free(writer);
+    return result;
+}
+
+/* Loads the index from the trailer.  Returns -1 if there's no valid one. */
+static int LoadIndex(SpeechRecordingReader* reader, uint64_t size)
+{
+    uint8_t trailer[TRAILER_LENGTH];
+    uint8_t* bytes;
+    uint64_t index_offset, count, i;
+    if (size < FILE_HEADER_LENGTH + TRAILER_LENGTH
+        || ReadAll(reader->fd, trailer, sizeof(trailer), size - TRAILER_LENGTH) != 0
+        || memcmp(trailer + 16, INDEX_MAGIC, 4) != 0)
+        return -1;
+    index_offset = GetU64(trailer);
+    count = GetU64(trailer + 8);
+    if (index_offset < FILE_HEADER_LENGTH || count > (size - index_offset) / INDEX_ENTRY_LENGTH
+        || index_offset + count * INDEX_ENTRY_LENGTH + TRAILER_LENGTH != size
+        || count > SIZE_MAX / INDEX_ENTRY_LENGTH)
+        return -1;
+
+    bytes = malloc((size_t)count * INDEX_ENTRY_LENGTH + 1);
+    reader->entries = malloc((size_t)count * sizeof(SpeechRecordingEntry) + 1);
+    if (bytes == NULL || reader->entries == NULL
+        || ReadAll(reader->fd, bytes, (size_t)count * INDEX_ENTRY_LENGTH, index_offset) != 0) {
+        free(bytes);
+        return -1;
+    }
+    for (i = 0; i < count; i++) {
+        const uint8_t* entry = bytes + i * INDEX_ENTRY_LENGTH;
+        SpeechRecordingEntry* out = &reader->entries[i];
+        out->offset = GetU64(entry);
+        out->interaction = GetU64(entry + 8);
+        out->timestamp = GetU64(entry + 16);
+        out->type = GetU32(entry + 24);
+        out->length = GetU32(entry + 28);
+        if (out->offset < FILE_HEADER_LENGTH + RECORD_HEADER_LENGTH
+            || out->offset + out->length > index_offset) {
+            free(bytes);
+            return -1;
+        }
+    }
+    free(bytes);
+    reader->count = (size_t)count;
+    return 0;
+}
+
+/* Builds the index by walking the record headers, up to a torn record. */
+static int ScanRecords(SpeechRecordingReader* reader, uint64_t size)
+{
+    uint8_t header[RECORD_HEADER_LENGTH];
+    uint64_t position = FILE_HEADER_LENGTH;
+    size_t capacity = 0;
+    free(reader->entries);
+    reader->entries = NULL;
+    reader->count = 0;
+    while (position + RECORD_HEADER_LENGTH <= size
+           && ReadAll(reader->fd, header, sizeof(header), position) == 0) {
+        SpeechRecordingEntry entry;
+        entry.type = GetU32(header);
+        entry.length = GetU32(header + 4);
+        entry.interaction = GetU64(header + 8);
+        entry.timestamp = GetU64(header + 16);
+        entry.offset = position + RECORD_HEADER_LENGTH;
+        if (entry.type < SpeechRecordingTypeRequest || entry.type > SpeechRecordingTypeError
+            || entry.offset + entry.length > size)
+            break;
+        if (AddEntry(&reader->entries, &reader->count, &capacity, &entry) != 0)
+            return -1;
+        position = entry.offset + entry.length;
+    }
+    return 0;
+}
+
+SpeechRecordingReader* SpeechRecordingOpen(const char* path)
+{
+    uint8_t header[FILE_HEADER_LENGTH];
+    struct stat info;
+    SpeechRecordingReader* reader = calloc(1, sizeof(SpeechRecordingReader));
+    if (reader == NULL)
+        return NULL;
+    reader->fd = open(path, O_RDONLY);
+    if (reader->fd < 0 || fstat(reader->fd, &info) != 0
+        || ReadAll(reader->fd, header, sizeof(header), 0) != 0
+        || memcmp(header, FILE_MAGIC, 4) != 0 || GetU32(header + 4) != VERSION
+        || (LoadIndex(reader, (uint64_t)info.st_size) != 0
+            && ScanRecords(reader, (uint64_t)info.st_size) != 0)) {
+        SpeechRecordingClose(reader);
+        return NULL;
+    }
+    return reader;
+}
+
+size_t SpeechRecordingCount(const SpeechRecordingReader* reader)
+{
+    return reader->count;
+}
+
+const SpeechRecordingEntry* SpeechRecordingEntryAt(const SpeechRecordingReader* reader, size_t i)
+{
+    return &reader->entries[i];
+}
+
+int SpeechRecordingRead(const SpeechRecordingReader* reader, const SpeechRecordingEntry* entry, void* buffer)
+{
+    return ReadAll(reader->fd, buffer, entry->length, entry->offset);
+}
+
+void SpeechRecordingClose(SpeechRecordingReader* reader)
+{
+    if (reader == NULL)
+        return;
+    if (reader->fd >= 0)
+        close(reader->fd);
+    free(reader->entries);
+    free(reader);
+}
@@ -0,0 +1,81 @@
+//  SpeechRecording.h
+//
+// Licensed by AT&T under 'Software Development Kit Tools Agreement' 2012.
+// TERMS AND CONDITIONS FOR USE, REPRODUCTION, AND DISTRIBUTION: http://developer.att.com/sdk_agreement/
+// Copyright 2012 AT&T Intellectual Property. All rights reserved.
+// For more information contact developer.support@att.com http://developer.att.com
+//
+// The binary file format of recorded speech interactions, for replaying
+// them later.  A file is an 8-byte header ("SPRC" and a version), then
+// records, each a 24-byte header (type, payload length, interaction, and
+// microseconds since recording started) and its payload, then an index of
+// every record and a 24-byte trailer pointing at the index.  All integers
+// are little-endian.
+//
+// The index lets a reader find any record without reading the others, so
+// recordings of any size can be opened in constant memory per record and
+// read with random access.  A file whose writer never finished, such as
+// after a crash, has no index; the reader then walks the record headers,
+// skipping the payloads, and stops at a torn record.
+//
+// Plain C and POSIX file calls, so tools off the device can read it too.
+
+#ifndef SPEECH_RECORDING_H
+#define SPEECH_RECORDING_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef enum SpeechRecordingType {
+    SpeechRecordingTypeRequest = 1,   /* "POST url", then the header lines, CRLF-separated */
+    SpeechRecordingTypeAudio = 2,     /* the request body */
+    SpeechRecordingTypePart = 3,      /* a multipart part: its header block, through CRLF CRLF, then its data */
+    SpeechRecordingTypeState = 4,     /* the name of the state entered */
+    SpeechRecordingTypeResponse = 5,  /* the HTTP status as 4 bytes, then the body */
+    SpeechRecordingTypeError = 6      /* "domain code" */
+} SpeechRecordingType;
+
+typedef struct SpeechRecordingEntry {
+    uint64_t offset;          /* file offset of the payload */
+    uint64_t interaction;
+    uint64_t timestamp;       /* microseconds since recording started */
+    uint32_t type;
+    uint32_t length;          /* bytes of payload */
+} SpeechRecordingEntry;
+
+typedef struct SpeechRecordingWriter SpeechRecordingWriter;
+typedef struct SpeechRecordingReader SpeechRecordingReader;
+
+/** Creates or truncates the file at path for writing.  Returns NULL if it
+    can't be opened. **/
+SpeechRecordingWriter* SpeechRecordingCreate(const char* path);
+
+/** Appends a record.  Returns 0, or -1 if the write failed, after which
+ *  every append fails; the records before it are still indexed. **/
+int SpeechRecordingAppend(SpeechRecordingWriter* writer, uint64_t interaction,
+                          SpeechRecordingType type, uint64_t timestamp,
+                          const void* payload, uint32_t length);
+
+/** Writes the index, closes the file, and frees writer.  Returns 0, or -1
+    if the index couldn't be written; the records are still readable. **/
+int SpeechRecordingFinish(SpeechRecordingWriter* writer);
+
+/** Opens a recording for reading, loading only its index.  Returns NULL if
+    the file can't be opened or isn't a recording. **/
+SpeechRecordingReader* SpeechRecordingOpen(const char* path);
+
+/** Number of records, in the order they were written. **/
+size_t SpeechRecordingCount(const SpeechRecordingReader* reader);
+
+/** The index entry of record i, which is less than the count. **/
+const SpeechRecordingEntry* SpeechRecordingEntryAt(const SpeechRecordingReader* reader, size_t i);
+
+/** Reads the payload of entry into buffer, which holds entry->length
+    bytes.  Safe to call from several threads at once.  Returns 0, or -1
+    if the read failed. **/
+int SpeechRecordingRead(const SpeechRecordingReader* reader, const SpeechRecordingEntry* entry, void* buffer);
+
+/** Closes the file and frees reader. **/
+void SpeechRecordingClose(SpeechRecordingReader* reader);
+
+#endif
@@ -0,0 +1,85 @@
+//  SpeechReplayer.h
+//
+// Licensed by AT&T under 'Software Development Kit Tools Agreement' 2012.
+// TERMS AND CONDITIONS FOR USE, REPRODUCTION, AND DISTRIBUTION: http://developer.att.com/sdk_agreement/
+// Copyright 2012 AT&T Intellectual Property. All rights reserved.
+// For more information contact developer.support@att.com http://developer.att.com
+
+#import <Foundation/NSObject.h>
+#import "SpeechMockServer.h"
+
+@class NSString, NSURL, NSDictionary;
+@class SpeechAuth;
+
+/**
+ * Type of block called when a replay ends.  report holds "interactions",
+ * the number in the recording; "replayed"; "skipped", those without
+ * recorded audio or over the limit of outstanding requests; "succeeded"
+ * and "failed"; "matched", "mismatched", and "unverified", comparing each
+ * outcome with the recorded one, which is unverified if the original was
+ * canceled; "mismatches", the numbers of the first interactions that
+ * differed; "elapsed"; and "recordedLatency" and "replayedLatency", each
+ * with "mean" and "max" in milliseconds.
+**/
+typedef void (^SpeechReplayReportBlock)(NSDictionary* report);
+
+/**
+ * Replays the interactions in a SpeechRecorder file as SpeechRequests,
+ * with their recorded headers and audio or multipart bodies, and compares
+ * what comes back with what was recorded, to reproduce field problems and
+ * to catch regressions.
+ *
+ * Interactions start at their recorded times, relative to the first, or
+ * back to back as fast as the limit of outstanding requests allows.  Only
+ * the recording's index is kept in memory; audio is read from the file
+ * when its request starts, so recordings of any size can be replayed.
+ *
+ * Against SpeechMockServer, with tagsRequests set and recordedResponder
+ * installed, every request gets its recorded response, so a replay gives
+ * the same results every time.
+ *
+ * Use SpeechReplayer only from the main thread.
+**/
+@interface SpeechReplayer : NSObject {
+}
+
+/** Creates a replayer of the recording at path, sending to the given
+ *  Speech API URL.  Returns nil if the file isn't a recording. **/
++ (SpeechReplayer*) replayerWithFile: (NSString*) path URL: (NSURL*) recognitionURL;
+
+/** Authenticator whose tokens the requests use.  The replay starts once it
+ *  has a token. **/
+@property (retain) SpeechAuth* speechAuth;
+
+/** Whether to start interactions at their recorded times, rather than as
+ *  fast as possible.  Defaults to YES. **/
+@property (assign) BOOL preservesTiming;
+
+/** Most requests to have running at once.  Defaults to 32. **/
+@property (assign) NSUInteger maxOutstanding;
+
+/** Whether to add an X-Arg naming the recorded interaction, ReplayInteraction,
+ *  which recordedResponder answers by.  For stand-in servers only.
+ *  Defaults to NO. **/
+@property (assign) BOOL tagsRequests;
+
+/** Number of interactions in the recording that can be replayed. **/
+@property (readonly) NSUInteger replayableCount;
+
+/** A block for SpeechMockServer's setResponder: that answers tagged
+ *  requests with their recorded responses, or fails them with their
+ *  recorded errors.  It keeps this replayer alive
+ *  until the mock server's responder is set to nil. **/
+- (SpeechMockResponder) recordedResponder;
+
+/** Starts replaying.  block is called once the requests started have all
+ *  finished. **/
+- (void) startWithCompletion: (SpeechReplayReportBlock) block;
+
+/** Stops starting requests; block is called when the running ones finish. **/
+- (void) stop;
+
+/** A readable form of a report, for the log. **/
++ (NSString*) descriptionOfReport: (NSDictionary*) report;
+
+@end
@@ -0,0 +1,553 @@
+//  SpeechReplayer.m
+//
+// Licensed by AT&T under 'Software Development Kit Tools Agreement' 2012.
+// TERMS AND CONDITIONS FOR USE, REPRODUCTION, AND DISTRIBUTION: http://developer.att.com/sdk_agreement/
+// Copyright 2012 AT&T Intellectual Property. All rights reserved.
+// For more information contact developer.support@att.com http://developer.att.com
+
+#import "SpeechReplayer.h"
+#import "SpeechRecording.h"
+#import "SpeechAuth.h"
+#import "SpeechRequest.h"
+#import "SpeechMultipartBody.h"
+#import "ATTSpeechKit.h"
+
+static const NSUInteger DEFAULT_MAX_OUTSTANDING = 32;
+
+/** Tune how closely requests keep to their recorded start times. **/
+static const NSTimeInterval TICK_INTERVAL = 0.01; // seconds
+
+/** Most mismatched interactions to list in the report. **/
+static const NSUInteger MAX_MISMATCHES_REPORTED = 100;
+
+static NSString* const TagArgument = @"ReplayInteraction";
+
+/* The header fields in recorded header text, skipping the request or
+   boundary line. */
+static NSDictionary* HeaderFields(NSData* text)
+{
+    NSString* string = [[[NSString alloc] initWithData: text encoding: NSUTF8StringEncoding] autorelease];
+    NSMutableDictionary* fields = [NSMutableDictionary dictionary];
+    for (NSString* line in [string componentsSeparatedByString: @"\r\n"]) {
+        NSRange colon = [line rangeOfString: @": "];
+        if (colon.location != NSNotFound)
+            [fields setObject: [line substringFromIndex: NSMaxRange(colon)]
+                       forKey: [line substringToIndex: colon.location]];
+    }
+    return fields;
+}
+
+/* Parses X-Arg pairs, key=value,key=value with the values URL-escaped. */
+static NSDictionary* ParseXArgs(NSString* header)
+{
+    NSMutableDictionary* xArgs = [NSMutableDictionary dictionary];
+    for (NSString* pair in [header componentsSeparatedByString: @","]) {
+        NSRange equals = [pair rangeOfString: @"="];
+        if (equals.location == NSNotFound)
+            continue;
+        NSString* value = [[pair substringFromIndex: NSMaxRange(equals)]
+                           stringByReplacingPercentEscapesUsingEncoding: NSUTF8StringEncoding];
+        if (value != nil)
+            [xArgs setObject: value forKey: [pair substringToIndex: equals.location]];
+    }
+    return xArgs;
+}
+
+/* The error as SpeechRecorder records it. */
+static NSString* ErrorText(NSError* error)
+{
+    return [NSString stringWithFormat: @"%@ %ld", error.domain, (long)error.code];
+}
+
+/* The error that ErrorText recorded, or nil if text isn't one. */
+static NSError* RecordedError(NSData* text)
+{
+    NSString* string = [[[NSString alloc] initWithData: text encoding: NSUTF8StringEncoding] autorelease];
+    NSRange space = [string rangeOfString: @" " options: NSBackwardsSearch];
+    if (space.location == NSNotFound || space.location == 0)
+        return nil;
+    return [NSError errorWithDomain: [string substringToIndex: space.location]
+                               code: [[string substringFromIndex: NSMaxRange(space)] integerValue]
+                           userInfo: nil];
+}
+
+/* The HTTP status at the start of a recorded response. */
+static NSInteger ResponseStatus(NSData* response)
+{
+    const uint8_t* bytes = (const uint8_t*)response.bytes;
+    if (response.length < 4)
+        return 0;
+    return (NSInteger)((uint32_t)bytes[0] | (uint32_t)bytes[1] << 8 | (uint32_t)bytes[2] << 16 | (uint32_t)bytes[3] << 24);
+}
+
+/* The body of a recorded response. */
+static NSData* ResponseBody(NSData* response)
+{
+    if (response.length < 4)
+        return [NSData data];
+    return [response subdataWithRange: NSMakeRange(4, response.length - 4)];
+}
+
+/* Mean and max of latencies in milliseconds. */
+static NSDictionary* LatencySummary(NSData* latencies)
+{
+    NSUInteger count = latencies.length / sizeof(double);
+    const double* values = (const double*)latencies.bytes;
+    if (count == 0)
+        return [NSDictionary dictionary];
+    double total = 0.0, max = 0.0;
+    for (NSUInteger i = 0; i < count; i++) {
+        total += values[i];
+        max = MAX(max, values[i]);
+    }
+    return [NSDictionary dictionaryWithObjectsAndKeys:
+            [NSNumber numberWithDouble: total / (double)count], @"mean",
+            [NSNumber numberWithDouble: max], @"max",
+            nil];
+}
+
+/**
+ * Where a recorded interaction's records are, as indexes into the recording.
+**/
+@interface SpeechReplayInteraction : NSObject {
+    @public
+    uint64_t number;
+    uint64_t start;      // timestamp of its first record
+    NSInteger request;   // -1 if none, as for the others
+    NSInteger audio;
+    NSInteger response;
+    NSInteger error;
+    NSMutableArray* parts; // of NSNumber
+}
+@end
+
+@implementation SpeechReplayInteraction
+
+- (id) init
+{
+    self = [super init];
+    if (self != nil) {
+        request = audio = response = error = -1;
+        parts = [[NSMutableArray alloc] init];
+    }
+    return self;
+}
+
+- (void) dealloc
+{
+    [parts release];
+    [super dealloc];
+}
+
+@end
+
+#pragma mark -
+
+@interface SpeechReplayer () {
+    @private
+    SpeechRecordingReader* reader;
+    BOOL running;
+    BOOL stopping;
+    CFAbsoluteTime startTime;
+    NSUInteger interactionCount;
+    NSUInteger nextIndex;
+    NSUInteger outstanding;
+    NSUInteger replayed;
+    NSUInteger skipped;
+    NSUInteger succeeded;
+    NSUInteger failed;
+    NSUInteger matched;
+    NSUInteger mismatched;
+    NSUInteger unverified;
+}
+@property (retain) NSURL* recognitionURL;
+@property (retain) NSArray* replayable;          // of SpeechReplayInteraction, by start time
+@property (retain) NSDictionary* responseEntries; // interaction number -> NSNumber record index
+@property (copy) NSString* token;
+@property (copy) SpeechReplayReportBlock completionBlock;
+@property (retain) NSTimer* timer;
+@property (retain) NSMutableData* recordedLatencies; // of double, in milliseconds
+@property (retain) NSMutableData* replayedLatencies;
+@property (retain) NSMutableArray* mismatches;
+
+- (BOOL) loadFile: (NSString*) path;
+- (NSData*) payloadAtIndex: (NSInteger) index;
+- (void) begin;
+- (void) tick: (NSTimer*) timer;
+- (void) replay: (SpeechReplayInteraction*) interaction;
+- (void) compare: (SpeechReplayInteraction*) interaction statusCode: (NSUInteger) statusCode
+      dictionary: (NSDictionary*) json error: (NSError*) error;
+- (void) finishIfDone;
+- (NSDictionary*) report;
+@end
+
+@implementation SpeechReplayer
+
+@synthesize speechAuth = _speechAuth;
+@synthesize preservesTiming = _preservesTiming;
+@synthesize maxOutstanding = _maxOutstanding;
+@synthesize tagsRequests = _tagsRequests;
+@synthesize recognitionURL = _recognitionURL;
+@synthesize replayable = _replayable;
+@synthesize responseEntries = _responseEntries;
+@synthesize token = _token;
+@synthesize completionBlock = _completionBlock;
+@synthesize timer = _timer;
+@synthesize recordedLatencies = _recordedLatencies;
+@synthesize replayedLatencies = _replayedLatencies;
+@synthesize mismatches = _mismatches;
+
++ (SpeechReplayer*) replayerWithFile: (NSString*) path URL: (NSURL*) recognitionURL
+{
+    SpeechReplayer* replayer = [[[self alloc] init] autorelease];
+    if (![replayer loadFile: path])
+        return nil;
+    replayer.recognitionURL = recognitionURL;
+    return replayer;
+}
+
+- (id) init
+{
+    self = [super init];
+    if (self != nil) {
+        _preservesTiming = YES;
+        _maxOutstanding = DEFAULT_MAX_OUTSTANDING;
+    }
+    return self;
+}
+
+- (void) dealloc
+{
+    [_timer invalidate];
+    [_speechAuth cancel];
+    SpeechRecordingClose(reader);
+    self.speechAuth = nil;
+    self.recognitionURL = nil;
+    self.replayable = nil;
+    self.responseEntries = nil;
+    self.token = nil;
+    self.completionBlock = nil;
+    self.timer = nil;
+    self.recordedLatencies = nil;
+    self.replayedLatencies = nil;
+    self.mismatches = nil;
+    [super dealloc];
+}
+
+- (BOOL) loadFile: (NSString*) path
+{
+    reader = SpeechRecordingOpen(path.fileSystemRepresentation);
+    if (reader == NULL)
+        return NO;
+    // Group the records by interaction, in the order they started.
+    NSMutableDictionary* byNumber = [NSMutableDictionary dictionary];
+    NSMutableArray* ordered = [NSMutableArray array];
+    size_t count = SpeechRecordingCount(reader);
+    for (size_t i = 0; i < count; i++) {
+        const SpeechRecordingEntry* entry = SpeechRecordingEntryAt(reader, i);
+        NSNumber* key = [NSNumber numberWithUnsignedLongLong: entry->interaction];
+        SpeechReplayInteraction* interaction = [byNumber objectForKey: key];
+        if (interaction == nil) {
+            interaction = [[[SpeechReplayInteraction alloc] init] autorelease];
+            interaction->number = entry->interaction;
+            interaction->start = entry->timestamp;
+            [byNumber setObject: interaction forKey: key];
+            [ordered addObject: interaction];
+        }
+        switch (entry->type) {
+            case SpeechRecordingTypeRequest: interaction->request = (NSInteger)i; break;
+            case SpeechRecordingTypeAudio: interaction->audio = (NSInteger)i; break;
+            case SpeechRecordingTypePart: [interaction->parts addObject: [NSNumber numberWithUnsignedLong: i]]; break;
+            case SpeechRecordingTypeResponse: interaction->response = (NSInteger)i; break;
+            case SpeechRecordingTypeError: interaction->error = (NSInteger)i; break;
+            default: break; // states are for reading, not replaying
+        }
+    }
+    interactionCount = ordered.count;
+
+    NSMutableArray* replayable = [NSMutableArray arrayWithCapacity: ordered.count];
+    NSMutableDictionary* responseEntries = [NSMutableDictionary dictionary];
+    for (SpeechReplayInteraction* interaction in ordered) {
+        // ATTSpeechService's interactions have no audio to send again.
+        if (interaction->request < 0 || (interaction->audio < 0 && interaction->parts.count == 0))
+            continue;
+        [replayable addObject: interaction];
+        NSInteger outcome = interaction->response >= 0 ? interaction->response : interaction->error;
+        if (outcome >= 0)
+            [responseEntries setObject: [NSNumber numberWithInteger: outcome]
+                                forKey: [NSNumber numberWithUnsignedLongLong: interaction->number]];
+    }
+    self.replayable = replayable;
+    self.responseEntries = responseEntries;
+    return YES;
+}
+
+- (NSUInteger) replayableCount
+{
+    return _replayable.count;
+}
+
+- (NSData*) payloadAtIndex: (NSInteger) index
+{
+    if (index < 0)
+        return nil;
+    const SpeechRecordingEntry* entry = SpeechRecordingEntryAt(reader, (size_t)index);
+    NSMutableData* payload = [NSMutableData dataWithLength: entry->length];
+    if (SpeechRecordingRead(reader, entry, payload.mutableBytes) != 0)
+        return nil;
+    return payload;
+}
+
+- (SpeechMockResponder) recordedResponder
+{
+    // Called on loading threads: the index and responseEntries never change
+    // once loaded, and payloads are read with pread, so no lock is needed.
+    return [[^NSData* (NSURLRequest* request, NSInteger* status, NSError** error) {
+        NSString* tag = [ParseXArgs([request valueForHTTPHeaderField: @"X-Arg"]) objectForKey: TagArgument];
+        if (tag == nil)
+            return nil;
+        NSNumber* key = [NSNumber numberWithUnsignedLongLong: strtoull(tag.UTF8String, NULL, 10)];
+        NSNumber* index = [_responseEntries objectForKey: key];
+        if (index == nil)
+            return nil;
+        NSData* payload = [self payloadAtIndex: index.integerValue];
+        if (SpeechRecordingEntryAt(reader, index.unsignedIntegerValue)->type == SpeechRecordingTypeError) {
+            // The original never got a response; fail the way it did.
+            *status = 0;
+            *error = RecordedError(payload);
+            return [NSData data];
+        }
+        *status = ResponseStatus(payload);
+        return ResponseBody(payload);
+    } copy] autorelease];
+}
+
+- (void) startWithCompletion: (SpeechReplayReportBlock) block
+{
+    NSAssert(_completionBlock == nil, @"SpeechReplayer is already running");
+    self.completionBlock = block;
+    self.recordedLatencies = [NSMutableData data];
+    self.replayedLatencies = [NSMutableData data];
+    self.mismatches = [NSMutableArray array];
+    running = stopping = NO;
+    nextIndex = outstanding = replayed = skipped = succeeded = failed = 0;
+    matched = mismatched = unverified = 0;
+    if (_speechAuth == nil) {
+        [self begin];
+        return;
+    }
+    // As SpeechLoadGenerator does, keep the token fresh and start once
+    // there is one.
+    __block SpeechReplayer* blockSelf = self;
+    [_speechAuth fetchTo: ^(NSString* token, NSError* error) {
+        if (token != nil) {
+            blockSelf.token = token;
+            if (!blockSelf->running && !blockSelf->stopping)
+                [blockSelf begin];
+        }
+        else if (!blockSelf->running) {
+            NSLog(@"SpeechReplayer couldn't get a token: %@", error);
+            [blockSelf stop];
+        }
+    }];
+}
+
+- (void) begin
+{
+    running = YES;
+    startTime = CFAbsoluteTimeGetCurrent();
+    // Interactions without audio can't be sent again.
+    skipped = interactionCount - _replayable.count;
+    if (_replayable.count == 0) {
+        [self stop];
+        return;
+    }
+    [self tick: nil];
+    if (!stopping)
+        self.timer = [NSTimer scheduledTimerWithTimeInterval: TICK_INTERVAL target: self
+                                                    selector: @selector(tick:)
+                                                    userInfo: nil repeats: YES];
+}
+
+- (void) tick: (NSTimer*) timer
+{
+    if (!_preservesTiming) {
+        // Keep the limit's worth running.
+        while (nextIndex < _replayable.count && outstanding < _maxOutstanding)
+            [self replay: [_replayable objectAtIndex: nextIndex++]];
+    }
+    else {
+        // Start every interaction that has come due, even if the timer fell
+        // behind, as the users' requests would have.
+        uint64_t first = ((SpeechReplayInteraction*)[_replayable objectAtIndex: 0])->start;
+        uint64_t elapsed = (uint64_t)((CFAbsoluteTimeGetCurrent() - startTime) * 1e6);
+        while (nextIndex < _replayable.count) {
+            SpeechReplayInteraction* interaction = [_replayable objectAtIndex: nextIndex];
+            if (interaction->start - first > elapsed)
+                break;
+            nextIndex++;
+            if (outstanding >= _maxOutstanding)
+                skipped++;
+            else
+                [self replay: interaction];
+        }
+    }
+    if (nextIndex >= _replayable.count)
+        [self stop];
+}
+
+- (void) replay: (SpeechReplayInteraction*) interaction
+{
+    NSDictionary* fields = HeaderFields([self payloadAtIndex: interaction->request]);
+    NSMutableDictionary* xArgs = [NSMutableDictionary dictionaryWithDictionary:
+                                  ParseXArgs([fields objectForKey: @"X-Arg"])];
+    if (_tagsRequests)
+        [xArgs setObject: [NSString stringWithFormat: @"%llu", interaction->number] forKey: TagArgument];
+
+    SpeechRequest* request = [SpeechRequest requestWithURL: _recognitionURL];
+    request.bearerAuthToken = _token;
+    request.speechContext = [fields objectForKey: @"X-SpeechContext"];
+    request.xArgs = xArgs.count > 0 ? xArgs : nil;
+    request.contentType = [fields objectForKey: @"Content-Type"];
+    replayed++;
+    outstanding++;
+    CFAbsoluteTime requestStart = CFAbsoluteTimeGetCurrent();
+    SpeechRequestBlock completion = ^(NSArray* strings, NSDictionary* json, NSError* error) {
+        double milliseconds = (CFAbsoluteTimeGetCurrent() - requestStart) * 1000.0;
+        outstanding--;
+        if (error == nil)
+            succeeded++;
+        else
+            failed++;
+        [_replayedLatencies appendBytes: &milliseconds length: sizeof(milliseconds)];
+        [self compare: interaction statusCode: request.statusCode dictionary: json error: error];
+        // As fast as possible means starting the next one now.
+        if (!_preservesTiming && !stopping)
+            [self tick: nil];
+        [self finishIfDone];
+    };
+
+    if (interaction->audio >= 0) {
+        [request startWithAudioData: [self payloadAtIndex: interaction->audio] completion: completion];
+        return;
+    }
+    // Rebuild the multipart body from its parts' headers, with a new boundary.
+    NSString* mediaType = [[request.contentType componentsSeparatedByString: @";"] objectAtIndex: 0];
+    NSString* subtype = [[mediaType componentsSeparatedByString: @"/"] lastObject];
+    SpeechMultipartBody* body = [SpeechMultipartBody bodyWithSubtype: subtype];
+    for (NSNumber* index in interaction->parts) {
+        NSData* part = [self payloadAtIndex: index.integerValue];
+        NSRange end = [part rangeOfData: [NSData dataWithBytes: "\r\n\r\n" length: 4]
+                                options: 0 range: NSMakeRange(0, part.length)];
+        if (end.location == NSNotFound)
+            continue;
+        NSDictionary* partFields = HeaderFields([part subdataWithRange: NSMakeRange(0, end.location)]);
+        [body addPart: [part subdataWithRange: NSMakeRange(NSMaxRange(end), part.length - NSMaxRange(end))]
+          contentType: [partFields objectForKey: @"Content-Type"]
+          disposition: [partFields objectForKey: @"Content-Disposition"]];
+    }
+    [request startWithMultipartBody: body completion: completion];
+}
+
+- (void) compare: (SpeechReplayInteraction*) interaction statusCode: (NSUInteger) statusCode
+      dictionary: (NSDictionary*) json error: (NSError*) error
+{
+    BOOL same;
+    if (interaction->response >= 0) {
+        NSData* response = [self payloadAtIndex: interaction->response];
+        double milliseconds = (double)(SpeechRecordingEntryAt(reader, (size_t)interaction->response)->timestamp
+                                       - interaction->start) / 1000.0;
+        [_recordedLatencies appendBytes: &milliseconds length: sizeof(milliseconds)];
+        NSInteger status = ResponseStatus(response);
+        if (status != 200)
+            same = (statusCode == (NSUInteger)status);
+        else {
+            // Compare the parsed results, since the JSON may be laid out
+            // differently, taking the last of a streamed response's objects
+            // as the request does.
+            NSDictionary* recorded = [SpeechRequest resultInResponseBody: ResponseBody(response)];
+            same = (error == nil && (recorded == json || [recorded isEqual: json]));
+        }
+    }
+    else if (interaction->error >= 0) {
+        NSData* text = [self payloadAtIndex: interaction->error];
+        same = (error != nil && [text isEqualToData: [ErrorText(error) dataUsingEncoding: NSUTF8StringEncoding]]);
+    }
+    else {
+        // The original was canceled before it finished.
+        unverified++;
+        return;
+    }
+    if (same)
+        matched++;
+    else {
+        mismatched++;
+        if (_mismatches.count < MAX_MISMATCHES_REPORTED)
+            [_mismatches addObject: [NSNumber numberWithUnsignedLongLong: interaction->number]];
+    }
+}
+
+- (void) stop
+{
+    if (stopping)
+        return;
+    stopping = YES;
+    [_timer invalidate];
+    self.timer = nil;
+    [self finishIfDone];
+}
+
+- (void) finishIfDone
+{
+    if (!stopping || outstanding > 0 || _completionBlock == nil)
+        return;
+    [_speechAuth cancel];
+    NSDictionary* report = [self report];
+    running = NO;
+    SpeechReplayReportBlock block = [[_completionBlock retain] autorelease];
+    self.completionBlock = nil;
+    block(report);
+}
+
+- (NSDictionary*) report
+{
+    NSTimeInterval elapsed = running ? CFAbsoluteTimeGetCurrent() - startTime : 0.0;
+    return [NSDictionary dictionaryWithObjectsAndKeys:
+            [NSNumber numberWithUnsignedInteger: interactionCount], @"interactions",
+            [NSNumber numberWithUnsignedInteger: replayed], @"replayed",
+            [NSNumber numberWithUnsignedInteger: skipped], @"skipped",
+            [NSNumber numberWithUnsignedInteger: succeeded], @"succeeded",
+            [NSNumber numberWithUnsignedInteger: failed], @"failed",
+            [NSNumber numberWithUnsignedInteger: matched], @"matched",
+            [NSNumber numberWithUnsignedInteger: mismatched], @"mismatched",
+            [NSNumber numberWithUnsignedInteger: unverified], @"unverified",
+            [[_mismatches copy] autorelease], @"mismatches",
+            [NSNumber numberWithDouble: elapsed], @"elapsed",
+            LatencySummary(_recordedLatencies), @"recordedLatency",
+            LatencySummary(_replayedLatencies), @"replayedLatency",
+            nil];
+}
+
++ (NSString*) descriptionOfReport: (NSDictionary*) report
+{
+    NSMutableString* text = [NSMutableString string];
+    [text appendFormat: @"%@ of %@ interactions replayed, %@ skipped, in %.1fs: %@ succeeded, %@ failed\n",
+     [report objectForKey: @"replayed"], [report objectForKey: @"interactions"],
+     [report objectForKey: @"skipped"], [[report objectForKey: @"elapsed"] doubleValue],
+     [report objectForKey: @"succeeded"], [report objectForKey: @"failed"]];
+    [text appendFormat: @"%@ matched the recording, %@ mismatched, %@ unverified\n",
+     [report objectForKey: @"matched"], [report objectForKey: @"mismatched"],
+     [report objectForKey: @"unverified"]];
+    for (NSString* name in [NSArray arrayWithObjects: @"recordedLatency", @"replayedLatency", nil]) {
+        NSDictionary* latency = [report objectForKey: name];
+        if (latency.count > 0)
+            [text appendFormat: @"%@ mean=%.0fms max=%.0fms\n", name,
+             [[latency objectForKey: @"mean"] doubleValue], [[latency objectForKey: @"max"] doubleValue]];
+    }
+    NSArray* mismatches = [report objectForKey: @"mismatches"];
+    if (mismatches.count > 0)
+        [text appendFormat: @"mismatched interactions: %@\n", [mismatches componentsJoinedByString: @", "]];
+    return text;
+}
+
+@end
@@ -0,0 +1,133 @@
+//  SpeechRequest.h
+//
+// Licensed by AT&T under 'Software Development Kit Tools Agreement' 2012.
+// TERMS AND CONDITIONS FOR USE, REPRODUCTION, AND DISTRIBUTION: http://developer.att.com/sdk_agreement/
+// Copyright 2012 AT&T Intellectual Property. All rights reserved.
+// For more information contact developer.support@att.com http://developer.att.com
+
+#import <Foundation/NSObject.h>
+#import <Foundation/NSDate.h>
+
+@class NSString, NSURL, NSArray, NSData, NSDictionary, NSError, NSInputStream;
+@class SpeechResultCache, SpeechMultipartBody;
+
+/**
+ * Type of block called when a SpeechRequest finishes.
+ * responseStrings holds the n-best hypotheses, like
+ * ATTSpeechService.responseStrings, and responseDictionary the parsed JSON.
+ * If the request fails, both are nil and error contains the error, using
+ * the same domains and codes as ATTSpeechService.
+**/
+typedef void (^SpeechRequestBlock)(NSArray* responseStrings,
+                                   NSDictionary* responseDictionary,
+                                   NSError* error);
+
+/**
+ * Type of block called with each interim result of a SpeechRequest.
+ * responseStrings and responseDictionary are as for SpeechRequestBlock.
+**/
+typedef void (^SpeechRequestPartialBlock)(NSArray* responseStrings,
+                                          NSDictionary* responseDictionary);
+
+/**
+ * Type of block that opens a new, unopened input stream of audio, starting
+ * from the beginning each time it is called.
+**/
+typedef NSInputStream* (^SpeechRequestStreamSource)(void);
+
+/**
+ * Sends prerecorded audio to the Speech API, without the microphone and
+ * without going through the ATTSpeechService singleton.  Any number of
+ * SpeechRequest objects may be active at once.
+ *
+ * Audio from a file or stream is uploaded with chunked transfer encoding as
+ * it is read, so the whole recording never needs to be in memory, and the
+ * upload starts as soon as the first bytes are available.
+ *
+ * Use SpeechRequest only from the main thread.
+**/
+@interface SpeechRequest : NSObject {
+}
+
+/** Creates a request to the given Speech API URL. **/
++ (SpeechRequest*) requestWithURL: (NSURL*) recognitionURL;
+
+/** The result a request reports for a whole response body: the last JSON
+ *  object in it, as a streamed response holds several.  nil if none. **/
++ (NSDictionary*) resultInResponseBody: (NSData*) body;
+
+/** The URL of the Speech API service. **/
+@property (readonly, retain) NSURL* recognitionURL;
+
+/** The OAuth access token, sent in the Authorization: Bearer header. **/
+@property (copy) NSString* bearerAuthToken;
+
+/** The Speech API speech context, sent in the X-SpeechContext header. **/
+@property (copy) NSString* speechContext;
+
+/** Key-value argument pairs, sent in the X-Arg header. **/
+@property (copy) NSDictionary* xArgs;
+
+/** MIME type of the audio.  If nil, it is guessed from the extension of an
+ *  audio file (.wav, .amr, or .spx). **/
+@property (copy) NSString* contentType;
+
+/** The maximum number of seconds to wait for the connection and response. **/
+@property (assign) NSTimeInterval connectionTimeout;
+
+/** Whether to cut leading and trailing silence from WAV audio before
+ *  sending it, using on-device voice activity detection.  Audio in which
+ *  no speech is detected is sent whole, leaving the server to decide.
+ *  Applies to audio data and files, not streams.  Default is NO. **/
+@property (assign) BOOL trimsSilence;
+
+/** Cache of earlier results to answer from when WAV audio sounds the same
+ *  as audio already recognized in the same speech context.  Successful
+ *  results of WAV audio are added to it.  Applies to audio data and files,
+ *  not streams.  Default is nil, for no caching. **/
+@property (retain) SpeechResultCache* resultCache;
+
+/** Whether the result came from resultCache rather than the server. **/
+@property (readonly) BOOL isCachedResult;
+
+/** Block called with each JSON result as soon as it has arrived, while the
+ *  rest of the response is still coming.  A server that streams interim
+ *  hypotheses sends a series of JSON objects, either back to back in a
+ *  chunked body or as the parts of a multipart body; each one is reported
+ *  here, and the last one is also passed to the completion block.  A
+ *  response with a single result reports it here once, then completes.
+ *  Set it before starting the request. **/
+@property (copy) SpeechRequestPartialBlock partialResultBlock;
+
+/** The HTTP status code of the response, or 0 if there was none. **/
+@property (readonly) NSUInteger statusCode;
+
+/** Sends audio data that is already in memory. **/
+- (void) startWithAudioData: (NSData*) audioData
+                 completion: (SpeechRequestBlock) block;
+
+/** Streams the contents of an audio file, reading it as it is sent. **/
+- (void) startWithAudioFile: (NSString*) path
+                 completion: (SpeechRequestBlock) block;
+
+/** Streams audio from an unopened input stream until it ends.  The stream
+ *  can't be sent again, so if the connection needs the body a second time,
+ *  such as after a redirect, the request fails; use
+ *  startWithAudioStreamSource: when the audio can be read again. **/
+- (void) startWithAudioStream: (NSInputStream*) stream
+                   completion: (SpeechRequestBlock) block;
+
+/** Streams audio from a stream made by source, calling it again for a
+ *  fresh stream whenever the connection needs to resend the body. **/
+- (void) startWithAudioStreamSource: (SpeechRequestStreamSource) source
+                         completion: (SpeechRequestBlock) block;
+
+/** Streams a multipart body, such as inline grammars and audio, straight
+ *  from its parts.  Sets contentType from the body. **/
+- (void) startWithMultipartBody: (SpeechMultipartBody*) body
+                     completion: (SpeechRequestBlock) block;
+
+/** Stops the request.  The block will not be called. **/
+- (void) cancel;
+
+@end
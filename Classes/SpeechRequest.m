@@ -0,0 +1,561 @@
+//  SpeechRequest.m
+//
+// Licensed by AT&T under 'Software Development Kit Tools Agreement' 2012.
+// TERMS AND CONDITIONS FOR USE, REPRODUCTION, AND DISTRIBUTION: http://developer.att.com/sdk_agreement/
+// Copyright 2012 AT&T Intellectual Property. All rights reserved.
+// For more information contact developer.support@att.com http://developer.att.com
+
+#import "SpeechRequest.h"
+#import "SpeechTransport.h"
+#import "ATTSpeechKit.h"
+#import "SpeechWAV.h"
+#import "SpeechVAD.h"
+#import "SpeechResultCache.h"
+#import "SpeechMultipartBody.h"
+#import "SpeechRequestHeaders.h"
+#import "SpeechRecorder.h"
+
+typedef enum
+{
+    RequestStateInitialized = 0,
+    RequestStateSending,
+    RequestStateFinished,
+    RequestStateCanceled
+} RequestState;
+
+/* Progress splitting a response into top-level JSON objects. */
+typedef struct JSONScan {
+    NSUInteger scanned;
+    NSUInteger objectStart;
+    NSUInteger depth;
+    BOOL inString;
+    BOOL escaped;
+} JSONScan;
+
+// Memory Management
+//
+// Like SpeechAuth, this object retains itself between the call to start
+// and the callback, so the client can autorelease it after starting.
+
+@interface SpeechRequest () {
+    @private
+    RequestState state;
+    uint64_t interaction;  // for SpeechRecorder, or 0
+    JSONScan scan;
+}
+@property (readwrite, retain) NSURL* recognitionURL;
+@property (readwrite) NSUInteger statusCode;
+@property (readwrite) BOOL isCachedResult;
+@property (retain) NSData* fingerprint;
+@property (retain) NSDate* startDate;
+@property (copy) SpeechRequestBlock completionBlock;
+@property (retain) NSURLConnection* connection;
+@property (retain) NSMutableData* data;
+@property (retain) NSDictionary* lastResult;
+@property (copy) SpeechRequestStreamSource bodyStreamSource;
+@property (retain) SpeechMultipartBody* multipartBody;
+
+- (NSMutableURLRequest*) URLRequest;
+- (void) startRequest: (NSMutableURLRequest*) request completion: (SpeechRequestBlock) block;
+- (void) startWithBodyStream: (NSInputStream*) stream source: (SpeechRequestStreamSource) source
+                  completion: (SpeechRequestBlock) block;
+- (void) startWithCachedResult: (NSDictionary*) json audio: (NSData*) audioData
+                     completion: (SpeechRequestBlock) block;
+- (uint64_t) recordingInteraction;
+- (void) scanForResults;
+- (void) finishWithStrings: (NSArray*) strings dictionary: (NSDictionary*) json error: (NSError*) error;
+- (void) clear;
+@end
+
+/** Tune the timeout values based on application behavior. **/
+static const NSTimeInterval DEFAULT_TIMEOUT = 30.0; // seconds
+
+/** Largest recognition response to accept. **/
+static const NSUInteger MAX_RESPONSE_LENGTH = 1024 * 1024;
+
+/* Guesses the MIME type of an audio file from its extension. */
+static NSString* ContentTypeForPath(NSString* path)
+{
+    NSString* extension = path.pathExtension.lowercaseString;
+    if ([extension isEqualToString: @"wav"])
+        return @"audio/wav";
+    if ([extension isEqualToString: @"amr"])
+        return @"audio/amr";
+    if ([extension isEqualToString: @"spx"])
+        return @"audio/x-speex";
+    return nil;
+}
+
+/* Cuts the silence from both ends of 16-bit mono WAV data.  Returns the
+   data unchanged if it is in some other format or no speech was found,
+   since a missed detection must not lose the user's words. */
+static NSData* TrimSilence(NSData* audioData)
+{
+    SpeechWAVInfo info;
+    if (!SpeechWAVParse(audioData.bytes, audioData.length, &info)
+        || info.channels != 1 || info.bits_per_sample != 16)
+        return audioData;
+    const uint8_t* bytes = (const uint8_t*)audioData.bytes;
+    if (((uintptr_t)(bytes + info.data_offset) & 1) != 0)
+        return audioData; // odd chunk layout; send it as it is
+
+    SpeechVADConfig config;
+    SpeechVADDefaultConfig(&config, info.sample_rate);
+    size_t start, end;
+    if (!SpeechVADFindSpeech(&config, (const int16_t*)(bytes + info.data_offset),
+                             info.data_length / 2, &start, &end))
+        return audioData;
+
+    uint32_t length = (uint32_t)((end - start) * 2);
+    NSMutableData* trimmed = [NSMutableData dataWithLength: SPEECH_WAV_HEADER_LENGTH];
+    SpeechWAVWriteHeader(trimmed.mutableBytes, info.sample_rate, length);
+    [trimmed appendBytes: bytes + info.data_offset + start * 2 length: length];
+    return trimmed;
+}
+
+/* Scans on through bytes, skipping anything between objects, such as
+   whitespace or multipart boundaries, and stops after the next complete
+   top-level object, setting its range.  Returns NO at the end of bytes. */
+static BOOL ScanToObject(JSONScan* scan, const char* bytes, NSUInteger length, NSRange* object)
+{
+    while (scan->scanned < length) {
+        NSUInteger at = scan->scanned++;
+        char c = bytes[at];
+        if (scan->inString) {
+            if (scan->escaped)
+                scan->escaped = NO;
+            else if (c == '\\')
+                scan->escaped = YES;
+            else if (c == '"')
+                scan->inString = NO;
+        }
+        else if (scan->depth == 0) {
+            if (c == '{') {
+                scan->objectStart = at;
+                scan->depth = 1;
+            }
+        }
+        else if (c == '"')
+            scan->inString = YES;
+        else if (c == '{' || c == '[')
+            scan->depth++;
+        else if ((c == '}' || c == ']') && --scan->depth == 0) {
+            *object = NSMakeRange(scan->objectStart, at + 1 - scan->objectStart);
+            return YES;
+        }
+    }
+    return NO;
+}
+
+/* Extracts Recognition.NBest[*].Hypothesis, checking every type along the way. */
+static NSArray* ResponseStrings(NSDictionary* json)
+{
+    if (![json isKindOfClass: [NSDictionary class]])
+        return nil;
+    NSDictionary* recognition = [json objectForKey: @"Recognition"];
+    if (![recognition isKindOfClass: [NSDictionary class]])
+        return nil;
+    NSArray* nbest = [recognition objectForKey: @"NBest"];
+    if (![nbest isKindOfClass: [NSArray class]])
+        return [NSArray array];
+    NSMutableArray* strings = [NSMutableArray arrayWithCapacity: nbest.count];
+    for (NSDictionary* result in nbest) {
+        if (![result isKindOfClass: [NSDictionary class]])
+            continue;
+        id hypothesis = [result objectForKey: @"Hypothesis"];
+        if ([hypothesis isKindOfClass: [NSString class]])
+            [strings addObject: hypothesis];
+    }
+    return strings;
+}
+
+@implementation SpeechRequest
+
+@synthesize recognitionURL = _recognitionURL;
+@synthesize bearerAuthToken = _bearerAuthToken;
+@synthesize speechContext = _speechContext;
+@synthesize xArgs = _xArgs;
+@synthesize contentType = _contentType;
+@synthesize connectionTimeout = _connectionTimeout;
+@synthesize trimsSilence = _trimsSilence;
+@synthesize statusCode = _statusCode;
+@synthesize completionBlock = _completionBlock;
+@synthesize connection = _connection;
+@synthesize data = _data;
+@synthesize partialResultBlock = _partialResultBlock;
+@synthesize resultCache = _resultCache;
+@synthesize isCachedResult = _isCachedResult;
+@synthesize fingerprint = _fingerprint;
+@synthesize startDate = _startDate;
+@synthesize lastResult = _lastResult;
+@synthesize bodyStreamSource = _bodyStreamSource;
+@synthesize multipartBody = _multipartBody;
+
++ (SpeechRequest*) requestWithURL: (NSURL*) recognitionURL
+{
+    SpeechRequest* request = [[[self alloc] init] autorelease];
+    request.recognitionURL = recognitionURL;
+    return request;
+}
+
++ (NSDictionary*) resultInResponseBody: (NSData*) body
+{
+    JSONScan scan = { 0 };
+    NSRange range;
+    NSDictionary* result = nil;
+    while (ScanToObject(&scan, (const char*)body.bytes, body.length, &range)) {
+        NSDictionary* json = [NSJSONSerialization JSONObjectWithData: [body subdataWithRange: range]
+                                                             options: 0 error: NULL];
+        if ([json isKindOfClass: [NSDictionary class]])
+            result = json;
+    }
+    return result;
+}
+
+- (id) init
+{
+    self = [super init];
+    if (self != nil) {
+        _connectionTimeout = DEFAULT_TIMEOUT;
+        state = RequestStateInitialized;
+    }
+    return self;
+}
+
+- (void) dealloc
+{
+    // We should have already been cleared, but just in case...
+    [_connection cancel];
+
+    self.recognitionURL = nil;
+    self.bearerAuthToken = nil;
+    self.speechContext = nil;
+    self.xArgs = nil;
+    self.contentType = nil;
+    self.completionBlock = nil;
+    self.connection = nil;
+    self.data = nil;
+    self.partialResultBlock = nil;
+    self.lastResult = nil;
+    self.resultCache = nil;
+    self.fingerprint = nil;
+    self.startDate = nil;
+    self.bodyStreamSource = nil;
+    self.multipartBody = nil;
+    [super dealloc];
+}
+
+- (NSMutableURLRequest*) URLRequest
+{
+    NSMutableURLRequest* request = [NSMutableURLRequest requestWithURL: _recognitionURL];
+    request.HTTPMethod = @"POST";
+    request.timeoutInterval = _connectionTimeout;
+    // The headers that don't change between requests are formatted once
+    // and shared.
+    SpeechRequestHeaders* headers = [SpeechRequestHeaders headersWithSpeechContext: _speechContext
+                                                                             xArgs: _xArgs];
+    [headers applyToRequest: request contentType: _contentType bearerAuthToken: _bearerAuthToken];
+    return request;
+}
+
+- (void) startWithAudioData: (NSData*) audioData
+                 completion: (SpeechRequestBlock) block
+{
+    if (_trimsSilence)
+        audioData = TrimSilence(audioData);
+    if (_resultCache != nil) {
+        self.fingerprint = [_resultCache fingerprintForAudio: audioData];
+        NSDictionary* json = [_resultCache resultForFingerprint: _fingerprint context: _speechContext];
+        if (json != nil) {
+            [self startWithCachedResult: json audio: audioData completion: block];
+            return;
+        }
+        self.startDate = [NSDate date];
+    }
+    NSMutableURLRequest* request = [self URLRequest];
+    request.HTTPBody = audioData;
+    self.bodyStreamSource = ^{
+        return [NSInputStream inputStreamWithData: audioData];
+    };
+    [self startRequest: request completion: block];
+}
+
+- (void) startWithAudioFile: (NSString*) path
+                 completion: (SpeechRequestBlock) block
+{
+    if (_contentType == nil)
+        self.contentType = ContentTypeForPath(path);
+    if ((_trimsSilence || _resultCache != nil) && [_contentType isEqualToString: @"audio/wav"]) {
+        // Trimming and fingerprinting need the whole file, so map it rather
+        // than reading it in.
+        NSData* audioData = [NSData dataWithContentsOfFile: path options: NSDataReadingMapped error: NULL];
+        if (audioData != nil) {
+            [self startWithAudioData: audioData completion: block];
+            return;
+        }
+    }
+    SpeechRecorder* recorder = [SpeechRecorder sharedRecorder];
+    if (recorder.isRecording) {
+        // The stream can't be recorded as it is sent, but the file can.
+        NSData* audioData = [NSData dataWithContentsOfFile: path options: NSDataReadingMapped error: NULL];
+        if (audioData != nil)
+            [recorder recordAudio: audioData interaction: [self recordingInteraction]];
+    }
+    [self startWithAudioStreamSource: ^{
+        return [NSInputStream inputStreamWithFileAtPath: path];
+    } completion: block];
+}
+
+- (void) startWithAudioStream: (NSInputStream*) stream
+                   completion: (SpeechRequestBlock) block
+{
+    // A stream that has been read can't be rewound, so there's no source
+    // to send it again from.
+    [self startWithBodyStream: stream source: nil completion: block];
+}
+
+- (void) startWithAudioStreamSource: (SpeechRequestStreamSource) source
+                         completion: (SpeechRequestBlock) block
+{
+    [self startWithBodyStream: source() source: source completion: block];
+}
+
+- (void) startWithBodyStream: (NSInputStream*) stream source: (SpeechRequestStreamSource) source
+                  completion: (SpeechRequestBlock) block
+{
+    // With a body stream and no Content-Length, NSURLConnection sends the
+    // body chunked, reading from the stream only as fast as the network
+    // takes the data.
+    NSMutableURLRequest* request = [self URLRequest];
+    [request setValue: @"chunked" forHTTPHeaderField: @"Transfer-Encoding"];
+    request.HTTPBodyStream = stream;
+    self.bodyStreamSource = source;
+    [self startRequest: request completion: block];
+}
+
+- (void) startWithMultipartBody: (SpeechMultipartBody*) body
+                     completion: (SpeechRequestBlock) block
+{
+    // Keep the body in case the connection needs to send it again.  A
+    // stream is made only when the connection asks, and the one it replaces
+    // is closed, since the connection won't read any more of it.
+    self.multipartBody = body;
+    self.bodyStreamSource = ^{
+        [body closeStreams];
+        return [body inputStream];
+    };
+    self.contentType = body.contentType;
+    NSMutableURLRequest* request = [self URLRequest];
+    [request setValue: [NSString stringWithFormat: @"%llu", body.contentLength]
+   forHTTPHeaderField: @"Content-Length"];
+    request.HTTPBodyStream = _bodyStreamSource();
+    SpeechRecorder* recorder = [SpeechRecorder sharedRecorder];
+    if (recorder.isRecording) {
+        uint64_t recording = [self recordingInteraction];
+        [body enumeratePartsUsingBlock: ^(NSData* headers, NSData* partData) {
+            [recorder recordPartHeaders: headers data: partData interaction: recording];
+        }];
+    }
+    [self startRequest: request completion: block];
+}
+
+- (void) startRequest: (NSMutableURLRequest*) request completion: (SpeechRequestBlock) block
+{
+    NSAssert(state == RequestStateInitialized, @"SpeechRequest can only be started once");
+    self.completionBlock = block;
+    self.data = [NSMutableData data];
+    state = RequestStateSending;
+    // Add a retention to this object so it doesn't dispose during the connection.
+    [self retain];
+
+    [[SpeechRecorder sharedRecorder] recordRequest: request interaction: [self recordingInteraction]];
+    self.connection = [[SpeechTransport sharedTransport] connectionWithRequest: request
+                                                                      delegate: self];
+    if (_connection == nil) {
+        // Report the error on the next time through the runloop.
+        [[NSOperationQueue mainQueue] addOperationWithBlock: ^{
+            NSError* error = [NSError errorWithDomain: ATTSpeechServiceErrorDomain
+                                                 code: ATTSpeechServiceErrorCodeConnectionFailure
+                                             userInfo: nil];
+            [self finishWithStrings: nil dictionary: nil error: error];
+        }];
+    }
+}
+
+- (void) startWithCachedResult: (NSDictionary*) json audio: (NSData*) audioData
+                     completion: (SpeechRequestBlock) block
+{
+    NSAssert(state == RequestStateInitialized, @"SpeechRequest can only be started once");
+    self.completionBlock = block;
+    self.isCachedResult = YES;
+    state = RequestStateSending;
+    [self retain];
+    SpeechRecorder* recorder = [SpeechRecorder sharedRecorder];
+    if (recorder.isRecording) {
+        // Record it as the request it stood in for, answered with the
+        // cached result, so a replay sends the audio and checks the result.
+        uint64_t recording = [self recordingInteraction];
+        NSMutableURLRequest* request = [self URLRequest];
+        request.HTTPBody = audioData;
+        [recorder recordRequest: request interaction: recording];
+        [recorder recordState: @"cached" interaction: recording];
+        [recorder recordResponseStatus: 200
+                                  data: [NSJSONSerialization dataWithJSONObject: json options: 0 error: NULL]
+                           interaction: recording];
+    }
+    // Answer on the next time through the runloop, as the server would.
+    [[NSOperationQueue mainQueue] addOperationWithBlock: ^{
+        [self finishWithStrings: ResponseStrings(json) dictionary: json error: nil];
+    }];
+}
+
+- (uint64_t) recordingInteraction
+{
+    if (interaction == 0)
+        interaction = [[SpeechRecorder sharedRecorder] beginInteraction];
+    return interaction;
+}
+
+- (void) finishWithStrings: (NSArray*) strings dictionary: (NSDictionary*) json error: (NSError*) error
+{
+    if (state != RequestStateSending)
+        return;
+    state = RequestStateFinished;
+    // HTTP errors were recorded with their response.
+    if (error != nil && ![error.domain isEqualToString: ATTSpeechServiceHTTPErrorDomain])
+        [[SpeechRecorder sharedRecorder] recordError: error interaction: interaction];
+    SpeechRequestBlock block = [[_completionBlock retain] autorelease];
+    [[self retain] autorelease];
+    [self clear];
+    block(strings, json, error);
+}
+
+- (void) clear
+{
+    // Completely dispose the connection, blocks, and response data when we are done.
+    self.completionBlock = nil;
+    self.partialResultBlock = nil;
+    self.lastResult = nil;
+    [_connection cancel];
+    self.connection = nil;
+    self.data = nil;
+    self.bodyStreamSource = nil;
+    // Stop feeding a body the canceled connection will never finish reading.
+    [_multipartBody closeStreams];
+    self.multipartBody = nil;
+    // And release the retain count we added during start.
+    [self release];
+}
+
+- (void) cancel
+{
+    if (state == RequestStateSending) {
+        state = RequestStateCanceled;
+        [[SpeechRecorder sharedRecorder] recordState: @"canceled" interaction: interaction];
+        [self clear];
+    }
+}
+
+// NSURLConnection delegate methods
+
+- (void) connection: (NSURLConnection*) connection
+ didReceiveResponse: (NSURLResponse*) response
+{
+    if ([response respondsToSelector: @selector(statusCode)])
+        self.statusCode = [(NSHTTPURLResponse*)response statusCode];
+    _data.length = 0;
+    memset(&scan, 0, sizeof(scan));
+    self.lastResult = nil;
+}
+
+- (NSInputStream*) connection: (NSURLConnection*) connection
+             needNewBodyStream: (NSURLRequest*) request
+{
+    // Sent again after a redirect or an authentication challenge, so start
+    // over from the beginning of the audio.
+    return _bodyStreamSource != nil ? _bodyStreamSource() : nil;
+}
+
+- (void) connection: (NSURLConnection*) connection
+     didReceiveData: (NSData*) data
+{
+    if (_data.length + data.length > MAX_RESPONSE_LENGTH) {
+        // Reported as a failed connection, as connection:didFailWithError:
+        // would, keeping the reason.
+        NSError* reason = [NSError errorWithDomain: NSURLErrorDomain
+                                              code: NSURLErrorDataLengthExceedsMaximum
+                                          userInfo: nil];
+        NSDictionary* userInfo = [NSDictionary dictionaryWithObject: reason forKey: NSUnderlyingErrorKey];
+        [self finishWithStrings: nil dictionary: nil
+                          error: [NSError errorWithDomain: ATTSpeechServiceErrorDomain
+                                                     code: ATTSpeechServiceErrorCodeConnectionFailure
+                                                 userInfo: userInfo]];
+        return;
+    }
+    [_data appendData: data];
+    if (_statusCode == 200)
+        [self scanForResults];
+}
+
+- (void) scanForResults
+{
+    // Report each top-level JSON object as its closing brace arrives.
+    // The partial block may cancel this request, so keep it alive meanwhile.
+    [[self retain] autorelease];
+    NSRange range;
+    while (state == RequestStateSending
+           && ScanToObject(&scan, (const char*)_data.bytes, _data.length, &range)) {
+        NSDictionary* json = [NSJSONSerialization JSONObjectWithData: [_data subdataWithRange: range]
+                                                             options: 0 error: NULL];
+        if ([json isKindOfClass: [NSDictionary class]]) {
+            self.lastResult = json;
+            if (_partialResultBlock != nil)
+                _partialResultBlock(ResponseStrings(json), json);
+        }
+    }
+}
+
+- (void) connectionDidFinishLoading: (NSURLConnection*) connection
+{
+    [[SpeechRecorder sharedRecorder] recordResponseStatus: _statusCode data: _data interaction: interaction];
+    if (_statusCode != 200) {
+        NSError* error = [NSError errorWithDomain: ATTSpeechServiceHTTPErrorDomain
+                                             code: _statusCode userInfo: nil];
+        [self finishWithStrings: nil dictionary: nil error: error];
+        return;
+    }
+    // A streamed response ends with the final result; otherwise the whole
+    // body is the result.
+    NSDictionary* json = _lastResult;
+    if (json == nil && _data.length)
+        json = [NSJSONSerialization JSONObjectWithData: _data options: 0 error: NULL];
+    if (![json isKindOfClass: [NSDictionary class]])
+        json = nil;
+    NSArray* strings = ResponseStrings(json);
+    // Only a result that recognized something is worth repeating.
+    if (_fingerprint != nil && strings.count > 0)
+        [_resultCache storeResult: json forFingerprint: _fingerprint context: _speechContext
+                        roundTrip: -[_startDate timeIntervalSinceNow]];
+    [self finishWithStrings: strings dictionary: json error: nil];
+}
+
+- (void) connection: (NSURLConnection*) connection didFailWithError: (NSError*) error
+{
+    // An error already in the service's terms, as a replay fails with,
+    // passes through as is.
+    if ([error.domain isEqualToString: ATTSpeechServiceErrorDomain]) {
+        [self finishWithStrings: nil dictionary: nil error: error];
+        return;
+    }
+    // Report it the way ATTSpeechService would, keeping the original error.
+    ATTSpeechServiceErrorCode code = ATTSpeechServiceErrorCodeConnectionFailure;
+    if ([error.domain isEqualToString: NSURLErrorDomain]
+        && (error.code == NSURLErrorTimedOut || error.code == NSURLErrorNetworkConnectionLost))
+        code = ATTSpeechServiceErrorCodeNoResponseFromServer;
+    NSDictionary* userInfo = [NSDictionary dictionaryWithObject: error forKey: NSUnderlyingErrorKey];
+    [self finishWithStrings: nil dictionary: nil
+                      error: [NSError errorWithDomain: ATTSpeechServiceErrorDomain
+                                                 code: code userInfo: userInfo]];
+}
+
+@end
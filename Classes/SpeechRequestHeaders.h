@@ -0,0 +1,46 @@
+//  SpeechRequestHeaders.h
+//
+// Licensed by AT&T under 'Software Development Kit Tools Agreement' 2012.
+// TERMS AND CONDITIONS FOR USE, REPRODUCTION, AND DISTRIBUTION: http://developer.att.com/sdk_agreement/
+// Copyright 2012 AT&T Intellectual Property. All rights reserved.
+// For more information contact developer.support@att.com http://developer.att.com
+
+#import <Foundation/NSObject.h>
+
+@class NSString, NSDictionary, NSMutableURLRequest;
+
+/**
+ * The HTTP headers of Speech API requests, formatted once for a speech
+ * context and set of X-Args and reused by every request that shares them.
+ *
+ * Percent-encoding the X-Args and building the header dictionary happen
+ * when the headers are first made, with the Content-Type of each audio
+ * format added the first time it is used.  A request then only copies in
+ * the finished dictionary and its bearer token, whose header value is
+ * reused while the token stays the same.
+ *
+ * Use SpeechRequestHeaders only from the main thread.
+**/
+@interface SpeechRequestHeaders : NSObject {
+}
+
+/** Headers for the given speech context and X-Arg pairs, either of which
+ *  may be nil.  Recently used headers are shared, so asking again with
+ *  the same arguments, especially the same dictionary, is cheap. **/
++ (SpeechRequestHeaders*) headersWithSpeechContext: (NSString*) speechContext
+                                             xArgs: (NSDictionary*) xArgs;
+
+@property (readonly, copy) NSString* speechContext;
+@property (readonly, copy) NSDictionary* xArgs;
+
+/** The header fields for audio of contentType, which may be nil, without
+ *  Authorization. **/
+- (NSDictionary*) fieldsForContentType: (NSString*) contentType;
+
+/** Sets the header fields of request for audio of contentType, sent with
+ *  bearerAuthToken.  Either may be nil. **/
+- (void) applyToRequest: (NSMutableURLRequest*) request
+            contentType: (NSString*) contentType
+        bearerAuthToken: (NSString*) bearerAuthToken;
+
+@end
@@ -0,0 +1,131 @@
+//  SpeechRequestHeaders.m
+//
+// Licensed by AT&T under 'Software Development Kit Tools Agreement' 2012.
+// TERMS AND CONDITIONS FOR USE, REPRODUCTION, AND DISTRIBUTION: http://developer.att.com/sdk_agreement/
+// Copyright 2012 AT&T Intellectual Property. All rights reserved.
+// For more information contact developer.support@att.com http://developer.att.com
+
+#import "SpeechRequestHeaders.h"
+
+/** Tune how many speech context and X-Arg combinations stay formatted.
+    An app typically has one per screen. **/
+static const NSUInteger RECENT_HEADERS_CAPACITY = 8;
+
+/* Formats X-Arg pairs as key=value,key=value with the values URL-escaped. */
+static NSString* FormatXArgs(NSDictionary* xArgs)
+{
+    NSMutableArray* pairs = [NSMutableArray arrayWithCapacity: xArgs.count];
+    for (NSString* key in xArgs) {
+        NSString* value = [[xArgs objectForKey: key] description];
+        NSString* escaped = [(NSString*)CFURLCreateStringByAddingPercentEscapes(
+            NULL, (CFStringRef)value, NULL, CFSTR(",=&+;:/?# "), kCFStringEncodingUTF8) autorelease];
+        [pairs addObject: [NSString stringWithFormat: @"%@=%@", key, escaped]];
+    }
+    return [pairs componentsJoinedByString: @","];
+}
+
+/* Whether two possibly nil objects are equal, checking identity first. */
+static BOOL SameObject(id a, id b)
+{
+    return a == b || (a != nil && [a isEqual: b]);
+}
+
+@interface SpeechRequestHeaders ()
+@property (readwrite, copy) NSString* speechContext;
+@property (readwrite, copy) NSDictionary* xArgs;
+@property (retain) NSDictionary* baseFields;              // without Content-Type
+@property (retain) NSMutableDictionary* fieldsByContentType;
+@property (copy) NSString* lastToken;
+@property (retain) NSString* lastAuthorization;
+@end
+
+@implementation SpeechRequestHeaders
+
+@synthesize speechContext = _speechContext;
+@synthesize xArgs = _xArgs;
+@synthesize baseFields = _baseFields;
+@synthesize fieldsByContentType = _fieldsByContentType;
+@synthesize lastToken = _lastToken;
+@synthesize lastAuthorization = _lastAuthorization;
+
++ (SpeechRequestHeaders*) headersWithSpeechContext: (NSString*) speechContext
+                                             xArgs: (NSDictionary*) xArgs
+{
+    // Most recently used first.
+    static NSMutableArray* recent = nil;
+    if (recent == nil)
+        recent = [[NSMutableArray alloc] initWithCapacity: RECENT_HEADERS_CAPACITY];
+
+    NSUInteger count = recent.count;
+    for (NSUInteger i = 0; i < count; i++) {
+        SpeechRequestHeaders* headers = [recent objectAtIndex: i];
+        if (SameObject(headers->_xArgs, xArgs) && SameObject(headers->_speechContext, speechContext)) {
+            if (i > 0) {
+                [headers retain];
+                [recent removeObjectAtIndex: i];
+                [recent insertObject: headers atIndex: 0];
+                [headers release];
+            }
+            return headers;
+        }
+    }
+
+    SpeechRequestHeaders* headers = [[[self alloc] init] autorelease];
+    headers.speechContext = speechContext;
+    headers.xArgs = xArgs;
+    NSMutableDictionary* fields = [NSMutableDictionary dictionaryWithObject: @"application/json"
+                                                                     forKey: @"Accept"];
+    if (speechContext != nil)
+        [fields setObject: speechContext forKey: @"X-SpeechContext"];
+    if (xArgs.count > 0)
+        [fields setObject: FormatXArgs(xArgs) forKey: @"X-Arg"];
+    headers.baseFields = fields;
+    headers.fieldsByContentType = [NSMutableDictionary dictionary];
+
+    if (count >= RECENT_HEADERS_CAPACITY)
+        [recent removeLastObject];
+    [recent insertObject: headers atIndex: 0];
+    return headers;
+}
+
+- (void) dealloc
+{
+    self.speechContext = nil;
+    self.xArgs = nil;
+    self.baseFields = nil;
+    self.fieldsByContentType = nil;
+    self.lastToken = nil;
+    self.lastAuthorization = nil;
+    [super dealloc];
+}
+
+- (NSDictionary*) fieldsForContentType: (NSString*) contentType
+{
+    if (contentType == nil)
+        return _baseFields;
+    NSDictionary* fields = [_fieldsByContentType objectForKey: contentType];
+    if (fields == nil) {
+        NSMutableDictionary* withType = [[_baseFields mutableCopy] autorelease];
+        [withType setObject: contentType forKey: @"Content-Type"];
+        fields = [[withType copy] autorelease];
+        [_fieldsByContentType setObject: fields forKey: contentType];
+    }
+    return fields;
+}
+
+- (void) applyToRequest: (NSMutableURLRequest*) request
+            contentType: (NSString*) contentType
+        bearerAuthToken: (NSString*) bearerAuthToken
+{
+    [request setAllHTTPHeaderFields: [self fieldsForContentType: contentType]];
+    if (bearerAuthToken != nil) {
+        // Tokens last for hours, so the header value nearly always matches.
+        if (!SameObject(_lastToken, bearerAuthToken)) {
+            self.lastToken = bearerAuthToken;
+            self.lastAuthorization = [@"Bearer " stringByAppendingString: bearerAuthToken];
+        }
+        [request setValue: _lastAuthorization forHTTPHeaderField: @"Authorization"];
+    }
+}
+
+@end
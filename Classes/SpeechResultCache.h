@@ -0,0 +1,75 @@
+//  SpeechResultCache.h
+//
+// Licensed by AT&T under 'Software Development Kit Tools Agreement' 2012.
+// TERMS AND CONDITIONS FOR USE, REPRODUCTION, AND DISTRIBUTION: http://developer.att.com/sdk_agreement/
+// Copyright 2012 AT&T Intellectual Property. All rights reserved.
+// For more information contact developer.support@att.com http://developer.att.com
+
+#import <Foundation/NSObject.h>
+#import <Foundation/NSDate.h>
+
+@class NSData, NSDictionary, NSString;
+
+/**
+ * Remembers recognition results by the sound of the audio, so an utterance
+ * that sounds like a recent one can be answered without asking the server.
+ * Meant for apps that hear the same few commands over and over.
+ *
+ * Audio is identified by a SpeechFingerprint of its speech, with leading
+ * and trailing silence removed.  Results are kept separately for each
+ * speech context, each in its own least-recently-used list.
+ *
+ * Attach a cache to SpeechRequest or SpeechBatch to use it.
+ * Use SpeechResultCache only from the main thread.
+**/
+@interface SpeechResultCache : NSObject {
+}
+
+/** Creates an empty cache. **/
++ (SpeechResultCache*) cache;
+
+/** Most results kept for each speech context.  Defaults to 100. **/
+@property (assign) NSUInteger capacity;
+
+/** How long a result stays usable.  Defaults to one day. **/
+@property (assign) NSTimeInterval timeToLive;
+
+/** Largest fingerprint distance that counts as the same utterance, as a
+ *  fraction of differing bits.  Defaults to 0.15; unrelated audio is
+ *  around 0.5. **/
+@property (assign) float maxDistance;
+
+/** Number of lookups, and how many of them were answered from the cache. **/
+@property (readonly) NSUInteger lookupCount;
+@property (readonly) NSUInteger hitCount;
+
+/** Total round-trip time the cached results originally took, counted once
+ *  for each hit: an estimate of the time the cache has saved. **/
+@property (readonly) NSTimeInterval timeSaved;
+
+/** The fingerprint of 16-bit mono WAV audio, or nil if the audio is in some
+ *  other format or too short to identify. **/
+- (NSData*) fingerprintForAudio: (NSData*) audioData;
+
+/** The cached recognition response for audio with this fingerprint in this
+ *  speech context, or nil if there is none. **/
+- (NSDictionary*) resultForFingerprint: (NSData*) fingerprint
+                               context: (NSString*) speechContext;
+
+/** Caches a recognition response that took roundTrip seconds to get. **/
+- (void) storeResult: (NSDictionary*) result
+      forFingerprint: (NSData*) fingerprint
+             context: (NSString*) speechContext
+           roundTrip: (NSTimeInterval) roundTrip;
+
+/** Empties the cache, keeping the counters. **/
+- (void) removeAllResults;
+
+/** Saves the cached results to a file, returning whether it succeeded. **/
+- (BOOL) writeToFile: (NSString*) path;
+
+/** Replaces the cached results with those saved in a file, returning
+ *  whether it succeeded.  Expired results are dropped. **/
+- (BOOL) readFromFile: (NSString*) path;
+
+@end
@@ -0,0 +1,207 @@
+//  SpeechResultCache.m
+//
+// Licensed by AT&T under 'Software Development Kit Tools Agreement' 2012.
+// TERMS AND CONDITIONS FOR USE, REPRODUCTION, AND DISTRIBUTION: http://developer.att.com/sdk_agreement/
+// Copyright 2012 AT&T Intellectual Property. All rights reserved.
+// For more information contact developer.support@att.com http://developer.att.com
+
+#import "SpeechResultCache.h"
+#import "SpeechFingerprint.h"
+#import "SpeechVAD.h"
+#import "SpeechWAV.h"
+
+/** Tune the cache size and lifetime based on how repetitive the app's
+    speech is. **/
+static const NSUInteger DEFAULT_CAPACITY = 100;
+static const NSTimeInterval DEFAULT_TIME_TO_LIVE = 24 * 60 * 60; // seconds
+
+/** Tune the matching: a lower distance means fewer false matches but
+    more misses. **/
+static const float DEFAULT_MAX_DISTANCE = 0.15f;
+
+/** Fingerprint words either way to search for the best alignment. **/
+static const int MAX_SHIFT = 3;
+
+// Keys of each entry, which is kept as a dictionary so it can be archived.
+static NSString* const FingerprintKey = @"fingerprint";
+static NSString* const ResultKey = @"result";
+static NSString* const DateKey = @"date";
+static NSString* const RoundTripKey = @"roundTrip";
+
+@interface SpeechResultCache ()
+@property (readwrite) NSUInteger lookupCount;
+@property (readwrite) NSUInteger hitCount;
+@property (readwrite) NSTimeInterval timeSaved;
+// Speech context -> array of entries, least recently used first.
+@property (retain) NSMutableDictionary* partitions;
+
+- (NSMutableArray*) partitionForContext: (NSString*) speechContext;
+@end
+
+@implementation SpeechResultCache
+
+@synthesize capacity = _capacity;
+@synthesize timeToLive = _timeToLive;
+@synthesize maxDistance = _maxDistance;
+@synthesize lookupCount = _lookupCount;
+@synthesize hitCount = _hitCount;
+@synthesize timeSaved = _timeSaved;
+@synthesize partitions = _partitions;
+
++ (SpeechResultCache*) cache
+{
+    return [[[self alloc] init] autorelease];
+}
+
+- (id) init
+{
+    self = [super init];
+    if (self != nil) {
+        _capacity = DEFAULT_CAPACITY;
+        _timeToLive = DEFAULT_TIME_TO_LIVE;
+        _maxDistance = DEFAULT_MAX_DISTANCE;
+        self.partitions = [NSMutableDictionary dictionary];
+    }
+    return self;
+}
+
+- (void) dealloc
+{
+    self.partitions = nil;
+    [super dealloc];
+}
+
+- (NSMutableArray*) partitionForContext: (NSString*) speechContext
+{
+    NSString* key = speechContext != nil ? speechContext : @"";
+    NSMutableArray* partition = [_partitions objectForKey: key];
+    if (partition == nil) {
+        partition = [NSMutableArray array];
+        [_partitions setObject: partition forKey: key];
+    }
+    return partition;
+}
+
+- (NSData*) fingerprintForAudio: (NSData*) audioData
+{
+    SpeechWAVInfo info;
+    if (!SpeechWAVParse(audioData.bytes, audioData.length, &info)
+        || info.channels != 1 || info.bits_per_sample != 16)
+        return nil;
+    const uint8_t* bytes = (const uint8_t*)audioData.bytes;
+    if (((uintptr_t)(bytes + info.data_offset) & 1) != 0)
+        return nil;
+    const int16_t* samples = (const int16_t*)(bytes + info.data_offset);
+    size_t count = info.data_length / 2;
+
+    // Fingerprint only the speech, so differing pauses don't matter.
+    SpeechVADConfig config;
+    SpeechVADDefaultConfig(&config, info.sample_rate);
+    size_t start = 0, end = count;
+    if (!SpeechVADFindSpeech(&config, samples, count, &start, &end))
+        return nil;
+
+    size_t length = SpeechFingerprintLength(end - start, info.sample_rate);
+    if (length == 0)
+        return nil;
+    NSMutableData* fingerprint = [NSMutableData dataWithLength: length * sizeof(uint32_t)];
+    SpeechFingerprintCompute(samples + start, end - start, info.sample_rate,
+                             fingerprint.mutableBytes, length);
+    return fingerprint;
+}
+
+- (NSDictionary*) resultForFingerprint: (NSData*) fingerprint
+                               context: (NSString*) speechContext
+{
+    if (fingerprint == nil)
+        return nil;
+    self.lookupCount = _lookupCount + 1;
+    NSMutableArray* partition = [self partitionForContext: speechContext];
+    NSDate* oldest = [NSDate dateWithTimeIntervalSinceNow: -_timeToLive];
+    NSDictionary* best = nil;
+    float bestDistance = _maxDistance;
+    NSUInteger i = partition.count;
+    while (i-- > 0) {
+        NSDictionary* entry = [partition objectAtIndex: i];
+        if ([[entry objectForKey: DateKey] compare: oldest] == NSOrderedAscending) {
+            [partition removeObjectAtIndex: i];
+            continue;
+        }
+        NSData* other = [entry objectForKey: FingerprintKey];
+        float distance = SpeechFingerprintDistance(fingerprint.bytes, fingerprint.length / sizeof(uint32_t),
+                                                   other.bytes, other.length / sizeof(uint32_t), MAX_SHIFT);
+        if (distance <= bestDistance) {
+            best = entry;
+            bestDistance = distance;
+        }
+    }
+    if (best == nil)
+        return nil;
+
+    // Move it to the most recently used end.
+    [[best retain] autorelease];
+    [partition removeObjectIdenticalTo: best];
+    [partition addObject: best];
+    self.hitCount = _hitCount + 1;
+    self.timeSaved = _timeSaved + [[best objectForKey: RoundTripKey] doubleValue];
+    return [best objectForKey: ResultKey];
+}
+
+- (void) storeResult: (NSDictionary*) result
+      forFingerprint: (NSData*) fingerprint
+             context: (NSString*) speechContext
+           roundTrip: (NSTimeInterval) roundTrip
+{
+    if (result == nil || fingerprint == nil || _capacity == 0)
+        return;
+    NSMutableArray* partition = [self partitionForContext: speechContext];
+    while (partition.count >= _capacity)
+        [partition removeObjectAtIndex: 0];
+    [partition addObject: [NSDictionary dictionaryWithObjectsAndKeys:
+                           [[fingerprint copy] autorelease], FingerprintKey,
+                           result, ResultKey,
+                           [NSDate date], DateKey,
+                           [NSNumber numberWithDouble: roundTrip], RoundTripKey,
+                           nil]];
+}
+
+- (void) removeAllResults
+{
+    [_partitions removeAllObjects];
+}
+
+- (BOOL) writeToFile: (NSString*) path
+{
+    // Keyed archiving, since JSON results can hold NSNull, which a
+    // property list can't.
+    return [NSKeyedArchiver archiveRootObject: _partitions toFile: path];
+}
+
+- (BOOL) readFromFile: (NSString*) path
+{
+    NSDictionary* saved = nil;
+    @try {
+        saved = [NSKeyedUnarchiver unarchiveObjectWithFile: path];
+    }
+    @catch (NSException* exception) {
+        // A damaged file is the same as no file.
+    }
+    if (![saved isKindOfClass: [NSDictionary class]])
+        return NO;
+
+    NSDate* oldest = [NSDate dateWithTimeIntervalSinceNow: -_timeToLive];
+    [_partitions removeAllObjects];
+    for (NSString* key in saved) {
+        NSMutableArray* partition = [NSMutableArray array];
+        for (NSDictionary* entry in [saved objectForKey: key]) {
+            if ([[entry objectForKey: DateKey] compare: oldest] == NSOrderedDescending)
+                [partition addObject: entry];
+        }
+        while (partition.count > _capacity)
+            [partition removeObjectAtIndex: 0];
+        [_partitions setObject: partition forKey: key];
+    }
+    return YES;
+}
+
+@end
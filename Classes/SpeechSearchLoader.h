@@ -0,0 +1,60 @@
+//  SpeechSearchLoader.h
+//
+// Licensed by AT&T under 'Software Development Kit Tools Agreement' 2012.
+// TERMS AND CONDITIONS FOR USE, REPRODUCTION, AND DISTRIBUTION: http://developer.att.com/sdk_agreement/
+// Copyright 2012 AT&T Intellectual Property. All rights reserved.
+// For more information contact developer.support@att.com http://developer.att.com
+
+#import <UIKit/UIKit.h>
+
+/**
+ * Shows search results for recognized text in a web view, quickly.
+ *
+ * Results that arrive in quick succession are debounced, so only the last
+ * one is searched.  A new query cancels the loads for the old one.  The
+ * other hypotheses of an n-best list are searched at the same time, so
+ * the user's correction is likely ready.  Pages are cached by query, after
+ * normalizing case and spacing, so a repeated query shows at once.
+ *
+ * Use SpeechSearchLoader only from the main thread.
+**/
+@interface SpeechSearchLoader : NSObject {
+}
+
+/** Creates a loader that searches with URLFormat, a format string whose
+ *  one %@ is replaced by the escaped query, and shows pages in webView. **/
++ (SpeechSearchLoader*) loaderWithURLFormat: (NSString*) URLFormat
+                                    webView: (UIWebView*) webView;
+
+/** The web view that shows results.  Not retained. **/
+@property (assign) UIWebView* webView;
+
+/** How long to wait for another query before searching.  Defaults to 0.15
+ *  seconds. **/
+@property (assign) NSTimeInterval debounceInterval;
+
+/** Most alternative hypotheses to search ahead of time.  Defaults to 2. **/
+@property (assign) NSUInteger maxPrefetches;
+
+/** Most pages to keep, and for how long.  Default to 20 and 10 minutes. **/
+@property (assign) NSUInteger cacheCapacity;
+@property (assign) NSTimeInterval timeToLive;
+
+/** Shows results for query, and searches ahead for the alternatives, such
+ *  as the rest of an n-best list.  Alternatives equal to query are skipped. **/
+- (void) showResultsForQuery: (NSString*) query alternatives: (NSArray*) alternatives;
+
+/** Shows results as above, calling block once query's page has been handed
+ *  to the web view, or the web view left to load it itself after a failed
+ *  search.  block is not called if a newer query or cancel comes first. **/
+- (void) showResultsForQuery: (NSString*) query alternatives: (NSArray*) alternatives
+                  completion: (void (^)(void)) block;
+
+/** Cancels every search in progress, and the completion block waiting on
+ *  it.  The cache is kept. **/
+- (void) cancel;
+
+/** Empties the cache. **/
+- (void) removeAllResults;
+
+@end
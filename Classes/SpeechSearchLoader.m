@@ -0,0 +1,404 @@
+//  SpeechSearchLoader.m
+//
+// Licensed by AT&T under 'Software Development Kit Tools Agreement' 2012.
+// TERMS AND CONDITIONS FOR USE, REPRODUCTION, AND DISTRIBUTION: http://developer.att.com/sdk_agreement/
+// Copyright 2012 AT&T Intellectual Property. All rights reserved.
+// For more information contact developer.support@att.com http://developer.att.com
+
+#import "SpeechSearchLoader.h"
+
+/** Tune the debounce to how quickly results can follow each other, such as
+    interim results while the user is still talking. **/
+static const NSTimeInterval DEFAULT_DEBOUNCE = 0.15; // seconds
+
+/** Tune the prefetching to how often users pick an alternative. **/
+static const NSUInteger DEFAULT_MAX_PREFETCHES = 2;
+
+/** Tune the cache to how often users repeat themselves. **/
+static const NSUInteger DEFAULT_CACHE_CAPACITY = 20;
+static const NSTimeInterval DEFAULT_TIME_TO_LIVE = 10 * 60; // seconds
+
+/** Tune the timeout values based on application behavior. **/
+static const NSTimeInterval FETCH_TIMEOUT = 15.0; // seconds
+
+// Keys of each cached page.
+static NSString* const DataKey = @"data";
+static NSString* const MIMETypeKey = @"MIMEType";
+static NSString* const EncodingKey = @"encoding";
+static NSString* const URLKey = @"URL";
+static NSString* const DateKey = @"date";
+
+/* The cache key for a query: lowercase, with single spaces between words. */
+static NSString* QueryKey(NSString* query)
+{
+    NSArray* words = [query.lowercaseString componentsSeparatedByCharactersInSet:
+                      [NSCharacterSet whitespaceAndNewlineCharacterSet]];
+    words = [words filteredArrayUsingPredicate: [NSPredicate predicateWithFormat: @"length > 0"]];
+    return [words componentsJoinedByString: @" "];
+}
+
+typedef void (^SpeechSearchFetchBlock)(NSData* data, NSURLResponse* response, NSError* error);
+
+// Memory Management
+//
+// NSURLConnection retains each SpeechSearchFetch while it loads, and the
+// fetch holds its block only until it finishes or is canceled.  The blocks
+// don't retain the loader, which cancels its fetches when it goes away.
+
+/**
+ * Loads one page into memory.
+**/
+@interface SpeechSearchFetch : NSObject {
+    @private
+    NSURLConnection* connection;
+    NSMutableData* data;
+    NSURLResponse* response;
+    SpeechSearchFetchBlock block;
+}
+- (id) initWithURL: (NSURL*) url block: (SpeechSearchFetchBlock) aBlock;
+- (void) finishWithError: (NSError*) error;
+- (void) cancel;
+@end
+
+@implementation SpeechSearchFetch
+
+- (id) initWithURL: (NSURL*) url block: (SpeechSearchFetchBlock) aBlock
+{
+    self = [super init];
+    if (self != nil) {
+        block = [aBlock copy];
+        data = [[NSMutableData alloc] init];
+        NSURLRequest* request = [NSURLRequest requestWithURL: url
+                                                 cachePolicy: NSURLRequestUseProtocolCachePolicy
+                                             timeoutInterval: FETCH_TIMEOUT];
+        connection = [[NSURLConnection alloc] initWithRequest: request delegate: self];
+    }
+    return self;
+}
+
+- (void) dealloc
+{
+    [connection cancel];
+    [connection release];
+    [data release];
+    [response release];
+    [block release];
+    [super dealloc];
+}
+
+- (void) finishWithError: (NSError*) error
+{
+    SpeechSearchFetchBlock finished = [block autorelease];
+    block = nil;
+    if (finished != nil)
+        finished(error == nil ? data : nil, response, error);
+}
+
+- (void) cancel
+{
+    [connection cancel];
+    [block release];
+    block = nil;
+}
+
+- (void) connection: (NSURLConnection*) aConnection didReceiveResponse: (NSURLResponse*) aResponse
+{
+    [response release];
+    response = [aResponse retain];
+    data.length = 0;
+}
+
+- (void) connection: (NSURLConnection*) aConnection didReceiveData: (NSData*) someData
+{
+    [data appendData: someData];
+}
+
+- (void) connectionDidFinishLoading: (NSURLConnection*) aConnection
+{
+    NSInteger status = [response respondsToSelector: @selector(statusCode)]
+        ? [(NSHTTPURLResponse*)response statusCode] : 200;
+    NSError* error = nil;
+    if (status != 200)
+        error = [NSError errorWithDomain: NSURLErrorDomain code: NSURLErrorBadServerResponse userInfo: nil];
+    [self finishWithError: error];
+}
+
+- (void) connection: (NSURLConnection*) aConnection didFailWithError: (NSError*) error
+{
+    [self finishWithError: error];
+}
+
+@end
+
+#pragma mark -
+
+@interface SpeechSearchLoader ()
+@property (copy) NSString* URLFormat;
+@property (retain) NSMutableDictionary* fetches;    // query key -> SpeechSearchFetch
+@property (retain) NSMutableDictionary* cache;      // query key -> page dictionary
+@property (retain) NSMutableArray* cacheOrder;      // query keys, least recently used first
+@property (copy) NSString* pendingQuery;
+@property (copy) NSArray* pendingAlternatives;
+@property (retain) NSTimer* debounceTimer;
+@property (copy) NSString* shownKey;
+@property (copy) void (^pendingCompletion)(void);
+@property (copy) void (^shownCompletion)(void);     // waiting for shownKey's page
+
+- (NSURL*) URLForQuery: (NSString*) query;
+- (NSDictionary*) freshPageForKey: (NSString*) key;
+- (NSDictionary*) cachedPageForKey: (NSString*) key;
+- (void) debounceTimerFired: (NSTimer*) timer;
+- (void) fetchQuery: (NSString*) query key: (NSString*) key;
+- (void) fetchForKey: (NSString*) key URL: (NSURL*) url finishedWithData: (NSData*) data
+            response: (NSURLResponse*) response error: (NSError*) error;
+- (void) showPage: (NSDictionary*) page;
+- (void) didShowResults;
+@end
+
+@implementation SpeechSearchLoader
+
+@synthesize webView = _webView;
+@synthesize debounceInterval = _debounceInterval;
+@synthesize maxPrefetches = _maxPrefetches;
+@synthesize cacheCapacity = _cacheCapacity;
+@synthesize timeToLive = _timeToLive;
+@synthesize URLFormat = _URLFormat;
+@synthesize fetches = _fetches;
+@synthesize cache = _cache;
+@synthesize cacheOrder = _cacheOrder;
+@synthesize pendingQuery = _pendingQuery;
+@synthesize pendingAlternatives = _pendingAlternatives;
+@synthesize debounceTimer = _debounceTimer;
+@synthesize shownKey = _shownKey;
+@synthesize pendingCompletion = _pendingCompletion;
+@synthesize shownCompletion = _shownCompletion;
+
++ (SpeechSearchLoader*) loaderWithURLFormat: (NSString*) URLFormat
+                                    webView: (UIWebView*) webView
+{
+    SpeechSearchLoader* loader = [[[self alloc] init] autorelease];
+    loader.URLFormat = URLFormat;
+    loader.webView = webView;
+    return loader;
+}
+
+- (id) init
+{
+    self = [super init];
+    if (self != nil) {
+        _debounceInterval = DEFAULT_DEBOUNCE;
+        _maxPrefetches = DEFAULT_MAX_PREFETCHES;
+        _cacheCapacity = DEFAULT_CACHE_CAPACITY;
+        _timeToLive = DEFAULT_TIME_TO_LIVE;
+        self.fetches = [NSMutableDictionary dictionary];
+        self.cache = [NSMutableDictionary dictionary];
+        self.cacheOrder = [NSMutableArray array];
+    }
+    return self;
+}
+
+- (void) dealloc
+{
+    [self cancel];
+    self.URLFormat = nil;
+    self.fetches = nil;
+    self.cache = nil;
+    self.cacheOrder = nil;
+    self.pendingQuery = nil;
+    self.pendingAlternatives = nil;
+    self.shownKey = nil;
+    self.pendingCompletion = nil;
+    self.shownCompletion = nil;
+    [super dealloc];
+}
+
+- (NSURL*) URLForQuery: (NSString*) query
+{
+    NSString* escaped = [(NSString*)CFURLCreateStringByAddingPercentEscapes(
+        NULL, (CFStringRef)query, NULL, CFSTR("!*'();:@&=+$,/?#[]"), kCFStringEncodingUTF8) autorelease];
+    return [NSURL URLWithString: [_URLFormat stringByReplacingOccurrencesOfString: @"%@" withString: escaped]];
+}
+
+// The page cached for key, if it hasn't expired, leaving its recency alone.
+- (NSDictionary*) freshPageForKey: (NSString*) key
+{
+    NSDictionary* page = [_cache objectForKey: key];
+    if (page == nil)
+        return nil;
+    if (-[[page objectForKey: DateKey] timeIntervalSinceNow] > _timeToLive) {
+        [_cache removeObjectForKey: key];
+        [_cacheOrder removeObject: key];
+        return nil;
+    }
+    return page;
+}
+
+// The page cached for key, as used: it becomes the most recently used.
+- (NSDictionary*) cachedPageForKey: (NSString*) key
+{
+    NSDictionary* page = [self freshPageForKey: key];
+    if (page == nil)
+        return nil;
+    // Move it to the most recently used end.
+    [[key retain] autorelease];
+    [_cacheOrder removeObject: key];
+    [_cacheOrder addObject: key];
+    return page;
+}
+
+- (void) showResultsForQuery: (NSString*) query alternatives: (NSArray*) alternatives
+{
+    [self showResultsForQuery: query alternatives: alternatives completion: nil];
+}
+
+- (void) showResultsForQuery: (NSString*) query alternatives: (NSArray*) alternatives
+                  completion: (void (^)(void)) block
+{
+    self.pendingCompletion = block;
+    self.pendingQuery = query;
+    self.pendingAlternatives = alternatives;
+    [_debounceTimer invalidate];
+    self.debounceTimer = nil;
+    // A page already in hand is worth showing without waiting.
+    if ([_cache objectForKey: QueryKey(query)] != nil) {
+        [self debounceTimerFired: nil];
+        return;
+    }
+    self.debounceTimer =
+        [NSTimer scheduledTimerWithTimeInterval: _debounceInterval target: self
+                                       selector: @selector(debounceTimerFired:)
+                                       userInfo: nil repeats: NO];
+}
+
+- (void) debounceTimerFired: (NSTimer*) timer
+{
+    self.debounceTimer = nil;
+    NSString* key = QueryKey(_pendingQuery);
+    if (key.length == 0)
+        return;
+
+    // Choose the alternatives to search ahead, in rank order.
+    NSMutableArray* keys = [NSMutableArray arrayWithObject: key];
+    NSMutableArray* queries = [NSMutableArray arrayWithObject: _pendingQuery];
+    for (NSString* alternative in _pendingAlternatives) {
+        if (queries.count > _maxPrefetches)
+            break;
+        NSString* alternativeKey = QueryKey(alternative);
+        if (alternativeKey.length > 0 && ![keys containsObject: alternativeKey]) {
+            [keys addObject: alternativeKey];
+            [queries addObject: alternative];
+        }
+    }
+
+    // Searches for anything else are no longer wanted.
+    for (NSString* fetchKey in [_fetches allKeys]) {
+        if (![keys containsObject: fetchKey]) {
+            [[_fetches objectForKey: fetchKey] cancel];
+            [_fetches removeObjectForKey: fetchKey];
+        }
+    }
+
+    self.shownKey = key;
+    self.shownCompletion = _pendingCompletion;
+    self.pendingCompletion = nil;
+    NSDictionary* page = [self cachedPageForKey: key];
+    if (page != nil) {
+        [self showPage: page];
+        [self didShowResults];
+    }
+    // Looking ahead isn't a use, so it doesn't keep the alternatives cached.
+    NSUInteger i;
+    for (i = 0; i < keys.count; i++) {
+        NSString* fetchKey = [keys objectAtIndex: i];
+        if ([_fetches objectForKey: fetchKey] == nil && [self freshPageForKey: fetchKey] == nil)
+            [self fetchQuery: [queries objectAtIndex: i] key: fetchKey];
+    }
+}
+
+- (void) fetchQuery: (NSString*) query key: (NSString*) key
+{
+    NSURL* url = [self URLForQuery: query];
+    if (url == nil)
+        return;
+    __block SpeechSearchLoader* blockSelf = self;
+    SpeechSearchFetch* fetch =
+        [[SpeechSearchFetch alloc] initWithURL: url block: ^(NSData* data, NSURLResponse* response, NSError* error) {
+            [blockSelf fetchForKey: key URL: url finishedWithData: data response: response error: error];
+        }];
+    [_fetches setObject: fetch forKey: key];
+    [fetch release];
+}
+
+- (void) fetchForKey: (NSString*) key URL: (NSURL*) url finishedWithData: (NSData*) data
+            response: (NSURLResponse*) response error: (NSError*) error
+{
+    [_fetches removeObjectForKey: key];
+    if (data == nil) {
+        // Let the web view try for itself, and show its own error.
+        if ([key isEqualToString: _shownKey]) {
+            [_webView stopLoading];
+            [_webView loadRequest: [NSURLRequest requestWithURL: url]];
+            [self didShowResults];
+        }
+        return;
+    }
+
+    NSDictionary* page =
+        [NSDictionary dictionaryWithObjectsAndKeys:
+         data, DataKey,
+         response.MIMEType != nil ? response.MIMEType : @"text/html", MIMETypeKey,
+         response.textEncodingName != nil ? response.textEncodingName : @"utf-8", EncodingKey,
+         response.URL != nil ? response.URL : url, URLKey,
+         [NSDate date], DateKey,
+         nil];
+    if (_cacheCapacity > 0) {
+        [_cacheOrder removeObject: key];
+        [_cacheOrder addObject: key];
+        [_cache setObject: page forKey: key];
+        while (_cacheOrder.count > _cacheCapacity) {
+            [_cache removeObjectForKey: [_cacheOrder objectAtIndex: 0]];
+            [_cacheOrder removeObjectAtIndex: 0];
+        }
+    }
+    if ([key isEqualToString: _shownKey]) {
+        [self showPage: page];
+        [self didShowResults];
+    }
+}
+
+- (void) showPage: (NSDictionary*) page
+{
+    [_webView stopLoading];
+    [_webView loadData: [page objectForKey: DataKey]
+              MIMEType: [page objectForKey: MIMETypeKey]
+      textEncodingName: [page objectForKey: EncodingKey]
+               baseURL: [page objectForKey: URLKey]];
+}
+
+// Calls the completion block waiting on the page just shown.
+- (void) didShowResults
+{
+    void (^block)(void) = [[_shownCompletion retain] autorelease];
+    self.shownCompletion = nil;
+    if (block != nil)
+        block();
+}
+
+- (void) cancel
+{
+    [_debounceTimer invalidate];
+    self.debounceTimer = nil;
+    self.pendingCompletion = nil;
+    self.shownCompletion = nil;
+    for (SpeechSearchFetch* fetch in [_fetches allValues])
+        [fetch cancel];
+    [_fetches removeAllObjects];
+}
+
+- (void) removeAllResults
+{
+    [_cache removeAllObjects];
+    [_cacheOrder removeAllObjects];
+}
+
+@end
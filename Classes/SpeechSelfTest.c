@@ -0,0 +1,346 @@
+//  SpeechSelfTest.c
+//
+// Licensed by AT&T under 'Software Development Kit Tools Agreement' 2012.
+// TERMS AND CONDITIONS FOR USE, REPRODUCTION, AND DISTRIBUTION: http://developer.att.com/sdk_agreement/
+// Copyright 2012 AT&T Intellectual Property. All rights reserved.
+// For more information contact developer.support@att.com http://developer.att.com
+
+#include "SpeechSelfTest.h"
+#include "SpeechAuthParser.h"
+#include "SpeechFingerprint.h"
+#include "SpeechMeter.h"
+#include "SpeechRecording.h"
+#include "SpeechTrie.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const double PI = 3.14159265358979323846;
+
+static int Checks = 0;
+static int Failures = 0;
+
+#define CHECK(condition) Check((condition) != 0, #condition, __FILE__, __LINE__)
+
+static void Check(int passed, const char* condition, const char* file, int line)
+{
+    Checks++;
+    if (!passed) {
+        Failures++;
+        fprintf(stderr, "%s:%d: check failed: %s\n", file, line, condition);
+    }
+}
+
+// SpeechRecording
+
+/* Copies the first length bytes of one file to another, as a crash that
+   cut the recording short would leave it.  Returns 0, or -1 on failure. */
+static int CopyPrefix(const char* from, const char* to, long length)
+{
+    FILE* in = fopen(from, "rb");
+    FILE* out = fopen(to, "wb");
+    int result = (in != NULL && out != NULL) ? 0 : -1;
+    while (result == 0 && length > 0) {
+        char buffer[256];
+        size_t chunk = length < (long)sizeof(buffer) ? (size_t)length : sizeof(buffer);
+        if (fread(buffer, 1, chunk, in) != chunk || fwrite(buffer, 1, chunk, out) != chunk)
+            result = -1;
+        length -= (long)chunk;
+    }
+    if (in != NULL)
+        fclose(in);
+    if (out != NULL && fclose(out) != 0)
+        result = -1;
+    return result;
+}
+
+static void CheckRecording(const char* directory)
+{
+    static const char request[] = "POST https://example.com/speech\r\nContent-Type: audio/wav\r\n";
+    static const char state[] = "state.recording";
+    char path[1024], torn_path[1024];
+    unsigned char audio[3000];
+    unsigned char buffer[3000];
+    SpeechRecordingWriter* writer;
+    SpeechRecordingReader* reader;
+    const SpeechRecordingEntry* entry;
+    size_t i;
+
+    snprintf(path, sizeof(path), "%s/SpeechSelfTest.sprc", directory);
+    snprintf(torn_path, sizeof(torn_path), "%s/SpeechSelfTestTorn.sprc", directory);
+    for (i = 0; i < sizeof(audio); i++)
+        audio[i] = (unsigned char)(i * 7);
+
+    writer = SpeechRecordingCreate(path);
+    CHECK(writer != NULL);
+    if (writer == NULL)
+        return;
+    CHECK(SpeechRecordingAppend(writer, 1, SpeechRecordingTypeRequest, 10, request, sizeof(request) - 1) == 0);
+    CHECK(SpeechRecordingAppend(writer, 1, SpeechRecordingTypeAudio, 20, audio, sizeof(audio)) == 0);
+    CHECK(SpeechRecordingAppend(writer, 2, SpeechRecordingTypeState, 30, state, sizeof(state) - 1) == 0);
+    CHECK(SpeechRecordingAppend(writer, 2, SpeechRecordingTypeError, 40, NULL, 0) == 0);
+    CHECK(SpeechRecordingFinish(writer) == 0);
+
+    // Read back through the index, out of order.
+    reader = SpeechRecordingOpen(path);
+    CHECK(reader != NULL);
+    if (reader != NULL) {
+        CHECK(SpeechRecordingCount(reader) == 4);
+        entry = SpeechRecordingEntryAt(reader, 2);
+        CHECK(entry->type == SpeechRecordingTypeState && entry->interaction == 2 && entry->timestamp == 30);
+        CHECK(entry->length == sizeof(state) - 1);
+        CHECK(SpeechRecordingRead(reader, entry, buffer) == 0 && memcmp(buffer, state, entry->length) == 0);
+        entry = SpeechRecordingEntryAt(reader, 1);
+        CHECK(entry->type == SpeechRecordingTypeAudio && entry->length == sizeof(audio));
+        CHECK(SpeechRecordingRead(reader, entry, buffer) == 0 && memcmp(buffer, audio, sizeof(audio)) == 0);
+        entry = SpeechRecordingEntryAt(reader, 3);
+        CHECK(entry->type == SpeechRecordingTypeError && entry->length == 0);
+        SpeechRecordingClose(reader);
+    }
+
+    // Without its index, and torn in the middle of the audio, the file
+    // still gives the records written before the tear.
+    entry = NULL;
+    reader = SpeechRecordingOpen(path);
+    if (reader != NULL) {
+        long tear = (long)SpeechRecordingEntryAt(reader, 1)->offset + 100;
+        SpeechRecordingClose(reader);
+        CHECK(CopyPrefix(path, torn_path, tear) == 0);
+        reader = SpeechRecordingOpen(torn_path);
+        CHECK(reader != NULL);
+        if (reader != NULL) {
+            CHECK(SpeechRecordingCount(reader) == 1);
+            entry = SpeechRecordingEntryAt(reader, 0);
+            CHECK(entry->type == SpeechRecordingTypeRequest && entry->length == sizeof(request) - 1);
+            CHECK(SpeechRecordingRead(reader, entry, buffer) == 0 && memcmp(buffer, request, entry->length) == 0);
+            SpeechRecordingClose(reader);
+        }
+        remove(torn_path);
+    }
+
+    // Anything else isn't a recording.
+    CHECK(CopyPrefix(path, torn_path, 4) == 0);
+    reader = SpeechRecordingOpen(torn_path);
+    CHECK(reader == NULL);
+    if (reader != NULL)
+        SpeechRecordingClose(reader);
+    remove(torn_path);
+    remove(path);
+}
+
+// SpeechTrie
+
+static void CheckTrie(void)
+{
+    static const char* const phrases[] = { "call home", "call mom", "play music", "pause music", "weather" };
+    SpeechTrie* trie = SpeechTrieCreate();
+    int32_t id = -1;
+    size_t i;
+
+    CHECK(trie != NULL);
+    if (trie == NULL)
+        return;
+    CHECK(SpeechTrieMatch(trie, "call", 4, 10, &id) == -1);
+    for (i = 0; i < sizeof(phrases) / sizeof(phrases[0]); i++)
+        CHECK(SpeechTrieAdd(trie, phrases[i], strlen(phrases[i]), (int32_t)i) == 0);
+    CHECK(SpeechTrieCount(trie) == 5);
+
+    CHECK(SpeechTrieMatch(trie, "call mom", 8, 0, &id) == 0 && id == 1);
+    CHECK(SpeechTrieMatch(trie, "call mum", 8, 2, &id) == 1 && id == 1);
+    CHECK(SpeechTrieMatch(trie, "play musik", 10, 2, &id) == 1 && id == 2);
+    CHECK(SpeechTrieMatch(trie, "wether", 6, 1, &id) == 1 && id == 4);
+    CHECK(SpeechTrieMatch(trie, "wthr", 4, 2, &id) == -1);
+    // A prefix of a phrase is that many deletions from it.
+    CHECK(SpeechTrieMatch(trie, "call", 4, 4, &id) == 4 && id == 1);
+    CHECK(SpeechTrieMatch(trie, "call", 4, 3, &id) == -1);
+    // "call hom" is one edit from "call home" and three from "call mom".
+    CHECK(SpeechTrieMatch(trie, "call hom", 8, 3, &id) == 1 && id == 0);
+    // Equally near phrases go to the lower id.
+    CHECK(SpeechTrieMatch(trie, "call xom", 8, 3, &id) == 1 && id == 1);
+    CHECK(SpeechTrieMatch(trie, "p music", 7, 4, &id) == 3 && id == 2);
+
+    // Adding a phrase again replaces its id without adding it twice.
+    CHECK(SpeechTrieAdd(trie, "weather", 7, 9) == 0);
+    CHECK(SpeechTrieCount(trie) == 5);
+    CHECK(SpeechTrieMatch(trie, "weather", 7, 0, &id) == 0 && id == 9);
+    SpeechTrieDestroy(trie);
+}
+
+// SpeechMeter
+
+static void CheckMeter(void)
+{
+    static SpeechMeter meter;
+    static SpeechMeterQueue queue;
+    SpeechMeterFrame frame, popped;
+    int16_t samples[512];
+    size_t i;
+    int band, loudest = 0;
+    uint32_t n;
+
+    CHECK(SpeechMeterInit(&meter, 16000, 500) == -1);
+    CHECK(SpeechMeterInit(&meter, 16000, 2 * SPEECH_METER_MAX_FRAME) == -1);
+    CHECK(SpeechMeterInit(&meter, 16000, 512) == 0);
+
+    memset(samples, 0, sizeof(samples));
+    SpeechMeterAnalyze(&meter, samples, &frame);
+    CHECK(frame.position == 0);
+    CHECK(frame.rms_db <= -90.0f && frame.peak_db <= -90.0f && frame.clipped == 0);
+
+    // A 1 kHz sine at half scale is 6 dB below full scale at its peak and
+    // 9 dB in RMS, with its energy in the band holding 1 kHz.
+    for (i = 0; i < 512; i++)
+        samples[i] = (int16_t)(16384.0 * sin(2.0 * PI * 1000.0 * (double)i / 16000.0));
+    SpeechMeterAnalyze(&meter, samples, &frame);
+    CHECK(frame.position == 512);
+    CHECK(fabsf(frame.peak_db + 6.0f) < 0.2f);
+    CHECK(fabsf(frame.rms_db + 9.0f) < 0.3f);
+    CHECK(frame.clipped == 0);
+    for (band = 1; band < SPEECH_METER_BANDS; band++) {
+        if (frame.bands_db[band] > frame.bands_db[loudest])
+            loudest = band;
+    }
+    CHECK(meter.band_start[loudest] <= 32 && 32 < meter.band_start[loudest + 1]);
+
+    for (i = 0; i < 512; i++)
+        samples[i] = (i % 2) ? 32767 : -32768;
+    SpeechMeterAnalyze(&meter, samples, &frame);
+    CHECK(frame.clipped == 512);
+    CHECK(frame.peak_db > -0.1f);
+
+    // The queue holds its capacity, then drops and counts the rest.
+    SpeechMeterQueueInit(&queue);
+    CHECK(SpeechMeterQueuePop(&queue, &popped) == 0);
+    for (n = 0; n < SPEECH_METER_QUEUE_CAPACITY; n++) {
+        frame.position = n;
+        CHECK(SpeechMeterQueuePush(&queue, &frame) == 1);
+    }
+    CHECK(SpeechMeterQueuePush(&queue, &frame) == 0);
+    CHECK(queue.dropped == 1);
+    for (n = 0; n < SPEECH_METER_QUEUE_CAPACITY; n++)
+        CHECK(SpeechMeterQueuePop(&queue, &popped) == 1 && popped.position == n);
+    CHECK(SpeechMeterQueuePop(&queue, &popped) == 0);
+}
+
+// SpeechAuthParser
+
+/* Parses body fed in pieces of step bytes, then finishes.  Bytes after
+   the object are fed too, since only whitespace may follow it. */
+static SpeechAuthParseStatus Parse(SpeechAuthParser* parser, const char* body, size_t step, size_t max_length)
+{
+    size_t length = strlen(body);
+    size_t offset;
+    SpeechAuthParseStatus status = SpeechAuthParseIncomplete;
+    SpeechAuthParserInit(parser, max_length);
+    for (offset = 0; offset < length && (status == SpeechAuthParseIncomplete || status == SpeechAuthParseDone);
+         offset += step) {
+        size_t chunk = length - offset < step ? length - offset : step;
+        status = SpeechAuthParserFeed(parser, body + offset, chunk);
+    }
+    if (status == SpeechAuthParseIncomplete || status == SpeechAuthParseDone)
+        status = SpeechAuthParserFinish(parser);
+    return status;
+}
+
+static void CheckAuthParser(void)
+{
+    static SpeechAuthParser parser;
+    static const char body[] =
+        "{\"access_token\":\"abc\\u0041\\\"def\",\"token_type\":\"bearer\",\n"
+        " \"expires_in\":3600, \"extra\":{\"list\":[1,2,{\"access_token\":\"nested\"}]},"
+        " \"refresh_token\":\"r1\"}";
+    size_t step;
+
+    // Any split of the body gives the same result.
+    for (step = 1; step <= sizeof(body); step += 7) {
+        CHECK(Parse(&parser, body, step, 4096) == SpeechAuthParseDone);
+        CHECK(parser.has_access_token && strcmp(parser.access_token, "abcA\"def") == 0);
+        CHECK(parser.access_token_length == 8);
+        CHECK(parser.has_refresh_token && strcmp(parser.refresh_token, "r1") == 0);
+        CHECK(parser.has_expires_in && parser.expires_in == 3600.0);
+    }
+
+    CHECK(Parse(&parser, "{\"access_token\":\"t\",\"expires_in\":\"1800\"}", 3, 4096) == SpeechAuthParseDone);
+    CHECK(parser.has_expires_in && parser.expires_in == 1800.0);
+    CHECK(!parser.has_refresh_token);
+
+    // A lifetime that isn't a finite number is left out.
+    CHECK(Parse(&parser, "{\"access_token\":\"t\",\"expires_in\":1e999}", 5, 4096) == SpeechAuthParseDone);
+    CHECK(!parser.has_expires_in);
+    CHECK(Parse(&parser, "{\"access_token\":\"t\",\"expires_in\":\"inf\"}", 5, 4096) == SpeechAuthParseDone);
+    CHECK(!parser.has_expires_in);
+    CHECK(Parse(&parser, "{\"access_token\":\"t\",\"expires_in\":\"soon\"}", 5, 4096) == SpeechAuthParseDone);
+    CHECK(!parser.has_expires_in);
+
+    CHECK(Parse(&parser, "{\"access_token\":\"t\"", 4, 4096) != SpeechAuthParseDone);
+    CHECK(Parse(&parser, "{\"access_token\":\"t\",}", 4, 4096) == SpeechAuthParseError);
+    CHECK(Parse(&parser, "[\"access_token\"]", 4, 4096) == SpeechAuthParseError);
+    CHECK(Parse(&parser, "{\"a\":1} x", 4, 4096) == SpeechAuthParseError);
+    CHECK(Parse(&parser, "{\"access_token\":\"0123456789\"}", 4, 16) == SpeechAuthParseTooLarge);
+}
+
+// SpeechFingerprint
+
+/* A second of a voice-like sound whose pitch and timbre keep changing,
+   at the given gain, with a little noise from seed. */
+static void Synthesize(int16_t* samples, size_t count, int sample_rate, double gain, unsigned seed)
+{
+    size_t i;
+    int harmonic;
+    for (i = 0; i < count; i++) {
+        double t = (double)i / sample_rate;
+        double pitch = 120.0 + 40.0 * sin(2.0 * PI * 1.5 * t);
+        double value = 0.0;
+        for (harmonic = 1; harmonic < 20; harmonic++)
+            value += sin(2.0 * PI * pitch * harmonic * t) / harmonic
+                     * (1.0 + sin(2.0 * PI * (3.0 * t + 0.3 * harmonic)));
+        seed = seed * 1103515245u + 12345u;
+        value += 0.05 * ((double)(seed >> 16 & 0x7fff) / 16384.0 - 1.0);
+        samples[i] = (int16_t)(gain * value * 3000.0);
+    }
+}
+
+static void CheckFingerprint(void)
+{
+    enum { RATE = 8000, COUNT = 2 * RATE, MAX_WORDS = 256 };
+    static int16_t a[COUNT], b[COUNT], c[COUNT];
+    static uint32_t fa[MAX_WORDS], fb[MAX_WORDS], fc[MAX_WORDS];
+    size_t la, lb, lc, i;
+
+    Synthesize(a, COUNT, RATE, 1.0, 1);
+    Synthesize(b, COUNT, RATE, 0.5, 2);
+    for (i = 0; i < COUNT; i++) {
+        double t = (double)i / RATE;
+        c[i] = (int16_t)(3000.0 * sin(2.0 * PI * (200.0 + 300.0 * t) * t));
+    }
+
+    la = SpeechFingerprintCompute(a, COUNT, RATE, fa, MAX_WORDS);
+    lb = SpeechFingerprintCompute(b, COUNT, RATE, fb, MAX_WORDS);
+    lc = SpeechFingerprintCompute(c, COUNT, RATE, fc, MAX_WORDS);
+    CHECK(la > 0 && la == SpeechFingerprintLength(COUNT, RATE) && la == lb && la == lc);
+    CHECK(SpeechFingerprintCompute(a, COUNT, RATE, fa, 10) == 10);
+    la = SpeechFingerprintCompute(a, COUNT, RATE, fa, MAX_WORDS);
+    CHECK(SpeechFingerprintCompute(a, 100, RATE, fa, MAX_WORDS) == 0 || la == 0);
+    CHECK(SpeechFingerprintLength(COUNT, 4000) == 0);
+
+    // The same sound, quieter and with other noise, is near; another sound
+    // is about as far as chance; too different a length is unrelated.
+    CHECK(SpeechFingerprintDistance(fa, la, fa, la, 0) == 0.0f);
+    CHECK(SpeechFingerprintDistance(fa, la, fb, lb, 3) < 0.15f);
+    CHECK(SpeechFingerprintDistance(fa + 2, la - 2, fb, lb, 3) < 0.15f);
+    CHECK(SpeechFingerprintDistance(fa, la, fc, lc, 3) > 0.3f);
+    CHECK(SpeechFingerprintDistance(fa, la, fb, lb / 2, 3) == 1.0f);
+}
+
+int SpeechSelfTest(const char* scratch_directory)
+{
+    Checks = Failures = 0;
+    CheckRecording(scratch_directory);
+    CheckTrie();
+    CheckMeter();
+    CheckAuthParser();
+    CheckFingerprint();
+    fprintf(stderr, "SpeechSelfTest: %d of %d checks failed\n", Failures, Checks);
+    return Failures;
+}
@@ -0,0 +1,21 @@
+//  SpeechSelfTest.h
+//
+// Licensed by AT&T under 'Software Development Kit Tools Agreement' 2012.
+// TERMS AND CONDITIONS FOR USE, REPRODUCTION, AND DISTRIBUTION: http://developer.att.com/sdk_agreement/
+// Copyright 2012 AT&T Intellectual Property. All rights reserved.
+// For more information contact developer.support@att.com http://developer.att.com
+//
+// Checks of the plain C modules: SpeechRecording, SpeechTrie, SpeechMeter,
+// SpeechAuthParser, and SpeechFingerprint.  The app runs them when launched
+// with -SpeechSelfTest YES; being plain C, they also build and run off the
+// device with any C99 compiler and a main() that calls SpeechSelfTest.
+
+#ifndef SPEECH_SELF_TEST_H
+#define SPEECH_SELF_TEST_H
+
+/** Runs every check, writing each failure and a summary to stderr.
+    scratch_directory is where a recording may be written and removed.
+    Returns the number of checks that failed. **/
+int SpeechSelfTest(const char* scratch_directory);
+
+#endif
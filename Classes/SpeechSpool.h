@@ -0,0 +1,87 @@
+//  SpeechSpool.h
+//
+// Licensed by AT&T under 'Software Development Kit Tools Agreement' 2012.
+// TERMS AND CONDITIONS FOR USE, REPRODUCTION, AND DISTRIBUTION: http://developer.att.com/sdk_agreement/
+// Copyright 2012 AT&T Intellectual Property. All rights reserved.
+// For more information contact developer.support@att.com http://developer.att.com
+
+#import <Foundation/NSObject.h>
+#import <Foundation/NSDate.h>
+
+@class NSString, NSURL, NSArray, NSData, NSDictionary, NSError;
+@class SpeechAuth;
+
+/**
+ * Type of block called when a spooled recognition finishes.  entryID is the
+ * value returned when the audio was added.  The other arguments are as for
+ * SpeechRequestBlock.  It is not called for failures that will be retried.
+**/
+typedef void (^SpeechSpoolResultBlock)(NSString* entryID,
+                                       NSArray* responseStrings,
+                                       NSDictionary* responseDictionary,
+                                       NSError* error);
+
+/**
+ * Keeps audio that couldn't be recognized because the network was down, and
+ * sends it again later.
+ *
+ * Audio is appended to a log file and flushed to disk before addAudioData:
+ * returns, so it survives the app being killed.  Each record carries a
+ * checksum; when the spool is opened, a record cut short by a crash, and
+ * anything after it, is discarded.  Finished entries are marked by
+ * appending a small record, and the log is compacted when it is opened and
+ * whenever it empties.
+ *
+ * Draining sends the spooled audio with SpeechRequest, a few requests at a
+ * time.  A connection failure pauses draining and tries again later, backing
+ * off up to a few minutes; the app can also call drain whenever it has
+ * reason to think the network is back.  A rejected OAuth token (HTTP 401)
+ * pauses draining the same way, after refreshing the token through
+ * speechAuth if it is set, so the audio is never dropped for it.
+ *
+ * Use SpeechSpool only from the main thread.
+**/
+@interface SpeechSpool : NSObject {
+}
+
+/** Opens the spool stored at path, creating it if needed, for requests to
+ *  the given Speech API URL.  Returns nil if the file can't be opened. **/
++ (SpeechSpool*) spoolWithPath: (NSString*) path recognitionURL: (NSURL*) recognitionURL;
+
+/** The OAuth access token for requests.  Keep it up to date, or set
+ *  speechAuth to have the spool do so. **/
+@property (copy) NSString* bearerAuthToken;
+
+/** Fetches bearerAuthToken, and refreshes it when the service rejects it.
+ *  The spool fetches with it as soon as it is set, and cancels it when
+ *  replaced or when the spool is deallocated.  Default is nil. **/
+@property (retain) SpeechAuth* speechAuth;
+
+/** Most requests to have running at once while draining.  Defaults to 2. **/
+@property (assign) NSUInteger maxConcurrentRequests;
+
+/** Block called as each spooled entry finishes. **/
+@property (copy) SpeechSpoolResultBlock resultBlock;
+
+/** Number of entries waiting to be sent, including any being sent now. **/
+@property (readonly) NSUInteger pendingCount;
+
+/** Whether the spool is draining now or waiting to retry. **/
+@property (readonly) BOOL isDraining;
+
+/** Durably adds audio to the spool, returning an ID for the entry, or nil
+ *  if it couldn't be written.  Doesn't start draining. **/
+- (NSString*) addAudioData: (NSData*) audioData
+               contentType: (NSString*) contentType
+             speechContext: (NSString*) speechContext
+                     xArgs: (NSDictionary*) xArgs;
+
+/** Starts sending the spooled entries, or retries right away if draining
+ *  was waiting after a failure. **/
+- (void) drain;
+
+/** Stops draining, canceling requests in progress.  Their entries stay
+ *  in the spool. **/
+- (void) stopDraining;
+
+@end
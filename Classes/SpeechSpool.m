@@ -0,0 +1,498 @@
+//  SpeechSpool.m
+//
+// Licensed by AT&T under 'Software Development Kit Tools Agreement' 2012.
+// TERMS AND CONDITIONS FOR USE, REPRODUCTION, AND DISTRIBUTION: http://developer.att.com/sdk_agreement/
+// Copyright 2012 AT&T Intellectual Property. All rights reserved.
+// For more information contact developer.support@att.com http://developer.att.com
+
+#import "SpeechSpool.h"
+#import "SpeechRequest.h"
+#import "SpeechAuth.h"
+#import "ATTSpeechKit.h"
+
+/** Tune the concurrency based on the service's rate limits. **/
+static const NSUInteger DEFAULT_MAX_CONCURRENT = 2;
+
+/** Tune the wait before draining again after a connection failure.  It
+    doubles with each failure in a row, up to the maximum. **/
+static const NSTimeInterval RETRY_MIN = 5.0;   // seconds
+static const NSTimeInterval RETRY_MAX = 300.0; // seconds
+
+// Log Format
+//
+// The log is a sequence of records, each a 12-byte header followed by a
+// payload.  The header holds a magic number, the payload length, and the
+// CRC-32 of the payload, all little-endian.  The payload's first byte is
+// its type: an entry, followed by a binary property list of the audio and
+// request settings, or a done marker, followed by the UTF-8 ID of a
+// finished entry.
+
+static const uint32_t RecordMagic = 0x314C5053; // "SPL1"
+static const NSUInteger RecordHeaderLength = 12;
+static const uint8_t RecordTypeEntry = 1;
+static const uint8_t RecordTypeDone = 2;
+
+static NSString* const EntryIDKey = @"id";
+static NSString* const AudioKey = @"audio";
+static NSString* const ContentTypeKey = @"contentType";
+static NSString* const SpeechContextKey = @"speechContext";
+static NSString* const XArgsKey = @"xArgs";
+
+static uint32_t CRC32(const uint8_t* bytes, NSUInteger length)
+{
+    static uint32_t table[256];
+    static dispatch_once_t once;
+    dispatch_once(&once, ^{
+        uint32_t i, k;
+        for (i = 0; i < 256; i++) {
+            uint32_t c = i;
+            for (k = 0; k < 8; k++)
+                c = (c & 1) ? 0xEDB88320 ^ (c >> 1) : c >> 1;
+            table[i] = c;
+        }
+    });
+    uint32_t crc = 0xFFFFFFFF;
+    NSUInteger i;
+    for (i = 0; i < length; i++)
+        crc = table[(crc ^ bytes[i]) & 0xFF] ^ (crc >> 8);
+    return crc ^ 0xFFFFFFFF;
+}
+
+static NSData* RecordWithPayload(NSData* payload)
+{
+    uint32_t header[3] = {
+        OSSwapHostToLittleInt32(RecordMagic),
+        OSSwapHostToLittleInt32((uint32_t)payload.length),
+        OSSwapHostToLittleInt32(CRC32(payload.bytes, payload.length))
+    };
+    NSMutableData* record = [NSMutableData dataWithCapacity: RecordHeaderLength + payload.length];
+    [record appendBytes: header length: RecordHeaderLength];
+    [record appendData: payload];
+    return record;
+}
+
+/* Whether the service rejected the OAuth token. */
+static BOOL IsAuthError(NSError* error)
+{
+    return [error.domain isEqualToString: ATTSpeechServiceHTTPErrorDomain] && error.code == 401;
+}
+
+/* Whether a failed request could succeed later, so its entry should stay.
+   A rejected token is retried with a new one. */
+static BOOL IsTransientError(NSError* error)
+{
+    if ([error.domain isEqualToString: ATTSpeechServiceErrorDomain])
+        return error.code == ATTSpeechServiceErrorCodeConnectionFailure
+            || error.code == ATTSpeechServiceErrorCodeNoResponseFromServer;
+    if ([error.domain isEqualToString: ATTSpeechServiceHTTPErrorDomain])
+        return error.code == 401 || error.code == 408 || error.code == 429 || error.code >= 500;
+    return NO;
+}
+
+/**
+ * Where a spooled entry's payload lies in the log.
+**/
+@interface SpeechSpoolEntry : NSObject {
+}
+@property (copy) NSString* entryID;
+@property (assign) unsigned long long offset;
+@property (assign) NSUInteger length;
+@end
+
+@implementation SpeechSpoolEntry
+
+@synthesize entryID = _entryID;
+@synthesize offset = _offset;
+@synthesize length = _length;
+
+- (void) dealloc
+{
+    self.entryID = nil;
+    [super dealloc];
+}
+
+@end
+
+#pragma mark -
+
+@interface SpeechSpool () {
+    @private
+    NSUInteger failures;
+    BOOL paused;
+    BOOL refreshingToken;
+}
+@property (copy) NSString* path;
+@property (retain) NSURL* recognitionURL;
+@property (retain) NSFileHandle* file;
+@property (retain) NSMutableArray* pending;     // of SpeechSpoolEntry, oldest first
+@property (retain) NSMutableDictionary* active; // entry ID -> SpeechRequest
+@property (retain) NSTimer* retryTimer;
+@property (readwrite) BOOL isDraining;
+
+- (BOOL) open;
+- (BOOL) rewriteLog: (NSData*) log;
+- (unsigned long long) appendRecord: (NSData*) record;
+- (NSDictionary*) loadEntry: (SpeechSpoolEntry*) entry;
+- (void) startRequests;
+- (void) entry: (SpeechSpoolEntry*) entry finishedWithStrings: (NSArray*) strings
+    dictionary: (NSDictionary*) json error: (NSError*) error;
+- (void) markDone: (SpeechSpoolEntry*) entry;
+- (void) scheduleRetryIfIdle;
+- (void) fetchTokenRefreshing: (BOOL) refresh;
+@end
+
+@implementation SpeechSpool
+
+@synthesize bearerAuthToken = _bearerAuthToken;
+@synthesize speechAuth = _speechAuth;
+@synthesize maxConcurrentRequests = _maxConcurrentRequests;
+@synthesize resultBlock = _resultBlock;
+@synthesize isDraining = _isDraining;
+@synthesize path = _path;
+@synthesize recognitionURL = _recognitionURL;
+@synthesize file = _file;
+@synthesize pending = _pending;
+@synthesize active = _active;
+@synthesize retryTimer = _retryTimer;
+
++ (SpeechSpool*) spoolWithPath: (NSString*) path recognitionURL: (NSURL*) recognitionURL
+{
+    SpeechSpool* spool = [[[self alloc] init] autorelease];
+    spool.path = path;
+    spool.recognitionURL = recognitionURL;
+    return [spool open] ? spool : nil;
+}
+
+- (id) init
+{
+    self = [super init];
+    if (self != nil) {
+        _maxConcurrentRequests = DEFAULT_MAX_CONCURRENT;
+        self.pending = [NSMutableArray array];
+        self.active = [NSMutableDictionary dictionary];
+    }
+    return self;
+}
+
+- (void) dealloc
+{
+    // Running requests retain the spool, so none are left by now.
+    [_retryTimer invalidate];
+    [_file closeFile];
+    self.speechAuth = nil;
+    self.bearerAuthToken = nil;
+    self.resultBlock = nil;
+    self.path = nil;
+    self.recognitionURL = nil;
+    self.file = nil;
+    self.pending = nil;
+    self.active = nil;
+    self.retryTimer = nil;
+    [super dealloc];
+}
+
+- (NSUInteger) pendingCount
+{
+    return _pending.count;
+}
+
+- (void) setSpeechAuth: (SpeechAuth*) speechAuth
+{
+    if (speechAuth == _speechAuth)
+        return;
+    [_speechAuth cancel];
+    [_speechAuth release];
+    _speechAuth = [speechAuth retain];
+    refreshingToken = NO;
+    if (_speechAuth != nil)
+        [self fetchTokenRefreshing: NO];
+}
+
+#pragma mark -
+#pragma mark Log
+
+- (BOOL) open
+{
+    NSFileManager* manager = [NSFileManager defaultManager];
+    if (![manager fileExistsAtPath: _path]
+        && ![manager createFileAtPath: _path contents: nil attributes: nil])
+        return NO;
+    NSData* log = [NSData dataWithContentsOfFile: _path options: NSDataReadingMapped error: NULL];
+    if (log == nil)
+        return NO;
+
+    // Replay the log, stopping at the first record that is incomplete or
+    // damaged: that is where a crash interrupted a write.
+    const uint8_t* bytes = (const uint8_t*)log.bytes;
+    NSUInteger offset = 0;
+    BOOL hasDone = NO;
+    NSMutableDictionary* entries = [NSMutableDictionary dictionary];
+    while (offset + RecordHeaderLength <= log.length) {
+        uint32_t header[3];
+        memcpy(header, bytes + offset, RecordHeaderLength);
+        NSUInteger length = OSSwapLittleToHostInt32(header[1]);
+        const uint8_t* payload = bytes + offset + RecordHeaderLength;
+        if (OSSwapLittleToHostInt32(header[0]) != RecordMagic || length == 0
+            || length > log.length - offset - RecordHeaderLength
+            || OSSwapLittleToHostInt32(header[2]) != CRC32(payload, length))
+            break;
+
+        if (payload[0] == RecordTypeEntry) {
+            NSData* plist = [log subdataWithRange: NSMakeRange(offset + RecordHeaderLength + 1, length - 1)];
+            NSDictionary* contents = [NSPropertyListSerialization propertyListWithData: plist options: 0
+                                                                                format: NULL error: NULL];
+            NSString* entryID = [contents isKindOfClass: [NSDictionary class]]
+                ? [contents objectForKey: EntryIDKey] : nil;
+            if ([entryID isKindOfClass: [NSString class]]) {
+                SpeechSpoolEntry* entry = [[[SpeechSpoolEntry alloc] init] autorelease];
+                entry.entryID = entryID;
+                entry.offset = offset + RecordHeaderLength;
+                entry.length = length;
+                [entries setObject: entry forKey: entryID];
+                [_pending addObject: entry];
+            }
+        }
+        else if (payload[0] == RecordTypeDone) {
+            NSString* entryID = [[[NSString alloc] initWithBytes: payload + 1 length: length - 1
+                                                        encoding: NSUTF8StringEncoding] autorelease];
+            SpeechSpoolEntry* entry = entryID != nil ? [entries objectForKey: entryID] : nil;
+            if (entry != nil)
+                [_pending removeObjectIdenticalTo: entry];
+            hasDone = YES;
+        }
+        offset += RecordHeaderLength + length;
+    }
+
+    // Drop finished entries and any damaged tail before appending more.
+    if ((hasDone || offset < log.length) && ![self rewriteLog: log])
+        return NO;
+    self.file = [NSFileHandle fileHandleForUpdatingAtPath: _path];
+    return _file != nil;
+}
+
+- (BOOL) rewriteLog: (NSData*) log
+{
+    // Write the pending entries to a new file and swap it in, so a crash
+    // leaves either the old log or the new one.
+    NSString* temporary = [_path stringByAppendingPathExtension: @"tmp"];
+    NSMutableData* compacted = [NSMutableData data];
+    for (SpeechSpoolEntry* entry in _pending) {
+        NSData* payload = [log subdataWithRange: NSMakeRange((NSUInteger)entry.offset, entry.length)];
+        entry.offset = compacted.length + RecordHeaderLength;
+        [compacted appendData: RecordWithPayload(payload)];
+    }
+    if (![compacted writeToFile: temporary atomically: NO])
+        return NO;
+    NSFileHandle* handle = [NSFileHandle fileHandleForUpdatingAtPath: temporary];
+    [handle synchronizeFile];
+    [handle closeFile];
+    return rename(temporary.fileSystemRepresentation, _path.fileSystemRepresentation) == 0;
+}
+
+- (unsigned long long) appendRecord: (NSData*) record
+{
+    // Returns the offset of the record, or ULLONG_MAX if it wasn't written.
+    unsigned long long offset = [_file seekToEndOfFile];
+    @try {
+        [_file writeData: record];
+        [_file synchronizeFile];
+    }
+    @catch (NSException* exception) {
+        // Don't leave a partial record for the next one to follow.
+        [_file truncateFileAtOffset: offset];
+        return ULLONG_MAX;
+    }
+    return offset;
+}
+
+- (NSDictionary*) loadEntry: (SpeechSpoolEntry*) entry
+{
+    [_file seekToFileOffset: entry.offset + 1];
+    NSData* plist = [_file readDataOfLength: entry.length - 1];
+    NSDictionary* contents = [NSPropertyListSerialization propertyListWithData: plist options: 0
+                                                                        format: NULL error: NULL];
+    return [contents isKindOfClass: [NSDictionary class]] ? contents : nil;
+}
+
+- (NSString*) addAudioData: (NSData*) audioData
+               contentType: (NSString*) contentType
+             speechContext: (NSString*) speechContext
+                     xArgs: (NSDictionary*) xArgs
+{
+    CFUUIDRef uuid = CFUUIDCreate(NULL);
+    NSString* entryID = [(NSString*)CFUUIDCreateString(NULL, uuid) autorelease];
+    CFRelease(uuid);
+
+    NSMutableDictionary* contents = [NSMutableDictionary dictionaryWithObjectsAndKeys:
+                                     entryID, EntryIDKey, audioData, AudioKey, nil];
+    if (contentType != nil)
+        [contents setObject: contentType forKey: ContentTypeKey];
+    if (speechContext != nil)
+        [contents setObject: speechContext forKey: SpeechContextKey];
+    if (xArgs != nil)
+        [contents setObject: xArgs forKey: XArgsKey];
+    NSData* plist = [NSPropertyListSerialization dataWithPropertyList: contents
+                                                               format: NSPropertyListBinaryFormat_v1_0
+                                                              options: 0 error: NULL];
+    if (plist == nil)
+        return nil;
+    NSMutableData* payload = [NSMutableData dataWithBytes: &RecordTypeEntry length: 1];
+    [payload appendData: plist];
+
+    unsigned long long offset = [self appendRecord: RecordWithPayload(payload)];
+    if (offset == ULLONG_MAX)
+        return nil;
+    SpeechSpoolEntry* entry = [[[SpeechSpoolEntry alloc] init] autorelease];
+    entry.entryID = entryID;
+    entry.offset = offset + RecordHeaderLength;
+    entry.length = payload.length;
+    [_pending addObject: entry];
+    return entryID;
+}
+
+- (void) markDone: (SpeechSpoolEntry*) entry
+{
+    [_pending removeObjectIdenticalTo: entry];
+    if (_pending.count == 0) {
+        // Nothing left, so start the log over.
+        [_file truncateFileAtOffset: 0];
+        [_file synchronizeFile];
+        return;
+    }
+    NSMutableData* payload = [NSMutableData dataWithBytes: &RecordTypeDone length: 1];
+    [payload appendData: [entry.entryID dataUsingEncoding: NSUTF8StringEncoding]];
+    [self appendRecord: RecordWithPayload(payload)];
+}
+
+#pragma mark -
+#pragma mark Draining
+
+- (void) drain
+{
+    [_retryTimer invalidate];
+    self.retryTimer = nil;
+    paused = NO;
+    self.isDraining = _pending.count > 0;
+    [self startRequests];
+}
+
+- (void) stopDraining
+{
+    [_retryTimer invalidate];
+    self.retryTimer = nil;
+    // Canceling the requests releases their hold on this object.
+    [[self retain] autorelease];
+    NSArray* requests = [_active allValues];
+    [_active removeAllObjects];
+    for (SpeechRequest* request in requests)
+        [request cancel];
+    self.isDraining = NO;
+}
+
+- (void) retryTimerFired: (NSTimer*) timer
+{
+    self.retryTimer = nil;
+    [self drain];
+}
+
+- (void) scheduleRetryIfIdle
+{
+    // Wait for the other requests to finish, and for any new token, before
+    // backing off, so that one retry covers them all.
+    if (!paused || !_isDraining || _active.count > 0 || _retryTimer != nil || refreshingToken)
+        return;
+    failures++;
+    NSTimeInterval delay = MIN(RETRY_MAX, RETRY_MIN * (1 << MIN(failures - 1, 16)));
+    // Jitter, so many devices coming back online don't all retry together.
+    delay *= 0.5 + 0.5 * arc4random_uniform(1000) / 1000.0;
+    self.retryTimer =
+        [NSTimer scheduledTimerWithTimeInterval: delay target: self
+                                       selector: @selector(retryTimerFired:)
+                                       userInfo: nil repeats: NO];
+}
+
+- (void) fetchTokenRefreshing: (BOOL) refresh
+{
+    // speechAuth keeps the block, so it mustn't retain the spool, which
+    // cancels speechAuth when deallocated.
+    __block SpeechSpool* blockSelf = self;
+    SpeechAuthBlock block = ^(NSString* token, NSError* error) {
+        if (token != nil)
+            blockSelf.bearerAuthToken = token;
+        if (blockSelf->refreshingToken) {
+            // Retry the rejected entries after the usual wait, with the new
+            // token or, if there isn't one, to try refreshing again.
+            blockSelf->refreshingToken = NO;
+            [blockSelf scheduleRetryIfIdle];
+        }
+    };
+    if (refresh) {
+        refreshingToken = YES;
+        [_speechAuth refreshTo: block];
+    }
+    else
+        [_speechAuth fetchTo: block];
+}
+
+- (void) startRequests
+{
+    NSUInteger limit = MAX(_maxConcurrentRequests, 1);
+    NSArray* entries = [[_pending copy] autorelease];
+    for (SpeechSpoolEntry* entry in entries) {
+        if (!_isDraining || paused || _active.count >= limit)
+            break;
+        if ([_active objectForKey: entry.entryID] != nil)
+            continue;
+
+        NSDictionary* contents = [self loadEntry: entry];
+        NSData* audioData = [contents objectForKey: AudioKey];
+        if (![audioData isKindOfClass: [NSData class]]) {
+            // The checksum matched, so this can only be a bug; don't retry it.
+            NSError* error = [NSError errorWithDomain: NSCocoaErrorDomain
+                                                 code: NSFileReadCorruptFileError userInfo: nil];
+            [self entry: entry finishedWithStrings: nil dictionary: nil error: error];
+            continue;
+        }
+        SpeechRequest* request = [SpeechRequest requestWithURL: _recognitionURL];
+        request.bearerAuthToken = _bearerAuthToken;
+        request.contentType = [contents objectForKey: ContentTypeKey];
+        request.speechContext = [contents objectForKey: SpeechContextKey];
+        request.xArgs = [contents objectForKey: XArgsKey];
+        [_active setObject: request forKey: entry.entryID];
+        // The request's block retains this spool until the entry finishes.
+        [request startWithAudioData: audioData
+                         completion: ^(NSArray* strings, NSDictionary* json, NSError* error) {
+            [self entry: entry finishedWithStrings: strings dictionary: json error: error];
+        }];
+    }
+}
+
+- (void) entry: (SpeechSpoolEntry*) entry finishedWithStrings: (NSArray*) strings
+    dictionary: (NSDictionary*) json error: (NSError*) error
+{
+    [[entry retain] autorelease];
+    [_active removeObjectForKey: entry.entryID];
+
+    if (error != nil && IsTransientError(error)) {
+        // Still offline, or the token expired.  Keep the entry, let the
+        // other requests finish, and try again later.
+        paused = YES;
+        if (IsAuthError(error) && _speechAuth != nil && !refreshingToken)
+            [self fetchTokenRefreshing: YES];
+        [self scheduleRetryIfIdle];
+        return;
+    }
+
+    failures = 0;
+    [self markDone: entry];
+    if (_pending.count == 0)
+        self.isDraining = NO;
+    else if (paused)
+        [self scheduleRetryIfIdle]; // Another entry failed while this one ran.
+    else
+        [self startRequests];
+    if (_resultBlock != nil)
+        _resultBlock(entry.entryID, strings, json, error);
+}
+
+@end
@@ -0,0 +1,70 @@
+//  SpeechTrace.h
+//
+// Licensed by AT&T under 'Software Development Kit Tools Agreement' 2012.
+// TERMS AND CONDITIONS FOR USE, REPRODUCTION, AND DISTRIBUTION: http://developer.att.com/sdk_agreement/
+// Copyright 2012 AT&T Intellectual Property. All rights reserved.
+// For more information contact developer.support@att.com http://developer.att.com
+
+#import <Foundation/NSObject.h>
+#include <stdint.h>
+
+@class NSData, NSDictionary, NSString;
+
+/**
+ * Lightweight latency tracing for speech interactions.
+ *
+ * Events are recorded into a fixed ring buffer of the most recent
+ * SPEECH_TRACE_CAPACITY events.  Recording takes no locks and allocates
+ * nothing, so it can be called from any thread, including audio callbacks.
+ * Names must be string literals or otherwise live forever.
+ *
+ * The buffer can be exported in the Chrome trace event format, for viewing
+ * in chrome://tracing, or summarized as percentiles of each span's duration.
+**/
+
+/** Number of events kept before the oldest are overwritten. **/
+#define SPEECH_TRACE_CAPACITY 4096
+
+/** The current time in the units the trace uses, from mach_absolute_time. **/
+uint64_t SpeechTraceNow(void);
+
+/** A duration between two SpeechTraceNow times, in milliseconds. **/
+double SpeechTraceMilliseconds(uint64_t duration);
+
+/** Records a span that began at start and ends now. **/
+void SpeechTraceEnd(const char* name, uint64_t start);
+
+/** Records a span with the given start and end times. **/
+void SpeechTraceSpan(const char* name, uint64_t start, uint64_t end);
+
+/** Records a single point in time. **/
+void SpeechTraceInstant(const char* name);
+
+/** Starts a new phase of a sequential process, such as the states of
+ *  ATTSpeechService, ending the previous phase as a span.  Returns the
+ *  name of the phase ended, or NULL if there was none, and sets
+ *  *milliseconds to its duration if milliseconds isn't NULL.  Pass NULL
+ *  to end the current phase without starting another.  Main thread only. **/
+const char* SpeechTracePhase(const char* name, double* milliseconds);
+
+@interface SpeechTrace : NSObject {
+}
+
+/** The recorded events as Chrome trace event JSON. **/
++ (NSData*) chromeTraceJSON;
+
+/** Writes chromeTraceJSON to a file, returning whether it succeeded. **/
++ (BOOL) writeChromeTraceToFile: (NSString*) path;
+
+/** For each span name, a dictionary with the count and the p50, p95 and
+ *  p99 durations in milliseconds, as NSNumbers under the keys "count",
+ *  "p50", "p95" and "p99". **/
++ (NSDictionary*) summary;
+
+/** Writes the summary to the console. **/
++ (void) logSummary;
+
+/** Discards all recorded events. **/
++ (void) reset;
+
+@end
@@ -0,0 +1,230 @@
+//  SpeechTrace.m
+//
+// Licensed by AT&T under 'Software Development Kit Tools Agreement' 2012.
+// TERMS AND CONDITIONS FOR USE, REPRODUCTION, AND DISTRIBUTION: http://developer.att.com/sdk_agreement/
+// Copyright 2012 AT&T Intellectual Property. All rights reserved.
+// For more information contact developer.support@att.com http://developer.att.com
+
+#import "SpeechTrace.h"
+#include <libkern/OSAtomic.h>
+#include <math.h>
+#include <mach/mach.h>
+#include <mach/mach_time.h>
+#include <pthread.h>
+
+// Ring Buffer
+//
+// Writers claim a slot by atomically incrementing a ticket counter, so they
+// never wait for each other.  A slot's sequence number is zero while it is
+// being written and the ticket plus one once it is complete; readers copy a
+// slot and keep the copy only if its sequence number was the same, and
+// nonzero, before and after.
+
+typedef struct TraceRecord {
+    volatile int64_t sequence;
+    uint64_t start;
+    uint64_t end;
+    const char* name;
+    uint32_t thread;
+    char phase;             /* 'X' for a span, 'i' for an instant */
+} TraceRecord;
+
+static TraceRecord Records[SPEECH_TRACE_CAPACITY];
+static volatile int64_t NextTicket = 0;
+
+/* State of SpeechTracePhase, used only on the main thread. */
+static const char* CurrentPhase = NULL;
+static uint64_t CurrentPhaseStart = 0;
+
+static void Record(char phase, const char* name, uint64_t start, uint64_t end)
+{
+    int64_t ticket = OSAtomicIncrement64Barrier(&NextTicket) - 1;
+    TraceRecord* record = &Records[ticket % SPEECH_TRACE_CAPACITY];
+    record->sequence = 0;
+    OSMemoryBarrier();
+    record->start = start;
+    record->end = end;
+    record->name = name;
+    record->thread = pthread_mach_thread_np(pthread_self());
+    record->phase = phase;
+    OSMemoryBarrier();
+    record->sequence = ticket + 1;
+}
+
+/* Copies out the complete records, oldest first. */
+static NSUInteger Snapshot(TraceRecord* records)
+{
+    NSUInteger count = 0;
+    int64_t last = NextTicket;
+    int64_t ticket = last > SPEECH_TRACE_CAPACITY ? last - SPEECH_TRACE_CAPACITY : 0;
+    for (; ticket < last; ticket++) {
+        TraceRecord* record = &Records[ticket % SPEECH_TRACE_CAPACITY];
+        int64_t sequence = record->sequence;
+        OSMemoryBarrier();
+        records[count] = *record;
+        OSMemoryBarrier();
+        if (sequence == ticket + 1 && record->sequence == sequence)
+            count++;
+    }
+    return count;
+}
+
+static double Microseconds(uint64_t time)
+{
+    static mach_timebase_info_data_t timebase;
+    static dispatch_once_t once;
+    dispatch_once(&once, ^{
+        mach_timebase_info(&timebase);
+    });
+    return (double)time * timebase.numer / timebase.denom / 1000.0;
+}
+
+uint64_t SpeechTraceNow(void)
+{
+    return mach_absolute_time();
+}
+
+double SpeechTraceMilliseconds(uint64_t duration)
+{
+    return Microseconds(duration) / 1000.0;
+}
+
+void SpeechTraceEnd(const char* name, uint64_t start)
+{
+    Record('X', name, start, mach_absolute_time());
+}
+
+void SpeechTraceSpan(const char* name, uint64_t start, uint64_t end)
+{
+    Record('X', name, start, end);
+}
+
+void SpeechTraceInstant(const char* name)
+{
+    uint64_t now = mach_absolute_time();
+    Record('i', name, now, now);
+}
+
+const char* SpeechTracePhase(const char* name, double* milliseconds)
+{
+    uint64_t now = mach_absolute_time();
+    const char* ended = CurrentPhase;
+    if (ended != NULL) {
+        Record('X', ended, CurrentPhaseStart, now);
+        if (milliseconds != NULL)
+            *milliseconds = SpeechTraceMilliseconds(now - CurrentPhaseStart);
+    }
+    CurrentPhase = name;
+    CurrentPhaseStart = now;
+    return ended;
+}
+
+/* The value at fraction of the way through sorted values, by nearest rank. */
+static double Percentile(NSArray* sorted, double fraction)
+{
+    NSUInteger rank = (NSUInteger)ceil(fraction * sorted.count);
+    if (rank > 0)
+        rank--;
+    return [[sorted objectAtIndex: MIN(rank, sorted.count - 1)] doubleValue];
+}
+
+@implementation SpeechTrace
+
++ (NSData*) chromeTraceJSON
+{
+    TraceRecord* records = malloc(sizeof(TraceRecord) * SPEECH_TRACE_CAPACITY);
+    if (records == NULL)
+        return nil;
+    NSUInteger count = Snapshot(records);
+    NSMutableArray* events = [NSMutableArray arrayWithCapacity: count];
+    NSNumber* pid = [NSNumber numberWithInt: [[NSProcessInfo processInfo] processIdentifier]];
+    NSUInteger i;
+    for (i = 0; i < count; i++) {
+        TraceRecord* record = &records[i];
+        NSMutableDictionary* event = [NSMutableDictionary dictionaryWithObjectsAndKeys:
+            [NSString stringWithUTF8String: record->name], @"name",
+            @"speech", @"cat",
+            [NSString stringWithFormat: @"%c", record->phase], @"ph",
+            [NSNumber numberWithDouble: Microseconds(record->start)], @"ts",
+            pid, @"pid",
+            [NSNumber numberWithUnsignedInt: record->thread], @"tid",
+            nil];
+        if (record->phase == 'X')
+            [event setObject: [NSNumber numberWithDouble: Microseconds(record->end - record->start)]
+                      forKey: @"dur"];
+        else
+            [event setObject: @"p" forKey: @"s"]; // process-wide instant
+        [events addObject: event];
+    }
+    free(records);
+    NSDictionary* trace = [NSDictionary dictionaryWithObjectsAndKeys:
+                           events, @"traceEvents",
+                           @"ms", @"displayTimeUnit", nil];
+    return [NSJSONSerialization dataWithJSONObject: trace options: 0 error: NULL];
+}
+
++ (BOOL) writeChromeTraceToFile: (NSString*) path
+{
+    return [[self chromeTraceJSON] writeToFile: path atomically: YES];
+}
+
++ (NSDictionary*) summary
+{
+    TraceRecord* records = malloc(sizeof(TraceRecord) * SPEECH_TRACE_CAPACITY);
+    if (records == NULL)
+        return nil;
+    NSUInteger count = Snapshot(records);
+    NSMutableDictionary* durations = [NSMutableDictionary dictionary];
+    NSUInteger i;
+    for (i = 0; i < count; i++) {
+        if (records[i].phase != 'X')
+            continue;
+        NSString* name = [NSString stringWithUTF8String: records[i].name];
+        NSMutableArray* values = [durations objectForKey: name];
+        if (values == nil) {
+            values = [NSMutableArray array];
+            [durations setObject: values forKey: name];
+        }
+        [values addObject: [NSNumber numberWithDouble:
+                            Microseconds(records[i].end - records[i].start) / 1000.0]];
+    }
+    free(records);
+
+    NSMutableDictionary* summary = [NSMutableDictionary dictionaryWithCapacity: durations.count];
+    for (NSString* name in durations) {
+        NSArray* sorted = [[durations objectForKey: name] sortedArrayUsingSelector: @selector(compare:)];
+        [summary setObject: [NSDictionary dictionaryWithObjectsAndKeys:
+                             [NSNumber numberWithUnsignedInteger: sorted.count], @"count",
+                             [NSNumber numberWithDouble: Percentile(sorted, 0.50)], @"p50",
+                             [NSNumber numberWithDouble: Percentile(sorted, 0.95)], @"p95",
+                             [NSNumber numberWithDouble: Percentile(sorted, 0.99)], @"p99",
+                             nil]
+                    forKey: name];
+    }
+    return summary;
+}
+
++ (void) logSummary
+{
+    NSDictionary* summary = [self summary];
+    NSArray* names = [summary.allKeys sortedArrayUsingSelector: @selector(compare:)];
+    for (NSString* name in names) {
+        NSDictionary* stats = [summary objectForKey: name];
+        NSLog(@"%@: n=%@ p50=%.1fms p95=%.1fms p99=%.1fms", name,
+              [stats objectForKey: @"count"],
+              [[stats objectForKey: @"p50"] doubleValue],
+              [[stats objectForKey: @"p95"] doubleValue],
+              [[stats objectForKey: @"p99"] doubleValue]);
+    }
+}
+
++ (void) reset
+{
+    // Invalidate every slot; writers in progress will republish their own.
+    int i;
+    for (i = 0; i < SPEECH_TRACE_CAPACITY; i++)
+        Records[i].sequence = 0;
+    OSMemoryBarrier();
+}
+
+@end
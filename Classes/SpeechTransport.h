@@ -0,0 +1,54 @@
+//  SpeechTransport.h
+//
+// Licensed by AT&T under 'Software Development Kit Tools Agreement' 2012.
+// TERMS AND CONDITIONS FOR USE, REPRODUCTION, AND DISTRIBUTION: http://developer.att.com/sdk_agreement/
+// Copyright 2012 AT&T Intellectual Property. All rights reserved.
+// For more information contact developer.support@att.com http://developer.att.com
+
+#import <Foundation/NSObject.h>
+#import <Foundation/NSDate.h>
+
+@class NSURL, NSURLRequest, NSURLConnection;
+
+/**
+ * Shared HTTP transport for this app's requests to the Speech API hosts.
+ *
+ * NSURLConnection keeps idle connections open per host, and the system
+ * resumes TLS sessions across the whole process.  Sending every request
+ * through this object gives them the same keep-alive settings, and lets the
+ * app warm up a host before the first request it cares about, so that the
+ * OAuth POST and the SDK's speech POST to the same host can skip the TCP and
+ * TLS handshakes.
+ *
+ * Use SpeechTransport only from the main thread.
+**/
+@interface SpeechTransport : NSObject {
+}
+
+/** Returns the transport shared by the whole app. **/
++ (SpeechTransport*) sharedTransport;
+
+/** How long a host's connections are expected to stay open after the last
+ *  request to it finishes.  Defaults to 15 seconds. **/
+@property (assign, nonatomic) NSTimeInterval keepAliveInterval;
+
+/** Number of requests started through this transport, including warm-ups. **/
+@property (readonly, nonatomic) NSUInteger requestCount;
+
+/** Number of those requests that went to a host with a connection that was
+ *  likely still open, so they probably didn't need a new handshake. **/
+@property (readonly, nonatomic) NSUInteger warmRequestCount;
+
+/** Starts loading request with the shared settings, like
+ *  +[NSURLConnection connectionWithRequest:delegate:]. **/
+- (NSURLConnection*) connectionWithRequest: (NSURLRequest*) request
+                                  delegate: (id) delegate;
+
+/** Opens a connection to url's host in the background, unless one is likely
+ *  open already.  Call this ahead of the first real request to that host. **/
+- (void) prewarmURL: (NSURL*) url;
+
+/** Whether a connection to url's host is likely still open. **/
+- (BOOL) isWarmURL: (NSURL*) url;
+
+@end
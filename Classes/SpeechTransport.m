@@ -0,0 +1,198 @@
+//  SpeechTransport.m
+//
+// Licensed by AT&T under 'Software Development Kit Tools Agreement' 2012.
+// TERMS AND CONDITIONS FOR USE, REPRODUCTION, AND DISTRIBUTION: http://developer.att.com/sdk_agreement/
+// Copyright 2012 AT&T Intellectual Property. All rights reserved.
+// For more information contact developer.support@att.com http://developer.att.com
+
+#import "SpeechTransport.h"
+
+/** Tune the timeout values based on application behavior. **/
+static const NSTimeInterval PREWARM_TIMEOUT = 10.0; // seconds
+static const NSTimeInterval DEFAULT_KEEP_ALIVE = 15.0; // seconds
+
+@interface SpeechTransport ()
+@property (retain) NSMutableDictionary* lastActivity; // host key -> NSDate
+- (NSString*) hostKeyForURL: (NSURL*) url;
+- (void) connectionEndedForHost: (NSString*) hostKey;
+@end
+
+/**
+ * Stands in for a connection's delegate so the transport can tell when
+ * the connection to a host goes idle.  Everything else goes straight
+ * through to the real delegate.
+**/
+@interface SpeechTransportDelegateProxy : NSProxy {
+    @private
+    id target;
+    NSString* hostKey;
+}
+- (id) initWithTarget: (id) aTarget hostKey: (NSString*) aHostKey;
+@end
+
+@implementation SpeechTransportDelegateProxy
+
+- (id) initWithTarget: (id) aTarget hostKey: (NSString*) aHostKey
+{
+    // NSProxy has no -init.
+    target = [aTarget retain];
+    hostKey = [aHostKey copy];
+    return self;
+}
+
+- (void) dealloc
+{
+    [target release];
+    [hostKey release];
+    [super dealloc];
+}
+
+- (BOOL) respondsToSelector: (SEL) selector
+{
+    if (selector == @selector(connectionDidFinishLoading:)
+        || selector == @selector(connection:didFailWithError:))
+        return YES;
+    return [target respondsToSelector: selector];
+}
+
+- (NSMethodSignature*) methodSignatureForSelector: (SEL) selector
+{
+    return [target methodSignatureForSelector: selector];
+}
+
+- (void) forwardInvocation: (NSInvocation*) invocation
+{
+    [invocation invokeWithTarget: target];
+}
+
+- (void) connectionDidFinishLoading: (NSURLConnection*) connection
+{
+    [[SpeechTransport sharedTransport] connectionEndedForHost: hostKey];
+    if ([target respondsToSelector: _cmd])
+        [target connectionDidFinishLoading: connection];
+}
+
+- (void) connection: (NSURLConnection*) connection didFailWithError: (NSError*) error
+{
+    [[SpeechTransport sharedTransport] connectionEndedForHost: hostKey];
+    if ([target respondsToSelector: _cmd])
+        [target connection: connection didFailWithError: error];
+}
+
+@end
+
+/**
+ * Delegate for warm-up requests, which only need to open the connection.
+**/
+@interface SpeechTransportPrewarmDelegate : NSObject
+@end
+
+@implementation SpeechTransportPrewarmDelegate
+
+- (void) connection: (NSURLConnection*) connection
+ didReceiveResponse: (NSURLResponse*) response
+{
+    // The connection is open, and any status will do.  Finishing normally
+    // (rather than canceling) leaves the connection in the pool.
+}
+
+@end
+
+#pragma mark -
+
+@implementation SpeechTransport
+
+@synthesize keepAliveInterval = _keepAliveInterval;
+@synthesize requestCount = _requestCount;
+@synthesize warmRequestCount = _warmRequestCount;
+@synthesize lastActivity = _lastActivity;
+
++ (SpeechTransport*) sharedTransport
+{
+    static SpeechTransport* shared = nil;
+    if (shared == nil)
+        shared = [[SpeechTransport alloc] init];
+    return shared;
+}
+
+- (id) init
+{
+    self = [super init];
+    if (self != nil) {
+        _keepAliveInterval = DEFAULT_KEEP_ALIVE;
+        self.lastActivity = [NSMutableDictionary dictionary];
+    }
+    return self;
+}
+
+- (void) dealloc
+{
+    self.lastActivity = nil;
+    [super dealloc];
+}
+
+- (NSString*) hostKeyForURL: (NSURL*) url
+{
+    // Connections are pooled by scheme, host, and port.
+    NSNumber* port = url.port;
+    return [NSString stringWithFormat: @"%@://%@:%@",
+            url.scheme.lowercaseString, url.host.lowercaseString,
+            port != nil ? (id)port : (id)@"-"];
+}
+
+- (BOOL) isWarmHost: (NSString*) hostKey
+{
+    // A host counts as active from the start of each request until the end
+    // of the last one.  Canceled connections don't report their end, so the
+    // start time stands in for it.
+    NSDate* last = [_lastActivity objectForKey: hostKey];
+    return last != nil && -[last timeIntervalSinceNow] < _keepAliveInterval;
+}
+
+- (BOOL) isWarmURL: (NSURL*) url
+{
+    return [self isWarmHost: [self hostKeyForURL: url]];
+}
+
+- (void) connectionEndedForHost: (NSString*) hostKey
+{
+    [_lastActivity setObject: [NSDate date] forKey: hostKey];
+}
+
+- (NSURLConnection*) connectionWithRequest: (NSURLRequest*) request
+                                  delegate: (id) delegate
+{
+    NSString* hostKey = [self hostKeyForURL: request.URL];
+    _requestCount++;
+    if ([self isWarmHost: hostKey])
+        _warmRequestCount++;
+
+    // HTTP/1.1 keeps connections alive by default; just make sure nothing
+    // asks to close them, and don't send cookies the Speech API doesn't use.
+    NSMutableURLRequest* shared = [[request mutableCopy] autorelease];
+    [shared setValue: @"keep-alive" forHTTPHeaderField: @"Connection"];
+    shared.HTTPShouldHandleCookies = NO;
+
+    SpeechTransportDelegateProxy* proxy =
+        [[[SpeechTransportDelegateProxy alloc] initWithTarget: delegate hostKey: hostKey] autorelease];
+    NSURLConnection* connection = [NSURLConnection connectionWithRequest: shared delegate: (id)proxy];
+    if (connection != nil)
+        [_lastActivity setObject: [NSDate date] forKey: hostKey];
+    return connection;
+}
+
+- (void) prewarmURL: (NSURL*) url
+{
+    if (url == nil || [self isWarmURL: url])
+        return;
+    // A HEAD request opens the connection (and negotiates TLS) without
+    // sending a body or downloading one.
+    NSMutableURLRequest* request = [NSMutableURLRequest requestWithURL: url];
+    request.HTTPMethod = @"HEAD";
+    request.timeoutInterval = PREWARM_TIMEOUT;
+    SpeechTransportPrewarmDelegate* delegate =
+        [[[SpeechTransportPrewarmDelegate alloc] init] autorelease];
+    [self connectionWithRequest: request delegate: delegate];
+}
+
+@end
@@ -0,0 +1,179 @@
+//  SpeechTrie.c
+//
+// Licensed by AT&T under 'Software Development Kit Tools Agreement' 2012.
+// TERMS AND CONDITIONS FOR USE, REPRODUCTION, AND DISTRIBUTION: http://developer.att.com/sdk_agreement/
+// Copyright 2012 AT&T Intellectual Property. All rights reserved.
+// For more information contact developer.support@att.com http://developer.att.com
+
+#include "SpeechTrie.h"
+#include <stdlib.h>
+
+/* Children are a linked list of siblings; 0 ends a list, since the root
+   is never anyone's child. */
+typedef struct Node {
+    uint32_t first_child;
+    uint32_t next_sibling;
+    int32_t id;               /* -1 unless a phrase ends here */
+    unsigned char label;
+} Node;
+
+struct SpeechTrie {
+    Node* nodes;
+    size_t node_count;
+    size_t node_capacity;
+    size_t phrase_count;
+    size_t max_length;        /* longest phrase, which bounds the search depth */
+};
+
+typedef struct Search {
+    const SpeechTrie* trie;
+    const unsigned char* text;
+    size_t length;
+    int* rows;                /* one row of length + 1 per depth */
+    int best;
+    int32_t best_id;
+} Search;
+
+static uint32_t NewNode(SpeechTrie* trie, unsigned char label)
+{
+    Node* node;
+    if (trie->node_count == trie->node_capacity) {
+        size_t capacity = trie->node_capacity * 2;
+        Node* nodes;
+        if (capacity > UINT32_MAX)
+            return 0;
+        nodes = (Node*)realloc(trie->nodes, capacity * sizeof(Node));
+        if (nodes == NULL)
+            return 0;
+        trie->nodes = nodes;
+        trie->node_capacity = capacity;
+    }
+    node = &trie->nodes[trie->node_count];
+    node->first_child = 0;
+    node->next_sibling = 0;
+    node->id = -1;
+    node->label = label;
+    return (uint32_t)trie->node_count++;
+}
+
+SpeechTrie* SpeechTrieCreate(void)
+{
+    SpeechTrie* trie = (SpeechTrie*)calloc(1, sizeof(SpeechTrie));
+    if (trie == NULL)
+        return NULL;
+    trie->node_capacity = 256;
+    trie->nodes = (Node*)malloc(trie->node_capacity * sizeof(Node));
+    if (trie->nodes == NULL) {
+        free(trie);
+        return NULL;
+    }
+    NewNode(trie, 0); // the root
+    return trie;
+}
+
+void SpeechTrieDestroy(SpeechTrie* trie)
+{
+    if (trie == NULL)
+        return;
+    free(trie->nodes);
+    free(trie);
+}
+
+int SpeechTrieAdd(SpeechTrie* trie, const char* phrase, size_t length, int32_t id)
+{
+    const unsigned char* bytes = (const unsigned char*)phrase;
+    uint32_t current = 0;
+    size_t i;
+    if (id < 0)
+        return -1;
+    for (i = 0; i < length; i++) {
+        uint32_t child = trie->nodes[current].first_child;
+        while (child != 0 && trie->nodes[child].label != bytes[i])
+            child = trie->nodes[child].next_sibling;
+        if (child == 0) {
+            child = NewNode(trie, bytes[i]);
+            if (child == 0)
+                return -1;
+            // NewNode may have moved the array.
+            trie->nodes[child].next_sibling = trie->nodes[current].first_child;
+            trie->nodes[current].first_child = child;
+        }
+        current = child;
+    }
+    if (trie->nodes[current].id < 0)
+        trie->phrase_count++;
+    trie->nodes[current].id = id;
+    if (length > trie->max_length)
+        trie->max_length = length;
+    return 0;
+}
+
+size_t SpeechTrieCount(const SpeechTrie* trie)
+{
+    return trie->phrase_count;
+}
+
+/* Visits node, whose row of the edit distance table is already at depth. */
+static void Walk(Search* search, uint32_t index, size_t depth)
+{
+    const Node* node = &search->trie->nodes[index];
+    size_t width = search->length + 1;
+    const int* row = search->rows + depth * width;
+    int* next = search->rows + (depth + 1) * width;
+    int smallest = row[0];
+    uint32_t child;
+    size_t j;
+
+    if (node->id >= 0) {
+        int distance = row[search->length];
+        if (distance < search->best
+            || (distance == search->best && (search->best_id < 0 || node->id < search->best_id))) {
+            search->best = distance;
+            search->best_id = node->id;
+        }
+    }
+    for (j = 1; j < width; j++)
+        if (row[j] < smallest)
+            smallest = row[j];
+    // Every phrase below here is at least this far from the text.
+    if (smallest > search->best || depth == search->trie->max_length)
+        return;
+
+    for (child = node->first_child; child != 0; child = search->trie->nodes[child].next_sibling) {
+        unsigned char label = search->trie->nodes[child].label;
+        next[0] = row[0] + 1;
+        for (j = 1; j < width; j++) {
+            int substitute = row[j - 1] + (search->text[j - 1] == label ? 0 : 1);
+            int insert = next[j - 1] + 1;
+            int remove = row[j] + 1;
+            int cost = substitute < insert ? substitute : insert;
+            next[j] = cost < remove ? cost : remove;
+        }
+        Walk(search, child, depth + 1);
+    }
+}
+
+int SpeechTrieMatch(const SpeechTrie* trie, const char* text, size_t length,
+                    int max_distance, int32_t* id)
+{
+    Search search;
+    size_t j;
+    if (trie->phrase_count == 0 || max_distance < 0)
+        return -1;
+    search.trie = trie;
+    search.text = (const unsigned char*)text;
+    search.length = length;
+    search.best = max_distance;
+    search.best_id = -1;
+    search.rows = (int*)malloc((trie->max_length + 1) * (length + 1) * sizeof(int));
+    if (search.rows == NULL)
+        return -1;
+    for (j = 0; j <= length; j++)
+        search.rows[j] = (int)j;
+    Walk(&search, 0, 0);
+    free(search.rows);
+    if (search.best_id < 0)
+        return -1;
+    *id = search.best_id;
+    return search.best;
+}
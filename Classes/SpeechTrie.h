@@ -0,0 +1,40 @@
+//  SpeechTrie.h
+//
+// Licensed by AT&T under 'Software Development Kit Tools Agreement' 2012.
+// TERMS AND CONDITIONS FOR USE, REPRODUCTION, AND DISTRIBUTION: http://developer.att.com/sdk_agreement/
+// Copyright 2012 AT&T Intellectual Property. All rights reserved.
+// For more information contact developer.support@att.com http://developer.att.com
+//
+// A byte trie of phrases with approximate lookup: finds the phrase with the
+// smallest edit distance to a string, walking the trie once with a row of
+// the Levenshtein table per level, and skipping every branch that can no
+// longer beat the best match so far.  Phrases sharing a prefix share both
+// its nodes and its rows.  Plain C; nodes live in one array.
+
+#ifndef SPEECH_TRIE_H
+#define SPEECH_TRIE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct SpeechTrie SpeechTrie;
+
+/** Creates an empty trie, or returns NULL if out of memory. **/
+SpeechTrie* SpeechTrieCreate(void);
+
+void SpeechTrieDestroy(SpeechTrie* trie);
+
+/** Adds a phrase of length bytes with the given non-negative id.  Adding a
+    phrase again replaces its id.  Returns 0, or -1 if out of memory. **/
+int SpeechTrieAdd(SpeechTrie* trie, const char* phrase, size_t length, int32_t id);
+
+/** Number of distinct phrases added. **/
+size_t SpeechTrieCount(const SpeechTrie* trie);
+
+/** Finds the phrase nearest to text, at most max_distance edits away; ties
+    go to the lower id.  Returns the distance and sets *id, or returns -1
+    if no phrase is close enough or memory runs out. **/
+int SpeechTrieMatch(const SpeechTrie* trie, const char* text, size_t length,
+                    int max_distance, int32_t* id);
+
+#endif
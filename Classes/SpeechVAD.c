@@ -0,0 +1,150 @@
+//  SpeechVAD.c
+//
+// Licensed by AT&T under 'Software Development Kit Tools Agreement' 2012.
+// TERMS AND CONDITIONS FOR USE, REPRODUCTION, AND DISTRIBUTION: http://developer.att.com/sdk_agreement/
+// Copyright 2012 AT&T Intellectual Property. All rights reserved.
+// For more information contact developer.support@att.com http://developer.att.com
+
+#include "SpeechVAD.h"
+#include <math.h>
+#include <string.h>
+
+/** The noise floor follows quieter frames immediately and louder
+    non-speech frames at this rate. **/
+static const float NOISE_ADAPT_RATE = 0.05f;
+
+/** Energy never counts as speech below this level, however quiet the room. **/
+static const float MIN_SPEECH_DB = 30.0f;
+
+/** Tune the noise floor assumed before any quieter frame has been seen: a
+    quiet room, well below conversational speech, so audio that starts
+    with speech isn't taken for noise.  A quieter frame lowers it at once. **/
+static const float INITIAL_NOISE_DB = 40.0f;
+
+void SpeechVADDefaultConfig(SpeechVADConfig* config, int sample_rate)
+{
+    config->sample_rate = sample_rate;
+    config->frame_ms = 20;
+    config->threshold_db = 10.0f;
+    config->fricative_zcr = 0.25f;
+    config->onset_ms = 60;
+    config->hangover_ms = 400;
+    config->padding_ms = 200;
+}
+
+static int FramesFor(const SpeechVADConfig* config, int ms)
+{
+    int frames = (ms + config->frame_ms - 1) / config->frame_ms;
+    return frames > 0 ? frames : 1;
+}
+
+void SpeechVADInit(SpeechVAD* vad, const SpeechVADConfig* config)
+{
+    memset(vad, 0, sizeof(*vad));
+    vad->config = *config;
+    vad->frame_length = (size_t)config->sample_rate * (size_t)config->frame_ms / 1000;
+    vad->onset_frames = FramesFor(config, config->onset_ms);
+    vad->hangover_frames = FramesFor(config, config->hangover_ms);
+    vad->noise_db = INITIAL_NOISE_DB;
+}
+
+/* Mean square of the frame, in dB relative to one LSB. */
+static float FrameEnergyDB(const int16_t* samples, size_t count)
+{
+    // Accumulate in float lanes so the loop vectorizes; int16 squares
+    // summed over a frame fit comfortably.
+    float sum = 0.0f;
+    size_t i;
+    for (i = 0; i < count; i++) {
+        float x = (float)samples[i];
+        sum += x * x;
+    }
+    return 10.0f * log10f(sum / (float)count + 1.0f);
+}
+
+/* Fraction of adjacent sample pairs that change sign. */
+static float FrameZeroCrossingRate(const int16_t* samples, size_t count)
+{
+    unsigned int crossings = 0;
+    size_t i;
+    for (i = 1; i < count; i++)
+        crossings += (unsigned int)((samples[i - 1] ^ samples[i]) < 0);
+    return (float)crossings / (float)count;
+}
+
+SpeechVADEvent SpeechVADProcessFrame(SpeechVAD* vad, const int16_t* samples)
+{
+    size_t count = vad->frame_length;
+    float energy = FrameEnergyDB(samples, count);
+    float zcr = FrameZeroCrossingRate(samples, count);
+    float threshold = vad->config.threshold_db;
+    int raw_speech;
+    SpeechVADEvent event = SpeechVADEventNone;
+
+    // Voiced speech is loud; fricatives are quieter but cross zero often.
+    raw_speech = energy > MIN_SPEECH_DB
+        && (energy > vad->noise_db + threshold
+            || (energy > vad->noise_db + threshold / 2.0f && zcr > vad->config.fricative_zcr));
+
+    // Track the noise floor during non-speech, dropping fast and rising slowly.
+    if (energy < vad->noise_db)
+        vad->noise_db = energy;
+    else if (!raw_speech && !vad->in_speech)
+        vad->noise_db += NOISE_ADAPT_RATE * (energy - vad->noise_db);
+
+    // Smooth the decisions: a state changes only after a run of frames
+    // that disagree with it.
+    if (raw_speech == vad->in_speech)
+        vad->run = 0;
+    else if (++vad->run >= (vad->in_speech ? vad->hangover_frames : vad->onset_frames)) {
+        vad->in_speech = raw_speech;
+        if (raw_speech) {
+            vad->start_frame = vad->frames + 1 - (size_t)vad->run;
+            event = SpeechVADEventSpeechStart;
+        }
+        else {
+            vad->end_frame = vad->frames + 1 - (size_t)vad->run;
+            event = SpeechVADEventSpeechEnd;
+        }
+        vad->run = 0;
+    }
+    vad->frames++;
+    return event;
+}
+
+int SpeechVADFindSpeech(const SpeechVADConfig* config,
+                        const int16_t* samples, size_t count,
+                        size_t* start, size_t* end)
+{
+    SpeechVAD vad;
+    size_t offset;
+    size_t first = 0, last = 0;
+    size_t padding;
+    int found = 0;
+
+    SpeechVADInit(&vad, config);
+    if (vad.frame_length == 0)
+        return 0;
+    for (offset = 0; offset + vad.frame_length <= count; offset += vad.frame_length) {
+        SpeechVADEvent event = SpeechVADProcessFrame(&vad, samples + offset);
+        if (event == SpeechVADEventSpeechStart && !found) {
+            first = vad.start_frame;
+            found = 1;
+        }
+        else if (event == SpeechVADEventSpeechEnd)
+            last = vad.end_frame;
+    }
+    if (!found)
+        return 0;
+    // Speech still going at the end runs to the end.
+    if (vad.in_speech || last < first)
+        last = vad.frames;
+
+    padding = (size_t)config->sample_rate * (size_t)config->padding_ms / 1000;
+    *start = first * vad.frame_length;
+    *start = *start > padding ? *start - padding : 0;
+    *end = last * vad.frame_length + padding;
+    if (*end > count)
+        *end = count;
+    return 1;
+}
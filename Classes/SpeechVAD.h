@@ -0,0 +1,68 @@
+//  SpeechVAD.h
+//
+// Licensed by AT&T under 'Software Development Kit Tools Agreement' 2012.
+// TERMS AND CONDITIONS FOR USE, REPRODUCTION, AND DISTRIBUTION: http://developer.att.com/sdk_agreement/
+// Copyright 2012 AT&T Intellectual Property. All rights reserved.
+// For more information contact developer.support@att.com http://developer.att.com
+//
+// Voice activity detection for 16-bit PCM audio.  Each frame is classified
+// by its energy relative to a running noise floor, with the zero-crossing
+// rate catching quiet fricatives, and the decisions are smoothed so that
+// speech starts after a short onset and ends after a hangover.
+// Plain C with no allocation; the per-frame loops are simple reductions the
+// compiler can vectorize.
+
+#ifndef SPEECH_VAD_H
+#define SPEECH_VAD_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct SpeechVADConfig {
+    int sample_rate;          /* samples per second */
+    int frame_ms;             /* analysis frame length */
+    float threshold_db;       /* energy above the noise floor that counts as speech */
+    float fricative_zcr;      /* zero crossings per sample that mark a fricative */
+    int onset_ms;             /* speech needed before a start is reported */
+    int hangover_ms;          /* silence needed before an end is reported */
+    int padding_ms;           /* audio kept around speech when trimming */
+} SpeechVADConfig;
+
+typedef enum SpeechVADEvent {
+    SpeechVADEventNone = 0,
+    SpeechVADEventSpeechStart,
+    SpeechVADEventSpeechEnd
+} SpeechVADEvent;
+
+typedef struct SpeechVAD {
+    SpeechVADConfig config;
+    size_t frame_length;      /* samples per frame */
+    int onset_frames;
+    int hangover_frames;
+    float noise_db;           /* running noise floor estimate */
+    int in_speech;
+    int run;                  /* consecutive frames disagreeing with in_speech */
+    size_t frames;            /* frames processed */
+    size_t start_frame;       /* first frame of the current or last speech */
+    size_t end_frame;         /* frame after the last speech ended */
+} SpeechVAD;
+
+/** Fills in config with defaults for the sample rate: 20 ms frames,
+    10 dB threshold, 60 ms onset, 400 ms hangover, 200 ms padding. **/
+void SpeechVADDefaultConfig(SpeechVADConfig* config, int sample_rate);
+
+/** Prepares vad to process a new stream. **/
+void SpeechVADInit(SpeechVAD* vad, const SpeechVADConfig* config);
+
+/** Processes one frame of vad->frame_length samples.  Returns an event when
+    speech starts or ends; start_frame and end_frame then say where. **/
+SpeechVADEvent SpeechVADProcessFrame(SpeechVAD* vad, const int16_t* samples);
+
+/** Finds the speech in a whole recording.  Returns 1 and sets start and end
+    to a sample range covering all the speech plus padding, or 0 if the
+    recording holds no speech. **/
+int SpeechVADFindSpeech(const SpeechVADConfig* config,
+                        const int16_t* samples, size_t count,
+                        size_t* start, size_t* end);
+
+#endif
@@ -0,0 +1,50 @@
+//  SpeechVocabulary.h
+//
+// Licensed by AT&T under 'Software Development Kit Tools Agreement' 2012.
+// TERMS AND CONDITIONS FOR USE, REPRODUCTION, AND DISTRIBUTION: http://developer.att.com/sdk_agreement/
+// Copyright 2012 AT&T Intellectual Property. All rights reserved.
+// For more information contact developer.support@att.com http://developer.att.com
+
+#import <Foundation/NSObject.h>
+
+@class NSString, NSArray;
+
+/**
+ * The phrases an app understands, for correcting recognition results
+ * against them.
+ *
+ * Phrases are compared after normalizing case, accents, punctuation, and
+ * spacing.  Each hypothesis of an n-best list is matched to its nearest
+ * phrase by edit distance, and the phrase whose match is best, allowing a
+ * little for the hypothesis's rank, is chosen.
+ *
+ * A vocabulary may be compiled on any thread, such as a background queue,
+ * and then used from one thread at a time.
+**/
+@interface SpeechVocabulary : NSObject {
+}
+
+/** Compiles a vocabulary of phrases.  Earlier phrases win ties.  Returns
+ *  nil if out of memory. **/
++ (SpeechVocabulary*) vocabularyWithPhrases: (NSArray*) phrases;
+
+/** Compiles a vocabulary from a UTF-8 text file with one phrase per line.
+ *  Returns nil if the file can't be read. **/
++ (SpeechVocabulary*) vocabularyWithContentsOfFile: (NSString*) path;
+
+/** Number of distinct phrases after normalizing. **/
+@property (readonly) NSUInteger count;
+
+/** Most edits allowed, as a fraction of the hypothesis's length, for it to
+ *  match a phrase.  Defaults to 0.3. **/
+@property (assign) float maxErrorRate;
+
+/** The phrase nearest to text, or nil if none is close enough.  If distance
+ *  isn't NULL, it is set to the number of edits. **/
+- (NSString*) phraseMatchingString: (NSString*) text distance: (NSUInteger*) distance;
+
+/** The phrase that best matches an n-best list, best hypothesis first, or
+ *  nil if none of them is close to any phrase. **/
+- (NSString*) phraseMatchingHypotheses: (NSArray*) nbest;
+
+@end
@@ -0,0 +1,161 @@
+//  SpeechVocabulary.m
+//
+// Licensed by AT&T under 'Software Development Kit Tools Agreement' 2012.
+// TERMS AND CONDITIONS FOR USE, REPRODUCTION, AND DISTRIBUTION: http://developer.att.com/sdk_agreement/
+// Copyright 2012 AT&T Intellectual Property. All rights reserved.
+// For more information contact developer.support@att.com http://developer.att.com
+
+#import "SpeechVocabulary.h"
+#import "SpeechTrie.h"
+
+/** Tune how forgiving matching is: more allows more misrecognized words
+    to be corrected, but also more unrelated speech to match a phrase. **/
+static const float DEFAULT_MAX_ERROR_RATE = 0.3f;
+
+/** Tune how much a hypothesis's rank counts against it, in the same units
+    as its error rate, so a lower-ranked hypothesis must match noticeably
+    better to win. **/
+static const float RANK_PENALTY = 0.05f;
+
+/* Lowercases text, removes accents, and turns each run of anything but
+   letters and digits into a single space. */
+static NSString* Normalize(NSString* text)
+{
+    NSString* folded = [text stringByFoldingWithOptions: NSCaseInsensitiveSearch | NSDiacriticInsensitiveSearch
+                                                 locale: nil];
+    NSCharacterSet* wordCharacters = [NSCharacterSet alphanumericCharacterSet];
+    NSUInteger length = folded.length;
+    // Normalized in place: the text only ever gets shorter.
+    NSMutableData* buffer = [NSMutableData dataWithLength: length * sizeof(unichar)];
+    unichar* characters = buffer.mutableBytes;
+    [folded getCharacters: characters range: NSMakeRange(0, length)];
+    NSUInteger normalized = 0;
+    BOOL space = NO;
+    NSUInteger i;
+    for (i = 0; i < length; i++) {
+        unichar c = characters[i];
+        if ([wordCharacters characterIsMember: c]) {
+            if (space && normalized > 0)
+                characters[normalized++] = ' ';
+            characters[normalized++] = c;
+            space = NO;
+        }
+        else
+            space = YES;
+    }
+    return [NSString stringWithCharacters: characters length: normalized];
+}
+
+@interface SpeechVocabulary () {
+    @private
+    SpeechTrie* trie;
+}
+@property (retain) NSMutableArray* phrases; // by trie id
+- (BOOL) addPhrases: (NSArray*) somePhrases;
+@end
+
+@implementation SpeechVocabulary
+
+@synthesize maxErrorRate = _maxErrorRate;
+@synthesize phrases = _phrases;
+
++ (SpeechVocabulary*) vocabularyWithPhrases: (NSArray*) phrases
+{
+    SpeechVocabulary* vocabulary = [[[self alloc] init] autorelease];
+    return [vocabulary addPhrases: phrases] ? vocabulary : nil;
+}
+
++ (SpeechVocabulary*) vocabularyWithContentsOfFile: (NSString*) path
+{
+    NSString* contents = [NSString stringWithContentsOfFile: path encoding: NSUTF8StringEncoding error: NULL];
+    if (contents == nil)
+        return nil;
+    NSMutableArray* phrases = [NSMutableArray array];
+    for (NSString* line in [contents componentsSeparatedByCharactersInSet: [NSCharacterSet newlineCharacterSet]]) {
+        line = [line stringByTrimmingCharactersInSet: [NSCharacterSet whitespaceCharacterSet]];
+        if (line.length > 0)
+            [phrases addObject: line];
+    }
+    return [self vocabularyWithPhrases: phrases];
+}
+
+- (id) init
+{
+    self = [super init];
+    if (self != nil) {
+        _maxErrorRate = DEFAULT_MAX_ERROR_RATE;
+        self.phrases = [NSMutableArray array];
+        trie = SpeechTrieCreate();
+        if (trie == NULL) {
+            [self release];
+            return nil;
+        }
+    }
+    return self;
+}
+
+- (void) dealloc
+{
+    SpeechTrieDestroy(trie);
+    self.phrases = nil;
+    [super dealloc];
+}
+
+- (BOOL) addPhrases: (NSArray*) somePhrases
+{
+    for (NSString* phrase in somePhrases) {
+        NSData* key = [Normalize(phrase) dataUsingEncoding: NSUTF8StringEncoding];
+        int32_t existing;
+        if (key.length == 0)
+            continue;
+        // Keep the first of phrases that normalize the same.
+        if (SpeechTrieMatch(trie, key.bytes, key.length, 0, &existing) == 0)
+            continue;
+        if (SpeechTrieAdd(trie, key.bytes, key.length, (int32_t)_phrases.count) != 0)
+            return NO;
+        [_phrases addObject: phrase];
+    }
+    return YES;
+}
+
+- (NSUInteger) count
+{
+    return _phrases.count;
+}
+
+- (NSString*) phraseMatchingString: (NSString*) text distance: (NSUInteger*) distance
+{
+    NSData* key = [Normalize(text) dataUsingEncoding: NSUTF8StringEncoding];
+    if (key.length == 0)
+        return nil;
+    int32_t phraseID;
+    int edits = SpeechTrieMatch(trie, key.bytes, key.length, (int)(_maxErrorRate * key.length), &phraseID);
+    if (edits < 0)
+        return nil;
+    if (distance != NULL)
+        *distance = (NSUInteger)edits;
+    return [_phrases objectAtIndex: (NSUInteger)phraseID];
+}
+
+- (NSString*) phraseMatchingHypotheses: (NSArray*) nbest
+{
+    NSString* best = nil;
+    float bestScore = 0.0f;
+    NSUInteger rank = 0;
+    for (NSString* hypothesis in nbest) {
+        NSUInteger length = [Normalize(hypothesis) lengthOfBytesUsingEncoding: NSUTF8StringEncoding];
+        NSUInteger distance;
+        NSString* phrase = [self phraseMatchingString: hypothesis distance: &distance];
+        if (phrase != nil) {
+            float score = (float)distance / (float)length + RANK_PENALTY * (float)rank;
+            if (best == nil || score < bestScore) {
+                best = phrase;
+                bestScore = score;
+            }
+        }
+        rank++;
+    }
+    return best;
+}
+
+@end
@@ -0,0 +1,94 @@
+//  SpeechWAV.c
+//
+// Licensed by AT&T under 'Software Development Kit Tools Agreement' 2012.
+// TERMS AND CONDITIONS FOR USE, REPRODUCTION, AND DISTRIBUTION: http://developer.att.com/sdk_agreement/
+// Copyright 2012 AT&T Intellectual Property. All rights reserved.
+// For more information contact developer.support@att.com http://developer.att.com
+
+#include "SpeechWAV.h"
+#include <string.h>
+
+// WAV fields are little-endian regardless of the host.
+
+static uint32_t Read32(const uint8_t* p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint16_t Read16(const uint8_t* p)
+{
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static void Write32(uint8_t* p, uint32_t value)
+{
+    p[0] = (uint8_t)value;
+    p[1] = (uint8_t)(value >> 8);
+    p[2] = (uint8_t)(value >> 16);
+    p[3] = (uint8_t)(value >> 24);
+}
+
+static void Write16(uint8_t* p, uint16_t value)
+{
+    p[0] = (uint8_t)value;
+    p[1] = (uint8_t)(value >> 8);
+}
+
+int SpeechWAVParse(const void* bytes, size_t length, SpeechWAVInfo* info)
+{
+    const uint8_t* p = (const uint8_t*)bytes;
+    size_t offset = 12;
+    int have_format = 0;
+    if (length < 12 || memcmp(p, "RIFF", 4) != 0 || memcmp(p + 8, "WAVE", 4) != 0)
+        return 0;
+    // Walk the chunks until the data chunk, which must follow the format.
+    while (offset + 8 <= length) {
+        const uint8_t* chunk = p + offset;
+        uint32_t chunk_length = Read32(chunk + 4);
+        if (memcmp(chunk, "fmt ", 4) == 0) {
+            if (chunk_length < 16 || offset + 8 + 16 > length)
+                return 0;
+            if (Read16(chunk + 8) != 1) // WAVE_FORMAT_PCM
+                return 0;
+            info->channels = Read16(chunk + 10);
+            info->sample_rate = (int)Read32(chunk + 12);
+            info->bits_per_sample = Read16(chunk + 22);
+            have_format = 1;
+        }
+        else if (memcmp(chunk, "data", 4) == 0) {
+            if (!have_format)
+                return 0;
+            info->data_offset = offset + 8;
+            info->data_length = length - info->data_offset;
+            if (chunk_length < info->data_length)
+                info->data_length = chunk_length;
+            return 1;
+        }
+        // Chunks are padded to an even length.  Check the length against
+        // what is left first, since adding it could wrap a 32-bit offset.
+        if (chunk_length > length - offset - 8
+            || (chunk_length & 1) > length - offset - 8 - chunk_length)
+            return 0;
+        offset += 8 + (size_t)chunk_length + (chunk_length & 1);
+    }
+    return 0;
+}
+
+void SpeechWAVWriteHeader(uint8_t header[SPEECH_WAV_HEADER_LENGTH],
+                          int sample_rate, uint32_t data_length)
+{
+    uint32_t riff_length = (data_length > 0xFFFFFFFF - 36) ? 0xFFFFFFFF : data_length + 36;
+    memcpy(header, "RIFF", 4);
+    Write32(header + 4, riff_length);
+    memcpy(header + 8, "WAVE", 4);
+    memcpy(header + 12, "fmt ", 4);
+    Write32(header + 16, 16);
+    Write16(header + 20, 1);                              // PCM
+    Write16(header + 22, 1);                              // mono
+    Write32(header + 24, (uint32_t)sample_rate);
+    Write32(header + 28, (uint32_t)sample_rate * 2);      // bytes per second
+    Write16(header + 32, 2);                              // bytes per frame
+    Write16(header + 34, 16);                             // bits per sample
+    memcpy(header + 36, "data", 4);
+    Write32(header + 40, data_length);
+}
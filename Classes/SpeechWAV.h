@@ -0,0 +1,40 @@
+//  SpeechWAV.h
+//
+// Licensed by AT&T under 'Software Development Kit Tools Agreement' 2012.
+// TERMS AND CONDITIONS FOR USE, REPRODUCTION, AND DISTRIBUTION: http://developer.att.com/sdk_agreement/
+// Copyright 2012 AT&T Intellectual Property. All rights reserved.
+// For more information contact developer.support@att.com http://developer.att.com
+//
+// Reading and writing the RIFF WAV container for 16-bit PCM audio, the
+// format of ATTSKAudioFormatWAV_NB and ATTSKAudioFormatWAV_WB.
+// Plain C with no allocation, so it can be shared by the audio code.
+
+#ifndef SPEECH_WAV_H
+#define SPEECH_WAV_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/** Size of the header written by SpeechWAVWriteHeader. **/
+#define SPEECH_WAV_HEADER_LENGTH 44
+
+typedef struct SpeechWAVInfo {
+    int sample_rate;       /* samples per second */
+    int channels;
+    int bits_per_sample;
+    size_t data_offset;    /* byte offset of the first sample */
+    size_t data_length;    /* bytes of sample data */
+} SpeechWAVInfo;
+
+/** Reads the header of a WAV file held in memory.  Returns 1 if it is
+    uncompressed PCM, filling in info, or 0 if it is not.  A data length
+    past the end of the buffer, as left by a streaming writer, is clipped
+    to the buffer. **/
+int SpeechWAVParse(const void* bytes, size_t length, SpeechWAVInfo* info);
+
+/** Writes a SPEECH_WAV_HEADER_LENGTH byte header for 16-bit mono PCM.
+    Pass 0xFFFFFFFF as data_length when streaming audio of unknown length. **/
+void SpeechWAVWriteHeader(uint8_t header[SPEECH_WAV_HEADER_LENGTH],
+                          int sample_rate, uint32_t data_length);
+
+#endif